@@ -0,0 +1,1201 @@
+#include <iostream>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <exception>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/falloc.h>
+#endif
+
+#include "linux_utils.h"
+#include "picoscope.h"
+#include "measurement.h"
+#include "channel.h"
+#include "trigger.h"
+#include "args.h"
+#include "acquisition.h"
+#include "realtime.h"
+#include "online.h"
+#include "analysis/sample-traits.h"
+
+#include "log.h"
+#include "timing.h"
+
+Acquisition::Acquisition(Measurement *m, Args *a)
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::Acquisition (Measurement=" << m << ", Args=" << a << ")";
+
+	int i;
+
+	measurement = m;
+	args        = a;
+	f_meta      = NULL;
+	fe          = NULL;
+	f_index     = NULL;
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		fb[i] = NULL;
+		ft[i] = NULL;
+		fs[i] = NULL;
+		fz[i] = NULL;
+	}
+	veto_channel    = -1;
+	auto_range_captures = 0;
+	auto_range_samples  = 0;
+	auto_range_seconds  = 0.0;
+	auto_trigger_distance = 0;
+	auto_trigger_seconds  = 0.0;
+	target_events   = 0;
+	target_live     = 0.0;
+	veto_seconds    = 0.0;
+	numa_node       = -1;
+	online          = NULL;
+	writers_busy    = 0;
+	writers_stop    = false;
+	seconds_open    = -1.0;
+	seconds_files   = 0.0;
+	seconds_buffers = 0.0;
+}
+
+Acquisition::~Acquisition()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::~Acquisition";
+
+	CloseFiles();
+	delete online;
+}
+
+void Acquisition::SetDefaults(Measurement *m)
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::SetDefaults (Measurement=" << m << ")";
+
+	int i;
+
+	// everything a job file can change, so that a job doesn't inherit the options of the previous one
+	m->SetTimebaseInPs(400);
+	m->EnableChannels(true,false,false,false);
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		m->GetChannel(i)->SetVoltage(U_MAX);
+	}
+	m->SetNTraces(1);
+	m->SetEts(0, 0);
+	m->RemoveTrigger();
+	m->RemoveSignalGenerator();
+}
+
+const char* Acquisition::RunJob(Measurement *m, Args &x, int argc, char **argv, std::vector<std::string> *files)
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::RunJob (Measurement=" << m << ")";
+
+	const char *error = NULL;
+
+	try {
+		// previous job might have failed
+		m->GetPicoscope()->SetStatus(PICO_OK);
+		SetDefaults(m);
+
+		x.parse_options(argc, argv, m);
+		if(!x.IsJustHelp()) {
+			if(x.IsDaemon() || x.IsClient() || x.IsJobFile()) {
+				throw "Jobs cannot start a daemon, contact a daemon or read another job file.";
+			}
+			Acquisition acq(m, &x);
+			acq.Configure();
+			if(x.GetLength() > 0) {
+				acq.AllocateBuffers();
+				acq.OpenFiles();
+				acq.StartWriters();
+				if(files != NULL) {
+					*files = acq.GetFiles();
+				}
+				acq.Run(argc, argv);
+				acq.CloseFiles();
+			}
+		}
+	} catch(Picoscope::PicoscopeException& ex) {
+		error = ex.GetErrorMessage();
+	} catch(Picoscope::PicoscopeUserException& ex) {
+		error = ex.GetErrorMessage();
+	} catch(const char* s) {
+		error = s;
+	} catch (std::bad_alloc& ba) {
+		error = "unable to allocate memory";
+	} catch (const std::exception &exc) {
+		std::cerr << "Exception: " << exc.what() << std::endl;
+		error = "exception in the acquisition";
+	} catch(...) {
+		error = "unknown exception in the acquisition";
+	}
+	return error;
+}
+
+void Acquisition::Configure()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::Configure";
+
+	int i;
+	Measurement *meas = GetMeasurement();
+	Args        &x    = *GetArgs();
+
+	if(x.GetFilename() == NULL) { // TODO: maybe we want to use just text file
+		throw("You have to provide some filename using '--name <filename>'.\n");
+	}
+
+	// meas->SetTimebaseInPs(10000);
+
+	// TODO: fixme
+	// (with --U auto the search starts at the biggest range)
+	if(x.IsAutoRange()) {
+		FindRanges();
+	}
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		meas->GetChannel(i)->SetVoltage(x.IsAutoRange() ? ranges.back() : x.GetVoltage());
+	}
+
+	// a->SetVoltage(U_100mV);
+	// a[0]->SetVoltage(x.GetVoltage());
+	// meas->SetLength(GIGA(1));
+	meas->SetLength(x.GetLength());
+	meas->SetNTraces(x.GetNTraces());
+
+	// a single trace is only triggered for equivalent-time sampling
+	meas->SetEts(x.GetEtsCycles(), x.GetEtsInterleave());
+	if(x.GetNTraces() > 1 || x.IsEts()) {
+		// TODO: fix trigger
+		FILE_LOG(logDEBUG4) << "Acquisition::Configure - checking for triggered events";
+		if(x.IsTriggered()) {
+			for(i=0; i<PICOSCOPE_N_CHANNELS && !(meas->GetChannel(i)->IsEnabled()); i++);
+			FILE_LOG(logDEBUG4) << "Acquisition::Configure - will trigger on channel " << (char)('A'+i);
+			meas->SetTrigger(x.GetTrigger(meas->GetChannel(i)));
+		}
+	}
+
+	if(x.IsOnline()) {
+		if(x.GetNTraces() < 2) {
+			throw "--psd, --timing, --peaks and --baseline only work with triggered events (--n <number> bigger than 1).";
+		}
+		if(x.IsBaseline() && meas->GetLengthBeforeTrigger() == 0) {
+			throw "--baseline needs samples before the trigger (--trig <x> <y> with x > 0).";
+		}
+		delete online;
+		online = new OnlineAnalysis(meas, &x);
+	}
+	if(!x.IsPsd() && (x.GetHistBins() > 0 || x.IsHistOnly())) {
+		throw "--hist and --hist-only need --psd.";
+	}
+	if(x.IsHistOnly() && x.GetHistBins() == 0) {
+		throw "--hist-only needs --hist.";
+	}
+}
+
+void Acquisition::AllocateBuffers()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::AllocateBuffers";
+
+	Measurement *meas = GetMeasurement();
+
+	// the pages are placed when they are touched for the first time, so the policy has to hold until they are prefaulted
+	numa_node = RealTime::FindUsbNumaNode();
+	RealTime::PreferNumaNode(numa_node);
+	try {
+		if(GetArgs()->GetNTraces() > 1) {
+			meas->AllocateMemoryRapidBlock(MEGA(50));
+		} else {
+			meas->AllocateMemoryBlock(MEGA(50));
+		}
+		meas->PrefaultMemory();
+	} catch(...) {
+		RealTime::ResetNumaPolicy();
+		throw;
+	}
+	RealTime::ResetNumaPolicy();
+}
+
+// opens picoscope while the files are being opened and the memory is being allocated
+void Acquisition::Start(Picoscope *p)
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::Start (Picoscope=" << p << ")";
+
+	Timing t_open, t_files, t_buffers;
+	std::exception_ptr error_files, error_buffers;
+	short progress = 0;
+
+	t_open.Start();
+	p->OpenAsync();
+
+	std::thread files([&]() {
+		t_files.Start();
+		try {
+			OpenFiles();
+		} catch(...) {
+			error_files = std::current_exception();
+		}
+		t_files.Stop();
+	});
+	std::thread buffers([&]() {
+		t_buffers.Start();
+		try {
+			AllocateBuffers();
+		} catch(...) {
+			error_buffers = std::current_exception();
+		}
+		t_buffers.Stop();
+	});
+
+	try {
+		while(!p->PollOpen(&progress)) {
+			Sleep(5);
+		}
+	} catch(...) {
+		files.join();
+		buffers.join();
+		throw;
+	}
+	t_open.Stop();
+	files.join();
+	buffers.join();
+	if(error_files) {
+		std::rethrow_exception(error_files);
+	}
+	if(error_buffers) {
+		std::rethrow_exception(error_buffers);
+	}
+
+	StartWriters();
+
+	seconds_open    = t_open.GetSecondsDouble();
+	seconds_files   = t_files.GetSecondsDouble();
+	seconds_buffers = t_buffers.GetSecondsDouble();
+	std::cerr << "-- Startup: open " << seconds_open << "s, files " << seconds_files
+	          << "s, buffers " << seconds_buffers << "s (in parallel)\n";
+}
+
+void Acquisition::Plan()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::Plan";
+
+	Measurement *meas = GetMeasurement();
+	Planner planner(meas);
+
+	plan = planner.Make(GetArgs()->IsMaxTraces() ? 0 : meas->GetNTraces());
+	// no more traces per arm than the events of --events
+	if(GetArgs()->GetTargetEvents() > 0 && GetArgs()->GetTargetEvents() < plan.segments) {
+		plan = planner.Make((unsigned long)GetArgs()->GetTargetEvents());
+	}
+	planner.Apply(plan);
+	std::cerr << "-- Plan: " << Planner::Describe(plan) << "\n";
+	// the buffers have been allocated for fewer traces
+	if(GetArgs()->IsMaxTraces()) {
+		AllocateBuffers();
+	}
+}
+
+// the ranges that the series supports, from the smallest to the biggest one
+void Acquisition::FindRanges()
+{
+	Channel *ch = GetMeasurement()->GetChannel(0);
+	unsigned int old = ch->GetVoltage();
+	int u;
+
+	ranges.clear();
+	range_volts.clear();
+	for(u=U_50mV; u<U_MAX; u++) {
+		try {
+			ch->SetVoltage((PICO_VOLTAGE)u);
+			range_volts.push_back(ch->GetVoltageInVolts());
+			ranges.push_back((PICO_VOLTAGE)u);
+		} catch(const char *) {
+			// not available for this series
+		}
+	}
+	// back to whatever it was (without marking the channel as changed)
+	for(u=0; u<(int)ranges.size(); u++) {
+		ch->SetVoltage(ranges[u]);
+		if(ch->GetVoltage() == old) {
+			break;
+		}
+	}
+	if(ranges.empty()) {
+		throw "No voltage range for --U auto.";
+	}
+}
+
+// the samples of a capture before the run: not longer than max_seconds at the sampling rate of the run
+static unsigned long PreCaptureLength(Measurement *meas, unsigned long samples, double max_seconds)
+{
+	unsigned long n = samples;
+
+	if(meas->GetTimebaseInNs() > 0 && max_seconds/(meas->GetTimebaseInNs()*1e-9) < n) {
+		n = (unsigned long)(max_seconds/(meas->GetTimebaseInNs()*1e-9));
+	}
+	return n < 1000 ? 1000 : n;
+}
+
+// --U auto: captures a few samples of every channel, starting with the biggest range, and takes the smallest range
+// that keeps the fraction of clipped samples below the limit; the next capture is taken with that range,
+// until the choice doesn't change any more
+void Acquisition::AutoRange()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::AutoRange";
+
+	Measurement *meas = GetMeasurement();
+	const auto_range_options &o = GetArgs()->GetAutoRangeOptions();
+	unsigned long n;
+	size_t index[PICOSCOPE_N_CHANNELS], best;
+	int clipping[PICOSCOPE_N_CHANNELS]; // the biggest range that clipped too much
+	bool done[PICOSCOPE_N_CHANNELS], all_done = false;
+	double per_value;
+	int i, capture;
+	Timing t;
+
+	t.Start();
+	n = PreCaptureLength(meas, o.samples, o.max_seconds);
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		index[i]     = ranges.size()-1;
+		clipping[i]  = -1;
+		done[i]      = !meas->GetChannel(i)->IsEnabled();
+	}
+	for(capture=0; capture<2*(int)ranges.size() && !all_done; capture++) {
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			meas->GetChannel(i)->SetVoltage(ranges[index[i]]);
+		}
+		std::cerr << "-- Auto range: capture " << capture+1 << " ... ";
+		n = meas->PreCapture(n);
+		auto_range_samples += n;
+		all_done = true;
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			if(done[i]) {
+				continue;
+			}
+			sample_statistics s;
+			meas->CountSamples(meas->GetData(i), n, s);
+			std::cerr << (char)('A'+i) << " " << range_volts[index[i]] << " V: " << s.clipped() << " clipped; ";
+			if(s.clipped() > o.max_clipped*s.count) {
+				// clips too much: the next bigger range (and never this one again)
+				clipping[i] = (int)index[i] > clipping[i] ? (int)index[i] : clipping[i];
+				if(index[i]+1 < ranges.size()) {
+					index[i]++;
+					all_done = false;
+				} else {
+					done[i] = true;
+				}
+				continue;
+			}
+			per_value = range_volts[index[i]]*(1 << 8)/(meas->GetSeries() == PICO_6000 ? ps6000_samples::max_value() : ps4000_samples::max_value());
+			best = smallest_range(s.histogram, per_value, range_volts, o.max_clipped);
+			best = (int)best <= clipping[i] ? clipping[i]+1 : best;
+			if(best >= index[i]) {
+				done[i] = true;
+			} else {
+				index[i] = best;
+				all_done = false;
+			}
+		}
+		std::cerr << "\n";
+	}
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		meas->GetChannel(i)->SetVoltage(ranges[index[i]]);
+	}
+	// a level in volts is a different fraction of the new range
+	if(meas->IsTriggered()) {
+		meas->SetTrigger(GetArgs()->GetTrigger(meas->GetTrigger()->GetChannel()));
+	}
+	t.Stop();
+	auto_range_captures = capture;
+	auto_range_seconds  = t.GetSecondsDouble();
+}
+
+// --trig <x> auto: measures the noise of the trigger channel in an untriggered capture and sets the level
+// and the hysteresis of the trigger so that the noise alone gives at most the requested rate of triggers
+void Acquisition::AutoTrigger()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::AutoTrigger";
+
+	Measurement *meas = GetMeasurement();
+	const auto_trigger_options &o = GetArgs()->GetAutoTriggerOptions();
+	Channel *ch = meas->GetTrigger()->GetChannel();
+	const int direction = meas->GetTrigger()->GetYFraction() < 0 ? -1 : 1;
+	const double max_value = meas->GetSeries() == PICO_6000 ? ps6000_samples::max_value() : ps4000_samples::max_value();
+	noise_measurement noise;
+	sample_statistics s;
+	unsigned long n;
+	int d, level, limit;
+	TriggerLogic logic;
+	Trigger *tr;
+	Timing t;
+
+	t.Start();
+	std::cerr << "-- Auto trigger: capture ... ";
+	n = meas->PreCapture(PreCaptureLength(meas, o.samples, o.max_seconds));
+	meas->CountSamples(meas->GetData(ch->GetIndex()), n, s);
+	// the pulses are on the side of the direction of the trigger, the noise is measured on the other one
+	measure_baseline_noise(s.histogram, direction, noise);
+	noise.hysteresis = (int)ceil(2*noise.rms);
+	noise.seconds    = n*meas->GetTimebaseInNs()*1e-9;
+	count_noise_crossings(meas->GetData(ch->GetIndex()), n, direction, noise);
+	// the level has to stay within the range (of the upper 8 bits)
+	limit = (int)(max_value/256) - direction*(int)noise.baseline;
+	d     = choose_trigger_distance(noise, o.rate, limit);
+	level = (int)noise.baseline + direction*d;
+	std::cerr << "baseline " << noise.baseline << ", rms " << noise.rms << " on channel " << (char)('A'+ch->GetIndex())
+	          << ": level " << level << ", hysteresis " << noise.hysteresis
+	          << " (about " << noise_trigger_rate(noise, d) << " noise triggers per second)\n";
+	if(noise_trigger_rate(noise, d) > o.rate) {
+		std::cerr << "The range of the channel doesn't have a level with at most " << o.rate << " noise triggers per second.\n";
+	}
+	// the same logic (pulse width qualifier, delay) with the new level
+	logic = meas->GetTrigger()->GetLogic();
+	logic.terms[0][0].level = level*256/max_value;
+	if(logic.pwq_type != PWQ_NONE && logic.pwq.channel == ch->GetIndex()) {
+		logic.pwq = logic.terms[0][0];
+	}
+	tr = new Trigger(ch, meas->GetTrigger()->GetXFraction(), logic);
+	// in 8-bit counts; very noisy signals would overflow the 16 bits of the trigger (and get the default hysteresis)
+	tr->SetHysteresis(noise.hysteresis*256 < SHRT_MAX ? (short)(noise.hysteresis*256) : SHRT_MAX);
+	meas->SetTrigger(tr);
+	t.Stop();
+	auto_trigger_noise    = noise;
+	auto_trigger_distance = d;
+	auto_trigger_seconds += t.GetSecondsDouble();
+	auto_trigger_levels.push_back(level);
+}
+
+// reserves disk space for the binary output, so that the file system doesn't have to find it while writing;
+// the size of the file doesn't change and the reservation is only a hint
+static void PreallocateFile(FILE *f, unsigned long long bytes)
+{
+#ifdef __linux__
+	if(bytes > 0 && fallocate(fileno(f), FALLOC_FL_KEEP_SIZE, 0, (off_t)bytes) != 0) {
+		FILE_LOG(logDEBUG2) << "PreallocateFile - unable to reserve " << bytes << " bytes";
+	}
+#endif
+}
+
+void Acquisition::OpenFiles()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::OpenFiles";
+
+	int i;
+	time_t now;
+	unsigned long long bytes;
+	Measurement *meas = GetMeasurement();
+	Args        &x    = *GetArgs();
+
+	time(&now);
+	time_start = *localtime(&now);
+	output_files.clear();
+
+	// where the batches of --events and --duration start in the files (of the traces or of the analysis)
+	if(x.IsTargetDriven()) {
+		std::string name = std::string(x.GetFilename()) + ".idx";
+		f_index = fopen(name.c_str(), "wt");
+		if(f_index == NULL) {
+			throw("Unable to open the index of the batches.\n");
+		}
+		output_files.push_back(name);
+		fprintf(f_index, "# batch first_trace traces captured start_s live_s\n");
+	}
+	// only the results of the analysis (and perhaps a few raw traces) are written
+	if(online != NULL) {
+		online->OpenFiles();
+		return;
+	}
+
+	// 6000 series writes a single byte per sample
+	bytes = (unsigned long long)x.GetLength()*(x.GetTargetEvents() > 0 ? x.GetTargetEvents() : x.GetNTraces()*x.GetNRepeats())
+	        *(meas->GetSeries() == PICO_6000 ? 1 : sizeof(short));
+
+	if(x.IsEts()) {
+		std::string name = std::string(x.GetFilename()) + (x.IsBinaryOutput() ? ".ets.bin" : ".ets.txt");
+		fe = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+		if(fe == NULL) {
+			throw("Unable to open file for the times of the ETS samples.\n");
+		}
+		output_files.push_back(name);
+	}
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(meas->GetChannel(i)->IsEnabled() && x.IsZeroSuppressed()) {
+			zero_suppress_options o = x.GetZeroSuppressOptions();
+			std::string name = std::string(x.GetFilename()) + (char)('A'+i) + (x.IsBinaryOutput() ? ".zs.bin" : ".zs.txt");
+
+			fz[i] = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+			if(fz[i] == NULL) {
+				throw("Unable to open file for the zero-suppressed trace.\n");
+			}
+			output_files.push_back(name);
+			// 6000 series keeps the 8 bits in the upper byte
+			if(meas->GetSeries() == PICO_6000) {
+				o.level      *= 1 << ps6000_samples::shift;
+				o.hysteresis *= 1 << ps6000_samples::shift;
+			}
+			suppressor[i].set_options(o);
+			suppressed[i] = zero_suppress_statistics();
+		} else if(meas->GetChannel(i)->IsEnabled()) {
+			if(x.IsTextOutput()) {
+				ft[i] = fopen(x.GetFilenameText(i), "wt");
+				if(ft[i] == NULL) {
+					throw("Unable to open text file.\n"); // TODO: write filename
+				}
+				output_files.push_back(x.GetFilenameText(i));
+			}
+			if(x.IsBinaryOutput()) {
+				fb[i] = fopen(x.GetFilenameBinary(i), "wb");
+				if(fb[i] == NULL) {
+					throw("Unable to open binary file.\n"); // TODO: write filename
+				}
+				output_files.push_back(x.GetFilenameBinary(i));
+				PreallocateFile(fb[i], bytes);
+			}
+			if(x.IsShaper()) {
+				std::string name = std::string(x.GetFilename()) + (char)('A'+i) + (x.IsBinaryOutput() ? ".shaped.bin" : ".shaped.txt");
+				fs[i] = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+				if(fs[i] == NULL) {
+					throw("Unable to open file for the shaped signal.\n");
+				}
+				output_files.push_back(name);
+				shaper[i].set_options(x.GetShaperOptions());
+			}
+		}
+	}
+}
+
+std::vector<std::string> Acquisition::GetFiles() const
+{
+	std::vector<std::string> files = output_files;
+
+	if(online != NULL) {
+		files.insert(files.end(), online->GetFiles().begin(), online->GetFiles().end());
+	}
+	return files;
+}
+
+void Acquisition::CloseFiles()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::CloseFiles";
+
+	int i;
+
+	StopWriters();
+	if(f_meta != NULL) {
+		fclose(f_meta);
+		f_meta = NULL;
+	}
+	if(online != NULL) {
+		online->CloseFiles();
+	}
+	if(fe != NULL) {
+		fclose(fe);
+		fe = NULL;
+	}
+	if(f_index != NULL) {
+		fclose(f_index);
+		f_index = NULL;
+	}
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(ft[i] != NULL) {
+			fclose(ft[i]);
+			ft[i] = NULL;
+		}
+		if(fb[i] != NULL) {
+			fclose(fb[i]);
+			fb[i] = NULL;
+		}
+		if(fs[i] != NULL) {
+			fclose(fs[i]);
+			fs[i] = NULL;
+		}
+		if(fz[i] != NULL) {
+			fclose(fz[i]);
+			fz[i] = NULL;
+		}
+	}
+}
+
+void Acquisition::WriteMetadata(int argc, char **argv)
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::WriteMetadata";
+
+	int i;
+	double tmp_dbl;
+	short  tmp_short;
+	Measurement *meas = GetMeasurement();
+	Args        &x    = *GetArgs();
+	FILE        *f;
+
+	f = f_meta = fopen(x.GetFilenameMeta(), "wt");
+	if(f == NULL) {
+		throw("Unable to open file with metadata.\n");
+	}
+	fprintf(f, "command:   ");
+	for(i=0; i<argc; i++) {
+		fprintf(f, " %s", argv[i]);
+	}
+	fprintf(f, "\n");
+	fprintf(f, "timestamp:  %d-%02d-%02d %02d:%02d:%02d\n\n",
+		time_start.tm_year+1900, time_start.tm_mon+1, time_start.tm_mday,
+		time_start.tm_hour, time_start.tm_min, time_start.tm_sec);
+	fprintf(f, "channels:   ");
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(meas->GetChannel(i)->IsEnabled()) {
+			fprintf(f, "%c", 'A'+i);
+		}
+	}
+	fprintf(f, "\n");
+	fprintf(f, "length:     %ld\n", x.GetLength());
+	fprintf(f, "samples:    %ld\n", meas->GetNTraces());
+	// fprintf(f, "unit_x:    %.1lf ns | %.1lf ns\n", meas->GetTimebaseInNs(), meas->GetReportedTimebaseInNs());
+	tmp_dbl = meas->GetTimebaseInNs();
+	fprintf(f, "unit_x:     %.1lf ns\n", tmp_dbl);
+	fprintf(f, "range_x:    %.1lf ns\n", x.GetLength()*tmp_dbl);
+	fprintf(f, "plan:       %s\n", Planner::Describe(plan).c_str());
+	// the range of the first channel (the same for all of them, unless it has been chosen automatically)
+	for(i=0; i<PICOSCOPE_N_CHANNELS && !meas->GetChannel(i)->IsEnabled(); i++);
+	tmp_dbl = i < PICOSCOPE_N_CHANNELS ? meas->GetChannel(i)->GetVoltageInVolts() : x.GetVoltageDouble();
+	fprintf(f, "unit_y:     %.10le V\n", meas->GetSeries() == PICO_6000 ? ps6000_samples::unit(tmp_dbl) : ps4000_samples::unit(tmp_dbl));
+	fprintf(f, "range_y:    %g V\n", tmp_dbl);
+	if(x.IsAutoRange()) {
+		fprintf(f, "autorange:  at most %g of the samples clipped, %d captures of %lu samples in %.3f s:",
+			x.GetAutoRangeOptions().max_clipped, auto_range_captures, auto_range_captures > 0 ? auto_range_samples/auto_range_captures : 0UL, auto_range_seconds);
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			if(meas->GetChannel(i)->IsEnabled()) {
+				fprintf(f, " %c %g V", 'A'+i, meas->GetChannel(i)->GetVoltageInVolts());
+			}
+		}
+		fprintf(f, "\n");
+	}
+
+	if(x.GetNTraces() > 1 || x.IsEts()) {
+		if(x.IsTriggered()) {
+			fprintf(f, "trigger_ch: %c\n", (char)(meas->GetTrigger()->GetChannel()->GetIndex()+'A'));
+			// fprintf(f, "trigger_xfrac: %g\n", meas->GetTrigger()->GetXFraction());
+			// fprintf(f, "trigger_yfrac: %g\n", meas->GetTrigger()->GetYFraction());
+			fprintf(f, "trigger_dx: %d (%g %% of %ld)\n", meas->GetLengthBeforeTrigger(), meas->GetLengthBeforeTrigger()*100.0/x.GetLength(), x.GetLength());
+			tmp_short = meas->GetTrigger()->GetThreshold();
+			tmp_dbl   = meas->GetTrigger()->GetYFraction();
+			fprintf(f, "trigger_dy: %g V (%d)\n", meas->GetTrigger()->GetThresholdInVolts() /*tmp_dbl*x.GetVoltageDouble()*/, tmp_short);
+			tmp_short = meas->GetTrigger()->GetHysteresis();
+			fprintf(f, "trigger_hy: %g V (%d)\n", tmp_short/(double)(meas->GetSeries() == PICO_6000 ? ps6000_samples::max_value() : ps4000_samples::max_value())
+				*meas->GetTrigger()->GetChannel()->GetVoltageInVolts(), tmp_short);
+			if(!meas->GetTrigger()->GetLogic().IsSimple()) {
+				fprintf(f, "trigger:    %s\n", meas->GetTrigger()->GetDescription().c_str());
+			}
+			if(x.IsAutoTrigger()) {
+				const noise_measurement &noise = auto_trigger_noise;
+				fprintf(f, "autotrig:   at most %g noise triggers per second: baseline %g, rms %.3f, level %+d and hysteresis %d from the baseline, about %.3g noise triggers per second (%.3g s of samples, %.3f s)\n",
+					x.GetAutoTriggerOptions().rate, noise.baseline, noise.rms, auto_trigger_levels.back() - (int)noise.baseline, noise.hysteresis,
+					noise_trigger_rate(noise, auto_trigger_distance), noise.seconds, auto_trigger_seconds);
+			}
+		}
+	}
+
+	// fprintf(f, "unit_x:    %.1lf ns | %.1lf ns\n", meas->GetTimebaseInNs(), meas->GetReportedTimebaseInNs());
+	if(seconds_open >= 0) {
+		fprintf(f, "startup:    open %.3f s, files %.3f s, buffers %.3f s (in parallel)\n", seconds_open, seconds_files, seconds_buffers);
+	}
+	fprintf(f, "out_bin:    %s\n", x.IsBinaryOutput() ? "yes" : "no");
+	fprintf(f, "out_dat:    %s\n", x.IsTextOutput()   ? "yes" : "no");
+}
+
+// one writer per enabled channel (they go to different files), pinned to the CPUs of --writer-cpu in turn
+void Acquisition::StartWriters()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::StartWriters";
+
+	int i;
+	Measurement *meas = GetMeasurement();
+	const std::vector<int> &cpus = GetArgs()->GetWriterCpus();
+
+	// the online analysis writes its own files
+	if(cpus.empty() || online != NULL || !writers.empty()) {
+		return;
+	}
+	writers_stop = false;
+	writers_busy = 0;
+	writer_error = NULL;
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(meas->GetChannel(i)->IsEnabled()) {
+			writers.push_back(std::thread(&Acquisition::WriterLoop, this, cpus[writers.size() % cpus.size()]));
+		}
+	}
+}
+
+void Acquisition::StopWriters()
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::StopWriters";
+
+	size_t i;
+
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		writers_stop = true;
+		writer_queue.clear();
+	}
+	writer_wake.notify_all();
+	for(i=0; i<writers.size(); i++) {
+		writers[i].join();
+	}
+	writers.clear();
+}
+
+void Acquisition::WriterLoop(int cpu)
+{
+	int channel;
+	std::exception_ptr e, error_pin;
+
+	// a writer that can't be pinned fails every chunk that it gets
+	try {
+		RealTime::PinThread(cpu);
+	} catch(...) {
+		error_pin = std::current_exception();
+	}
+	std::unique_lock<std::mutex> lock(writer_mutex);
+	while(true) {
+		writer_wake.wait(lock, [this]() { return writers_stop || !writer_queue.empty(); });
+		if(writers_stop) {
+			return;
+		}
+		channel = writer_queue.front();
+		writer_queue.pop_front();
+		writers_busy++;
+		lock.unlock();
+		e = error_pin;
+		if(!e) {
+			try {
+				WriteChannel(channel);
+			} catch(...) {
+				e = std::current_exception();
+			}
+		}
+		lock.lock();
+		if(e) {
+			writer_error = e;
+		}
+		writers_busy--;
+		writer_done.notify_all();
+	}
+}
+
+// writes whatever has been fetched by the last call to GetNextData or GetNextDataBulk
+void Acquisition::WriteData()
+{
+	int i;
+	Measurement *meas = GetMeasurement();
+	std::exception_ptr e;
+
+	// every channel goes to its own files, so they can be written at the same time
+	if(writers.empty()) {
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			if(meas->GetChannel(i)->IsEnabled()) {
+				WriteChannel(i);
+			}
+		}
+	} else {
+		std::unique_lock<std::mutex> lock(writer_mutex);
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			if(meas->GetChannel(i)->IsEnabled()) {
+				writer_queue.push_back(i);
+			}
+		}
+		writer_wake.notify_all();
+		writer_done.wait(lock, [this]() { return writer_queue.empty() && writers_busy == 0; });
+		e = writer_error;
+		writer_error = NULL;
+		if(e) {
+			std::rethrow_exception(e);
+		}
+	}
+	if(fe != NULL) {
+		WriteEtsTimes();
+	}
+}
+
+// the times of the samples of an ETS trace (in the same order as the samples in the files of the channels)
+void Acquisition::WriteEtsTimes()
+{
+	Measurement *meas = GetMeasurement();
+	const std::vector<int64_t> &t = meas->GetEtsTimesFs();
+	size_t n = meas->GetLengthFetched() < t.size() ? meas->GetLengthFetched() : t.size();
+
+	if(n == 0) {
+		return;
+	}
+	if(GetArgs()->IsBinaryOutput()) {
+		write_ets_times_binary(&t[0], n, fe);
+	} else {
+		write_ets_times_text(&t[0], n, fe);
+	}
+}
+
+void Acquisition::WriteChannel(int i)
+{
+	Measurement *meas = GetMeasurement();
+
+	if(fz[i] != NULL) {
+		WriteSuppressed(i);
+	}
+	// the binary file counts the samples while converting them
+	if(fb[i] == NULL) {
+		meas->CountSamples(i);
+	}
+	if(ft[i] != NULL) {
+		meas->WriteDataTxt(ft[i], i); // zero for channel A
+	}
+	if(fb[i] != NULL) {
+		meas->WriteDataBin(fb[i], i); // zero for channel A
+	}
+	if(fs[i] != NULL) {
+		WriteShaped(i);
+	}
+}
+
+// filters the samples fetched by the last call to GetNextData, continuing from the previous chunk
+void Acquisition::WriteShaped(int i)
+{
+	Measurement *meas = GetMeasurement();
+	unsigned long n = meas->GetLengthFetched();
+	// the same units as the binary files
+	float scale = meas->GetSeries() == PICO_6000 ? 1.0/(1 << ps6000_samples::shift) : 1.0/(1 << ps4000_samples::shift);
+
+	shaped[i].resize(n);
+	shaper[i].process(meas->GetData(i), &shaped[i][0], n);
+	if(GetArgs()->IsBinaryOutput()) {
+		write_floats_binary(&shaped[i][0], n, fs[i], scale);
+	} else {
+		write_floats_text(&shaped[i][0], n, fs[i], scale);
+	}
+}
+
+// keeps the windows around the pulses of the samples fetched by the last call to GetNextData, continuing from the previous chunk
+void Acquisition::WriteSuppressed(int i)
+{
+	Measurement *meas = GetMeasurement();
+	bool is_binary = GetArgs()->IsBinaryOutput();
+	bool is_8bit   = meas->GetSeries() == PICO_6000;
+	std::vector<char> data_8bit;
+	FILE *f = fz[i];
+	Timing t;
+
+	t.Start();
+	suppressor[i].process(meas->GetData(i), meas->GetLengthFetched(), [&](uint64_t index, const short *x, size_t n, bool is_new) {
+		size_t k;
+
+		// the same samples as in the binary files
+		if(is_8bit) {
+			data_8bit.resize(n);
+			for(k=0; k<n; k++) {
+				data_8bit[k] = x[k] >> 8;
+			}
+			if(is_binary) {
+				write_zs_piece_binary(index, &data_8bit[0], n, f);
+			} else {
+				write_zs_piece_text(index, &data_8bit[0], n, is_new, f);
+			}
+		} else if(is_binary) {
+			write_zs_piece_binary(index, x, n, f);
+		} else {
+			write_zs_piece_text(index, x, n, is_new, f);
+		}
+	}, suppressed[i]);
+	t.Stop();
+	suppressed[i].seconds += t.GetSecondsDouble();
+}
+
+// the statistics of the samples of every channel and a histogram of their (8-bit) values
+void Acquisition::WriteSampleStatistics()
+{
+	Measurement *meas = GetMeasurement();
+	double scale = meas->GetSeries() == PICO_6000 ? 1.0/(1 << ps6000_samples::shift) : 1.0;
+	int i;
+
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(meas->GetChannel(i)->IsEnabled()) {
+			fprintf(f_meta, "samples_%c:  ", 'A'+i);
+			write_sample_statistics(meas->GetSampleStatistics(i), f_meta, scale);
+			fprintf(f_meta, "\nvalues_%c:   ", 'A'+i);
+			write_sample_histogram(meas->GetSampleStatistics(i), f_meta);
+			fprintf(f_meta, "%s\n", meas->GetSeries() == PICO_6000 ? "" : " (upper 8 bits)");
+		}
+	}
+}
+
+unsigned long Acquisition::ApplyVeto()
+{
+	Measurement *meas = GetMeasurement();
+	unsigned long length  = meas->GetLength();
+	unsigned long ntraces = meas->GetLengthFetched()/length;
+	veto_options opt = GetArgs()->GetVetoOptions().scaled(meas->GetSeries() == PICO_6000 ? 1 << ps6000_samples::shift : 1 << ps4000_samples::shift);
+	Timing t;
+	int i;
+
+	// the pulse is on the trigger channel (or on the first channel without a trigger)
+	if(veto_channel < 0) {
+		for(i=0; i<PICOSCOPE_N_CHANNELS && !meas->GetChannel(i)->IsEnabled(); i++);
+		veto_channel = meas->IsTriggered() ? meas->GetTrigger()->GetChannel()->GetIndex() : i;
+	}
+	t.Start();
+	opt.baseline_length = meas->GetLengthBeforeTrigger();
+	calculate_veto_features(trace_span<short>(meas->GetData(veto_channel), ntraces, length), opt, veto_values);
+	apply_veto(veto_values, opt, 0, ntraces, veto_keep, veto_stats);
+	ntraces = meas->KeepTraces(veto_keep);
+	t.Stop();
+	veto_seconds += t.GetSecondsDouble();
+
+	return ntraces;
+}
+
+bool Acquisition::IsTargetReached(unsigned int run)
+{
+	Args &x = *GetArgs();
+
+	if(!x.IsTargetDriven()) {
+		return run >= x.GetNRepeats();
+	}
+	if(x.GetTargetEvents() > 0 && target_events >= x.GetTargetEvents()) {
+		return true;
+	}
+	target_clock.Stop();
+	return x.GetTargetSeconds() > 0 && target_clock.GetSecondsDouble() >= x.GetTargetSeconds();
+}
+
+// 1h02m03s, 4m05s or 6.7s
+static std::string FormatSeconds(double seconds)
+{
+	char buffer[64];
+	long s = (long)seconds;
+
+	if(seconds >= 3600) {
+		sprintf(buffer, "%ldh%02ldm%02lds", s/3600, (s/60)%60, s%60);
+	} else if(seconds >= 60) {
+		sprintf(buffer, "%ldm%02lds", s/60, s%60);
+	} else {
+		sprintf(buffer, "%.1fs", seconds);
+	}
+	return buffer;
+}
+
+void Acquisition::FinishBatch(unsigned int batch, unsigned long traces, double start)
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::FinishBatch (batch=" << batch << ", traces=" << traces << ")";
+
+	Args &x = *GetArgs();
+	double live = GetMeasurement()->GetRunSeconds(), elapsed, fraction = 0.0;
+
+	fprintf(f_index, "%u %llu %lu %lu %.6f %.6f\n", batch, (unsigned long long)target_events, traces,
+		GetMeasurement()->GetNTraces(), start, live);
+	// the index is complete up to here even if the run doesn't end properly
+	fflush(f_index);
+	target_events += traces;
+	target_live   += live;
+
+	// whichever of the targets comes first
+	target_clock.Stop();
+	elapsed = target_clock.GetSecondsDouble();
+	if(x.GetTargetEvents() > 0) {
+		fraction = (double)target_events/x.GetTargetEvents();
+	}
+	if(x.GetTargetSeconds() > 0 && elapsed/x.GetTargetSeconds() > fraction) {
+		fraction = elapsed/x.GetTargetSeconds();
+	}
+	fraction = fraction < 1 ? fraction : 1;
+	fprintf(stderr, "-- Batch %u: %llu events", batch+1, (unsigned long long)target_events);
+	if(x.GetTargetEvents() > 0) {
+		fprintf(stderr, " of %llu", (unsigned long long)x.GetTargetEvents());
+	}
+	fprintf(stderr, " (%.1f %%) in %s, live %s (%.1f %%), %.0f events/s, ETA %s\n",
+		fraction*100, FormatSeconds(elapsed).c_str(), FormatSeconds(target_live).c_str(), elapsed > 0 ? target_live*100/elapsed : 0.0,
+		elapsed > 0 ? target_events/elapsed : 0.0, fraction > 0 ? FormatSeconds(elapsed*(1 - fraction)/fraction).c_str() : "?");
+}
+
+void Acquisition::Run(int argc, char **argv)
+{
+	FILE_LOG(logDEBUG3) << "Acquisition::Run";
+
+	unsigned int run=0, i;
+	unsigned long n, batch_traces;
+	double batch_start = 0.0;
+	Measurement *meas = GetMeasurement();
+	Args        &x    = *GetArgs();
+
+	// restores the affinity and the priority of the thread when the run is over
+	RealTime realtime;
+
+	realtime.Apply(x.GetCpu(), x.GetRtPriority());
+	// a thread with real-time priority can afford to check more often
+	meas->SetWaitInterval(x.GetRtPriority() > 0 ? 1 : 200);
+	meas->GetWaitLatency().Reset();
+
+	meas->ResetSkippedCalls();
+	Plan();
+	if(x.IsAutoRange()) {
+		AutoRange();
+	}
+	if(x.IsAutoTrigger() && meas->IsTriggered()) {
+		AutoTrigger();
+	}
+	meas->ResetSampleStatistics();
+	meas->InitializeSignalGenerator();
+	target_clock.Start();
+	meas->RunBlock();
+
+	/* metadata */
+	WriteMetadata(argc, argv);
+
+	// triggered (TODO: we could also ask for a single triggered event)
+	if(x.GetNTraces() > 1) {
+		for(run=0; !IsTargetReached(run) && !_kbhit(); run++) {
+			//FILE_LOG(logINFO) << "Running experiment nr. " << run+1;
+			if(run>0) {
+				// the batches of --events and --duration are a single run
+				if(!x.IsTargetDriven()) {
+					std::cerr << "\nRepeat #" << run+1 << std::endl;
+				}
+				// the short capture of the recheck changes the length and the traces of the measurement,
+				// so the online analysis of the last batch has to be finished first
+				if(x.IsAutoTrigger() && x.GetAutoTriggerOptions().recheck) {
+					if(online != NULL) {
+						online->Wait();
+					}
+					AutoTrigger();
+				}
+				// the last batch only captures the events that are still missing (unless some of them may be dropped)
+				if(x.GetTargetEvents() > 0 && !x.IsVeto() && x.GetTargetEvents() - target_events < meas->GetNTraces()) {
+					meas->SetNTraces((unsigned long)(x.GetTargetEvents() - target_events));
+				}
+				target_clock.Stop();
+				batch_start = target_clock.GetSecondsDouble();
+				meas->RunBlock();
+			}
+			batch_traces = 0;
+			// with online analysis the traces are analysed while the next ones are being fetched
+			// (or while picoscope is waiting for the triggers of the next repeat)
+			while((n = meas->GetNextDataBulk()) > 0) {
+				if(x.IsVeto() && (n = ApplyVeto()) == 0) {
+					continue;
+				}
+				if(online != NULL) {
+					online->Submit();
+				} else {
+					WriteData();
+					meas->PrintSampleStatistics();
+				}
+				batch_traces += n;
+			}
+			if(x.IsTargetDriven()) {
+				FinishBatch(run, batch_traces, batch_start);
+			}
+		}
+		if(x.IsTargetDriven()) {
+			target_clock.Stop();
+			fprintf(f_meta, "target:     ");
+			if(x.GetTargetEvents() > 0) {
+				fprintf(f_meta, "%llu events%s", (unsigned long long)x.GetTargetEvents(), x.GetTargetSeconds() > 0 ? " or " : "");
+			}
+			if(x.GetTargetSeconds() > 0) {
+				fprintf(f_meta, "%g s", x.GetTargetSeconds());
+			}
+			fprintf(f_meta, ": %u batches of up to %lu traces, %llu events in %.3f s (live %.3f s, %.1f %%), index in %s.idx\n",
+				run, plan.segments, (unsigned long long)target_events, target_clock.GetSecondsDouble(), target_live,
+				target_clock.GetSecondsDouble() > 0 ? target_live*100/target_clock.GetSecondsDouble() : 0.0, x.GetFilename());
+		}
+		if(x.IsAutoTrigger() && x.GetAutoTriggerOptions().recheck) {
+			fprintf(f_meta, "retrig:     levels of the repeats:");
+			for(i=0; i<auto_trigger_levels.size(); i++) {
+				fprintf(f_meta, " %d", auto_trigger_levels[i]);
+			}
+			fprintf(f_meta, " (%.3f s)\n", auto_trigger_seconds);
+		}
+		if(x.IsVeto()) {
+			fprintf(f_meta, "veto:       %s on channel %c: kept %llu of %llu traces (%.3f %%) in %.3f s",
+				veto_description(x.GetVetoOptions()).c_str(), 'A'+veto_channel, (unsigned long long)veto_stats.accepted,
+				(unsigned long long)veto_stats.traces, veto_stats.traces > 0 ? veto_stats.accepted*100.0/veto_stats.traces : 0.0, veto_seconds);
+			for(i=0; i<VETO_NCUTS; i++) {
+				if(x.GetVetoOptions().enabled[i]) {
+					fprintf(f_meta, ", %llu failed %s", (unsigned long long)veto_stats.rejected[i], veto_cut_name(i));
+				}
+			}
+			fprintf(f_meta, "\n");
+		}
+		if(online != NULL) {
+			online->Wait();
+			online->SaveHistograms();
+			online->SaveAverages();
+			online->FlushEvents();
+			online->WriteMetadata(f_meta);
+		}
+		// tmp_dbl = meas->GetRatePerSecond();
+		// fprintf(f, "\nrate:       \n");
+		// if(fabs(tmp_dbl) > 1e6) {
+		// 	fprintf(f, "%.3f MS/s\n", tmp_dbl*1e-6);
+		// } else if(fabs(tmp_dbl) > 1e3) {
+		// 	fprintf(f, "%.3f kS/s\n", tmp_dbl*1e-3);
+		// } else {
+		// 	fprintf(f, "%f S/s\n", tmp_dbl);
+		// }
+	} else {
+		for(run=0; run<x.GetNRepeats() && !_kbhit(); run++) {
+			if(run>0) {
+				std::cerr << "\nRepeat #" << run+1 << std::endl;
+				meas->RunBlock();
+			}
+			// every repeat is a new trace for the filter and the zero suppression
+			for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+				shaper[i].reset();
+				suppressor[i].reset();
+			}
+			while(meas->GetNextData() > 0) {
+				WriteData();
+				meas->PrintSampleStatistics();
+			}
+		}
+		if(x.IsEts()) {
+			fprintf(f_meta, "ets:        %u interleaves of %u cycles, %ld ps between samples, %lu of %u traces put in the order of the sample times\n",
+				meas->GetEtsInterleave(), meas->GetEtsCycles(), meas->GetEtsSampleTimePs(), meas->GetEtsReordered(), run);
+		}
+		if(x.IsShaper()) {
+			fprintf(f_meta, "shaper:     %s, filtered in chunks of at most %lu samples\n",
+				shaper_description(x.GetShaperOptions()).c_str(), meas->GetMaxTraceLengthToFetch());
+		}
+		if(x.IsZeroSuppressed()) {
+			const zero_suppress_options &o = x.GetZeroSuppressOptions();
+			fprintf(f_meta, "zs:         below %g, hysteresis %g, %u samples before and %u after every pulse",
+				o.level, o.hysteresis, o.pre, o.post);
+			for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+				if(fz[i] != NULL) {
+					const zero_suppress_statistics &s = suppressed[i];
+					fprintf(f_meta, "; %c: %llu pulses in %llu windows, kept %llu of %llu samples (%.3f %%), scanned and written at %.2f GS/s",
+						'A'+i, (unsigned long long)s.pulses, (unsigned long long)s.windows, (unsigned long long)s.kept,
+						(unsigned long long)s.samples, s.ratio()*100, s.seconds > 0 ? s.samples*1e-9/s.seconds : 0.0);
+				}
+			}
+			fprintf(f_meta, "\n");
+		}
+	}
+	if(run>1 && !x.IsTargetDriven()) {
+		fprintf(f_meta, "repeats:    %u\n", run);
+	}
+	WriteSampleStatistics();
+	if(meas->GetSkippedCallsTotal() > 0) {
+		fprintf(f_meta, "skipped:    %lu driver calls (%.1f ms)\n", meas->GetSkippedCallsTotal(), meas->GetSkippedSecondsTotal()*1e3);
+	}
+
+	if(x.GetCpu() >= 0 || x.GetRtPriority() > 0 || numa_node >= 0) {
+		fprintf(f_meta, "realtime:   cpu %d, SCHED_FIFO %d, NUMA node %d, writers", x.GetCpu(), x.GetRtPriority(), numa_node);
+		for(i=0; i<x.GetWriterCpus().size(); i++) {
+			fprintf(f_meta, "%s%d", i>0 ? "," : " ", x.GetWriterCpus()[i]);
+		}
+		fprintf(f_meta, "%s\n", x.GetWriterCpus().empty() ? " -" : "");
+	}
+	if(meas->GetWaitLatency().GetCount() > 0) {
+		fprintf(f_meta, "sched_lat:  %lu wakeups after %lu ms, late by %.1f us on average, %.1f us at most\n",
+			meas->GetWaitLatency().GetCount(), x.GetRtPriority() > 0 ? 1UL : 200UL,
+			meas->GetWaitLatency().GetMean()*1e6, meas->GetWaitLatency().GetMax()*1e6);
+	}
+
+	fclose(f_meta);
+	f_meta = NULL;
+}
@@ -0,0 +1,140 @@
+#ifndef __ACQUISITION_H__
+#define __ACQUISITION_H__
+
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "picoscope.h"
+#include "measurement.h"
+#include "args.h"
+#include "online.h"
+#include "planner.h"
+#include "timing.h"
+
+#define MEGA(a) ((unsigned long)(a*1000000UL))
+#define GIGA(a) ((unsigned long)(a*1000000000UL))
+
+/*
+	A single acquisition as described by command-line arguments:
+	- passes the arguments to the measurement
+	- allocates memory and opens the output files (while picoscope is being opened)
+	- runs the picoscope and writes the data and the metadata
+
+	The picoscope has to be opened (and closed) by the caller,
+	so that the same device may be used for many acquisitions.
+ */
+class Acquisition {
+public:
+	Acquisition(Measurement *m, Args *a);
+	~Acquisition();
+
+	// settings that are used when nothing else is requested on the command line
+	static void SetDefaults(Measurement *m);
+	// parses the arguments and runs a complete acquisition on an open picoscope
+	// returns NULL on success or the error message; 'files' gets the names of the output files that were opened
+	static const char* RunJob(Measurement *m, Args &x, int argc, char **argv, std::vector<std::string> *files = NULL);
+
+	void Configure();
+	void AllocateBuffers();
+	void OpenFiles();
+	// opens picoscope, the files and allocates the buffers at the same time
+	void Start(Picoscope *p);
+	void Run(int argc, char **argv);
+	void CloseFiles();
+
+	Measurement* GetMeasurement() const { return measurement; };
+	Args*        GetArgs()        const { return args; };
+	// the names of the output files that OpenFiles has opened, including those of the online analysis (without the metadata)
+	std::vector<std::string> GetFiles() const;
+
+private:
+	Measurement *measurement;
+	Args        *args;
+
+	FILE *f_meta;
+	std::vector<std::string> output_files;
+	FILE *fb[PICOSCOPE_N_CHANNELS], *ft[PICOSCOPE_N_CHANNELS];
+	// a single long trace filtered with --shaper chunk by chunk
+	FILE *fs[PICOSCOPE_N_CHANNELS];
+	pulse_shaper       shaper[PICOSCOPE_N_CHANNELS];
+	std::vector<float> shaped[PICOSCOPE_N_CHANNELS];
+	// only the windows around the pulses of a single long trace with --zs
+	FILE *fz[PICOSCOPE_N_CHANNELS];
+	zero_suppressor<short>   suppressor[PICOSCOPE_N_CHANNELS];
+	zero_suppress_statistics suppressed[PICOSCOPE_N_CHANNELS];
+	// --ets: the times of the samples
+	FILE *fe;
+	// --veto: the features of the traces of the last block and which of them are kept
+	veto_features        veto_values;
+	std::vector<uint8_t> veto_keep;
+	veto_statistics      veto_stats;
+	int                  veto_channel;
+	double               veto_seconds;
+	// --U auto: the ranges of the series (ascending) and what it took to choose them
+	std::vector<PICO_VOLTAGE> ranges;
+	std::vector<double>       range_volts;
+	int                       auto_range_captures;
+	unsigned long             auto_range_samples;
+	double                    auto_range_seconds;
+	// --trig <x> auto: the last measurement of the noise and the levels that were chosen (one per check)
+	noise_measurement         auto_trigger_noise;
+	int                       auto_trigger_distance;
+	std::vector<int>          auto_trigger_levels;
+	double                    auto_trigger_seconds;
+	// --events and --duration: the index of the batches, the events written so far, how long picoscope
+	// was armed for them and the time since the first batch was armed
+	FILE                     *f_index;
+	uint64_t                  target_events;
+	double                    target_live;
+	Timing                    target_clock;
+	// the timebase and the traces per arm, as checked with picoscope before the run
+	MeasurementPlan           plan;
+	struct tm time_start;
+	// how long the steps of Start() took (negative when picoscope has been opened elsewhere)
+	double seconds_open, seconds_files, seconds_buffers;
+	// node where the buffers have been allocated (-1 if unknown)
+	int numa_node;
+	// only when the traces are analysed during the acquisition
+	OnlineAnalysis *online;
+	// --writer-cpu: pinned threads that write the channels queued by WriteData, from Start() until CloseFiles()
+	std::vector<std::thread> writers;
+	std::mutex               writer_mutex;
+	std::condition_variable  writer_wake, writer_done;
+	std::deque<int>          writer_queue;
+	int                      writers_busy;
+	bool                     writers_stop;
+	std::exception_ptr       writer_error;
+
+	void WriteMetadata(int argc, char **argv);
+	void StartWriters();
+	void StopWriters();
+	void WriterLoop(int cpu);
+	void WriteData();
+	void WriteChannel(int i);
+	void WriteShaped(int i);
+	void WriteSuppressed(int i);
+	void WriteEtsTimes();
+	void WriteSampleStatistics();
+	// chooses the timebase and the number of traces per arm with picoscope and shows them (--n max: as many as fit)
+	void Plan();
+	void FindRanges();
+	// chooses the range of every channel from a few short captures (--U auto)
+	void AutoRange();
+	// sets the level and the hysteresis of the trigger from the noise of a short capture (--trig <x> auto)
+	void AutoTrigger();
+	// true when the run is over: after the repeats, or when the target of --events or --duration is reached
+	bool IsTargetReached(unsigned int run);
+	// adds a batch of 'traces' events (armed 'start' seconds after the first one) to the index and shows the progress
+	void FinishBatch(unsigned int batch, unsigned long traces, double start);
+	// drops the traces of the last block that fail the cuts of --veto; returns the number of traces that are left
+	unsigned long ApplyVeto();
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __AUTO_RANGE_H__
+#define __AUTO_RANGE_H__
+
+#include <cmath>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+	Choice of the voltage range of a channel from a short capture before the run.
+
+	The capture gives the histogram of the (upper 8 bits of the) samples at the range it was taken with,
+	so the fraction of the samples that would be clipped with any smaller range can be counted.
+	A value of the histogram stands for anything up to half a value further from zero, so that a coarse capture
+	at a big range never suggests a range that is too small; samples that were clipped in the capture
+	are above every range up to the one of the capture.
+
+	The search starts at the biggest range and usually needs two or three captures:
+	the next one is taken with the range that was chosen, which gives a finer histogram,
+	until the choice doesn't change any more (or the range of the capture turns out to clip too much).
+ */
+struct auto_range_options {
+	double max_clipped;  // the fraction of the samples that may be clipped
+	unsigned long samples; // samples of every capture (at most)
+	double max_seconds;  // for the samples of a capture
+
+	auto_range_options() : max_clipped(1e-4), samples(1000000), max_seconds(0.05) {};
+};
+
+// the fraction of the samples of a histogram (counts[value+128], 'volts_per_value' volts each) at or above 'range' volts
+inline double fraction_above_range(const uint64_t *histogram, double volts_per_value, double range)
+{
+	uint64_t total = 0, above = 0;
+	int i;
+
+	for(i=0; i<256; i++) {
+		total += histogram[i];
+		// at most half a value further from zero
+		if((fabs((double)(i-128)) + 0.5)*volts_per_value >= range) {
+			above += histogram[i];
+		}
+	}
+	return total > 0 ? (double)above/total : 0;
+}
+
+// the index of the smallest of the ranges (ascending, in volts) that clips at most the fraction 'max_clipped' of the samples
+// (the biggest one when none of them does)
+inline size_t smallest_range(const uint64_t *histogram, double volts_per_value, const std::vector<double> &ranges, double max_clipped)
+{
+	size_t i;
+
+	for(i=0; i+1<ranges.size(); i++) {
+		if(fraction_above_range(histogram, volts_per_value, ranges[i]) <= max_clipped) {
+			return i;
+		}
+	}
+	return ranges.empty() ? 0 : ranges.size()-1;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef __AUTO_TRIGGER_H__
+#define __AUTO_TRIGGER_H__
+
+#include <cmath>
+#include <cstddef>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+	Choice of the level and the hysteresis of the trigger from the noise of an untriggered capture.
+
+	Everything is in values of the upper 8 bits of the samples (the steps of the trigger of 6000 series).
+	The baseline is the median of the histogram of the capture and the noise is measured on the quiet side
+	of the baseline (above it for negative pulses), where the pulses don't contribute: the rms of the samples
+	on that side and the number of times the signal crosses every distance from the baseline
+	(with the same hysteresis as the trigger, so that they are the triggers that noise would give).
+	The noise is assumed to be symmetric around the baseline.
+
+	The rate of noise triggers at a distance d is the larger of the crossings that were counted and
+	the rate of a gaussian noise with the same rms (Rice: the rate at the baseline times exp(-d^2/2 rms^2)),
+	which is needed for rates that are too low to be seen in a short capture.
+	The level is the smallest distance whose rate is at most the target.
+ */
+struct auto_trigger_options {
+	double        rate;        // noise triggers per second
+	bool          recheck;     // again before every repeat
+	unsigned long samples;     // of the capture (at most)
+	double        max_seconds; // for the samples of the capture
+
+	auto_trigger_options() : rate(1), recheck(false), samples(1000000), max_seconds(0.05) {};
+};
+
+struct noise_measurement {
+	double   baseline;       // median
+	double   rms;            // on the quiet side
+	int      hysteresis;     // that the crossings were counted with
+	double   seconds;        // of the capture
+	uint64_t crossings[129]; // [d]: of baseline+d (or -d) on the quiet side
+
+	noise_measurement() : baseline(0), rms(0), hysteresis(1), seconds(0)
+	{
+		int i;
+		for(i=0; i<129; i++) {
+			crossings[i] = 0;
+		}
+	}
+};
+
+// the median and the rms on the quiet side (opposite to the pulses, 'direction' = -1 for negative ones) of a histogram (counts[value+128])
+inline void measure_baseline_noise(const uint64_t *histogram, int direction, noise_measurement &m)
+{
+	uint64_t total = 0, below = 0, n = 0;
+	double sum2 = 0, d;
+	int i, median = 0;
+
+	for(i=0; i<256; i++) {
+		total += histogram[i];
+	}
+	for(i=0; i<256; i++) {
+		below += histogram[i];
+		if(2*below >= total) {
+			median = i - 128;
+			break;
+		}
+	}
+	for(i=0; i<256; i++) {
+		d = (i - 128 - median)*(double)-direction;
+		if(d > 0) {
+			sum2 += d*d*histogram[i];
+			n    += histogram[i];
+		} else if(d == 0) {
+			// the samples at the baseline belong to both sides
+			n    += histogram[i]/2;
+		}
+	}
+	m.baseline = median;
+	// at least the noise of the quantization
+	m.rms = n > 0 ? sqrt(sum2/n) : 0;
+	m.rms = m.rms > sqrt(1/12.0) ? m.rms : sqrt(1/12.0);
+}
+
+/*
+	Counts how often the signal x[] (in samples of the driver, whose upper 8 bits are used) crosses baseline+d
+	away from the baseline on the quiet side (opposite to 'direction' of the pulses), for every d from 1 to 128 at once; a level is armed again when the
+	signal is back within d-hysteresis. The levels that are waiting to be armed are always 1 ... m,
+	so every sample only changes m and marks the newly crossed levels in a difference array.
+ */
+inline void count_noise_crossings(const int16_t *x, size_t n, int direction, noise_measurement &m)
+{
+	int64_t diff[130] = {0};
+	const int b = (int)m.baseline, h = m.hysteresis > 0 ? m.hysteresis : 1;
+	int armed_from = 1, e;  // levels below armed_from have been crossed and wait
+	size_t i;
+
+	for(i=0; i<n; i++) {
+		e = ((x[i] >> 8) - b)*-direction;
+		e = e > 128 ? 128 : e;
+		if(e >= armed_from) {
+			diff[armed_from]++;
+			diff[e+1]--;
+			armed_from = e+1;
+		}
+		// back within d-h for the levels d >= e+h
+		armed_from = armed_from > e+h ? (e+h > 1 ? e+h : 1) : armed_from;
+	}
+	for(i=1; i<=128; i++) {
+		diff[i] += diff[i-1];
+		m.crossings[i] += (uint64_t)diff[i];
+	}
+}
+
+// the expected rate of noise triggers (per second) at the distance d from the baseline
+inline double noise_trigger_rate(const noise_measurement &m, int d)
+{
+	double measured, at_baseline, gauss;
+	int d0;
+
+	if(m.seconds <= 0 || d < 1) {
+		return HUGE_VAL;
+	}
+	measured = d <= 128 ? m.crossings[d]/m.seconds : 0;
+	// the rate at the baseline from the crossings about one rms away from it
+	d0 = (int)ceil(m.rms);
+	d0 = d0 < 1 ? 1 : (d0 > 128 ? 128 : d0);
+	at_baseline = m.crossings[d0]/m.seconds*exp(d0*d0/(2*m.rms*m.rms));
+	gauss = at_baseline*exp(-d*(double)d/(2*m.rms*m.rms));
+	return measured > gauss ? measured : gauss;
+}
+
+// the smallest distance from the baseline (in values) with at most 'rate' noise triggers per second (at most 'max_distance')
+inline int choose_trigger_distance(const noise_measurement &m, double rate, int max_distance)
+{
+	int d;
+
+	for(d=1; d<max_distance; d++) {
+		if(noise_trigger_rate(m, d) <= rate) {
+			break;
+		}
+	}
+	return d;
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef __AVERAGE_H__
+#define __AVERAGE_H__
+
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	The average of many triggered traces (and the rms around it) sample by sample,
+	for the shape of the pulses or for signals below the noise.
+
+	The traces are summed into exact 64-bit accumulators, so the order doesn't matter and the sums of
+	several threads can simply be added. The samples of a block of traces are first summed into narrow
+	accumulators of the type (sample_traits<T>::accumulator, which the compiler vectorizes)
+	and only added to the 64-bit sums after at most sample_traits<T>::block traces.
+ */
+struct trace_average {
+	std::vector<int64_t> sum;
+	std::vector<int64_t> sum2;  // sum of squares (empty without the rms)
+	uint64_t             count;
+
+	trace_average() : count(0) {};
+	trace_average(size_t length, bool rms) : sum(length, 0), sum2(rms ? length : 0, 0), count(0) {};
+
+	size_t length()  const { return sum.size(); };
+	bool   has_rms() const { return !sum2.empty(); };
+	double mean(size_t i) const { return count > 0 ? (double)sum[i]/count : 0; };
+	// the standard deviation of the samples around the mean
+	double rms(size_t i) const
+	{
+		double m = mean(i), v;
+
+		if(count == 0 || sum2.empty()) {
+			return 0;
+		}
+		v = (double)sum2[i]/count - m*m;
+		return v > 0 ? sqrt(v) : 0;
+	}
+	void reset()
+	{
+		sum.assign(sum.size(), 0);
+		sum2.assign(sum2.size(), 0);
+		count = 0;
+	}
+	void merge(const trace_average &a)
+	{
+		size_t i;
+
+		for(i=0; i<sum.size() && i<a.sum.size(); i++) {
+			sum[i] += a.sum[i];
+		}
+		for(i=0; i<sum2.size() && i<a.sum2.size(); i++) {
+			sum2[i] += a.sum2[i];
+		}
+		count += a.count;
+	}
+};
+
+// adds the traces of the span to the average (only the first avg.length() samples of every trace)
+template<typename T> void accumulate_traces(const trace_span<T> &traces, trace_average &avg)
+{
+	typedef typename sample_traits<T>::accumulator accumulator;
+	const size_t len = traces.length < avg.length() ? traces.length : avg.length();
+	std::vector<accumulator> partial(len);
+	size_t n, i, end;
+
+	for(n=0; n<traces.ntraces; n=end) {
+		end = traces.ntraces - n < sample_traits<T>::block ? traces.ntraces : n + sample_traits<T>::block;
+		partial.assign(len, 0);
+		for(; n<end; n++) {
+			const T *x = traces.trace(n);
+			accumulator *p = &partial[0];
+
+			for(i=0; i<len; i++) {
+				p[i] += x[i];
+			}
+			if(avg.has_rms()) {
+				int64_t *s2 = &avg.sum2[0];
+				for(i=0; i<len; i++) {
+					s2[i] += (int32_t)x[i]*(int32_t)x[i];
+				}
+			}
+		}
+		for(i=0; i<len; i++) {
+			avg.sum[i] += (int64_t)partial[i];
+		}
+	}
+	avg.count += traces.ntraces;
+}
+
+// one sample per line: the mean (and the rms) with three decimals, multiplied by 'scale'
+inline void write_average_text(const trace_average &avg, FILE *f, double scale=1)
+{
+	char buffer[1<<16];
+	char *p = buffer;
+	size_t i;
+	long milli;
+	int k;
+
+	for(i=0; i<avg.length(); i++) {
+		if(p - buffer > (long)sizeof(buffer) - 80) {
+			fwrite(buffer, 1, p-buffer, f);
+			p = buffer;
+		}
+		for(k=0; k<(avg.has_rms() ? 2 : 1); k++) {
+			milli = lround((k == 0 ? avg.mean(i) : avg.rms(i))*scale*1000);
+			if(k > 0) {
+				*p++ = '\t';
+			}
+			if(milli < 0) {
+				*p++ = '-';
+				milli = -milli;
+			}
+			p = ngamma_append_int(p, milli/1000);
+			*p++ = '.';
+			*p++ = '0' + (milli/100)%10;
+			*p++ = '0' + (milli/10)%10;
+			*p++ = '0' + milli%10;
+		}
+		*p++ = '\n';
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+// mean (and rms) as floats per sample
+inline void write_average_binary(const trace_average &avg, FILE *f, double scale=1)
+{
+	float buffer[4096];
+	size_t i, k = 0;
+
+	for(i=0; i<avg.length(); i++) {
+		buffer[k++] = (float)(avg.mean(i)*scale);
+		if(avg.has_rms()) {
+			buffer[k++] = (float)(avg.rms(i)*scale);
+		}
+		if(k >= sizeof(buffer)/sizeof(buffer[0]) - 1) {
+			fwrite(buffer, sizeof(float), k, f);
+			k = 0;
+		}
+	}
+	fwrite(buffer, sizeof(float), k, f);
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef __BASELINE_H__
+#define __BASELINE_H__
+
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+#include <limits>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	The baseline (DC offset) of every trace, estimated from the samples before the trigger.
+
+	* mean:    average of the pre-trigger samples
+	* median:  median of the averages of blocks of pre-trigger samples, so that a pulse
+	           or a spike in the pre-trigger region only spoils a few blocks
+	* running: the mean smoothed over consecutive traces (b += (mean - b)*weight),
+	           for slow drifts when the pre-trigger region is short and noisy;
+	           this has to be done in the order of traces with running_baselines
+
+	The baseline can either be subtracted from the samples (subtract_baselines)
+	or only be used to correct the n-gamma features (correct_integrals).
+ */
+enum baseline_method {
+	BASELINE_MEAN,
+	BASELINE_MEDIAN,
+	BASELINE_RUNNING
+};
+
+struct baseline_options {
+	baseline_method method;
+	unsigned int    length; // number of samples at the start of the trace (usually the pre-trigger samples)
+	unsigned int    block;  // block size for the median
+	double          weight; // weight of a new trace for the running estimate
+
+	baseline_options() : method(BASELINE_MEAN), length(0), block(16), weight(1.0/64) {};
+};
+
+// baselines of all traces of the span (in the units of samples), written to out[first ... first+traces.ntraces);
+// without samples before the trigger (opt.length == 0) there is no baseline and 0 is written, so nothing gets corrected
+// (the samples of the pulse must never be taken for the baseline)
+template<typename T> void calculate_baselines_batch(const trace_span<T> &traces, const baseline_options &opt, std::vector<float> &out, size_t first=0)
+{
+	// at most this many blocks for the median; longer pre-trigger regions get bigger blocks
+	const size_t max_blocks = 64;
+	const size_t len = opt.length < traces.length ? opt.length : traces.length;
+	size_t block = opt.block > 0 ? opt.block : 1;
+	size_t n, b, nblocks;
+	float means[max_blocks];
+
+	if(out.size() < first + traces.ntraces) {
+		out.resize(first + traces.ntraces);
+	}
+	if(len == 0) {
+		for(n=0; n<traces.ntraces; n++) {
+			out[first+n] = 0;
+		}
+		return;
+	}
+	if(len/block > max_blocks) {
+		block = (len + max_blocks - 1)/max_blocks;
+	}
+	nblocks = len/block > 0 ? len/block : 1;
+	if(nblocks == 1) {
+		block = len;
+	}
+	for(n=0; n<traces.ntraces; n++) {
+		const T *x = traces.trace(n);
+
+		// sum_samples is vectorized with the accumulators of the type of samples
+		if(opt.method == BASELINE_MEDIAN) {
+			for(b=0; b<nblocks; b++) {
+				means[b] = (float)sum_samples(x + b*block, block)/block;
+			}
+			std::nth_element(means, means + nblocks/2, means + nblocks);
+			out[first+n] = means[nblocks/2];
+		} else {
+			out[first+n] = (float)sum_samples(x, len)/len;
+		}
+	}
+}
+
+// the running estimate over baselines[first ... first+n) in the order of traces;
+// 'state' is the estimate after the previous trace (NaN before the first one)
+inline void running_baselines(std::vector<float> &baselines, size_t first, size_t n, double &state, double weight)
+{
+	size_t i;
+
+	for(i=first; i<first+n; i++) {
+		if(std::isnan(state)) {
+			state = baselines[i];
+		} else {
+			state += (baselines[i] - state)*weight;
+		}
+		baselines[i] = (float)state;
+	}
+}
+
+// subtracts the (rounded) baseline from the traces [first, first+ntraces) of a buffer of traces of the given length;
+// samples equal to 'clip' are left alone, so that they are still recognised as out of range
+template<typename T> void subtract_baselines(T *data, size_t ntraces, size_t length, const std::vector<float> &baselines, size_t first, T clip)
+{
+	const int32_t lo = std::numeric_limits<T>::min(), hi = std::numeric_limits<T>::max();
+	size_t n, i;
+
+	for(n=first; n<first+ntraces; n++) {
+		T *x = data + n*length;
+		const int32_t b = (int32_t)lround(baselines[n]);
+
+		// no branches, so that the loop can be vectorized
+		for(i=0; i<length; i++) {
+			int32_t v = (int32_t)x[i] - b;
+			v = v < lo ? lo : (v > hi ? hi : v);
+			x[i] = (x[i] == clip) ? clip : (T)v;
+		}
+	}
+}
+
+// the n-gamma features as if the baseline had been subtracted (the integrals and the peak are measured downwards);
+// the baselines are multiplied by 'scale' first (1/256 when the features of 6000 series have already been scaled to 8 bits)
+inline void correct_integrals(ngamma_features &features, const std::vector<float> &baselines, size_t first, size_t n,
+	unsigned int length, unsigned int integral2_length, float scale=1)
+{
+	size_t i;
+	float b;
+
+	for(i=first; i<first+n; i++) {
+		b = baselines[i]*scale;
+		features.integral1[i] += (int32_t)lround(b*length);
+		features.peak[i]      += (int32_t)lround(b);
+		// the second integral is missing when its window didn't fit into the trace
+		if(features.i_start_integrate2[i] + integral2_length <= length) {
+			features.integral2[i] += (int32_t)lround(b*integral2_length);
+		}
+	}
+}
+
+// one baseline per line (three decimals)
+inline void write_baselines_text(const std::vector<float> &baselines, FILE *f, size_t first=0, size_t n=(size_t)-1, float scale=1)
+{
+	char buffer[1<<16];
+	char *p = buffer;
+	size_t i, last;
+	long milli;
+
+	last = (n == (size_t)-1 || first+n > baselines.size()) ? baselines.size() : first+n;
+	for(i=first; i<last; i++) {
+		if(p - buffer > (long)sizeof(buffer) - 40) {
+			fwrite(buffer, 1, p-buffer, f);
+			p = buffer;
+		}
+		milli = lround(baselines[i]*scale*1000);
+		if(milli < 0) {
+			*p++ = '-';
+			milli = -milli;
+		}
+		p = ngamma_append_int(p, milli/1000);
+		*p++ = '.';
+		*p++ = '0' + (milli/100)%10;
+		*p++ = '0' + (milli/10)%10;
+		*p++ = '0' + milli%10;
+		*p++ = '\n';
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+// one float per trace
+inline void write_baselines_binary(const std::vector<float> &baselines, FILE *f, size_t first=0, size_t n=(size_t)-1, float scale=1)
+{
+	float buffer[4096];
+	size_t i, k = 0, last;
+
+	last = (n == (size_t)-1 || first+n > baselines.size()) ? baselines.size() : first+n;
+	for(i=first; i<last; i++) {
+		buffer[k++] = baselines[i]*scale;
+		if(k == sizeof(buffer)/sizeof(buffer[0])) {
+			fwrite(buffer, sizeof(float), k, f);
+			k = 0;
+		}
+	}
+	fwrite(buffer, sizeof(float), k, f);
+}
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef __COINCIDENCE_H__
+#define __COINCIDENCE_H__
+
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	Coincidences between the pulses (hits) of several channels.
+
+	The hits of every channel have to come in the order of time (as the timestamps of --timing do).
+	The channels are merged (k-way) into a single stream in the order of time, which is cut into events:
+	an event starts with a hit and contains every hit up to 'window' ps later;
+	events with hits in at least 'multiplicity' different channels are the coincidences.
+
+	The builder is streaming: hits are added channel by channel in blocks of any size,
+	and an event is only built when no channel can deliver an earlier hit any more
+	(every channel has a hit after the end of the event, or finish() has been called).
+	Memory only grows with the hits that are waiting for the other channels.
+	When the clock starts again (a new run), restart() builds the remaining events of the old one first.
+
+	The accidental coincidences are estimated in two ways:
+	* from the rates of singles, for every pair of channels R_i*R_j*2*window
+	* with a delayed window: hits of channel j that have a hit of a channel i<j
+	  within 'window' of 'delay' ps earlier, which are (nearly) all accidental for delay >> window
+ */
+struct coincidence_hit {
+	int64_t  time_ps;
+	uint32_t trace;   // index of the trace in the files of the channel
+	uint32_t channel;
+	float    energy;  // any feature of the pulse (integral1, amplitude of the shaped pulse, ...)
+};
+
+struct coincidence_options {
+	int64_t      window_ps;
+	unsigned int multiplicity; // minimal number of different channels in an event
+	int64_t      delay_ps;     // for the accidentals (0: 100 windows)
+
+	coincidence_options() : window_ps(10000), multiplicity(2), delay_ps(0) {};
+};
+
+struct coincidence_statistics {
+	std::vector<uint64_t> singles;      // hits of every channel
+	std::vector<uint64_t> pairs;        // events with both channels of a pair [i*nchannels+j], i<j (any multiplicity)
+	std::vector<uint64_t> delayed;      // delayed coincidences of every pair [i*nchannels+j], i<j
+	uint64_t              events;       // all events (also those with a single hit)
+	uint64_t              coincidences; // events with at least 'multiplicity' channels
+	uint64_t              unsorted;     // hits that came earlier than the previous hit of their channel
+	int64_t               first_ps, last_ps; // of the current run
+	double                elapsed_ps;   // of the previous runs
+
+	double seconds() const { return (elapsed_ps + (last_ps > first_ps ? last_ps - first_ps : 0))*1e-12; };
+	double rate(size_t channel) const { return seconds() > 0 ? singles[channel]/seconds() : 0; };
+	uint64_t hits() const
+	{
+		uint64_t n = 0;
+		size_t i;
+
+		for(i=0; i<singles.size(); i++) {
+			n += singles[i];
+		}
+		return n;
+	}
+	// expected accidental coincidences of a pair of channels from their rates: R_i*R_j*2*window*time
+	double accidentals(size_t i, size_t j, int64_t window_ps) const
+	{
+		return rate(i)*rate(j)*2*window_ps*1e-12*seconds();
+	};
+};
+
+class event_builder {
+public:
+	event_builder(const coincidence_options &o, unsigned int n) :
+		opt(o), nchannels(n), queues(n), watermark(n, numeric_limits<int64_t>::min()), recent(n)
+	{
+		if(opt.delay_ps <= 0) {
+			opt.delay_ps = 100*opt.window_ps;
+		}
+		stats.singles.assign(n, 0);
+		stats.pairs.assign(n*n, 0);
+		stats.delayed.assign(n*n, 0);
+		stats.events       = 0;
+		stats.coincidences = 0;
+		stats.unsorted     = 0;
+		stats.elapsed_ps   = 0;
+		stats.first_ps     = numeric_limits<int64_t>::max();
+		stats.last_ps      = numeric_limits<int64_t>::min();
+		finished = false;
+	}
+
+	const coincidence_options&    get_options()    const { return opt; };
+	const coincidence_statistics& get_statistics() const { return stats; };
+	unsigned int                  get_channels()   const { return nchannels; };
+
+	// hits of a channel in the order of time (following those of the previous call)
+	void add(unsigned int channel, const coincidence_hit *hits, size_t n)
+	{
+		size_t i;
+		std::deque<coincidence_hit> &q = queues[channel];
+
+		for(i=0; i<n; i++) {
+			if(hits[i].time_ps < watermark[channel]) {
+				stats.unsorted++;
+			} else {
+				watermark[channel] = hits[i].time_ps;
+			}
+			q.push_back(hits[i]);
+			q.back().channel = channel;
+		}
+	}
+	// no more hits will come: the remaining events can be built
+	void finish() { finished = true; };
+	// a channel won't deliver any hits before 't' (so that a quiet channel doesn't hold back the events)
+	void advance(unsigned int channel, int64_t t)
+	{
+		watermark[channel] = t > watermark[channel] ? t : watermark[channel];
+	}
+	// the time of the last hit added to a channel
+	int64_t get_last_time(unsigned int channel) const { return watermark[channel]; };
+
+	// builds the remaining events; the following hits start from a new clock
+	template<class F> uint64_t restart(F on_event)
+	{
+		uint64_t found;
+		unsigned int c;
+
+		finish();
+		found = build(on_event);
+		for(c=0; c<nchannels; c++) {
+			watermark[c] = numeric_limits<int64_t>::min();
+			recent[c].clear();
+		}
+		if(stats.last_ps > stats.first_ps) {
+			stats.elapsed_ps += stats.last_ps - stats.first_ps;
+		}
+		stats.first_ps = numeric_limits<int64_t>::max();
+		stats.last_ps  = numeric_limits<int64_t>::min();
+		finished = false;
+		return found;
+	}
+
+	/*
+		Builds every event that is complete and calls on_event(const coincidence_hit *hits, size_t n, uint32_t channel_mask)
+		for the coincidences; returns the number of coincidences.
+	 */
+	template<class F> uint64_t build(F on_event)
+	{
+		uint64_t found = 0;
+		unsigned int c, best;
+		int64_t next, safe = finished ? numeric_limits<int64_t>::max() : safe_time();
+
+		for(;;) {
+			// the channel with the earliest hit (there are only a few channels: a linear search is the fastest)
+			best = nchannels;
+			for(c=0; c<nchannels; c++) {
+				if(!queues[c].empty() && (best == nchannels || queues[c].front().time_ps < queues[best].front().time_ps)) {
+					best = c;
+				}
+			}
+			// the next hit can't come before this (hits that are not there yet come at 'safe' or later)
+			next = best == nchannels || safe < queues[best].front().time_ps ? safe : queues[best].front().time_ps;
+			// the event is complete when the next hit is too late for it
+			if(!event.empty() && next > event[0].time_ps + opt.window_ps) {
+				found += close_event(on_event);
+			}
+			// other channels may still deliver hits before this one (or at the same time, from a channel that comes first)
+			if(best == nchannels || (!finished && queues[best].front().time_ps >= safe)) {
+				break;
+			}
+			take(queues[best].front());
+			queues[best].pop_front();
+		}
+		return found;
+	}
+
+private:
+	coincidence_options                        opt;
+	unsigned int                               nchannels;
+	std::vector<std::deque<coincidence_hit> >  queues;
+	std::vector<int64_t>                       watermark;
+	// hits of the last 'delay+window' ps of every channel, for the delayed coincidences
+	std::vector<std::deque<int64_t> >          recent;
+	std::vector<coincidence_hit>               event;
+	coincidence_statistics                     stats;
+	bool                                       finished;
+
+	// no channel can deliver a hit before this time any more
+	int64_t safe_time() const
+	{
+		int64_t safe = numeric_limits<int64_t>::max();
+		unsigned int c;
+
+		for(c=0; c<nchannels; c++) {
+			safe = watermark[c] < safe ? watermark[c] : safe;
+		}
+		return safe;
+	}
+
+	// the next hit in the order of time
+	void take(const coincidence_hit &h)
+	{
+		unsigned int c;
+
+		stats.singles[h.channel]++;
+		stats.first_ps = h.time_ps < stats.first_ps ? h.time_ps : stats.first_ps;
+		stats.last_ps  = h.time_ps > stats.last_ps  ? h.time_ps : stats.last_ps;
+		// delayed coincidences with the hits of the other channels about 'delay' earlier
+		for(c=0; c<nchannels; c++) {
+			std::deque<int64_t> &r = recent[c];
+			while(!r.empty() && r.front() < h.time_ps - opt.delay_ps - opt.window_ps) {
+				r.pop_front();
+			}
+			// one direction only (the earlier channel delayed), so that the width is 2*window as for the coincidences
+			if(c < h.channel) {
+				std::deque<int64_t>::const_iterator it;
+				for(it=r.begin(); it!=r.end() && *it <= h.time_ps - opt.delay_ps + opt.window_ps; ++it) {
+					stats.delayed[c*nchannels+h.channel]++;
+				}
+			}
+		}
+		recent[h.channel].push_back(h.time_ps);
+		event.push_back(h);
+	}
+
+	template<class F> uint64_t close_event(F &on_event)
+	{
+		uint32_t mask = 0;
+		unsigned int i, j, nch = 0;
+
+		for(i=0; i<event.size(); i++) {
+			mask |= 1U << event[i].channel;
+		}
+		for(i=0; i<nchannels; i++) {
+			nch += (mask >> i) & 1;
+		}
+		stats.events++;
+		// pairs are counted in every event, to compare them with the accidentals
+		if(nch > 1) {
+			for(i=0; i<nchannels; i++) {
+				for(j=i+1; j<nchannels; j++) {
+					if(((mask >> i) & 1) && ((mask >> j) & 1)) {
+						stats.pairs[i*nchannels+j]++;
+					}
+				}
+			}
+		}
+		if(nch >= opt.multiplicity && nch > 1) {
+			stats.coincidences++;
+			on_event(&event[0], event.size(), mask);
+			event.clear();
+			return 1;
+		}
+		event.clear();
+		return 0;
+	}
+};
+
+// one line per event: time of the first hit (ps), number of hits, channel mask,
+// then channel (its name), trace, time after the first hit (ps) and energy of every hit
+inline void write_event_text(const coincidence_hit *hits, size_t n, uint32_t mask, const char *channel_names, FILE *f)
+{
+	char buffer[64 + 80*32];
+	char *p = buffer;
+	size_t i;
+	long milli;
+
+	n = n < 32 ? n : 32;
+	p = ngamma_append_int(p, hits[0].time_ps);
+	*p++ = '\t';
+	p = ngamma_append_int(p, n);
+	*p++ = '\t';
+	p = ngamma_append_int(p, mask);
+	for(i=0; i<n; i++) {
+		*p++ = '\t';
+		*p++ = channel_names[hits[i].channel];
+		*p++ = '\t';
+		p = ngamma_append_int(p, hits[i].trace);
+		*p++ = '\t';
+		p = ngamma_append_int(p, hits[i].time_ps - hits[0].time_ps);
+		*p++ = '\t';
+		milli = lround(hits[i].energy*1000);
+		if(milli < 0) {
+			*p++ = '-';
+			milli = -milli;
+		}
+		p = ngamma_append_int(p, milli/1000);
+		*p++ = '.';
+		*p++ = '0' + (milli/100)%10;
+		*p++ = '0' + (milli/10)%10;
+		*p++ = '0' + milli%10;
+	}
+	*p++ = '\n';
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+// time of the first hit (int64), number of hits and channel mask (uint32),
+// then channel, trace (uint32), time after the first hit (int32, ps) and energy (float) of every hit
+inline void write_event_binary(const coincidence_hit *hits, size_t n, uint32_t mask, FILE *f)
+{
+	char buffer[16 + 16*32];
+	char *p = buffer;
+	uint32_t u;
+	int32_t dt;
+	size_t i;
+
+	n = n < 32 ? n : 32;
+	memcpy(p, &hits[0].time_ps, 8); p += 8;
+	u = n;
+	memcpy(p, &u, 4);    p += 4;
+	memcpy(p, &mask, 4); p += 4;
+	for(i=0; i<n; i++) {
+		dt = (int32_t)(hits[i].time_ps - hits[0].time_ps);
+		memcpy(p, &hits[i].channel, 4); p += 4;
+		memcpy(p, &hits[i].trace, 4);   p += 4;
+		memcpy(p, &dt, 4);              p += 4;
+		memcpy(p, &hits[i].energy, 4);  p += 4;
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __ETS_H__
+#define __ETS_H__
+
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	Equivalent-time sampling: picoscope captures a repetitive signal several times (interleaves), each time
+	with a slightly different delay after the trigger, and returns all of them as a single trace
+	with the time of every sample (in fs, relative to the trigger).
+
+	The samples are put into the order of their times before they are written. The trace usually
+	already is in order, which a single pass finds out; otherwise it consists of a few runs that are
+	in order (one per interleave), which are merged pairwise (O(n log runs) instead of sorting everything).
+	The same order is then applied to the samples of every channel.
+ */
+struct ets_sorter {
+	std::vector< std::pair<int64_t, uint32_t> > a, b;
+	std::vector<size_t> runs;
+	std::vector<uint32_t> order;
+
+	static bool earlier(const std::pair<int64_t, uint32_t> &x, const std::pair<int64_t, uint32_t> &y) { return x.first < y.first; };
+
+	// sorts the times t[0 ... n) and remembers the order for apply(); false when they were in order already
+	bool sort(int64_t *t, size_t n)
+	{
+		size_t i, r;
+
+		runs.clear();
+		runs.push_back(0);
+		for(i=1; i<n; i++) {
+			if(t[i] < t[i-1]) {
+				runs.push_back(i);
+			}
+		}
+		if(runs.size() == 1) {
+			return false;
+		}
+		runs.push_back(n);
+		a.resize(n);
+		b.resize(n);
+		for(i=0; i<n; i++) {
+			a[i] = std::make_pair(t[i], (uint32_t)i);
+		}
+		// neighbouring runs are merged until a single one is left (std::merge keeps equal times in order)
+		while(runs.size() > 2) {
+			std::vector<size_t> merged;
+			for(r=0; r+1<runs.size(); r+=2) {
+				merged.push_back(runs[r]);
+				if(r+2 < runs.size()) {
+					std::merge(a.begin()+runs[r], a.begin()+runs[r+1], a.begin()+runs[r+1], a.begin()+runs[r+2], b.begin()+runs[r], earlier);
+				} else {
+					std::copy(a.begin()+runs[r], a.begin()+runs[r+1], b.begin()+runs[r]);
+				}
+			}
+			merged.push_back(n);
+			runs.swap(merged);
+			a.swap(b);
+		}
+		order.resize(n);
+		for(i=0; i<n; i++) {
+			t[i]     = a[i].first;
+			order[i] = a[i].second;
+		}
+		return true;
+	}
+
+	// puts the samples x[0 ... n) into the order of the last sort()
+	template<typename T> void apply(T *x, size_t n, std::vector<T> &buffer) const
+	{
+		size_t i;
+
+		buffer.assign(x, x + n);
+		for(i=0; i<n && i<order.size(); i++) {
+			x[i] = buffer[order[i]];
+		}
+	}
+};
+
+// the times of the samples: int64 in fs
+inline void write_ets_times_binary(const int64_t *t, size_t n, FILE *f)
+{
+	fwrite(t, sizeof(int64_t), n, f);
+}
+
+// one time per line, in fs
+inline void write_ets_times_text(const int64_t *t, size_t n, FILE *f)
+{
+	char buffer[1<<16];
+	char *p = buffer;
+	size_t i;
+
+	for(i=0; i<n; i++) {
+		if(p - buffer > (long)sizeof(buffer) - 30) {
+			fwrite(buffer, 1, p-buffer, f);
+			p = buffer;
+		}
+		p = ngamma_append_int(p, t[i]);
+		*p++ = '\n';
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+#endif
@@ -0,0 +1,499 @@
+#ifndef __FILTERS_H__
+#define __FILTERS_H__
+
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	Digital pulse shaping for energy spectroscopy.
+
+	* moving average of 'length' samples
+	* FIR with arbitrary taps (y[n] = sum of taps[k]*x[n-k])
+	* trapezoidal (Jordanov): rising edge of 'rise' samples, flat top of 'flat' samples,
+	  with the pole-zero correction for pulses decaying exponentially with the time constant 'tau' (in samples);
+	  tau=0 is for steps (no decay)
+	* CR-RC^n: one CR differentiator and 'order' RC integrators with the same time constant 'tau',
+	  scaled so that a step gives (approximately) a peak of the same height
+
+	A pulse_shaper keeps its state between calls to process(), so a long capture can be filtered
+	in chunks (as fetched by GetNextData) with exactly the same result as in one piece;
+	the traces of a rapid-block buffer are filtered one by one after reset().
+	The first sample after reset() fills the history, so a trace that starts on the baseline doesn't start with a step.
+	The output of the trapezoidal and the CR-RC^n filter doesn't contain the baseline.
+
+	The parts without feedback (the differences and the taps) are loops over samples, which the compiler vectorizes.
+	The recursive parts (running sums, RC stages) depend on the previous output and have to follow the samples;
+	shape_traces runs CR-RC^n on a group of traces at once, so that those loops are vectorized over the traces instead.
+ */
+enum shaper_type {
+	SHAPER_NONE,
+	SHAPER_MOVING_AVERAGE,
+	SHAPER_FIR,
+	SHAPER_TRAPEZOIDAL,
+	SHAPER_CRRC
+};
+
+struct shaper_options {
+	shaper_type        type;
+	unsigned int       length; // moving average
+	unsigned int       rise;   // trapezoidal
+	unsigned int       flat;
+	double             tau;    // trapezoidal (decay of the pulses) and CR-RC^n (shaping time), in samples
+	unsigned int       order;  // CR-RC^n
+	std::vector<float> taps;   // FIR
+
+	shaper_options() : type(SHAPER_NONE), length(1), rise(1), flat(0), tau(0), order(1) {};
+};
+
+class pulse_shaper {
+public:
+	pulse_shaper() { set_options(shaper_options()); };
+	pulse_shaper(const shaper_options &o) { set_options(o); };
+
+	void set_options(const shaper_options &o)
+	{
+		unsigned int i;
+
+		opt = o;
+		switch(opt.type) {
+			case SHAPER_MOVING_AVERAGE:
+				opt.length = opt.length > 0 ? opt.length : 1;
+				nhistory   = opt.length;
+				break;
+			case SHAPER_FIR:
+				if(opt.taps.empty()) {
+					opt.taps.push_back(1);
+				}
+				nhistory = opt.taps.size() - 1;
+				break;
+			case SHAPER_TRAPEZOIDAL:
+				opt.rise = opt.rise > 0 ? opt.rise : 1;
+				nhistory = 2*opt.rise + opt.flat;
+				// M = 1/(exp(1/tau)-1); the flat top of a pulse with the height A is then A*rise*(M+1)
+				pole_zero = opt.tau > 0 ? 1.0/expm1(1.0/opt.tau) : 0;
+				break;
+			case SHAPER_CRRC:
+				opt.order = opt.order > 0 ? opt.order : 1;
+				opt.tau   = opt.tau > 0 ? opt.tau : 1;
+				nhistory  = 0;
+				decay     = exp(-1.0/opt.tau);
+				// the peak of CR-RC^n for a unit step is n^n e^-n / n! (in the limit of many samples per tau)
+				gain = 1;
+				for(i=1; i<=opt.order; i++) {
+					gain *= i/(double)opt.order;
+				}
+				gain *= exp((double)opt.order);
+				break;
+			default:
+				nhistory = 0;
+				break;
+		}
+		stages.resize(opt.type == SHAPER_CRRC ? opt.order+1 : 0);
+		reset();
+	}
+	const shaper_options& get_options() const { return opt; };
+
+	// the next sample starts a new trace
+	void reset()
+	{
+		size_t i;
+
+		is_primed = false;
+		history.assign(nhistory, 0.0f);
+		sum = 0;
+		sum2 = 0;
+		x_prev = 0;
+		for(i=0; i<stages.size(); i++) {
+			stages[i] = 0;
+		}
+	}
+
+	// filters n samples (that follow those of the previous call) into y
+	template<typename T> void process(const T *x, float *y, size_t n)
+	{
+		size_t i, k;
+
+		if(n == 0) {
+			return;
+		}
+		if(!is_primed) {
+			prime((float)x[0]);
+		}
+		// the history followed by the new samples, so that x[i-k] is just work[nhistory+i-k]
+		work.resize(nhistory + n);
+		for(i=0; i<nhistory; i++) {
+			work[i] = history[i];
+		}
+		for(i=0; i<n; i++) {
+			work[nhistory+i] = (float)x[i];
+		}
+		const float *w = &work[nhistory];
+
+		switch(opt.type) {
+			case SHAPER_MOVING_AVERAGE: {
+				const size_t m = opt.length;
+				// integer samples are summed exactly (and faster) in integers
+				typename sample_traits<T>::total total = (typename sample_traits<T>::total)sum;
+				differences.resize(n);
+				for(i=0; i<n; i++) {
+					differences[i] = w[i] - w[(ptrdiff_t)i-(ptrdiff_t)m];
+				}
+				for(i=0; i<n; i++) {
+					total += (typename sample_traits<T>::total)differences[i];
+					y[i]   = (float)((double)total/m);
+				}
+				sum = (double)total;
+				break;
+			}
+			case SHAPER_FIR: {
+				const size_t ntaps = opt.taps.size();
+				for(i=0; i<n; i++) {
+					y[i] = 0;
+				}
+				for(k=0; k<ntaps; k++) {
+					const float h = opt.taps[k];
+					const float *v = w - k;
+					for(i=0; i<n; i++) {
+						y[i] += h*v[i];
+					}
+				}
+				break;
+			}
+			case SHAPER_TRAPEZOIDAL: {
+				const ptrdiff_t r = opt.rise, l = opt.rise + opt.flat;
+				const double norm = opt.tau > 0 ? 1.0/(opt.rise*(pole_zero+1)) : 1.0/opt.rise;
+				// p = sum of d and S = sum of p, exact (and without the latency of floating point additions) for integer samples
+				typename sample_traits<T>::total p = (typename sample_traits<T>::total)sum, S = (typename sample_traits<T>::total)sum2;
+				differences.resize(n);
+				// exact for integer samples (up to 2^22)
+				for(i=0; i<n; i++) {
+					const ptrdiff_t j = i;
+					differences[i] = (w[j] - w[j-r]) - (w[j-l] - w[j-l-r]);
+				}
+				// Jordanov: p += d; r = p + M*d; s += r, which is the same as s = S + M*p
+				if(opt.tau > 0) {
+					for(i=0; i<n; i++) {
+						p   += (typename sample_traits<T>::total)differences[i];
+						S   += p;
+						y[i] = (float)((S + pole_zero*p)*norm);
+					}
+				} else {
+					for(i=0; i<n; i++) {
+						p   += (typename sample_traits<T>::total)differences[i];
+						y[i] = (float)(p*norm);
+					}
+				}
+				sum  = (double)p;
+				sum2 = (double)S;
+				break;
+			}
+			case SHAPER_CRRC: {
+				const size_t nstages = stages.size();
+				for(i=0; i<n; i++) {
+					double v = w[i];
+					// CR: y = a*(y + x - x_prev), then RC: y = a*y + (1-a)*x
+					stages[0] = decay*(stages[0] + v - x_prev);
+					x_prev    = v;
+					for(k=1; k<nstages; k++) {
+						stages[k] = decay*stages[k] + (1-decay)*stages[k-1];
+					}
+					y[i] = (float)(stages[nstages-1]*gain);
+				}
+				break;
+			}
+			default:
+				for(i=0; i<n; i++) {
+					y[i] = w[i];
+				}
+				break;
+		}
+		// the last samples for the next call
+		for(i=0; i<nhistory; i++) {
+			history[i] = work[n+i];
+		}
+	}
+
+	/*
+		CR-RC^n of the traces [0, ntraces) of a buffer (with the given length) at the same time,
+		each of them starting from reset(); the state of the shaper is not changed.
+		The recursion goes over the samples, the innermost loop over the traces,
+		which the compiler turns into vector instructions.
+	 */
+	template<typename T> void crrc_traces(const T *x, size_t length, size_t ntraces, float *y) const
+	{
+		const size_t lanes = 8, tile = 64;
+		const size_t nstages = stages.size();
+		size_t first, t, i, i0, ni, k, nt;
+		// x_prev and up to 16 stages for every lane; a tile of samples of all lanes (transposed)
+		double state[lanes*(1+16)], in[tile*lanes];
+		float out[tile*lanes];
+		double *prev = state, *s = state + lanes;
+
+		if(nstages > 16) {
+			throw "CR-RC^n is only supported up to n=15.";
+		}
+		for(first=0; first<ntraces; first+=nt) {
+			nt = ntraces-first < lanes ? ntraces-first : lanes;
+			for(t=0; t<lanes; t++) {
+				prev[t] = t < nt ? (double)(float)x[(first+t)*length] : 0;
+				for(k=0; k<nstages; k++) {
+					s[k*lanes+t] = 0;
+				}
+			}
+			for(i0=0; i0<length; i0+=ni) {
+				ni = length-i0 < tile ? length-i0 : tile;
+				for(t=0; t<lanes; t++) {
+					for(i=0; i<ni; i++) {
+						in[i*lanes+t] = t < nt ? (double)(float)x[(first+t)*length + i0+i] : 0;
+					}
+				}
+				// the same operations as in process(), for all lanes at once
+				for(i=0; i<ni; i++) {
+					const double *v = in + i*lanes;
+					for(t=0; t<lanes; t++) {
+						s[t]    = decay*(s[t] + v[t] - prev[t]);
+						prev[t] = v[t];
+					}
+					for(k=1; k<nstages; k++) {
+						for(t=0; t<lanes; t++) {
+							s[k*lanes+t] = decay*s[k*lanes+t] + (1-decay)*s[(k-1)*lanes+t];
+						}
+					}
+					for(t=0; t<lanes; t++) {
+						out[i*lanes+t] = (float)(s[(nstages-1)*lanes+t]*gain);
+					}
+				}
+				for(t=0; t<nt; t++) {
+					for(i=0; i<ni; i++) {
+						y[(first+t)*length + i0+i] = out[i*lanes+t];
+					}
+				}
+			}
+		}
+	}
+
+private:
+	shaper_options      opt;
+	size_t              nhistory;
+	bool                is_primed;
+	std::vector<float>  history, work, differences;
+	double              sum, sum2, x_prev, pole_zero, decay, gain;
+	std::vector<double> stages;
+
+	// the history as if the signal had always been at the level of the first sample
+	void prime(float x0)
+	{
+		size_t i;
+
+		for(i=0; i<nhistory; i++) {
+			history[i] = x0;
+		}
+		// the moving average of a constant signal is that constant
+		sum       = opt.type == SHAPER_MOVING_AVERAGE ? (double)x0*opt.length : 0;
+		x_prev    = x0;
+		is_primed = true;
+	}
+};
+
+// for example "trapezoidal, rise 20, flat 10, tau 300 samples"
+inline std::string shaper_description(const shaper_options &o)
+{
+	char buffer[200];
+
+	switch(o.type) {
+		case SHAPER_MOVING_AVERAGE:
+			snprintf(buffer, sizeof(buffer), "moving average of %u samples", o.length);
+			break;
+		case SHAPER_FIR:
+			snprintf(buffer, sizeof(buffer), "FIR with %u taps", (unsigned int)o.taps.size());
+			break;
+		case SHAPER_TRAPEZOIDAL:
+			snprintf(buffer, sizeof(buffer), "trapezoidal, rise %u, flat %u, tau %g samples", o.rise, o.flat, o.tau);
+			break;
+		case SHAPER_CRRC:
+			snprintf(buffer, sizeof(buffer), "CR-RC^%u, tau %g samples", o.order, o.tau);
+			break;
+		default:
+			snprintf(buffer, sizeof(buffer), "none");
+			break;
+	}
+	return std::string(buffer);
+}
+
+/*
+	The amplitude (energy) of the shaped pulse of every trace: the level before the pulse
+	(average of the first baseline_length samples of the shaped trace) minus its minimum,
+	and the position of the minimum.
+ */
+struct shaped_features {
+	std::vector<float>    amplitude;
+	std::vector<uint32_t> position;
+
+	void resize(size_t n)
+	{
+		amplitude.resize(n);
+		position.resize(n);
+	}
+	size_t size() const { return amplitude.size(); };
+};
+
+// shapes every trace of the span separately and writes its amplitude to out[first ... first+traces.ntraces);
+// 'shaped' is a buffer for the filtered traces (of the thread)
+template<typename T> void shape_traces(const trace_span<T> &traces, pulse_shaper &shaper, unsigned int baseline_length,
+	shaped_features &out, std::vector<float> &shaped, size_t first=0)
+{
+	const size_t len = traces.length;
+	const size_t nbase = baseline_length > 0 && baseline_length < len ? baseline_length : 1;
+	const size_t group = 256;
+	size_t n, g, ng, i;
+
+	if(out.size() < first + traces.ntraces) {
+		out.resize(first + traces.ntraces);
+	}
+	shaped.resize(group*len);
+	for(g=0; g<traces.ntraces; g+=ng) {
+		ng = traces.ntraces-g < group ? traces.ntraces-g : group;
+		if(shaper.get_options().type == SHAPER_CRRC) {
+			shaper.crrc_traces(traces.trace(g), len, ng, &shaped[0]);
+		} else {
+			for(n=0; n<ng; n++) {
+				shaper.reset();
+				shaper.process(traces.trace(g+n), &shaped[n*len], len);
+			}
+		}
+		for(n=0; n<ng; n++) {
+			const float *y = &shaped[n*len];
+			float minimum = y[0];
+			double level = 0;
+			uint32_t i_min;
+
+			float m[8] = { y[0], y[0], y[0], y[0], y[0], y[0], y[0], y[0] };
+
+			// in lanes, so that the compiler can vectorize it (the order doesn't matter for the minimum)
+			for(i=0; i+8<=len; i+=8) {
+				for(size_t l=0; l<8; l++) {
+					m[l] = y[i+l] < m[l] ? y[i+l] : m[l];
+				}
+			}
+			for(; i<len; i++) {
+				minimum = y[i] < minimum ? y[i] : minimum;
+			}
+			for(i=0; i<8; i++) {
+				minimum = m[i] < minimum ? m[i] : minimum;
+			}
+			for(i_min=0; y[i_min] != minimum; i_min++);
+			for(i=0; i<nbase; i++) {
+				level += y[i];
+			}
+			out.amplitude[first+g+n] = (float)(level/nbase - minimum);
+			out.position[first+g+n]  = i_min;
+		}
+	}
+}
+
+// one value per line with three decimals, optionally multiplied by 'scale'
+inline void write_floats_text(const float *values, size_t n, FILE *f, float scale=1)
+{
+	char buffer[1<<16];
+	char *p = buffer;
+	size_t i;
+	long milli;
+
+	for(i=0; i<n; i++) {
+		if(p - buffer > (long)sizeof(buffer) - 40) {
+			fwrite(buffer, 1, p-buffer, f);
+			p = buffer;
+		}
+		milli = lround(values[i]*scale*1000);
+		if(milli < 0) {
+			*p++ = '-';
+			milli = -milli;
+		}
+		p = ngamma_append_int(p, milli/1000);
+		*p++ = '.';
+		*p++ = '0' + (milli/100)%10;
+		*p++ = '0' + (milli/10)%10;
+		*p++ = '0' + milli%10;
+		*p++ = '\n';
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+// float per value, optionally multiplied by 'scale'
+inline void write_floats_binary(const float *values, size_t n, FILE *f, float scale=1)
+{
+	float buffer[4096];
+	size_t i, k = 0;
+
+	for(i=0; i<n; i++) {
+		buffer[k++] = values[i]*scale;
+		if(k == sizeof(buffer)/sizeof(buffer[0])) {
+			fwrite(buffer, sizeof(float), k, f);
+			k = 0;
+		}
+	}
+	fwrite(buffer, sizeof(float), k, f);
+}
+
+// one line per trace: amplitude (three decimals) and the position of the minimum
+inline void write_shaped_text(const shaped_features &features, FILE *f, size_t first=0, size_t n=(size_t)-1, float scale=1)
+{
+	char buffer[1<<16];
+	char *p = buffer;
+	size_t i, last;
+	long milli;
+
+	last = (n == (size_t)-1 || first+n > features.size()) ? features.size() : first+n;
+	for(i=first; i<last; i++) {
+		if(p - buffer > (long)sizeof(buffer) - 60) {
+			fwrite(buffer, 1, p-buffer, f);
+			p = buffer;
+		}
+		milli = lround(features.amplitude[i]*scale*1000);
+		if(milli < 0) {
+			*p++ = '-';
+			milli = -milli;
+		}
+		p = ngamma_append_int(p, milli/1000);
+		*p++ = '.';
+		*p++ = '0' + (milli/100)%10;
+		*p++ = '0' + (milli/10)%10;
+		*p++ = '0' + milli%10;
+		*p++ = '\t';
+		p = ngamma_append_int(p, features.position[i]);
+		*p++ = '\n';
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+// amplitude (float) and position (uint32) per trace
+inline void write_shaped_binary(const shaped_features &features, FILE *f, size_t first=0, size_t n=(size_t)-1, float scale=1)
+{
+	char buffer[8*1024];
+	size_t i, k = 0, last;
+	float a;
+
+	last = (n == (size_t)-1 || first+n > features.size()) ? features.size() : first+n;
+	for(i=first; i<last; i++) {
+		a = features.amplitude[i]*scale;
+		memcpy(buffer+k,   &a,                      sizeof(float));
+		memcpy(buffer+k+4, &features.position[i], sizeof(uint32_t));
+		k += 8;
+		if(k == sizeof(buffer)) {
+			fwrite(buffer, 1, k, f);
+			k = 0;
+		}
+	}
+	fwrite(buffer, 1, k, f);
+}
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	Histograms with fixed binning, so that the memory doesn't grow with the number of events.
+
+	They are not thread-safe on purpose: every thread fills its own copy
+	and the copies are added together with merge() from time to time.
+	Bin 0 holds the underflow and bin nbins+1 the overflow.
+ */
+struct histogram_axis {
+	double       min, max;
+	unsigned int nbins;
+
+	histogram_axis() : min(0), max(1), nbins(1) {};
+	histogram_axis(unsigned int n, double lo, double hi) : min(lo), max(hi), nbins(n) {};
+
+	// index of the bin including under- and overflow
+	unsigned int bin(double x) const
+	{
+		if(x < min) {
+			return 0;
+		}
+		if(x >= max) {
+			return nbins+1;
+		}
+		// rounding must not move a value just below max into the overflow
+		unsigned int i = (unsigned int)((x-min)*nbins/(max-min));
+		return 1 + (i < nbins ? i : nbins-1);
+	}
+	double low_edge(unsigned int i) const { return min + (i-1)*(max-min)/nbins; };
+	bool operator==(const histogram_axis &a) const { return min == a.min && max == a.max && nbins == a.nbins; };
+};
+
+class histogram1d {
+public:
+	histogram1d() {};
+	histogram1d(const histogram_axis &a) : axis(a), counts(a.nbins+2, 0) {};
+
+	void fill(double x) { counts[axis.bin(x)]++; };
+	void reset() { counts.assign(counts.size(), 0); };
+	void merge(const histogram1d &h)
+	{
+		size_t i;
+
+		if(!(axis == h.axis)) {
+			throw "Histograms with different binning cannot be merged.";
+		}
+		for(i=0; i<counts.size(); i++) {
+			counts[i] += h.counts[i];
+		}
+	}
+	uint64_t entries() const
+	{
+		uint64_t n = 0;
+		size_t i;
+
+		for(i=0; i<counts.size(); i++) {
+			n += counts[i];
+		}
+		return n;
+	}
+
+	const histogram_axis&        get_axis()   const { return axis; };
+	const std::vector<uint64_t>& get_counts() const { return counts; };
+
+	// "# name" header, then the lower edge of the bin and the count on each line
+	void write_text(FILE *f, const char *name) const
+	{
+		unsigned int i;
+
+		fprintf(f, "# %s: %u bins from %g to %g, underflow %llu, overflow %llu\n", name, axis.nbins, axis.min, axis.max,
+			(unsigned long long)counts[0], (unsigned long long)counts[axis.nbins+1]);
+		for(i=1; i<=axis.nbins; i++) {
+			fprintf(f, "%g\t%llu\n", axis.low_edge(i), (unsigned long long)counts[i]);
+		}
+		fprintf(f, "\n\n");
+	}
+	// nbins (uint32), min, max (double), nbins+2 counts (uint64) including under- and overflow
+	void write_binary(FILE *f) const
+	{
+		uint32_t n = axis.nbins;
+
+		fwrite(&n, sizeof(n), 1, f);
+		fwrite(&axis.min, sizeof(double), 1, f);
+		fwrite(&axis.max, sizeof(double), 1, f);
+		fwrite(&counts[0], sizeof(uint64_t), counts.size(), f);
+	}
+
+private:
+	histogram_axis        axis;
+	std::vector<uint64_t> counts;
+};
+
+class histogram2d {
+public:
+	histogram2d() {};
+	histogram2d(const histogram_axis &ax, const histogram_axis &ay) : x(ax), y(ay), counts((ax.nbins+2)*(ay.nbins+2), 0) {};
+
+	void fill(double vx, double vy) { counts[y.bin(vy)*(x.nbins+2) + x.bin(vx)]++; };
+	void reset() { counts.assign(counts.size(), 0); };
+	void merge(const histogram2d &h)
+	{
+		size_t i;
+
+		if(!(x == h.x) || !(y == h.y)) {
+			throw "Histograms with different binning cannot be merged.";
+		}
+		for(i=0; i<counts.size(); i++) {
+			counts[i] += h.counts[i];
+		}
+	}
+
+	const histogram_axis&        get_axis_x() const { return x; };
+	const std::vector<uint64_t>& get_counts() const { return counts; };
+
+	// "# name" header, then a matrix with a row for every bin of y (without under- and overflow),
+	// which gnuplot can read with "matrix"
+	void write_text(FILE *f, const char *name) const
+	{
+		unsigned int i, j;
+
+		fprintf(f, "# %s: x %u bins from %g to %g, y %u bins from %g to %g\n", name,
+			x.nbins, x.min, x.max, y.nbins, y.min, y.max);
+		for(j=1; j<=y.nbins; j++) {
+			for(i=1; i<=x.nbins; i++) {
+				fprintf(f, i>1 ? "\t%llu" : "%llu", (unsigned long long)counts[j*(x.nbins+2)+i]);
+			}
+			fprintf(f, "\n");
+		}
+		fprintf(f, "\n\n");
+	}
+	// both axes as for histogram1d, then (nx+2)*(ny+2) counts with x changing fastest
+	void write_binary(FILE *f) const
+	{
+		uint32_t n;
+
+		n = x.nbins;
+		fwrite(&n, sizeof(n), 1, f);
+		fwrite(&x.min, sizeof(double), 1, f);
+		fwrite(&x.max, sizeof(double), 1, f);
+		n = y.nbins;
+		fwrite(&n, sizeof(n), 1, f);
+		fwrite(&y.min, sizeof(double), 1, f);
+		fwrite(&y.max, sizeof(double), 1, f);
+		fwrite(&counts[0], sizeof(uint64_t), counts.size(), f);
+	}
+
+private:
+	histogram_axis        x, y;
+	std::vector<uint64_t> counts;
+};
+
+/*
+	The histograms of the n-gamma features:
+	integral2 against integral1 (the neutron/gamma plot), integral1 and the height of the peak.
+	Traces with a problem are only counted.
+ */
+struct psd_histograms {
+	histogram2d integrals;
+	histogram1d integral1;
+	histogram1d peak;
+	uint64_t    problems;
+
+	psd_histograms() : problems(0) {};
+	psd_histograms(unsigned int bins, double integral1_max, double integral2_max, double peak_max) :
+		integrals(histogram_axis(bins, 0, integral1_max), histogram_axis(bins, 0, integral2_max)),
+		integral1(histogram_axis(bins, 0, integral1_max)),
+		peak(histogram_axis(bins < peak_max ? bins : (unsigned int)peak_max, 0, peak_max)),
+		problems(0) {};
+
+	void fill(const ngamma_features &f, size_t first, size_t n)
+	{
+		size_t i;
+
+		for(i=first; i<first+n; i++) {
+			if(f.problem[i]) {
+				problems++;
+				continue;
+			}
+			integrals.fill(f.integral1[i], f.integral2[i]);
+			integral1.fill(f.integral1[i]);
+			peak.fill(f.peak[i]);
+		}
+	}
+	void merge(const psd_histograms &h)
+	{
+		integrals.merge(h.integrals);
+		integral1.merge(h.integral1);
+		peak.merge(h.peak);
+		problems += h.problems;
+	}
+	void reset()
+	{
+		integrals.reset();
+		integral1.reset();
+		peak.reset();
+		problems = 0;
+	}
+
+	void write_text(FILE *f) const
+	{
+		fprintf(f, "# events: %llu, with problems: %llu\n", (unsigned long long)integral1.entries(), (unsigned long long)problems);
+		integral1.write_text(f, "integral1");
+		peak.write_text(f, "peak");
+		integrals.write_text(f, "integral2 (rows) vs. integral1 (columns)");
+	}
+	// "PSDH", version (uint32), number of problems (uint64), then integral1, peak and the 2D histogram
+	void write_binary(FILE *f) const
+	{
+		uint32_t version = 1;
+		uint64_t n = problems;
+
+		fwrite("PSDH", 1, 4, f);
+		fwrite(&version, sizeof(version), 1, f);
+		fwrite(&n, sizeof(n), 1, f);
+		integral1.write_binary(f);
+		peak.write_binary(f);
+		integrals.write_binary(f);
+	}
+	// writes a snapshot to a temporary file first, so that a reader never sees half of it
+	bool save(const char *filename, bool binary) const
+	{
+		std::string tmp = std::string(filename) + ".tmp";
+		FILE *f = fopen(tmp.c_str(), binary ? "wb" : "wt");
+
+		if(f == NULL) {
+			return false;
+		}
+		if(binary) {
+			write_binary(f);
+		} else {
+			write_text(f);
+		}
+		fclose(f);
+		// rename replaces the old snapshot atomically on POSIX; on Windows it fails when the file exists
+#ifdef _WIN32
+		remove(filename);
+#endif
+		return rename(tmp.c_str(), filename) == 0;
+	}
+};
+
+#endif
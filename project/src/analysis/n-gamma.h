@@ -1,23 +1,29 @@
+#ifndef __N_GAMMA_H__
+#define __N_GAMMA_H__
+
 #include <cmath>
 #include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <stdint.h>
+
+#include "sample-traits.h"
 
 using namespace std;
 
 // possible values for n-gamma discrimination with dt=200ps:
 //   length: 650, dt1: 175, length: 250
-// we assume that the signals are negative
-template<typename T> void calculate_and_write_integrals_i(const std::vector<T>inData, unsigned int integral2_dt1, unsigned int integral2_length, FILE *f)
+// we assume that the signals are negative;
+// the integrals are summed in sample_traits<T>::total, so they can't overflow for any type of samples,
+// and samples equal to 'clip' (out of range) mark the trace as a problem
+template<typename T> void calculate_and_write_integrals_i(const std::vector<T> &inData, unsigned int integral2_dt1, unsigned int integral2_length, FILE *f,
+	T clip=sample_traits<T>::clip())
 {
 	unsigned int i_peak = 0;
 	unsigned int i_trigger_half_peak;
 	unsigned int i_start_integrate2;
 	bool problem = false;
-
-	// TODO: it could happen that inData was double, so integrals would have to be double as well
-	// and it would be nice to have a function that would work with both,
-	// but as long as inData can be 8bit characters, we cannot afford to use "T" type for the integral
-	// NB: we cannot be sure that int is ok for this!!!
-	int integral1 = 0, integral2 = 0;
+	typename sample_traits<T>::total integral1 = 0, integral2 = 0;
 
 	// calculate the minimum (negative maximum first)
 	for(unsigned int i=0; i<static_cast<unsigned int>(inData.size()); i++) {
@@ -26,8 +32,7 @@ template<typename T> void calculate_and_write_integrals_i(const std::vector<T>in
 			i_peak = i;
 		}
 		// overflow
-		// TODO: fix this
-		if(inData[i] == -127)
+		if(inData[i] == clip)
 			problem = true;
 	}
 	if(i_peak == 0)
@@ -56,5 +61,203 @@ template<typename T> void calculate_and_write_integrals_i(const std::vector<T>in
 	// * maximum - should correlate with the first integral
 	// * i_start_integrate2 - should not be an outlier
 	// * "-1" if there was a problem
-	fprintf(f, "%d\t%d\t%d\t%d\t%d\t%d\n", integral1, integral2, -inData[i_peak], i_peak, i_start_integrate2, problem ? 1 : 0);
+	if(sample_traits<T>::is_integer) {
+		fprintf(f, "%lld\t%lld\t%lld\t%d\t%d\t%d\n", (long long)integral1, (long long)integral2, -(long long)inData[i_peak], i_peak, i_start_integrate2, problem ? 1 : 0);
+	} else {
+		fprintf(f, "%.15g\t%.15g\t%.15g\t%d\t%d\t%d\n", (double)integral1, (double)integral2, 0.0-inData[i_peak], i_peak, i_start_integrate2, problem ? 1 : 0);
+	}
+}
+
+/*
+	Batch version of the above for a whole rapid-block buffer at once.
+
+	The traces are not copied: trace_span only points to memory that somebody else owns
+	(for example the buffer of a channel filled by GetNextDataBulk) laid out as [ntraces][length].
+	The results go to a struct of arrays that is allocated once and reused,
+	so that writing them (text or binary) is a separate step.
+ */
+template<typename T> struct trace_span {
+	const T *data;
+	size_t   ntraces;
+	size_t   length;
+
+	trace_span() : data(NULL), ntraces(0), length(0) {};
+	trace_span(const T *d, size_t n, size_t len) : data(d), ntraces(n), length(len) {};
+
+	const T* trace(size_t i) const { return data + i*length; };
+	// traces [first, first+n)
+	trace_span<T> sub(size_t first, size_t n) const { return trace_span<T>(trace(first), n, length); };
+};
+
+struct ngamma_features {
+	std::vector<int32_t>  integral1;
+	std::vector<int32_t>  integral2;
+	std::vector<int32_t>  peak;
+	std::vector<uint32_t> i_peak;
+	std::vector<uint32_t> i_start_integrate2;
+	std::vector<uint8_t>  problem;
+
+	void resize(size_t n)
+	{
+		integral1.resize(n);
+		integral2.resize(n);
+		peak.resize(n);
+		i_peak.resize(n);
+		i_start_integrate2.resize(n);
+		problem.resize(n);
+	}
+	size_t size() const { return integral1.size(); };
+};
+
+// Same quantities as calculate_and_write_integrals_i for every trace of the span,
+// written to out[first ... first+traces.ntraces).
+// 'clip' is the value of a sample that went out of range (see the formats in sample-traits.h);
+// the sums are divided by 2^shift (8 for the 16-bit samples of 6000 series, to get the results of the 8-bit files)
+// and a trace whose sums don't fit into the features is marked as a problem.
+// The loops over samples only contain sums, minimum and comparisons, so that the compiler can vectorize them.
+template<typename T> void calculate_integrals_batch(const trace_span<T> &traces, unsigned int integral2_dt1, unsigned int integral2_length, T clip, ngamma_features &out,
+	size_t first=0, int shift=0)
+{
+	typedef typename sample_traits<T>::accumulator accumulator;
+	typedef typename sample_traits<T>::total total;
+	const size_t len = traces.length;
+	size_t n, i;
+
+	if(out.size() < first + traces.ntraces) {
+		out.resize(first + traces.ntraces);
+	}
+	// traces without samples have no minimum
+	if(len == 0) {
+		for(n=0; n<traces.ntraces; n++) {
+			out.integral1[first+n]          = 0;
+			out.integral2[first+n]          = 0;
+			out.peak[first+n]               = 0;
+			out.i_peak[first+n]             = 0;
+			out.i_start_integrate2[first+n] = 0;
+			out.problem[first+n]            = 1;
+		}
+		return;
+	}
+	for(n=0; n<traces.ntraces; n++) {
+		const T *x = traces.trace(n);
+		total sum, sum2 = 0;
+		int32_t clipped = 0;
+		T minimum = x[0];
+		uint32_t i_peak, i_half, i_start;
+		bool problem = false;
+
+		// sum, minimum and the number of clipped samples in a single pass
+		// when the trace is short enough for the accumulator (always for 8 bits)
+		if(sample_traits<T>::is_integer && len <= sample_traits<T>::block) {
+			accumulator s = 0;
+			for(i=0; i<len; i++) {
+				s       += x[i];
+				minimum  = x[i] < minimum ? x[i] : minimum;
+				clipped += (x[i] == clip);
+			}
+			sum = s;
+		} else {
+			sum = sum_samples(x, len);
+			for(i=0; i<len; i++) {
+				minimum  = x[i] < minimum ? x[i] : minimum;
+				clipped += (x[i] == clip);
+			}
+		}
+		// the first sample with the minimum value (same as the strict '<' above)
+		for(i_peak=0; x[i_peak] != minimum; i_peak++);
+		if(i_peak == 0 || clipped > 0 || len < 2) {
+			problem = true;
+		}
+		// the last point before the peak that exceeds half the size of the peak
+		for(i_half=0; i_half < i_peak && 2*(accumulator)x[i_half+1] >= (accumulator)minimum; i_half++);
+		if(i_half < 4 || i_half+1 >= i_peak) {
+			problem = true;
+		}
+
+		i_start = i_half + integral2_dt1;
+		if(i_start + integral2_length > len) {
+			problem = true;
+		} else {
+			sum2 = sum_samples(x + i_start, integral2_length);
+		}
+
+		out.integral1[first+n]          = narrow_sum(-sum, shift, problem);
+		out.integral2[first+n]          = narrow_sum(-sum2, shift, problem);
+		out.peak[first+n]               = narrow_sum(-(total)minimum, shift, problem);
+		out.i_peak[first+n]             = i_peak;
+		out.i_start_integrate2[first+n] = i_start;
+		out.problem[first+n]            = problem ? 1 : 0;
+	}
 }
+
+// writes a decimal number to the buffer and returns the position after it
+// (64 bits everywhere: long has only 32 bits on Windows, which isn't enough for timestamps in ps)
+inline char* ngamma_append_int(char *p, int64_t value)
+{
+	char digits[24];
+	int n = 0;
+	uint64_t u;
+
+	if(value < 0) {
+		*p++ = '-';
+		u = -(uint64_t)value;
+	} else {
+		u = value;
+	}
+	do {
+		digits[n++] = '0' + u%10;
+		u /= 10;
+	} while(u > 0);
+	while(n > 0) {
+		*p++ = digits[--n];
+	}
+	return p;
+}
+
+// the same columns as calculate_and_write_integrals_i, but formatted without fprintf
+inline void write_integrals_text(const ngamma_features &features, FILE *f, size_t first=0, size_t n=(size_t)-1)
+{
+	char buffer[1<<16];
+	char *p = buffer;
+	size_t i, last;
+
+	last = (n == (size_t)-1 || first+n > features.size()) ? features.size() : first+n;
+	for(i=first; i<last; i++) {
+		// a line has at most 6 numbers of 11 characters
+		if(p - buffer > (long)sizeof(buffer) - 100) {
+			fwrite(buffer, 1, p-buffer, f);
+			p = buffer;
+		}
+		p = ngamma_append_int(p, features.integral1[i]);          *p++ = '\t';
+		p = ngamma_append_int(p, features.integral2[i]);          *p++ = '\t';
+		p = ngamma_append_int(p, features.peak[i]);               *p++ = '\t';
+		p = ngamma_append_int(p, features.i_peak[i]);             *p++ = '\t';
+		p = ngamma_append_int(p, features.i_start_integrate2[i]); *p++ = '\t';
+		p = ngamma_append_int(p, features.problem[i]);            *p++ = '\n';
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+// one record of six int32 values (in the byte order of the machine) per trace, in the same order as the text
+inline void write_integrals_binary(const ngamma_features &features, FILE *f, size_t first=0, size_t n=(size_t)-1)
+{
+	int32_t buffer[6*1024];
+	size_t i, k = 0, last;
+
+	last = (n == (size_t)-1 || first+n > features.size()) ? features.size() : first+n;
+	for(i=first; i<last; i++) {
+		buffer[k++] = features.integral1[i];
+		buffer[k++] = features.integral2[i];
+		buffer[k++] = features.peak[i];
+		buffer[k++] = features.i_peak[i];
+		buffer[k++] = features.i_start_integrate2[i];
+		buffer[k++] = features.problem[i];
+		if(k == sizeof(buffer)/sizeof(buffer[0])) {
+			fwrite(buffer, sizeof(int32_t), k, f);
+			k = 0;
+		}
+	}
+	fwrite(buffer, sizeof(int32_t), k, f);
+}
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef __PEAKS_H__
+#define __PEAKS_H__
+
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	Finds every (negative) pulse in a trace, so that pile-up can be recognised.
+
+	A pulse starts where the difference x[i] - x[i-gap] drops below -threshold (the leading edge);
+	its peak is the minimum until the signal turns up again: within 'holdoff' samples of the leading edge
+	only a rise by more than the threshold above the minimum ends the pulse (smaller ones are the noise on the edge),
+	after that any sample above the minimum does. So a second pulse within the holdoff is still found
+	when the signal recovers by more than the threshold between the two; otherwise they are one pulse.
+	The search then continues after the peak (at least 'gap' samples, so that the difference doesn't reach
+	back to the leading edge), so the falling tail of a pulse doesn't trigger again,
+	while a second pulse sitting on the tail of the first one does.
+	The height of a pulse is measured from the level just before its leading edge.
+
+	With threshold 0 the threshold is nsigma times the RMS of the difference
+	in the first baseline_length samples of each trace (the noise before the trigger).
+ */
+struct peak_options {
+	unsigned int gap;             // distance of the samples for the difference
+	double       threshold;       // in the units of samples (0: from the noise)
+	double       nsigma;
+	unsigned int holdoff;         // samples after the leading edge in which only a rise by more than the threshold ends a pulse
+	unsigned int baseline_length; // samples for the noise
+
+	peak_options() : gap(4), threshold(0), nsigma(5), holdoff(8), baseline_length(32) {};
+};
+
+/*
+	At most max_peaks pulses per trace are kept (npeaks counts all of them),
+	so the memory of a block of traces doesn't depend on their contents.
+ */
+struct peak_features {
+	size_t                max_peaks;
+	std::vector<uint16_t> npeaks;
+	std::vector<int32_t>  spacing;  // shortest distance between two neighbouring peaks (-1 for a single pulse)
+	std::vector<uint32_t> position; // [trace*max_peaks + k]
+	std::vector<int32_t>  height;
+
+	peak_features() : max_peaks(8) {};
+
+	void resize(size_t n)
+	{
+		npeaks.resize(n);
+		spacing.resize(n);
+		position.resize(n*max_peaks);
+		height.resize(n*max_peaks);
+	}
+	size_t size() const { return npeaks.size(); };
+	bool is_piled_up(size_t i) const { return npeaks[i] > 1; };
+};
+
+// pulses of all traces of the span, written to out[first ... first+traces.ntraces)
+template<typename T> void find_peaks_batch(const trace_span<T> &traces, const peak_options &opt, peak_features &out, size_t first=0)
+{
+	const size_t len   = traces.length;
+	const size_t gap   = opt.gap > 0 ? opt.gap : 1;
+	const size_t nbase = opt.baseline_length < len ? opt.baseline_length : len;
+	const size_t block = 16;
+	size_t n, i, j, m, k, b;
+
+	if(out.size() < first + traces.ntraces) {
+		out.resize(first + traces.ntraces);
+	}
+	for(n=0; n<traces.ntraces; n++) {
+		const T *x = traces.trace(n);
+		uint32_t *position = &out.position[(first+n)*out.max_peaks];
+		int32_t  *height   = &out.height[(first+n)*out.max_peaks];
+		int32_t threshold, d, spacing = -1;
+		uint32_t last = 0;
+		int64_t sum2 = 0;
+
+		threshold = (int32_t)opt.threshold;
+		if(opt.threshold <= 0) {
+			for(i=gap; i<nbase; i++) {
+				d     = (int32_t)x[i] - (int32_t)x[i-gap];
+				sum2 += (int64_t)d*d;
+			}
+			threshold = nbase > gap ? (int32_t)ceil(opt.nsigma*sqrt((double)sum2/(nbase-gap))) : 1;
+			threshold = threshold > 0 ? threshold : 1;
+		}
+
+		k = 0;
+		i = gap;
+		while(i < len) {
+			// most samples are not on a leading edge: blocks of them are skipped with a loop
+			// that has no branches (which lets the compiler vectorize it)
+			while(i+block <= len) {
+				int32_t hit = 0;
+				for(b=0; b<block; b++) {
+					hit |= ((int32_t)x[i+b] - (int32_t)x[i+b-gap] < -threshold);
+				}
+				if(hit) {
+					break;
+				}
+				i += block;
+			}
+			if(i >= len) {
+				break;
+			}
+			if((int32_t)x[i] - (int32_t)x[i-gap] >= -threshold) {
+				i++;
+				continue;
+			}
+			// the leading edge of a pulse: follow it down to the peak
+			for(j=m=i; j<len && (int32_t)x[j] - (int32_t)x[m] <= threshold && (j < i+opt.holdoff || x[j] <= x[m]); j++) {
+				m = x[j] < x[m] ? j : m;
+			}
+			if(k < out.max_peaks) {
+				position[k] = m;
+				height[k]   = (int32_t)x[i-gap] - (int32_t)x[m];
+			}
+			if(k > 0 && (spacing < 0 || (int32_t)(m-last) < spacing)) {
+				spacing = m-last;
+			}
+			last = m;
+			k++;
+			i = j > m+gap ? j : m+gap;
+		}
+		for(j=k; j<out.max_peaks; j++) {
+			position[j] = 0;
+			height[j]   = 0;
+		}
+		out.npeaks[first+n]  = k < 0xffff ? k : 0xffff;
+		out.spacing[first+n] = spacing;
+	}
+}
+
+// marks the n-gamma features of piled-up traces (problem |= 2), so that they are left out of the histograms
+inline unsigned long flag_pileup(const peak_features &peaks, ngamma_features &features, size_t first, size_t n)
+{
+	unsigned long count = 0;
+	size_t i;
+
+	for(i=first; i<first+n; i++) {
+		if(peaks.is_piled_up(i)) {
+			features.problem[i] |= 2;
+			count++;
+		}
+	}
+	return count;
+}
+
+// one line per trace: npeaks, spacing, then the position and height of each pulse (at most max_peaks)
+inline void write_peaks_text(const peak_features &peaks, FILE *f, size_t first=0, size_t n=(size_t)-1)
+{
+	char buffer[1<<16];
+	char *p = buffer;
+	size_t i, k, last, np;
+
+	last = (n == (size_t)-1 || first+n > peaks.size()) ? peaks.size() : first+n;
+	for(i=first; i<last; i++) {
+		if(p - buffer > (long)sizeof(buffer) - 30*(long)(peaks.max_peaks+1)) {
+			fwrite(buffer, 1, p-buffer, f);
+			p = buffer;
+		}
+		p = ngamma_append_int(p, peaks.npeaks[i]);
+		*p++ = '\t';
+		p = ngamma_append_int(p, peaks.spacing[i]);
+		np = peaks.npeaks[i] < peaks.max_peaks ? peaks.npeaks[i] : peaks.max_peaks;
+		for(k=0; k<np; k++) {
+			*p++ = '\t';
+			p = ngamma_append_int(p, peaks.position[i*peaks.max_peaks+k]);
+			*p++ = '\t';
+			p = ngamma_append_int(p, peaks.height[i*peaks.max_peaks+k]);
+		}
+		*p++ = '\n';
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+// npeaks, spacing and max_peaks pairs of position and height (zero when unused) as int32 per trace
+inline void write_peaks_binary(const peak_features &peaks, FILE *f, size_t first=0, size_t n=(size_t)-1)
+{
+	std::vector<int32_t> buffer(2 + 2*peaks.max_peaks);
+	size_t i, k, last;
+
+	last = (n == (size_t)-1 || first+n > peaks.size()) ? peaks.size() : first+n;
+	for(i=first; i<last; i++) {
+		buffer[0] = peaks.npeaks[i];
+		buffer[1] = peaks.spacing[i];
+		for(k=0; k<peaks.max_peaks; k++) {
+			buffer[2+2*k] = peaks.position[i*peaks.max_peaks+k];
+			buffer[3+2*k] = peaks.height[i*peaks.max_peaks+k];
+		}
+		fwrite(&buffer[0], sizeof(int32_t), buffer.size(), f);
+	}
+}
+
+#endif
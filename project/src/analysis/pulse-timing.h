@@ -0,0 +1,203 @@
+#ifndef __PULSE_TIMING_H__
+#define __PULSE_TIMING_H__
+
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	Sub-sample timing of (negative) pulses.
+
+	The crossing time is the moment when the leading edge of the pulse crosses a threshold:
+	* constant fraction (CFD): the threshold is a fraction of the amplitude (baseline - minimum),
+	  so the time doesn't depend on the height of the pulse
+	* leading edge: the threshold is a fixed distance below the baseline
+	The baseline is the average of the first samples of each trace.
+	The crossing is searched backwards from the peak (the last sample above the threshold before the peak),
+	so that noise before the pulse doesn't matter, and interpolated between the two samples around it
+	either linearly or with a cubic through four samples.
+
+	Times are in units of samples from the start of the trace;
+	add_trigger_times turns them into absolute timestamps in picoseconds.
+ */
+struct timing_options {
+	bool         is_cfd;          // constant fraction (true) or leading edge (false)
+	double       fraction;        // CFD: fraction of the amplitude, for example 0.3
+	double       level;           // leading edge: distance of the threshold below the baseline (in the units of samples)
+	bool         is_cubic;        // cubic instead of linear interpolation
+	unsigned int baseline_length; // number of samples at the start of the trace for the baseline
+
+	timing_options() : is_cfd(true), fraction(0.3), level(0), is_cubic(false), baseline_length(16) {};
+};
+
+struct pulse_times {
+	std::vector<double>  crossing;     // in samples from the start of the trace
+	std::vector<int64_t> timestamp_ps; // only set by add_trigger_times
+	std::vector<uint8_t> problem;
+
+	void resize(size_t n)
+	{
+		crossing.resize(n);
+		timestamp_ps.resize(n);
+		problem.resize(n);
+	}
+	size_t size() const { return crossing.size(); };
+};
+
+// the solution of p(u) = y for u in [0,1] of the cubic through (-1,p0), (0,p1), (1,p2), (2,p3),
+// starting from the linear solution u (p1 > y >= p2)
+inline double pulse_timing_cubic(double p0, double p1, double p2, double p3, double y, double u)
+{
+	const double a = p1;
+	const double b = -p0/3 - p1/2 + p2 - p3/6;
+	const double c = p0/2 - p1 + p2/2;
+	const double d = -p0/6 + p1/2 - p2/2 + p3/6;
+	double f, df;
+	int k;
+
+	// Newton; three steps are more than enough when starting from the linear solution
+	for(k=0; k<3; k++) {
+		f  = a + u*(b + u*(c + u*d)) - y;
+		df = b + u*(2*c + u*3*d);
+		if(df == 0) {
+			break;
+		}
+		u -= f/df;
+	}
+	return u < 0 ? 0 : (u > 1 ? 1 : u);
+}
+
+// crossing times of all traces of the span, written to out[first ... first+traces.ntraces)
+template<typename T> void calculate_crossing_times_batch(const trace_span<T> &traces, const timing_options &opt, pulse_times &out, size_t first=0)
+{
+	const size_t len = traces.length;
+	const size_t nbase = opt.baseline_length < len ? (opt.baseline_length > 0 ? opt.baseline_length : 1) : len;
+	size_t n, i;
+
+	if(out.size() < first + traces.ntraces) {
+		out.resize(first + traces.ntraces);
+	}
+	// traces without samples have no minimum
+	if(len == 0) {
+		for(n=0; n<traces.ntraces; n++) {
+			out.crossing[first+n]     = -1;
+			out.timestamp_ps[first+n] = 0;
+			out.problem[first+n]      = 1;
+		}
+		return;
+	}
+	for(n=0; n<traces.ntraces; n++) {
+		const T *x = traces.trace(n);
+		T minimum = x[0], t_threshold;
+		uint32_t i_peak;
+		int32_t last = -1;
+		double baseline, threshold, u;
+		bool problem = false;
+
+		for(i=0; i<len; i++) {
+			minimum = x[i] < minimum ? x[i] : minimum;
+		}
+		for(i_peak=0; x[i_peak] != minimum; i_peak++);
+		baseline  = (double)sum_samples(x, nbase)/nbase;
+		threshold = opt.is_cfd ? baseline + opt.fraction*(minimum - baseline) : baseline - opt.level;
+
+		// for integer samples x > threshold is the same as x > floor(threshold),
+		// so the search can be done without conversions and without branches (which lets the compiler vectorize it)
+		if(threshold <= (double)minimum || threshold >= baseline) {
+			problem = true;
+		} else {
+			t_threshold = sample_traits<T>::is_integer ? (T)floor(threshold) : (T)threshold;
+			for(i=0; i<i_peak; i++) {
+				last = (x[i] > t_threshold) ? (int32_t)i : last;
+			}
+			if(last < 0) {
+				problem = true;
+			}
+		}
+
+		if(problem) {
+			out.crossing[first+n] = -1;
+		} else {
+			// x[last] > threshold >= x[last+1]
+			u = (x[last] - threshold)/(double)(x[last] - x[last+1]);
+			if(opt.is_cubic && last >= 1 && (size_t)last+2 < len) {
+				u = pulse_timing_cubic(x[last-1], x[last], x[last+1], x[last+2], threshold, u);
+			}
+			out.crossing[first+n] = last + u;
+		}
+		out.timestamp_ps[first+n] = 0;
+		out.problem[first+n]      = problem ? 1 : 0;
+	}
+}
+
+// timestamp = time of the trigger of the segment + time between the trigger sample and the crossing
+// (trigger_ps[k] belongs to the trace first+k, dt_ps is the time between two samples)
+inline void add_trigger_times(pulse_times &times, const int64_t *trigger_ps, double dt_ps, double trigger_sample, size_t first, size_t n)
+{
+	size_t i;
+
+	for(i=first; i<first+n; i++) {
+		times.timestamp_ps[i] = trigger_ps[i-first] + (int64_t)llround((times.crossing[i] - trigger_sample)*dt_ps);
+	}
+}
+
+// one line per trace: crossing (in samples, three decimals), timestamp (ps), problem
+inline void write_times_text(const pulse_times &times, FILE *f, size_t first=0, size_t n=(size_t)-1)
+{
+	char buffer[1<<16];
+	char *p = buffer;
+	size_t i, last;
+	long milli;
+
+	last = (n == (size_t)-1 || first+n > times.size()) ? times.size() : first+n;
+	for(i=first; i<last; i++) {
+		if(p - buffer > (long)sizeof(buffer) - 100) {
+			fwrite(buffer, 1, p-buffer, f);
+			p = buffer;
+		}
+		if(times.problem[i]) {
+			*p++ = '-'; *p++ = '1';
+		} else {
+			milli = lround(times.crossing[i]*1000);
+			p = ngamma_append_int(p, milli/1000);
+			*p++ = '.';
+			*p++ = '0' + (milli/100)%10;
+			*p++ = '0' + (milli/10)%10;
+			*p++ = '0' + milli%10;
+		}
+		*p++ = '\t';
+		p = ngamma_append_int(p, times.timestamp_ps[i]);
+		*p++ = '\t';
+		*p++ = times.problem[i] ? '1' : '0';
+		*p++ = '\n';
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+// crossing (double, -1 for traces with a problem) and timestamp in ps (int64) per trace
+inline void write_times_binary(const pulse_times &times, FILE *f, size_t first=0, size_t n=(size_t)-1)
+{
+	char buffer[16*1024];
+	size_t i, k = 0, last;
+
+	last = (n == (size_t)-1 || first+n > times.size()) ? times.size() : first+n;
+	for(i=first; i<last; i++) {
+		memcpy(buffer+k,   &times.crossing[i],     sizeof(double));
+		memcpy(buffer+k+8, &times.timestamp_ps[i], sizeof(int64_t));
+		k += 16;
+		if(k == sizeof(buffer)) {
+			fwrite(buffer, 1, k, f);
+			k = 0;
+		}
+	}
+	fwrite(buffer, 1, k, f);
+}
+
+#endif
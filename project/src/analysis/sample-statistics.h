@@ -0,0 +1,175 @@
+#ifndef __SAMPLE_STATISTICS_H__
+#define __SAMPLE_STATISTICS_H__
+
+#include <cmath>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+#include <type_traits>
+
+#include "sample-traits.h"
+
+using namespace std;
+
+/*
+	Running statistics of the samples of a channel: minimum, maximum, mean, rms,
+	a histogram of the values and the number of samples at the ends of the range (clipped).
+
+	The samples are counted in the same pass that converts them to the 8 bits of the binary files
+	(6000 series), so that the data only goes through the memory once: a block of samples is
+	converted and summed in a loop that the compiler vectorizes, then its 8-bit values are
+	histogrammed while they are still in the cache.
+
+	The histogram has a bin for each value of the upper 8 bits of the samples of the driver
+	(all the values of the files of 6000 series, bins of 256 values for 4000 series).
+	The sums are exact, so the statistics of several threads can simply be merged.
+ */
+struct sample_statistics {
+	uint64_t count;
+	int32_t  min, max;
+	int64_t  sum;
+	double   sum2;
+	uint64_t clipped_low, clipped_high;
+	uint64_t histogram[256];  // [value+128] of the upper 8 bits
+
+	sample_statistics() { reset(); };
+
+	void reset()
+	{
+		count = 0;
+		min   = 32767;
+		max   = -32768;
+		sum   = 0;
+		sum2  = 0;
+		clipped_low = clipped_high = 0;
+		memset(histogram, 0, sizeof(histogram));
+	}
+	void merge(const sample_statistics &s)
+	{
+		int i;
+
+		count += s.count;
+		min    = s.min < min ? s.min : min;
+		max    = s.max > max ? s.max : max;
+		sum   += s.sum;
+		sum2  += s.sum2;
+		clipped_low  += s.clipped_low;
+		clipped_high += s.clipped_high;
+		for(i=0; i<256; i++) {
+			histogram[i] += s.histogram[i];
+		}
+	}
+	uint64_t clipped() const { return clipped_low + clipped_high; };
+	double mean() const { return count > 0 ? (double)sum/count : 0; };
+	double rms() const
+	{
+		double m = mean(), v;
+
+		if(count == 0) {
+			return 0;
+		}
+		v = sum2/count - m*m;
+		return v > 0 ? sqrt(v) : 0;
+	}
+};
+
+// samples of a block, so that the narrow sums can't overflow (2^12 samples of at most 2^15, squared 2^30)
+const size_t sample_statistics_block = 4096;
+
+/*
+	Adds n samples of a series with the given format (ps4000_samples, ps6000_samples) to the statistics;
+	when out8 isn't NULL, it gets the upper 8 bits of the samples (the binary files of 6000 series).
+ */
+template<class format> void count_samples(const int16_t *x, size_t n, sample_statistics &s, int8_t *out8=NULL)
+{
+	// the samples without the unused low bits: 8 bits for 6000 series, whose squares can be summed in 32 bits
+	typedef typename conditional<(format::shift >= 8), int8_t,  int16_t>::type narrow;
+	typedef typename conditional<(format::shift >= 8), int32_t, int64_t>::type square_sum;
+	const narrow top = (narrow)(format::max_value() >> format::shift);
+	int8_t buffer[sample_statistics_block];
+	uint32_t h[4][256];
+	size_t i, j, k, l;
+
+	memset(h, 0, sizeof(h));
+	for(j=0; j<n; j+=k) {
+		const int16_t *v = x + j;
+		int8_t *o = out8 != NULL ? out8 + j : buffer;
+		int32_t sum = 0;
+		square_sum sum2 = 0;
+		uint32_t low = 0, high = 0;
+		narrow lo = numeric_limits<narrow>::max(), hi = numeric_limits<narrow>::min();
+
+		k = n - j < sample_statistics_block ? n - j : sample_statistics_block;
+		for(i=0; i<k; i++) {
+			const narrow w = (narrow)(v[i] >> format::shift);
+			o[i]  = (int8_t)(v[i] >> 8);
+			sum  += w;
+			sum2 += (int32_t)w*w;
+			lo    = w < lo ? w : lo;
+			hi    = w > hi ? w : hi;
+			low  += w <= -top ? 1 : 0;
+			high += w >=  top ? 1 : 0;
+		}
+		// four copies of the histogram, so that equal values in a row don't wait for each other
+		for(i=0; i+4<=k; i+=4) {
+			for(l=0; l<4; l++) {
+				h[l][(uint8_t)(o[i+l] + 128)]++;
+			}
+		}
+		for(; i<k; i++) {
+			h[0][(uint8_t)(o[i] + 128)]++;
+		}
+		s.count += k;
+		s.sum   += (int64_t)sum << format::shift;
+		s.sum2  += ldexp((double)sum2, 2*format::shift);
+		s.min    = ((int32_t)lo << format::shift) < s.min ? (int32_t)lo << format::shift : s.min;
+		s.max    = ((int32_t)hi << format::shift) > s.max ? (int32_t)hi << format::shift : s.max;
+		s.clipped_low  += low;
+		s.clipped_high += high;
+		// before the 32-bit counts could overflow
+		if((j/sample_statistics_block) % (1 << 18) == (1 << 18) - 1) {
+			for(i=0; i<256; i++) {
+				s.histogram[i] += (uint64_t)h[0][i] + h[1][i] + h[2][i] + h[3][i];
+			}
+			memset(h, 0, sizeof(h));
+		}
+	}
+	for(i=0; i<256; i++) {
+		s.histogram[i] += (uint64_t)h[0][i] + h[1][i] + h[2][i] + h[3][i];
+	}
+}
+
+// "min -3, max 127, mean -0.123, rms 1.234, clipped 0 below and 12 above the range (0.001 % of 1000000 samples)",
+// in units of the files ('scale')
+inline void write_sample_statistics(const sample_statistics &s, FILE *f, double scale=1)
+{
+	fprintf(f, "min %g, max %g, mean %.3f, rms %.3f, clipped %llu below and %llu above the range (%.3g %% of %llu samples)",
+		s.count > 0 ? s.min*scale : 0.0, s.count > 0 ? s.max*scale : 0.0, s.mean()*scale, s.rms()*scale,
+		(unsigned long long)s.clipped_low, (unsigned long long)s.clipped_high,
+		s.count > 0 ? s.clipped()*100.0/s.count : 0.0, (unsigned long long)s.count);
+}
+
+// the counts of the histogram from the lowest to the highest value that occurred: "from -3: 10 200 5 1"
+inline void write_sample_histogram(const sample_statistics &s, FILE *f)
+{
+	int first = 0, last = 255, i;
+
+	while(first < 256 && s.histogram[first] == 0) {
+		first++;
+	}
+	while(last >= first && s.histogram[last] == 0) {
+		last--;
+	}
+	if(first > last) {
+		fprintf(f, "-");
+		return;
+	}
+	fprintf(f, "from %d:", first - 128);
+	for(i=first; i<=last; i++) {
+		fprintf(f, " %llu", (unsigned long long)s.histogram[i]);
+	}
+}
+
+#endif
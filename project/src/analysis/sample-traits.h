@@ -0,0 +1,143 @@
+#ifndef __SAMPLE_TRAITS_H__
+#define __SAMPLE_TRAITS_H__
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+	Properties of the type of samples, resolved at compile time, so that every analysis kernel
+	gets the right accumulators for int8 (binary files), int16 (the driver) and float/double (filtered traces).
+
+	* accumulator: sum of at most 'block' samples (per lane), narrow enough for the compiler to vectorize the sum,
+	               wide enough that it never overflows
+	* total:       sum of any number of samples
+	* clip():      the value of a sample that went out of range when nothing else is known;
+	               use the formats below when the series is known
+ */
+template<typename T> struct sample_traits;
+
+template<> struct sample_traits<int8_t> {
+	typedef int32_t accumulator;
+	typedef int64_t total;
+	static const bool   is_integer = true;
+	static const size_t block      = (size_t)1 << 24; // 2^31/2^7
+	static int8_t clip() { return -127; };
+};
+
+template<> struct sample_traits<int16_t> {
+	typedef int32_t accumulator;
+	typedef int64_t total;
+	static const bool   is_integer = true;
+	static const size_t block      = (size_t)1 << 16; // 2^31/2^15
+	static int16_t clip() { return -32512; };
+};
+
+template<> struct sample_traits<float> {
+	typedef double accumulator;
+	typedef double total;
+	static const bool   is_integer = false;
+	static const size_t block      = (size_t)-1;
+	// samples that are already floating point can't be clipped any more
+	static float clip() { return -numeric_limits<float>::infinity(); };
+};
+
+template<> struct sample_traits<double> {
+	typedef double accumulator;
+	typedef double total;
+	static const bool   is_integer = false;
+	static const size_t block      = (size_t)-1;
+	static double clip() { return -numeric_limits<double>::infinity(); };
+};
+
+/*
+	How the samples of each series are stored:
+	* max_value(): the sample at the top of the range (bottom: -max_value(), which is also the clipped value)
+	* shift:       the number of unused low bits (6000 series keeps 8 bits in the upper byte of a short)
+	A sample x is x/max_value()*range volts for the range of the channel.
+ */
+struct ps4000_samples {
+	typedef int16_t type;
+	enum { shift = 0 };
+	static int32_t max_value() { return 32764; };    // PS4000_MAX_VALUE
+	static type    clip()      { return -32764; };
+	static double  unit(double range) { return range/max_value(); };
+};
+
+struct ps6000_samples {
+	typedef int16_t type;
+	enum { shift = 8 };
+	static int32_t max_value() { return 32512; };    // PS6000_MAX_VALUE = 127*256
+	static type    clip()      { return -32512; };
+	static double  unit(double range) { return range/max_value(); };
+};
+
+// the 8-bit samples of 6000 series written to the binary files
+struct ps6000_file_samples {
+	typedef int8_t type;
+	enum { shift = 0 };
+	static int32_t max_value() { return 127; };
+	static type    clip()      { return -127; };
+	static double  unit(double range) { return range/max_value(); };
+};
+
+// sum of n samples, vectorized by the compiler for every type: integers are summed in blocks
+// that can't overflow the accumulator, floating point numbers in lanes of independent partial sums
+// (the compiler doesn't reorder a single floating point sum)
+template<typename T> typename sample_traits<T>::total sum_samples(const T *x, size_t n)
+{
+	typedef typename sample_traits<T>::accumulator accumulator;
+	const size_t lanes = sample_traits<T>::is_integer ? 1 : 8;
+	const size_t block = sample_traits<T>::block;
+	typename sample_traits<T>::total total = 0;
+	size_t i = 0, end, l;
+
+	while(n-i >= lanes) {
+		accumulator part[lanes] = {0};
+
+		// at most 'block' samples in each lane before they are added to the total
+		end = i + ((n-i)/lanes < block ? (n-i)/lanes : block)*lanes;
+		for(; i<end; i+=lanes) {
+			for(l=0; l<lanes; l++) {
+				part[l] += x[i+l];
+			}
+		}
+		for(l=0; l<lanes; l++) {
+			total += part[l];
+		}
+	}
+	for(; i<n; i++) {
+		total += x[i];
+	}
+	return total;
+}
+
+// total/2^shift as int32 (integers truncated like '/', floating point rounded);
+// 'overflow' is set when it doesn't fit
+inline int32_t narrow_sum(int64_t total, int shift, bool &overflow)
+{
+	// the same as total/2^shift, without a division
+	int64_t v = (total + ((total >> 63) & (((int64_t)1 << shift) - 1))) >> shift;
+
+	if(v > numeric_limits<int32_t>::max() || v < numeric_limits<int32_t>::min()) {
+		overflow = true;
+		return v > 0 ? numeric_limits<int32_t>::max() : numeric_limits<int32_t>::min();
+	}
+	return (int32_t)v;
+}
+
+inline int32_t narrow_sum(double total, int shift, bool &overflow)
+{
+	double v = nearbyint(ldexp(total, -shift));
+
+	if(!(v <= numeric_limits<int32_t>::max() && v >= numeric_limits<int32_t>::min())) {
+		overflow = true;
+		return v > 0 ? numeric_limits<int32_t>::max() : numeric_limits<int32_t>::min();
+	}
+	return (int32_t)v;
+}
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef __VETO_H__
+#define __VETO_H__
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstddef>
+#include <limits>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	Software veto of the traces of a rapid-block run: traces that fail any of the cuts are dropped
+	before they are written or analysed (noise and ringing that passed the single-level hardware trigger).
+
+	The features of a (negative) pulse, relative to the mean of the first 'baseline_length' samples:
+	* height: baseline - minimum
+	* area:   sum of (baseline - sample) over the whole trace
+	* tot:    time over threshold, the number of samples more than 'tot_level' below the baseline
+	* rise:   time between 10 % and 90 % of the height on the leading edge before the minimum (in samples, interpolated)
+
+	The features are calculated for 16 traces at once: tiles of samples are transposed
+	so that the inner loop runs over the traces and is vectorized by the compiler.
+	The rise time is only searched (trace by trace, around the peak) when its cut is enabled.
+ */
+enum veto_cut {
+	VETO_HEIGHT,
+	VETO_AREA,
+	VETO_TOT,
+	VETO_RISE,
+	VETO_NCUTS
+};
+
+inline const char* veto_cut_name(int cut)
+{
+	static const char *names[VETO_NCUTS] = {"height", "area", "tot", "rise"};
+	return cut >= 0 && cut < VETO_NCUTS ? names[cut] : "?";
+}
+
+struct veto_options {
+	bool         enabled[VETO_NCUTS];
+	double       min[VETO_NCUTS], max[VETO_NCUTS]; // a trace is accepted for min <= value <= max
+	double       tot_level;
+	unsigned int baseline_length;
+
+	veto_options() : tot_level(0), baseline_length(0)
+	{
+		int i;
+		for(i=0; i<VETO_NCUTS; i++) {
+			enabled[i] = false;
+			min[i]     = -numeric_limits<double>::infinity();
+			max[i]     =  numeric_limits<double>::infinity();
+		}
+	}
+	bool any() const
+	{
+		int i;
+		for(i=0; i<VETO_NCUTS; i++) {
+			if(enabled[i]) {
+				return true;
+			}
+		}
+		return false;
+	}
+	// the cuts in other units of samples (for example 256 for 6000 series, when the cuts are given in 8 bits)
+	veto_options scaled(double factor) const
+	{
+		veto_options o = *this;
+		o.min[VETO_HEIGHT] *= factor; o.max[VETO_HEIGHT] *= factor;
+		o.min[VETO_AREA]   *= factor; o.max[VETO_AREA]   *= factor;
+		o.tot_level        *= factor;
+		return o;
+	}
+};
+
+struct veto_features {
+	std::vector<float>    height, area, rise;
+	std::vector<uint32_t> tot;
+
+	void resize(size_t n)
+	{
+		height.resize(n);
+		area.resize(n);
+		rise.resize(n);
+		tot.resize(n);
+	}
+	size_t size() const { return height.size(); };
+	double get(int cut, size_t i) const
+	{
+		switch(cut) {
+			case VETO_HEIGHT: return height[i];
+			case VETO_AREA:   return area[i];
+			case VETO_TOT:    return tot[i];
+			default:          return rise[i];
+		}
+	}
+};
+
+struct veto_statistics {
+	uint64_t traces, accepted;
+	uint64_t rejected[VETO_NCUTS]; // traces that failed each cut (a trace may fail several)
+
+	veto_statistics() : traces(0), accepted(0)
+	{
+		int i;
+		for(i=0; i<VETO_NCUTS; i++) {
+			rejected[i] = 0;
+		}
+	}
+};
+
+// where the distance below the baseline d[] last rises above 'level' before the sample 'peak' (interpolated)
+template<typename T> double veto_crossing_before(const T *x, size_t peak, float baseline, double level)
+{
+	size_t j = peak;
+	double d0, d1;
+
+	while(j > 0 && baseline - x[j-1] >= level) {
+		j--;
+	}
+	if(j == 0) {
+		return 0;
+	}
+	d0 = baseline - x[j-1];
+	d1 = baseline - x[j];
+	return (j-1) + (d1 > d0 ? (level - d0)/(d1 - d0) : 0);
+}
+
+// the features of all traces of the span, written to out[first ... first+traces.ntraces)
+template<typename T> void calculate_veto_features(const trace_span<T> &traces, const veto_options &opt, veto_features &out, size_t first=0)
+{
+	typedef typename sample_traits<T>::accumulator accumulator;
+	const size_t lanes = 16, tile = 64;
+	const size_t length = traces.length;
+	const size_t nbase = opt.baseline_length > 0 && opt.baseline_length < length ? opt.baseline_length : (length > 0 ? length : 1);
+	T buffer[tile][lanes];
+	float base[lanes], threshold[lanes];
+	typename sample_traits<T>::total total[lanes];
+	T lo[lanes];
+	uint32_t at[lanes], tot[lanes];
+	size_t n, m, l, i, i0, k;
+
+	if(out.size() < first + traces.ntraces) {
+		out.resize(first + traces.ntraces);
+	}
+	if(length == 0) {
+		return;
+	}
+	for(n=0; n<traces.ntraces; n+=lanes) {
+		m = traces.ntraces - n < lanes ? traces.ntraces - n : lanes;
+		for(l=0; l<lanes; l++) {
+			const T *x = traces.trace(n + (l < m ? l : 0));
+			base[l]      = (float)sum_samples(x, nbase)/nbase;
+			threshold[l] = base[l] - (float)opt.tot_level;
+			total[l]     = 0;
+			lo[l]        = x[0];
+			at[l]        = 0;
+			tot[l]       = 0;
+		}
+		for(i0=0; i0<length; i0+=tile) {
+			accumulator part[lanes] = {0};
+
+			k = length - i0 < tile ? length - i0 : tile;
+			// transposed, so that the loops below run over the traces
+			for(l=0; l<lanes; l++) {
+				const T *x = traces.trace(n + (l < m ? l : 0)) + i0;
+				for(i=0; i<k; i++) {
+					buffer[i][l] = x[i];
+				}
+			}
+			for(i=0; i<k; i++) {
+				for(l=0; l<lanes; l++) {
+					const T v = buffer[i][l];
+					part[l] += v;
+					at[l]    = v < lo[l] ? (uint32_t)(i0+i) : at[l];
+					lo[l]    = v < lo[l] ? v : lo[l];
+					tot[l]  += (float)v < threshold[l] ? 1 : 0;
+				}
+			}
+			for(l=0; l<lanes; l++) {
+				total[l] += part[l];
+			}
+		}
+		for(l=0; l<m; l++) {
+			out.height[first+n+l] = base[l] - (float)lo[l];
+			out.area[first+n+l]   = (float)(base[l]*(double)length - (double)total[l]);
+			out.tot[first+n+l]    = tot[l];
+			out.rise[first+n+l]   = 0;
+			if(opt.enabled[VETO_RISE]) {
+				const T *x = traces.trace(n+l);
+				double h = base[l] - (float)lo[l];
+				out.rise[first+n+l] = (float)(veto_crossing_before(x, at[l], base[l], 0.9*h) - veto_crossing_before(x, at[l], base[l], 0.1*h));
+			}
+		}
+	}
+}
+
+// keep[i] = 1 for the traces [first, first+n) that pass every cut that is enabled
+inline void apply_veto(const veto_features &f, const veto_options &opt, size_t first, size_t n, std::vector<uint8_t> &keep, veto_statistics &stats)
+{
+	size_t i;
+	int c;
+	bool ok, pass;
+	double v;
+
+	if(keep.size() < first + n) {
+		keep.resize(first + n);
+	}
+	for(i=first; i<first+n; i++) {
+		ok = true;
+		for(c=0; c<VETO_NCUTS; c++) {
+			if(opt.enabled[c]) {
+				v    = f.get(c, i);
+				pass = v >= opt.min[c] && v <= opt.max[c];
+				stats.rejected[c] += pass ? 0 : 1;
+				ok = ok && pass;
+			}
+		}
+		keep[i] = ok ? 1 : 0;
+		stats.accepted += ok ? 1 : 0;
+	}
+	stats.traces += n;
+}
+
+// for example "height 5 .. inf, tot (3 below the baseline) 4 .. 100"
+inline std::string veto_description(const veto_options &opt)
+{
+	std::string s;
+	char buffer[200];
+	int c;
+
+	for(c=0; c<VETO_NCUTS; c++) {
+		if(opt.enabled[c]) {
+			if(c == VETO_TOT) {
+				snprintf(buffer, sizeof(buffer), "%stot (%g below the baseline) %g .. %g", s.empty() ? "" : ", ", opt.tot_level, opt.min[c], opt.max[c]);
+			} else {
+				snprintf(buffer, sizeof(buffer), "%s%s %g .. %g", s.empty() ? "" : ", ", veto_cut_name(c), opt.min[c], opt.max[c]);
+			}
+			s += buffer;
+		}
+	}
+	return s;
+}
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef __ZERO_SUPPRESS_H__
+#define __ZERO_SUPPRESS_H__
+
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#include "n-gamma.h"
+
+using namespace std;
+
+/*
+	Zero suppression of a long capture that is fetched in chunks: only windows around the pulses are kept.
+
+	A pulse starts where the signal drops below 'level' (negative pulses); the detector is armed again
+	once the signal is back above level+hysteresis, so that noise around the level doesn't give more pulses.
+	From every pulse 'pre' samples before and 'post' samples from the crossing on are kept;
+	overlapping windows are merged. Windows may start in the previous chunk (the last 'pre' samples are kept)
+	and end in the next one.
+
+	The kept samples are passed on in pieces with the absolute index of their first sample;
+	a piece that doesn't continue the previous one starts a new window.
+
+	The detector skips blocks of samples with a single comparison of their minimum (or maximum, while
+	it waits to be armed again), which the compiler vectorizes; only the block with the crossing is searched sample by sample.
+ */
+struct zero_suppress_options {
+	double       level;      // in units of samples
+	double       hysteresis;
+	unsigned int pre, post;
+
+	zero_suppress_options() : level(0), hysteresis(0), pre(100), post(400) {};
+};
+
+struct zero_suppress_statistics {
+	uint64_t samples;   // scanned
+	uint64_t kept;
+	uint64_t pulses;    // crossings of the level
+	uint64_t windows;   // after merging
+	double   seconds;   // spent in the detector
+
+	zero_suppress_statistics() : samples(0), kept(0), pulses(0), windows(0), seconds(0) {};
+	double ratio() const { return samples > 0 ? (double)kept/samples : 0; };
+};
+
+template<typename T> class zero_suppressor {
+public:
+	// samples per block that is skipped at once
+	enum { block = 64 };
+
+	zero_suppressor() { set_options(zero_suppress_options()); };
+	zero_suppressor(const zero_suppress_options &o) { set_options(o); };
+
+	void set_options(const zero_suppress_options &o)
+	{
+		opt = o;
+		reset();
+	}
+	const zero_suppress_options& get_options() const { return opt; };
+
+	// a new capture: the sample index starts at 0 again
+	void reset()
+	{
+		position     = 0;
+		armed        = true;
+		open         = false;
+		open_start   = 0;
+		keep_until   = 0;
+		written      = 0;
+		is_new       = false;
+		history.clear();
+		crossings.clear();
+	}
+
+	// the first sample of the next chunk
+	uint64_t get_position() const { return position; };
+
+	/*
+		Scans the next chunk x[0 ... n) and calls on_piece(uint64_t index, const T *samples, size_t count, bool is_new_window)
+		for the samples that are kept; 'stats' is updated.
+	 */
+	template<class F> void process(const T *x, size_t n, F on_piece, zero_suppress_statistics &stats)
+	{
+		size_t k;
+		uint64_t start, end, from;
+
+		detect(x, n);
+		stats.samples += n;
+		stats.pulses  += crossings.size();
+		for(k=0; k<crossings.size(); k++) {
+			start = crossings[k] >= opt.pre ? crossings[k] - opt.pre : 0;
+			end   = crossings[k] + opt.post;
+			if(open && start <= keep_until) {
+				// overlaps the window that is still open
+				keep_until = end > keep_until ? end : keep_until;
+				continue;
+			}
+			flush(x, n, on_piece, stats);
+			open       = true;
+			open_start = start > written ? start : written;
+			keep_until = end > open_start ? end : open_start;
+			// a window that continues right after the previous one isn't new
+			is_new = !(stats.windows > 0 && open_start == written);
+			stats.windows += is_new ? 1 : 0;
+		}
+		flush(x, n, on_piece, stats);
+		// the last samples for the windows that start before the next chunk
+		if(opt.pre > 0) {
+			if(n >= opt.pre) {
+				history.assign(x + n - opt.pre, x + n);
+			} else {
+				from = history.size() + n > opt.pre ? history.size() + n - opt.pre : 0;
+				history.erase(history.begin(), history.begin() + from);
+				history.insert(history.end(), x, x + n);
+			}
+		}
+		position += n;
+	}
+
+private:
+	zero_suppress_options opt;
+	uint64_t              position;    // absolute index of the first sample of the current chunk
+	bool                  armed;
+	bool                  open;        // a window hasn't been written completely yet
+	uint64_t              open_start;  // the first sample of the open window that hasn't been written yet
+	uint64_t              keep_until;  // the end of the open window
+	uint64_t              written;     // every sample before this one has been written (or dropped)
+	bool                  is_new;
+	std::vector<T>        history;     // the last 'pre' samples before the current chunk
+	std::vector<uint64_t> crossings;
+
+	// the crossings of the chunk (absolute indices)
+	void detect(const T *x, size_t n)
+	{
+		const double rearm = opt.level + opt.hysteresis;
+		size_t j = 0, end, l;
+
+		crossings.clear();
+		while(j < n) {
+			if(armed) {
+				// whole blocks above the level
+				for(; j + block <= n; j += block) {
+					T lo = x[j];
+					for(l=1; l<block; l++) {
+						lo = x[j+l] < lo ? x[j+l] : lo;
+					}
+					if(lo < opt.level) {
+						break;
+					}
+				}
+				end = j + block < n ? j + block : n;
+				for(; j<end && !(x[j] < opt.level); j++);
+				if(j < end) {
+					crossings.push_back(position + j);
+					armed = false;
+					j++;
+				}
+			} else {
+				for(; j + block <= n; j += block) {
+					T hi = x[j];
+					for(l=1; l<block; l++) {
+						hi = x[j+l] > hi ? x[j+l] : hi;
+					}
+					if(!(hi < rearm)) {
+						break;
+					}
+				}
+				end = j + block < n ? j + block : n;
+				for(; j<end && x[j] < rearm; j++);
+				if(j < end) {
+					armed = true;
+					j++;
+				}
+			}
+		}
+	}
+
+	// writes the open window up to its end or up to the end of the chunk
+	template<class F> void flush(const T *x, size_t n, F &on_piece, zero_suppress_statistics &stats)
+	{
+		uint64_t from, to;
+
+		if(!open) {
+			return;
+		}
+		from = open_start > written ? open_start : written;
+		to   = keep_until < position + n ? keep_until : position + n;
+		// from the samples of the previous chunks
+		if(from < position) {
+			on_piece(from, &history[history.size() - (position - from)], (size_t)(position - from), is_new);
+			stats.kept += position - from;
+			is_new = false;
+			from = position;
+		}
+		if(to > from) {
+			on_piece(from, x + (from - position), (size_t)(to - from), is_new);
+			stats.kept += to - from;
+			is_new = false;
+		}
+		written    = to > written ? to : written;
+		open       = keep_until > position + n;
+		open_start = written;
+	}
+};
+
+// a piece of a window: index of the first sample (uint64), number of samples (uint32), then the samples
+// (the same type as in the binary files: 8 bits for 6000 series)
+template<typename T> void write_zs_piece_binary(uint64_t index, const T *x, size_t n, FILE *f)
+{
+	uint32_t count = (uint32_t)n;
+
+	fwrite(&index, sizeof(index), 1, f);
+	fwrite(&count, sizeof(count), 1, f);
+	fwrite(x, sizeof(T), n, f);
+}
+
+// one sample per line: absolute index and value; an empty line before every new window
+template<typename T> void write_zs_piece_text(uint64_t index, const T *x, size_t n, bool is_new_window, FILE *f)
+{
+	char buffer[1<<16];
+	char *p = buffer;
+	size_t i;
+
+	if(is_new_window) {
+		*p++ = '\n';
+	}
+	for(i=0; i<n; i++) {
+		if(p - buffer > (long)sizeof(buffer) - 50) {
+			fwrite(buffer, 1, p-buffer, f);
+			p = buffer;
+		}
+		p = ngamma_append_int(p, (int64_t)(index + i));
+		*p++ = '\t';
+		p = ngamma_append_int(p, x[i]);
+		*p++ = '\n';
+	}
+	fwrite(buffer, 1, p-buffer, f);
+}
+
+#endif
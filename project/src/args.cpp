@@ -11,6 +11,15 @@
 #include <math.h>
 #include <cstddef>
 
+// makes sure that an option is followed by enough values
+static void require_values(int argc, char **argv, int i, int n)
+{
+	if(i+n >= argc) {
+		fprintf(stderr, "option '%s' requires %d value(s)\n", argv[i], n);
+		throw "missing value for an option";
+	}
+}
+
 int lookup_table(const struct gen_table *tbl, const char *opt)
 {
 	if(opt[0]=='-' && opt[1]=='-') {
@@ -33,12 +42,50 @@ Args::Args()
 	SetLength(0);
 	SetVoltage(U_MAX);
 	ntraces          = 1;
+	is_max_traces    = false;
 	nrepeats         = 1;
+	target_events    = 0;
+	target_seconds   = 0.0;
 	filename         = NULL;
 	filename_meta    = NULL;
 	is_just_help     = false;
 	is_binary_output = false;
 	is_text_output   = false;
+	is_auto_range    = false;
+	auto_range       = auto_range_options();
+	is_triggered     = false;
+	x_frac           = 0.0;
+	y_frac           = 0.0;
+	is_trigger_in_volts = false;
+	y_volts          = 0.0;
+	is_auto_trigger  = false;
+	auto_trigger     = auto_trigger_options();
+	is_trigger_logic = false;
+	trigger_logic    = TriggerLogic();
+	ets_cycles       = 0;
+	ets_interleave   = 0;
+	daemon_socket    = NULL;
+	client_socket    = NULL;
+	job_file         = NULL;
+	cpu              = -1;
+	rt_priority      = 0;
+	is_psd           = false;
+	psd_dt1          = 0;
+	psd_length       = 0;
+	keep_raw         = 0;
+	hist_bins        = 0;
+	hist_integral1_max = 0.0;
+	hist_integral2_max = 0.0;
+	is_hist_only     = false;
+	is_timing        = false;
+	is_peaks         = false;
+	is_baseline      = false;
+	is_baseline_subtracted = false;
+	baseline         = BASELINE_MEAN;
+	is_coincidence   = false;
+	is_average       = false;
+	is_average_rms   = false;
+	is_zero_suppressed = false;
 
 	for(i=0; i<5; i++) {
 		filename_binary[i] = NULL;
@@ -65,8 +112,13 @@ void Args::PrintUsage()
 	std::cout << "    --name <str>  # filename without extention (ext. is added automatically)\n";
 	std::cout << "    --l <number> | --length <number>   # length of single trace\n";
 	std::cout << "    --repeat <number>                  # repeat the same measurement number of times\n";
+	std::cout << "    --events <number> | --duration <time>  # instead of --repeat: capture batches of triggered traces (of --n,\n";
+	std::cout << "      # or as many as fit) until there are this many (10M, 2.5k, ...) or for this long (90s, 30m, 2h, 1d); the traces\n";
+	std::cout << "      # of all the batches go to the same files and <name>.idx tells where every batch starts\n";
 	std::cout << "    --U <str> | --voltage <str>        # voltage range\n";
 	std::cout << "      allowed values: 50mV, 100mV, 200mV, 500mV, 1V, 2V, 5V, 10V, 20V\n";
+	std::cout << "    --U auto [<fraction>]              # the smallest range of every channel that clips at most the fraction\n";
+	std::cout << "                                       # of the samples (default 0.0001) of a short capture before the run\n";
 	std::cout << "\n";
 	std::cout << "    --ch <str> | --channel <str>       # list of channels, for example: acd\n";
 	std::cout << "    --dt (<number>ns | <number>ps)     # sampling rate\n";
@@ -82,7 +134,88 @@ void Args::PrintUsage()
 	std::cout << "      # x between (0,1) represents trigger point on x axis\n";
 	std::cout << "      # y between (-1,1) represents trigger point on y axis and implies direction\n";
 	std::cout << "      # y < 0 triggers on falling signal; y > 0 on raising signal\n";
-	std::cout << "    --n <number>                       # number of traces\n";
+	std::cout << "      # y with a unit (for example -20mV or 0.1V) is an absolute level, which stays the same with --U auto\n";
+	std::cout << "    --trig <x> -auto|auto [<rate>] [recheck]\n";
+	std::cout << "      # the level and the hysteresis from the noise of a short capture before the run, so that the noise gives\n";
+	std::cout << "      # at most <rate> triggers per second (1 by default); -auto triggers on falling signal, auto on raising signal;\n";
+	std::cout << "      # with 'recheck' the noise is measured again before every repeat\n";
+	std::cout << "    --trig <x> \"<expression>\"             # conditions on several channels, OR (|) of AND (&) terms, for example\n";
+	std::cout << "      #   --trig 0.3 \"A<-20mV & B<-20mV | C>0.1\"   (< falling through the level, > rising)\n";
+	std::cout << "      #   --trig 0.3 \"A in -0.2:-0.1\"             (entering a window, 'out' for leaving it)\n";
+	std::cout << "      # every channel can only have one condition (picoscope has one level or window per channel)\n";
+	std::cout << "    --pwq <condition> <width>          # pulse width qualifier required by every term of the trigger, for example\n";
+	std::cout << "      #   --pwq \"A<-20mV\" \">10\"   (<N, >N, N:M in range, !N:M out of range; in samples)\n";
+	std::cout << "      # with --trig <x> auto a condition on the trigger channel gets the level that is chosen\n";
+	std::cout << "    --trig-delay <samples>             # the trigger point this many samples after the trigger event\n";
+	std::cout << "    --ets <cycles> <interleave>        # equivalent-time sampling of a repetitive signal (needs --trig, a single trace):\n";
+	std::cout << "      # <interleave> captures out of <cycles> (at most 250 and 50 for 6000 series, 400 and 80 for 4000 series);\n";
+	std::cout << "      # the samples are written in the order of their times, which go to <name>.ets.bin|.ets.txt (in fs)\n";
+	std::cout << "    --n <number> | --n max             # number of traces (per run); max: as many as fit into the memory\n";
+	std::cout << "      # the timebase and the traces are checked with picoscope and shown before the run\n";
+	std::cout << "\n";
+	std::cout << "  keeping picoscope open between measurements:\n";
+	std::cout << "    --daemon <socket>                  # open picoscope once and run jobs received on a unix socket\n";
+	std::cout << "    --socket <socket>                  # send this measurement to a running daemon\n";
+	std::cout << "    --jobs <file>                      # run all measurements from a job file\n";
+	std::cout << "      # one measurement per line (continued with '\\' at the end of line), '#' for comments\n";
+	std::cout << "      # {a,b,c} sweeps over a list, [from:to:step] over a range, for example\n";
+	std::cout << "      #   --name scan --l 10k --n 100 --U {50mV,100mV} --dt [400:1600:400]ps --trig 0.2 [-0.1:-0.3:-0.1]\n";
+	std::cout << "      # the index of the combination is appended to the name; --name <str> sets the name of the manifest\n";
+	std::cout << "\n";
+	std::cout << "  analysis during the acquisition (triggered events only):\n";
+	std::cout << "    --psd <dt1> <length>               # write n-gamma integrals to <name><channel>.psd.txt (.psd.bin with --bin)\n";
+	std::cout << "                                       # instead of the raw traces; for example --psd 175 250 at 200ps\n";
+	std::cout << "    --keep-raw <n>                     # still write every n-th raw trace\n";
+	std::cout << "    --hist <bins> <int1 max> <int2 max> # also fill histograms of integral2 vs. integral1, integral1 and the peak\n";
+	std::cout << "                                       # (in units of 8-bit samples for 6000 series) into <name><channel>.hist.txt\n";
+	std::cout << "                                       # (.hist.bin with --bin), updated after every block of traces\n";
+	std::cout << "    --hist-only                        # write only the histograms, not the integrals of every trace\n";
+	std::cout << "    --timing cfd <fraction>            # time of every pulse with a constant fraction discriminator (e.g. 0.3)\n";
+	std::cout << "    --timing le <level>                # or where the leading edge crosses <level> below the baseline\n";
+	std::cout << "                                       # (in units of 8-bit samples for 6000 series); written to <name><channel>.time.txt\n";
+	std::cout << "                                       # (.time.bin): crossing in samples and the timestamp in ps\n";
+	std::cout << "    --cubic                            # cubic instead of linear interpolation for --timing\n";
+	std::cout << "    --peaks <threshold>                # find every pulse of a trace where the signal drops by more than <threshold>\n";
+	std::cout << "                                       # within 4 samples (0: 5 sigma of the noise) and write them to <name><channel>.peaks.txt;\n";
+	std::cout << "                                       # with --psd piled-up traces get problem 2 and are left out of the histograms\n";
+	std::cout << "    --baseline <mean|median|running>   # baseline of every trace from the samples before the trigger (mean, median of\n";
+	std::cout << "                                       # blocks or mean smoothed over traces) written to <name><channel>.baseline.txt;\n";
+	std::cout << "                                       # the n-gamma integrals are corrected for it\n";
+	std::cout << "    --subtract-baseline                # subtract it from the traces (also the kept raw ones) before any other analysis\n";
+	std::cout << "    --shaper trap <rise> <flat> <tau>  # trapezoidal filter (tau: decay of the pulses for the pole-zero correction, 0 for steps)\n";
+	std::cout << "    --shaper crrc <tau> <n>            # CR-RC^n with the shaping time tau\n";
+	std::cout << "    --shaper ma <n>                    # moving average of n samples\n";
+	std::cout << "    --shaper fir <file>                # FIR filter with the taps from a file (numbers separated by spaces or lines)\n";
+	std::cout << "                                       # all in samples; the amplitude and the position of the shaped pulse of every trace\n";
+	std::cout << "                                       # go to <name><channel>.energy.txt (in units of 8-bit samples for 6000 series);\n";
+	std::cout << "                                       # without --n the whole shaped trace goes to <name><channel>.shaped.txt\n";
+	std::cout << "    --coincidence <window> <n>         # with --timing and several channels: hits of at least n channels within <window> ns\n";
+	std::cout << "                                       # of the first one are written as events to <name>.events.txt (.events.bin),\n";
+	std::cout << "                                       # with the amplitude from --shaper or integral1 from --psd; the singles, coincidences\n";
+	std::cout << "                                       # and estimated accidentals of every pair of channels go to the metadata\n";
+	std::cout << "    --average [rms]                    # average of all triggered traces (and the rms around it) sample by sample\n";
+	std::cout << "                                       # to <name><channel>.average.txt (.average.bin), in units of 8-bit samples\n";
+	std::cout << "                                       # for 6000 series; nothing else is written unless asked for\n";
+	std::cout << "\n";
+	std::cout << "  dropping traces (triggered events only, before they are written or analysed):\n";
+	std::cout << "    --veto height <min> <max>          # keep only traces with a pulse height (baseline - minimum) in [min, max]\n";
+	std::cout << "    --veto area <min> <max>            # ... with an area (sum of baseline - sample) in [min, max]\n";
+	std::cout << "    --veto tot <level> <min> <max>     # ... that stay more than <level> below the baseline for [min, max] samples\n";
+	std::cout << "    --veto rise <min> <max>            # ... with a rise time (10 % - 90 %) of [min, max] samples\n";
+	std::cout << "                                       # on the trigger channel, with the baseline from the pre-trigger samples, in units\n";
+	std::cout << "                                       # of 8-bit samples for 6000 series (\"inf\" for no limit); may be repeated\n";
+	std::cout << "\n";
+	std::cout << "  a single long capture (without --n):\n";
+	std::cout << "    --zs <level> <hyst> <pre> <post>   # zero suppression: keep only <pre> samples before and <post> samples after\n";
+	std::cout << "                                       # every drop of the signal below <level> (in units of 8-bit samples for 6000\n";
+	std::cout << "                                       # series; the next pulse needs the signal back above level+hyst first);\n";
+	std::cout << "                                       # written to <name><channel>.zs.bin (index and length of every piece, then\n";
+	std::cout << "                                       # its samples) or .zs.txt (index and value of every sample) instead of the trace\n";
+	std::cout << "\n";
+	std::cout << "  on a busy machine (Linux only):\n";
+	std::cout << "    --cpu <cpu>                        # pin the acquisition thread to a CPU\n";
+	std::cout << "    --rt <priority>                    # run the acquisition thread with SCHED_FIFO (1-99)\n";
+	std::cout << "    --writer-cpu <cpu>[,<cpu>...]      # write the channels in parallel on threads pinned to these CPUs\n";
 }
 
 void Args::parse_options(int argc, char** argv, Measurement *m)
@@ -113,56 +246,358 @@ void Args::parse_options(int argc, char** argv, Measurement *m)
 				break;
 			case PICO_ARG_FILENAME:
 				// fprintf(stderr, "  (filename recognized in '%s' '%s')\n", argv[i], argv[i+1]);
+				require_values(argc, argv, i, 1);
 				SetFilename(argv[++i]);
 				// fprintf(stderr, "  (name: '%s')\n", GetFilename());
 				break;
 			case PICO_ARG_LENGTH:
 				// fprintf(stderr, "  (length recognized in '%s' '%s')\n", argv[i], argv[i+1]);
+				require_values(argc, argv, i, 1);
 				ParseAndSetLength(argv[++i]);
 				break;
 			case PICO_ARG_NTRACES:
+				require_values(argc, argv, i, 1);
 				ParseAndSetNTraces(argv[++i]);
 				break;
 			case PICO_ARG_NREPEATS:
+				require_values(argc, argv, i, 1);
 				ParseAndSetNRepeats(argv[++i]);
 				break;
+			case PICO_ARG_EVENTS:
+				require_values(argc, argv, i, 1);
+				ParseAndSetTargetEvents(argv[++i]);
+				break;
+			case PICO_ARG_DURATION:
+				require_values(argc, argv, i, 1);
+				ParseAndSetTargetDuration(argv[++i]);
+				break;
 			case PICO_ARG_CHANNEL:
+				require_values(argc, argv, i, 1);
 				ParseAndSetChannels(argv[++i]);
 				break;
 			case PICO_ARG_VOLTAGE:
 				// fprintf(stderr, "  (voltage recognized in '%s' '%s')\n", argv[i], argv[i+1]);
-				ParseAndSetVoltage(argv[++i]);
+				require_values(argc, argv, i, 1);
+				if(strcmp(argv[i+1], "auto") == 0) {
+					is_auto_range = true;
+					voltage = U_MAX;
+					i++;
+					// the fraction of clipped samples is optional
+					if(i+1 < argc && sscanf(argv[i+1], "%lf", &auto_range.max_clipped) == 1) {
+						if(auto_range.max_clipped < 0 || auto_range.max_clipped >= 1) {
+							throw "--U auto [<fraction>]: the fraction of clipped samples has to be between 0 and 1";
+						}
+						i++;
+					}
+				} else {
+					is_auto_range = false;
+					ParseAndSetVoltage(argv[++i]);
+				}
 				break;
 			case PICO_ARG_RATE:
+				require_values(argc, argv, i, 1);
 				ParseAndSetRate(argv[++i]);
 				break;
 			case PICO_ARG_TRIGGER:
+				require_values(argc, argv, i, 2);
 				ParseAndSetTrigger(argv[i+1], argv[i+2]);
 				i+=2;
+				// the rate of noise triggers and "recheck" are optional
+				if(is_auto_trigger && i+1 < argc && sscanf(argv[i+1], "%lf", &auto_trigger.rate) == 1) {
+					if(auto_trigger.rate <= 0) {
+						throw "--trig <x> auto [<rate>]: the rate of noise triggers has to be positive";
+					}
+					i++;
+				}
+				if(is_auto_trigger && i+1 < argc && strcmp(argv[i+1], "recheck") == 0) {
+					auto_trigger.recheck = true;
+					i++;
+				}
+				break;
+			case PICO_ARG_PWQ:
+				require_values(argc, argv, i, 2);
+				ParseAndSetPulseWidthQualifier(argv[i+1], argv[i+2]);
+				i+=2;
+				break;
+			case PICO_ARG_TRIGGER_DELAY:
+				require_values(argc, argv, i, 1);
+				if(sscanf(argv[++i], "%u", &trigger_logic.delay) != 1) {
+					throw "--trig-delay <samples>: the delay has to be a number of samples";
+				}
+				break;
+			case PICO_ARG_ETS:
+				require_values(argc, argv, i, 2);
+				if(sscanf(argv[i+1], "%u", &ets_cycles) != 1 || sscanf(argv[i+2], "%u", &ets_interleave) != 1 ||
+				   ets_interleave < 1 || ets_cycles < ets_interleave) {
+					throw "--ets <cycles> <interleave>: both have to be positive numbers with at least as many cycles as interleaves";
+				}
+				i+=2;
 				break;
 			case PICO_ARG_SIGNAL_SQUARE:
+				require_values(argc, argv, i, 2);
 				ParseAndSetSquareSignalGenerator(argv[i+1],argv[i+2]);
 				// ParseAndSetSignalGeneratorVoltage(argv[i+1]);
 				// ParseAndSetSignalGeneratorTime(argv[i+2]);
 				i+=2;
 				break;
+			case PICO_ARG_DAEMON:
+				require_values(argc, argv, i, 1);
+				daemon_socket = argv[++i];
+				break;
+			case PICO_ARG_SOCKET:
+				require_values(argc, argv, i, 1);
+				client_socket = argv[++i];
+				break;
+			case PICO_ARG_JOBS:
+				require_values(argc, argv, i, 1);
+				job_file = argv[++i];
+				break;
+			case PICO_ARG_CPU:
+				require_values(argc, argv, i, 1);
+				if(sscanf(argv[++i], "%d", &cpu) != 1 || cpu < 0) {
+					throw "--cpu <cpu>: cpu has to be a non-negative number";
+				}
+				break;
+			case PICO_ARG_WRITER_CPU:
+				require_values(argc, argv, i, 1);
+				ParseAndSetWriterCpus(argv[++i]);
+				break;
+			case PICO_ARG_RT:
+				require_values(argc, argv, i, 1);
+				if(sscanf(argv[++i], "%d", &rt_priority) != 1 || rt_priority < 1 || rt_priority > 99) {
+					throw "--rt <priority>: priority has to be between 1 and 99";
+				}
+				break;
+			case PICO_ARG_PSD:
+				require_values(argc, argv, i, 2);
+				if(sscanf(argv[i+1], "%u", &psd_dt1) != 1 || sscanf(argv[i+2], "%u", &psd_length) != 1 || psd_length == 0) {
+					throw "--psd <dt1> <length>: expecting two positive numbers of samples";
+				}
+				is_psd = true;
+				i += 2;
+				break;
+			case PICO_ARG_KEEP_RAW:
+				require_values(argc, argv, i, 1);
+				if(sscanf(argv[++i], "%lu", &keep_raw) != 1) {
+					throw "--keep-raw <n>: n has to be a number";
+				}
+				break;
+			case PICO_ARG_HIST:
+				require_values(argc, argv, i, 3);
+				if(sscanf(argv[i+1], "%u", &hist_bins) != 1 || hist_bins == 0 ||
+				   sscanf(argv[i+2], "%lf", &hist_integral1_max) != 1 || hist_integral1_max <= 0 ||
+				   sscanf(argv[i+3], "%lf", &hist_integral2_max) != 1 || hist_integral2_max <= 0) {
+					throw "--hist <bins> <integral1 max> <integral2 max>: expecting three positive numbers";
+				}
+				i += 3;
+				break;
+			case PICO_ARG_HIST_ONLY:
+				is_hist_only = true;
+				break;
+			case PICO_ARG_ZERO_SUPPRESS:
+				require_values(argc, argv, i, 4);
+				if(sscanf(argv[i+1], "%lf", &zero_suppress.level) != 1 ||
+				   sscanf(argv[i+2], "%lf", &zero_suppress.hysteresis) != 1 || zero_suppress.hysteresis < 0 ||
+				   sscanf(argv[i+3], "%u", &zero_suppress.pre) != 1 ||
+				   sscanf(argv[i+4], "%u", &zero_suppress.post) != 1 || zero_suppress.post == 0) {
+					throw "--zs <level> <hysteresis> <pre> <post>: the hysteresis has to be positive or 0, pre and post numbers of samples (post at least 1)";
+				}
+				is_zero_suppressed = true;
+				i += 4;
+				break;
+			case PICO_ARG_VETO:
+				ParseAndSetVeto(argc, argv, i);
+				break;
+			case PICO_ARG_AVERAGE:
+				is_average = true;
+				if(i+1 < argc && strcmp(argv[i+1], "rms") == 0) {
+					is_average_rms = true;
+					i++;
+				}
+				break;
+			case PICO_ARG_TIMING:
+				require_values(argc, argv, i, 2);
+				if(strcmp(argv[i+1], "cfd") == 0) {
+					timing.is_cfd = true;
+					if(sscanf(argv[i+2], "%lf", &timing.fraction) != 1 || timing.fraction <= 0 || timing.fraction >= 1) {
+						throw "--timing cfd <fraction>: the fraction has to be between 0 and 1";
+					}
+				} else if(strcmp(argv[i+1], "le") == 0) {
+					timing.is_cfd = false;
+					if(sscanf(argv[i+2], "%lf", &timing.level) != 1 || timing.level <= 0) {
+						throw "--timing le <level>: the level has to be a positive number";
+					}
+				} else {
+					throw "--timing <cfd|le> <fraction|level>: unknown method";
+				}
+				is_timing = true;
+				i += 2;
+				break;
+			case PICO_ARG_CUBIC:
+				timing.is_cubic = true;
+				break;
+			case PICO_ARG_BASELINE:
+				require_values(argc, argv, i, 1);
+				i++;
+				if(strcmp(argv[i], "mean") == 0) {
+					baseline = BASELINE_MEAN;
+				} else if(strcmp(argv[i], "median") == 0) {
+					baseline = BASELINE_MEDIAN;
+				} else if(strcmp(argv[i], "running") == 0) {
+					baseline = BASELINE_RUNNING;
+				} else {
+					throw "--baseline <mean|median|running>: unknown method";
+				}
+				is_baseline = true;
+				break;
+			case PICO_ARG_SUBTRACT_BASELINE:
+				is_baseline            = true;
+				is_baseline_subtracted = true;
+				break;
+			case PICO_ARG_SHAPER:
+				ParseAndSetShaper(argc, argv, i);
+				break;
+			case PICO_ARG_COINCIDENCE:
+				{
+					double window_ns;
+
+					require_values(argc, argv, i, 2);
+					if(sscanf(argv[i+1], "%lf", &window_ns) != 1 || window_ns <= 0 ||
+					   sscanf(argv[i+2], "%u", &coincidence.multiplicity) != 1 || coincidence.multiplicity < 2) {
+						throw "--coincidence <window> <n>: the window (in ns) has to be positive and n at least 2";
+					}
+					coincidence.window_ps = (int64_t)llround(window_ns*1000);
+					is_coincidence = true;
+					i += 2;
+				}
+				break;
+			case PICO_ARG_PEAKS:
+				require_values(argc, argv, i, 1);
+				if(sscanf(argv[++i], "%lf", &peaks.threshold) != 1 || peaks.threshold < 0) {
+					throw "--peaks <threshold>: the threshold has to be a positive number or 0";
+				}
+				is_peaks = true;
+				break;
 			case PICO_NOT_ARG:
 				fprintf(stderr, "WARNING: this is not an argument '%s'\n", argv[i]);
-				throw;
+				throw "invalid argument";
 				break;
 			default:
 				fprintf(stderr, "  (invalid option '%s')\n", argv[i]);
-				throw;
+				throw "invalid option";
 				break;
 		}
 	}
 
+	if(IsTargetDriven()) {
+		if(!is_triggered || IsEts() || is_zero_suppressed) {
+			throw "--events and --duration need triggered traces (--trig, without --ets or --zs)";
+		}
+		if(nrepeats > 1) {
+			throw "--events and --duration replace --repeat";
+		}
+		// the batches are as big as the memory allows unless --n says otherwise
+		if(ntraces <= 1) {
+			is_max_traces = true;
+			ntraces       = 2;
+		}
+	}
+	if(IsVeto() && ntraces <= 1) {
+		throw "--veto is only for triggered events (with --n)";
+	}
+	if((trigger_logic.pwq_type != PWQ_NONE || trigger_logic.delay > 0) && !is_triggered) {
+		throw "--pwq and --trig-delay need a trigger (--trig)";
+	}
+	if(IsEts() && (!is_triggered || ntraces > 1)) {
+		throw "--ets needs a trigger (--trig) and a single trace (without --n)";
+	}
+	if(is_zero_suppressed && ntraces > 1) {
+		throw "--zs is only for a single long capture (without --n)";
+	}
+	if(is_coincidence && !is_timing) {
+		throw "--coincidence needs the timestamps from --timing";
+	}
 	// default output is text
 	if(!IsBinaryOutput() && !IsTextOutput()) {
 		is_text_output = true;
 	}
 }
 
+// --shaper <type> <parameters> starting at argv[i]; i is moved to the last parameter
+void Args::ParseAndSetShaper(int argc, char **argv, int &i)
+{
+	FILE *f;
+	float tap;
+
+	require_values(argc, argv, i, 2);
+	shaper = shaper_options();
+	if(strcmp(argv[i+1], "trap") == 0) {
+		require_values(argc, argv, i, 4);
+		if(sscanf(argv[i+2], "%u", &shaper.rise) != 1 || shaper.rise == 0 ||
+		   sscanf(argv[i+3], "%u", &shaper.flat) != 1 ||
+		   sscanf(argv[i+4], "%lf", &shaper.tau) != 1 || shaper.tau < 0) {
+			throw "--shaper trap <rise> <flat> <tau>: rise has to be positive, flat and tau positive or 0";
+		}
+		shaper.type = SHAPER_TRAPEZOIDAL;
+		i += 4;
+	} else if(strcmp(argv[i+1], "crrc") == 0) {
+		require_values(argc, argv, i, 3);
+		if(sscanf(argv[i+2], "%lf", &shaper.tau) != 1 || shaper.tau <= 0 ||
+		   sscanf(argv[i+3], "%u", &shaper.order) != 1 || shaper.order < 1 || shaper.order > 15) {
+			throw "--shaper crrc <tau> <n>: tau has to be positive and n between 1 and 15";
+		}
+		shaper.type = SHAPER_CRRC;
+		i += 3;
+	} else if(strcmp(argv[i+1], "ma") == 0) {
+		if(sscanf(argv[i+2], "%u", &shaper.length) != 1 || shaper.length == 0) {
+			throw "--shaper ma <n>: n has to be a positive number";
+		}
+		shaper.type = SHAPER_MOVING_AVERAGE;
+		i += 2;
+	} else if(strcmp(argv[i+1], "fir") == 0) {
+		f = fopen(argv[i+2], "rt");
+		if(f == NULL) {
+			fprintf(stderr, "Unable to open %s\n", argv[i+2]);
+			throw "--shaper fir <file>: unable to read the taps";
+		}
+		while(fscanf(f, "%f", &tap) == 1) {
+			shaper.taps.push_back(tap);
+		}
+		fclose(f);
+		if(shaper.taps.empty()) {
+			throw "--shaper fir <file>: there are no taps in the file";
+		}
+		shaper.type = SHAPER_FIR;
+		i += 2;
+	} else {
+		throw "--shaper <trap|crrc|ma|fir> <parameters>: unknown filter";
+	}
+}
+
+// --veto <cut> [<level>] <min> <max> starting at argv[i]; i is moved to the last parameter
+void Args::ParseAndSetVeto(int argc, char **argv, int &i)
+{
+	int c;
+
+	require_values(argc, argv, i, 3);
+	for(c=0; c<VETO_NCUTS && strcmp(argv[i+1], veto_cut_name(c)) != 0; c++);
+	if(c == VETO_NCUTS) {
+		throw "--veto <height|area|tot|rise> ...: unknown cut";
+	}
+	i++;
+	if(c == VETO_TOT) {
+		require_values(argc, argv, i, 3);
+		if(sscanf(argv[++i], "%lf", &veto.tot_level) != 1 || veto.tot_level < 0) {
+			throw "--veto tot <level> <min> <max>: the level has to be positive or 0";
+		}
+	}
+	if(sscanf(argv[i+1], "%lf", &veto.min[c]) != 1 || sscanf(argv[i+2], "%lf", &veto.max[c]) != 1 || veto.min[c] > veto.max[c]) {
+		throw "--veto <cut> <min> <max>: expecting two numbers with min <= max";
+	}
+	veto.enabled[c] = true;
+	i += 2;
+}
+
 void Args::SetFilename(char *name)
 {
 	int i;
@@ -171,14 +606,14 @@ void Args::SetFilename(char *name)
 	if(filename_meta != NULL) free(filename_meta);
 
 	filename        = (char *)malloc(strlen(name)+1);
-	filename_meta   = (char *)malloc(strlen(name)+4);
+	filename_meta   = (char *)malloc(strlen(name)+5);
 
 	for(i=0; i<5; i++) {
 		if(filename_binary[i] != NULL) free(filename_binary[i]);
 		if(filename_text[i]   != NULL) free(filename_text[i]  );
 
-		filename_binary[i] = (char *)malloc(strlen(name)+5);
-		filename_text[i]   = (char *)malloc(strlen(name)+5);
+		filename_binary[i] = (char *)malloc(strlen(name)+6);
+		filename_text[i]   = (char *)malloc(strlen(name)+6);
 	}
 
 	if((filename != NULL) && (filename_meta != NULL)) {
@@ -233,23 +668,19 @@ void Args::ParseAndSetChannels(char *str)
 	for(i=0; i<strlen(str); i++) {
 		c = str[i];
 		// convert character into number
-		if(c>='A' && c<='A'+PICOSCOPE_N_CHANNELS) {
+		if(c>='A' && c<'A'+PICOSCOPE_N_CHANNELS) {
 			c_i = c-'A';
-		} else if(c>='a' && c<='a'+PICOSCOPE_N_CHANNELS) {
+		} else if(c>='a' && c<'a'+PICOSCOPE_N_CHANNELS) {
 			c_i = c-'a';
 		} else {
-			fprintf(stderr, "invalid channel '%c'\n", c);
-			// return -1;
+			throw Picoscope::PicoscopeUserException("--ch <channels>: channels have to be letters from A to D");
 		}
 		// make sure that channel has not been enabled yet (though this should not matter much)
 		if(channel_enabled[c_i] == true) {
 			fprintf(stderr, "channel '%c' requested more than once\n", c);
-			// return -1;
-		// } else {
 		}
 		channel_enabled[c_i] = true;
 		FILE_LOG(logDEBUG4) << "Args::ParseAndSetChannels - enable channel " << c_i << " (" << (char)('A' + c_i) << ")";
-		// }
 	}
 
 	n_channels = 0;
@@ -258,15 +689,14 @@ void Args::ParseAndSetChannels(char *str)
 			n_channels++;
 		}
 	}
-	if(n_channels>0) {
-		GetMeasurement()->EnableChannels(
-			channel_enabled[0],
-			channel_enabled[1],
-			channel_enabled[2],
-			channel_enabled[3]);
-	} else {
-		fprintf(stderr, "error parsing channels: no valid channel, won't set anything\n", c);
+	if(n_channels == 0) {
+		throw Picoscope::PicoscopeUserException("--ch <channels>: no channel given");
 	}
+	GetMeasurement()->EnableChannels(
+		channel_enabled[0],
+		channel_enabled[1],
+		channel_enabled[2],
+		channel_enabled[3]);
 }
 
 void Args::ParseAndSetVoltage(char *str)
@@ -297,7 +727,9 @@ void Args::ParseAndSetRate(char *str)
 	long number;
 	char unit[20];
 
-	sscanf(str, "%d%s", &number, unit);
+	if(sscanf(str, "%ld%19s", &number, unit) != 2) {
+		throw "You can only use <number>ps or <number>ns for sampling rate --dt.";
+	}
 	if(strcmp(unit,"ps")==0) {
 		if(number>=200) {
 			GetMeasurement()->SetTimebaseInPs((unsigned long)number);
@@ -315,6 +747,24 @@ void Args::ParseAndSetRate(char *str)
 	}
 }
 
+void Args::ParseAndSetWriterCpus(char *str)
+{
+	int value, used;
+
+	writer_cpus.clear();
+	while(sscanf(str, "%d%n", &value, &used) == 1 && value >= 0) {
+		writer_cpus.push_back(value);
+		str += used;
+		if(*str != ',') {
+			break;
+		}
+		str++;
+	}
+	if(*str != '\0' || writer_cpus.empty()) {
+		throw "--writer-cpu <cpu>[,<cpu>...]: expecting a list of CPUs like 2,3";
+	}
+}
+
 // void Args::ParseAndSetSignalGeneratorVoltage(char *str)
 // {
 // 	generator_voltage = ParseVoltage(str);
@@ -364,6 +814,14 @@ void Args::ParseAndSetLength(char *str_orig)
 
 void Args::ParseAndSetNTraces(char *str)
 {
+	// rapid block mode with as many traces per run as fit into the memory (chosen by the planner)
+	if(strcmp(str, "max") == 0) {
+		is_max_traces = true;
+		ntraces       = 2;
+		std::cerr << "    (fetching as many traces as fit)\n";
+		return;
+	}
+	is_max_traces = false;
 	ntraces = (unsigned long)atoi(str);
 	if(ntraces == 0) {
 		throw "something is wrong; there are no traces to fetch.\n";
@@ -382,15 +840,185 @@ void Args::ParseAndSetNRepeats(char *str)
 	}
 }
 
+void Args::ParseAndSetTargetEvents(char *str)
+{
+	double number = 0;
+	char unit = '\0';
+
+	if(sscanf(str, "%lf%c", &number, &unit) < 1 || number < 1) {
+		throw "--events <number>: the number of events has to be positive (for example 1000, 2.5k, 10M or 1G)";
+	}
+	switch(unit) {
+		case '\0': break;
+		case 'k': number *= 1e3; break;
+		case 'M': number *= 1e6; break;
+		case 'G': number *= 1e9; break;
+		default:
+			throw "--events <number>: the only units are k, M and G";
+	}
+	target_events = (uint64_t)llround(number);
+	std::cerr << "    (capturing until there are " << target_events << " events)\n";
+}
+
+void Args::ParseAndSetTargetDuration(char *str)
+{
+	double number = 0;
+	char unit = 's';
+
+	if(sscanf(str, "%lf%c", &number, &unit) < 1 || number <= 0) {
+		throw "--duration <time>: the time has to be positive (for example 90s, 30m, 2h or 1d)";
+	}
+	switch(unit) {
+		case 's': break;
+		case 'm': number *= 60; break;
+		case 'h': number *= 3600; break;
+		case 'd': number *= 86400; break;
+		default:
+			throw "--duration <time>: the only units are s, m, h and d";
+	}
+	target_seconds = number;
+	std::cerr << "    (capturing for " << target_seconds << " s)\n";
+}
+
+// a level with a unit (V or mV) is returned in volts (true), a plain number as it is (a fraction of the range)
+static bool ParseTriggerLevel(const char *str, double &level)
+{
+	char unit[20] = "";
+	int n = sscanf(str, "%lf%19s", &level, unit);
+
+	if(n < 1) {
+		throw "--trigger: invalid level";
+	} else if(n == 1) {
+		return false;
+	} else if(strcmp(unit, "V") == 0) {
+		return true;
+	} else if(strcmp(unit, "mV") == 0) {
+		level *= 1e-3;
+		return true;
+	}
+	throw "--trigger <xfrac> <yfrac>|<level>(V|mV): invalid unit of the level";
+}
+
+// "A<-20mV", "B>0.1", "Cin-0.2:-0.1", "Dout-50mV:50mV" (without spaces)
+static TriggerCondition ParseTriggerCondition(const std::string &str)
+{
+	TriggerCondition cond;
+	std::string rest;
+	size_t colon;
+	bool lower_volts;
+
+	if(str.size() < 3 || str[0] < 'A' || str[0] > 'D') {
+		throw "--trigger: a condition has to start with a channel (A-D)";
+	}
+	cond.channel = str[0] - 'A';
+	if(str[1] == '<' || str[1] == '>') {
+		cond.type     = str[1] == '>' ? TRIGGER_RISING : TRIGGER_FALLING;
+		cond.is_volts = ParseTriggerLevel(str.c_str() + 2, cond.level);
+		return cond;
+	}
+	if(str.compare(1, 2, "in") == 0) {
+		cond.type = TRIGGER_ENTER;
+		rest = str.substr(3);
+	} else if(str.compare(1, 3, "out") == 0) {
+		cond.type = TRIGGER_EXIT;
+		rest = str.substr(4);
+	} else {
+		throw "--trigger: a condition is <channel><level, <channel>>level, <channel> in <lower>:<upper> or <channel> out <lower>:<upper>";
+	}
+	colon = rest.find(':');
+	if(colon == std::string::npos) {
+		throw "--trigger: a window needs <lower>:<upper>";
+	}
+	lower_volts   = ParseTriggerLevel(rest.substr(0, colon).c_str(), cond.lower);
+	cond.is_volts = ParseTriggerLevel(rest.substr(colon+1).c_str(), cond.level);
+	if(lower_volts != cond.is_volts || cond.lower >= cond.level) {
+		throw "--trigger: the window needs lower < upper in the same units";
+	}
+	return cond;
+}
+
+// OR (|) of AND (&) terms of conditions
+static void ParseTriggerExpression(const char *str, TriggerLogic &logic)
+{
+	std::string s;
+	size_t start, end, and_start, and_end;
+
+	for(; *str; str++) {
+		if(*str != ' ' && *str != '\t') {
+			s += *str;
+		}
+	}
+	logic.terms.clear();
+	for(start=0; start<=s.size(); start=end+1) {
+		end = s.find('|', start);
+		end = end == std::string::npos ? s.size() : end;
+		logic.terms.push_back(std::vector<TriggerCondition>());
+		for(and_start=start; and_start<=end; and_start=and_end+1) {
+			and_end = s.find('&', and_start);
+			and_end = (and_end == std::string::npos || and_end > end) ? end : and_end;
+			logic.terms.back().push_back(ParseTriggerCondition(s.substr(and_start, and_end-and_start)));
+		}
+	}
+}
+
+void Args::ParseAndSetPulseWidthQualifier(char *strc, char *strw)
+{
+	std::string c;
+	unsigned int lower, upper;
+
+	for(; *strc; strc++) {
+		if(*strc != ' ') {
+			c += *strc;
+		}
+	}
+	trigger_logic.pwq = ParseTriggerCondition(c);
+	if(sscanf(strw, "<%u", &lower) == 1) {
+		trigger_logic.pwq_type = PWQ_LESS_THAN;
+	} else if(sscanf(strw, ">%u", &lower) == 1) {
+		trigger_logic.pwq_type = PWQ_GREATER_THAN;
+	} else if(sscanf(strw, "!%u:%u", &lower, &upper) == 2 && lower < upper) {
+		trigger_logic.pwq_type = PWQ_OUT_OF_RANGE;
+	} else if(sscanf(strw, "%u:%u", &lower, &upper) == 2 && lower < upper) {
+		trigger_logic.pwq_type = PWQ_IN_RANGE;
+	} else {
+		throw "--pwq <condition> <width>: the width is <N, >N, N:M or !N:M (in samples)";
+	}
+	trigger_logic.pwq_lower = lower;
+	trigger_logic.pwq_upper = trigger_logic.pwq_type == PWQ_IN_RANGE || trigger_logic.pwq_type == PWQ_OUT_OF_RANGE ? upper : 0;
+}
+
 void Args::ParseAndSetTrigger(char *strx, char *stry)
 {
 	is_triggered = true;
 	x_frac = atof(strx);
-	y_frac = atof(stry);
+	is_trigger_in_volts = false;
+	is_auto_trigger = false;
+	is_trigger_logic = false;
 
 	if(x_frac < 0 || x_frac > 1) {
 		throw "--trigger <xfrac> <yfrac>: xfrac has to be between 0 and 1";
 	}
+	// the level is chosen later; the sign is the direction
+	if(strcmp(stry, "auto") == 0 || strcmp(stry, "+auto") == 0 || strcmp(stry, "-auto") == 0) {
+		is_auto_trigger = true;
+		auto_trigger    = auto_trigger_options();
+		y_frac = stry[0] == '-' ? -0.0001 : 0.0001;
+		return;
+	}
+	// conditions on channels
+	if(stry[0] >= 'A' && stry[0] <= 'D') {
+		is_trigger_logic = true;
+		ParseTriggerExpression(stry, trigger_logic);
+		y_frac = 0.0;
+		return;
+	}
+	// an absolute level: the fraction of the range is only known when the range is
+	if(ParseTriggerLevel(stry, y_volts)) {
+		is_trigger_in_volts = true;
+		y_frac = 0.0;
+		return;
+	}
+	y_frac = atof(stry);
 	if(y_frac < -1 || y_frac > 1) {
 		throw "--trigger <xfrac> <yfrac>: yfrac has to be between -1 and 1";
 	}
@@ -398,7 +1026,54 @@ void Args::ParseAndSetTrigger(char *strx, char *stry)
 
 Trigger* Args::GetTrigger(Channel *ch)
 {
-	Trigger *tr = new Trigger(ch,GetTriggerXFraction(), GetTriggerYFraction());
+	double y = GetTriggerYFraction();
+
+	if(is_trigger_in_volts) {
+		y = y_volts/ch->GetVoltageInVolts();
+		if(y < -1 || y > 1) {
+			fprintf(stderr, "The level of the trigger (%g V) is outside the range of channel %c (%g V).\n", y_volts, 'A'+ch->GetIndex(), ch->GetVoltageInVolts());
+			throw "--trigger <xfrac> <level>: the level is outside the range of the channel";
+		}
+	}
+	if(!is_trigger_logic && trigger_logic.pwq_type == PWQ_NONE && trigger_logic.delay == 0) {
+		Trigger *tr = new Trigger(ch, GetTriggerXFraction(), y);
+		return tr;
+	}
+
+	Measurement *m = ch->GetMeasurement();
+	TriggerLogic logic = trigger_logic;
+	size_t t, c;
+
+	if(!is_trigger_logic) {
+		TriggerCondition cond;
+		cond.channel = ch->GetIndex();
+		cond.type    = (y > 0) ? TRIGGER_RISING : TRIGGER_FALLING;
+		cond.level   = y;
+		logic.terms.assign(1, std::vector<TriggerCondition>(1, cond));
+		// the level is only known after the noise has been measured
+		if(is_auto_trigger && logic.pwq_type != PWQ_NONE && logic.pwq.channel == cond.channel) {
+			logic.pwq = cond;
+		}
+	}
+	// the levels in volts as fractions of the ranges of their channels
+	for(t=0; t<=logic.terms.size(); t++) {
+		size_t n = t < logic.terms.size() ? logic.terms[t].size() : (logic.pwq_type != PWQ_NONE ? 1 : 0);
+		for(c=0; c<n; c++) {
+			TriggerCondition &cond = t < logic.terms.size() ? logic.terms[t][c] : logic.pwq;
+			if(cond.is_volts) {
+				double u = m->GetChannel(cond.channel)->GetVoltageInVolts();
+				if(fabs(cond.level) > u || fabs(cond.lower) > u) {
+					fprintf(stderr, "A level of the trigger (%g V) is outside the range of channel %c (%g V).\n",
+						fabs(cond.level) > u ? cond.level : cond.lower, 'A'+cond.channel, u);
+					throw "--trigger: a level is outside the range of its channel";
+				}
+				cond.level   /= u;
+				cond.lower   /= u;
+				cond.is_volts = false;
+			}
+		}
+	}
+	Trigger *tr = new Trigger(m->GetChannel(logic.terms[0][0].channel), GetTriggerXFraction(), logic);
 	return tr;
 }
 
@@ -422,15 +1097,15 @@ void Args::ParseAndSetSquareSignalGenerator(char *str_voltage, char *str_freq)
 		peak_to_peak_in_microvolts = (unsigned long)round(voltage*1e3);
 	} else {
 		std::cerr << "Invalid unit for voltage (" << unit << "). Use \"V\" or \"mV\".\n";
-		throw;
+		throw "invalid unit for voltage of signal generator";
 	}
 	if(frequency < PS6000_MIN_FREQUENCY) {
 		std::cerr << "Frequency for signal generator too low. It should be at least " << PS6000_MIN_FREQUENCY << " Hz.\n";
-		throw;
+		throw "frequency for signal generator too low";
 	}
 	if(frequency > PS6000_SQUARE_MAX_FREQUENCY) {
 		std::cerr << "Frequency for signal generator too high. It should be at most " << PS6000_SQUARE_MAX_FREQUENCY << " Hz.\n";
-		throw;
+		throw "frequency for signal generator too high";
 	}
 
 	GetMeasurement()->AddSignalGeneratorSquare(peak_to_peak_in_microvolts, (float)frequency);
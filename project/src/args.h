@@ -5,8 +5,18 @@
 #include "measurement.h"
 #include "channel.h"
 #include "trigger.h"
+#include "analysis/pulse-timing.h"
+#include "analysis/peaks.h"
+#include "analysis/baseline.h"
+#include "analysis/filters.h"
+#include "analysis/coincidence.h"
+#include "analysis/zero-suppress.h"
+#include "analysis/veto.h"
+#include "analysis/auto-range.h"
+#include "analysis/auto-trigger.h"
 
 #include <cstddef>
+#include <vector>
 
 class Args;
 
@@ -22,12 +32,37 @@ enum PICO_args {
 	PICO_ARG_LENGTH,   // --length | --l
 	PICO_ARG_NTRACES,  // --n
 	PICO_ARG_NREPEATS, // --repeat <number of repeats>
+	PICO_ARG_EVENTS,   // --events <number>
+	PICO_ARG_DURATION, // --duration <time>
 	PICO_ARG_CHANNEL,  // --ch
 	PICO_ARG_FILENAME, // --name
 	PICO_ARG_VOLTAGE,  // --voltage | --U
 	PICO_ARG_RATE,     // --dt
 	PICO_ARG_TRIGGER,  // --trigger | --trig
+	PICO_ARG_PWQ,      // --pwq <condition> <width>
+	PICO_ARG_TRIGGER_DELAY, // --trig-delay <samples>
+	PICO_ARG_ETS,      // --ets <cycles> <interleave>
 	PICO_ARG_SIGNAL_SQUARE, // --square
+	PICO_ARG_DAEMON,   // --daemon <socket>
+	PICO_ARG_SOCKET,   // --socket <socket>
+	PICO_ARG_JOBS,     // --jobs <file>
+	PICO_ARG_CPU,      // --cpu <cpu>
+	PICO_ARG_WRITER_CPU, // --writer-cpu <cpu>[,<cpu>...]
+	PICO_ARG_RT,       // --rt <priority>
+	PICO_ARG_PSD,      // --psd <dt1> <length>
+	PICO_ARG_KEEP_RAW, // --keep-raw <n>
+	PICO_ARG_HIST,     // --hist <bins> <integral1 max> <integral2 max>
+	PICO_ARG_HIST_ONLY, // --hist-only
+	PICO_ARG_TIMING,   // --timing <cfd|le> <fraction|level>
+	PICO_ARG_CUBIC,    // --cubic
+	PICO_ARG_PEAKS,    // --peaks <threshold>
+	PICO_ARG_BASELINE, // --baseline <mean|median|running>
+	PICO_ARG_SUBTRACT_BASELINE, // --subtract-baseline
+	PICO_ARG_SHAPER,   // --shaper <ma|fir|trap|crrc> <parameters>
+	PICO_ARG_COINCIDENCE, // --coincidence <window ns> <multiplicity>
+	PICO_ARG_AVERAGE,  // --average [rms]
+	PICO_ARG_ZERO_SUPPRESS, // --zs <level> <hysteresis> <pre> <post>
+	PICO_ARG_VETO,     // --veto <height|area|rise> <min> <max> | --veto tot <level> <min> <max>
 	PICO_ARG_OTHER,
 	PICO_ARG_UNKNOWN,
 	PICO_NOT_ARG
@@ -43,6 +78,8 @@ static struct gen_table PICO_arguments[] = {
 	{ "length",  PICO_ARG_LENGTH   },
 	{ "n",       PICO_ARG_NTRACES  }, // --n <number of traces>
 	{ "repeat",  PICO_ARG_NREPEATS }, // --repeat <number of repeats>
+	{ "events",  PICO_ARG_EVENTS   }, // --events <number>
+	{ "duration", PICO_ARG_DURATION }, // --duration <time>
 	{ "ch",      PICO_ARG_CHANNEL  },
 	{ "channel", PICO_ARG_CHANNEL  },
 	{ "U",       PICO_ARG_VOLTAGE  }, // --U <XmV>
@@ -50,8 +87,31 @@ static struct gen_table PICO_arguments[] = {
 	{ "dt",      PICO_ARG_RATE     }, // --dt <number>ns | <nuber>ps | <number>MHz <number>GHz
 	{ "trigger", PICO_ARG_TRIGGER  }, // --trigger <xfrac> <yfrac>
 	{ "trig",    PICO_ARG_TRIGGER  },
+	{ "pwq",     PICO_ARG_PWQ      }, // --pwq <condition> <width>
+	{ "trig-delay", PICO_ARG_TRIGGER_DELAY }, // --trig-delay <samples>
+	{ "ets",     PICO_ARG_ETS      }, // --ets <cycles> <interleave>
 	{ "name",    PICO_ARG_FILENAME },
 	{ "square",  PICO_ARG_SIGNAL_SQUARE}, // --square <XmV> <Xns>
+	{ "daemon",  PICO_ARG_DAEMON   }, // --daemon <socket>
+	{ "socket",  PICO_ARG_SOCKET   }, // --socket <socket>
+	{ "jobs",    PICO_ARG_JOBS     }, // --jobs <file>
+	{ "cpu",     PICO_ARG_CPU      }, // --cpu <cpu>
+	{ "writer-cpu", PICO_ARG_WRITER_CPU }, // --writer-cpu <cpu>[,<cpu>...]
+	{ "rt",      PICO_ARG_RT       }, // --rt <priority>
+	{ "psd",     PICO_ARG_PSD      }, // --psd <dt1> <length>
+	{ "keep-raw", PICO_ARG_KEEP_RAW }, // --keep-raw <n>
+	{ "hist",    PICO_ARG_HIST     }, // --hist <bins> <integral1 max> <integral2 max>
+	{ "hist-only", PICO_ARG_HIST_ONLY }, // --hist-only
+	{ "timing",  PICO_ARG_TIMING   }, // --timing <cfd|le> <fraction|level>
+	{ "cubic",   PICO_ARG_CUBIC    }, // --cubic
+	{ "peaks",   PICO_ARG_PEAKS    }, // --peaks <threshold>
+	{ "baseline", PICO_ARG_BASELINE }, // --baseline <mean|median|running>
+	{ "subtract-baseline", PICO_ARG_SUBTRACT_BASELINE }, // --subtract-baseline
+	{ "shaper",  PICO_ARG_SHAPER   }, // --shaper <ma|fir|trap|crrc> <parameters>
+	{ "coincidence", PICO_ARG_COINCIDENCE }, // --coincidence <window ns> <multiplicity>
+	{ "average", PICO_ARG_AVERAGE  }, // --average [rms]
+	{ "zs",      PICO_ARG_ZERO_SUPPRESS }, // --zs <level> <hysteresis> <pre> <post>
+	{ "veto",    PICO_ARG_VETO     }, // --veto <height|area|rise> <min> <max> | --veto tot <level> <min> <max>
 	{ NULL,      PICO_ARG_OTHER    }
 };
 
@@ -100,6 +160,9 @@ public:
 	void SetVoltage(PICO_VOLTAGE v) { voltage = v; };
 	PICO_VOLTAGE GetVoltage() const { return voltage; };
 	double GetVoltageDouble();
+	// --U auto: the range of every channel is chosen from a short capture before the run
+	bool IsAutoRange() const { return is_auto_range; };
+	const auto_range_options& GetAutoRangeOptions() const { return auto_range; };
 
 	void ParseAndSetRate(char *);
 
@@ -109,13 +172,33 @@ public:
 
 	void ParseAndSetNTraces(char *);
 	unsigned long GetNTraces() const { return ntraces; };
+	// --n max: the planner chooses the number of traces (GetNTraces() is only bigger than 1 until then)
+	bool IsMaxTraces() const { return is_max_traces; };
 
 	void ParseAndSetNRepeats(char *);
 	unsigned long GetNRepeats() const { return nrepeats; };
 
+	// --events and --duration: rapid block captures are repeated until the target is reached (0: no target)
+	void ParseAndSetTargetEvents(char *);
+	void ParseAndSetTargetDuration(char *);
+	bool          IsTargetDriven()   const { return target_events > 0 || target_seconds > 0; };
+	uint64_t      GetTargetEvents()  const { return target_events; };
+	double        GetTargetSeconds() const { return target_seconds; };
+
 	bool IsTriggered() const { return is_triggered; };
 	void ParseAndSetTrigger(char *, char *);
+	// the level of the trigger is a fraction of the range of the channel, or converted to one when it is given in volts;
+	// with a logic expression (or a pulse width qualifier or a delay) the channels of the expression are used instead of ch
 	Trigger* GetTrigger(Channel *ch);
+	void ParseAndSetPulseWidthQualifier(char *, char *);
+	// --trig <x> auto|-auto: the level and the hysteresis are chosen from the noise before the run
+	// (until then GetTrigger() only has the direction)
+	bool IsAutoTrigger() const { return is_auto_trigger; };
+	const auto_trigger_options& GetAutoTriggerOptions() const { return auto_trigger; };
+	// equivalent-time sampling of a single triggered trace (the limits of the series are checked by the measurement)
+	bool         IsEts()            const { return ets_interleave > 0; };
+	unsigned int GetEtsCycles()     const { return ets_cycles; };
+	unsigned int GetEtsInterleave() const { return ets_interleave; };
 
 	void ParseAndSetSquareSignalGenerator(char *, char *);
 
@@ -126,17 +209,112 @@ public:
 	bool IsTextOutput() const { return is_text_output; };
 	bool IsBinaryOutput() const { return is_binary_output; };
 
+	// keep picoscope open and accept jobs on a unix socket
+	bool  IsDaemon()      const { return daemon_socket != NULL; };
+	char* GetDaemonSocket() const { return daemon_socket; };
+	// send the job to a daemon instead of running it
+	bool  IsClient()      const { return client_socket != NULL; };
+	char* GetClientSocket() const { return client_socket; };
+	// run all the measurements from a job file
+	bool  IsJobFile()     const { return job_file != NULL; };
+	char* GetJobFile()    const { return job_file; };
+
+	// CPU for the acquisition thread (-1 if not pinned) and its SCHED_FIFO priority (0 if not used)
+	int   GetCpu()        const { return cpu; };
+	int   GetRtPriority() const { return rt_priority; };
+	// CPUs for the threads that write the channels to files (empty: written by the acquisition thread)
+	const std::vector<int>& GetWriterCpus() const { return writer_cpus; };
+	void  ParseAndSetWriterCpus(char *);
+
+	// n-gamma features are calculated during the acquisition instead of writing raw traces
+	bool          IsPsd()        const { return is_psd; };
+	unsigned int  GetPsdDt1()    const { return psd_dt1; };
+	unsigned int  GetPsdLength() const { return psd_length; };
+	// every n-th raw trace is still written in online mode (0: none)
+	unsigned long GetKeepRaw()   const { return keep_raw; };
+	// histograms of the n-gamma features in online mode (0 bins: none)
+	unsigned int  GetHistBins()  const { return hist_bins; };
+	double        GetHistIntegral1Max() const { return hist_integral1_max; };
+	double        GetHistIntegral2Max() const { return hist_integral2_max; };
+	// only the histograms are written, not the features of every trace
+	bool          IsHistOnly()   const { return is_hist_only; };
+	// sub-sample timing of the pulses in online mode
+	bool          IsTiming()     const { return is_timing; };
+	const timing_options& GetTimingOptions() const { return timing; };
+	// every pulse of a trace (pile-up) in online mode
+	bool          IsPeaks()      const { return is_peaks; };
+	const peak_options& GetPeakOptions() const { return peaks; };
+	// baseline of every trace from the pre-trigger samples in online mode
+	bool          IsBaseline()   const { return is_baseline; };
+	// subtracted from the traces before any other analysis (otherwise only the n-gamma features are corrected)
+	bool          IsBaselineSubtracted() const { return is_baseline_subtracted; };
+	baseline_method GetBaselineMethod() const { return baseline; };
+	// pulse shaping: the amplitude of every triggered trace in online mode, the shaped signal of a single long trace
+	bool          IsShaper()     const { return shaper.type != SHAPER_NONE; };
+	const shaper_options& GetShaperOptions() const { return shaper; };
+	void          ParseAndSetShaper(int argc, char **argv, int &i);
+	// events from the timestamps of several channels in online mode (needs --timing)
+	bool          IsCoincidence() const { return is_coincidence; };
+	const coincidence_options& GetCoincidenceOptions() const { return coincidence; };
+	// average of all triggered traces (and their rms) instead of the traces
+	bool          IsAverage()    const { return is_average; };
+	bool          IsAverageRms() const { return is_average_rms; };
+	// only windows around the pulses of a single long capture are written (level in units of 8-bit samples for 6000 series)
+	bool          IsZeroSuppressed() const { return is_zero_suppressed; };
+	const zero_suppress_options& GetZeroSuppressOptions() const { return zero_suppress; };
+	// cuts on the traces of a rapid-block run (in units of 8-bit samples for 6000 series); the others are dropped
+	bool          IsVeto()       const { return veto.any(); };
+	const veto_options& GetVetoOptions() const { return veto; };
+	void          ParseAndSetVeto(int argc, char **argv, int &i);
+	// any kind of analysis during the acquisition
+	bool          IsOnline()     const { return is_psd || is_timing || is_peaks || is_baseline || is_average || (IsShaper() && ntraces > 1); };
+
 private:
 	Measurement *measurement;
 	char *filename, *filename_binary[5], *filename_text[5], *filename_meta;
 	unsigned long length;
 	unsigned long ntraces;
+	bool is_max_traces;
 	unsigned long nrepeats;
+	uint64_t target_events;
+	double target_seconds;
 	PICO_VOLTAGE voltage;
+	bool is_auto_range;
+	auto_range_options auto_range;
 	bool is_triggered;
 	double x_frac, y_frac;
+	bool is_trigger_in_volts;
+	double y_volts;
+	bool is_auto_trigger;
+	auto_trigger_options auto_trigger;
+	// --trig <x> "<expression>", --pwq and --trig-delay (the levels may still be in volts)
+	bool is_trigger_logic;
+	TriggerLogic trigger_logic;
+	unsigned int ets_cycles, ets_interleave;
 	bool is_just_help;
 	bool is_binary_output, is_text_output;
+	char *daemon_socket, *client_socket, *job_file;
+	int cpu, rt_priority;
+	std::vector<int> writer_cpus;
+	bool is_psd;
+	unsigned int psd_dt1, psd_length;
+	unsigned long keep_raw;
+	unsigned int hist_bins;
+	double hist_integral1_max, hist_integral2_max;
+	bool is_hist_only;
+	bool is_timing;
+	timing_options timing;
+	bool is_peaks;
+	peak_options peaks;
+	bool is_baseline, is_baseline_subtracted;
+	baseline_method baseline;
+	shaper_options shaper;
+	bool is_coincidence;
+	coincidence_options coincidence;
+	bool is_average, is_average_rms;
+	bool is_zero_suppressed;
+	veto_options veto;
+	zero_suppress_options zero_suppress;
 	// bool channel_enabled[PICOSCOPE_N_CHANNELS];
 
 	PICO_VOLTAGE generator_voltage;
@@ -16,7 +16,9 @@ Channel::Channel(int i, Measurement* m)
 
 	index = i;
 	measurement = m;
-	Disable();
+	is_enabled = false;
+	is_dirty = true;
+	voltage = 0;
 	// if nothing else is set, make sure that at least some voltage is there ..., that is the maximum
 	SetVoltage(U_MAX);
 }
@@ -31,6 +33,8 @@ short        Channel::GetHandle()      const { return GetPicoscope()->GetHandle(
 
 void Channel::SetVoltage(PICO_VOLTAGE u)
 {
+	unsigned int voltage_old = voltage;
+
 	// 6000
 	if(GetSeries() == PICO_6000) {
 		switch(u) {
@@ -66,6 +70,9 @@ void Channel::SetVoltage(PICO_VOLTAGE u)
 			default      : throw("unknown voltage setting; should not happen"); break;
 		}
 	}
+	if(voltage != voltage_old) {
+		is_dirty = true;
+	}
 }
 
 double Channel::GetVoltageInVolts()
@@ -132,6 +139,7 @@ void Channel::SetChannelInPicoscope()
 		std::cerr << "Unable to setup the channel " << (char)('A'+GetIndex()) << std::endl;
 		throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
 	}
+	is_dirty = false;
 }
 
 
@@ -14,8 +14,8 @@ public:
 	Channel(int, Measurement*);
 	~Channel();
 
-	void Enable()           { is_enabled = true;  }
-	void Disable()          { is_enabled = false; }
+	void Enable()           { if(!is_enabled) { is_enabled = true;  is_dirty = true; } }
+	void Disable()          { if(is_enabled)  { is_enabled = false; is_dirty = true; } }
 	bool IsEnabled() const  { return is_enabled;  }
 	void SetVoltage(PICO_VOLTAGE);
 	unsigned int GetVoltage() const { return voltage; } // has to be cast to (PS4000_RANGE/PS6000_RANGE)
@@ -33,11 +33,15 @@ public:
 	short        GetHandle()      const;
 
 	void SetChannelInPicoscope(); // passes the data to picoscope
+	// true if settings have changed since they were last passed to picoscope
+	bool IsDirty() const    { return is_dirty; }
+	void SetDirty()         { is_dirty = true; }
 private:
 	Measurement* measurement; // to be able to access the variables and functions of parent measurement ...
 	int index; // A, B, C, D
 
 	bool is_enabled;
+	bool is_dirty;
 	unsigned int voltage;
 };
 
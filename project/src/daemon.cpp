@@ -0,0 +1,414 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "picoscope.h"
+#include "measurement.h"
+#include "args.h"
+#include "acquisition.h"
+#include "daemon.h"
+
+#include "log.h"
+
+#ifdef _WIN32
+
+Daemon::Daemon(Picoscope *p, Measurement *m, const char *path)
+{
+	throw "Daemon mode is not available on Windows.";
+}
+
+Daemon::~Daemon() {}
+void Daemon::Run() {}
+
+int Daemon::Submit(const char *path, int argc, char **argv)
+{
+	throw "Daemon mode is not available on Windows.";
+}
+
+#else
+
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+
+// there is only a single daemon per process, so the synchronisation lives here
+static std::mutex              jobs_mutex;
+static std::condition_variable jobs_available;
+static volatile sig_atomic_t   daemon_stop = 0;
+// set before the listener is started and only read afterwards, so both threads may use it
+static std::chrono::steady_clock::time_point daemon_epoch;
+// a client that doesn't send its job within this time is dropped
+static const double            daemon_read_timeout = 5.0;
+
+static void daemon_signal_handler(int)
+{
+	daemon_stop = 1;
+}
+
+// seconds since the daemon has been started
+static double daemon_time()
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - daemon_epoch;
+	return elapsed.count();
+}
+
+static bool fill_socket_address(struct sockaddr_un *addr, const char *path)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if(strlen(path) >= sizeof(addr->sun_path)) {
+		return false;
+	}
+	strcpy(addr->sun_path, path);
+	return true;
+}
+
+Daemon::Daemon(Picoscope *p, Measurement *m, const char *path)
+{
+	FILE_LOG(logDEBUG3) << "Daemon::Daemon (Picoscope=" << p << ", Measurement=" << m << ", socket=" << path << ")";
+
+	picoscope     = p;
+	measurement   = m;
+	socket_path   = path;
+	listen_fd     = -1;
+	jobs_received = 0;
+	jobs_done     = 0;
+	jobs_failed   = 0;
+	latency_total = 0.0;
+	latency_max   = 0.0;
+}
+
+Daemon::~Daemon()
+{
+	FILE_LOG(logDEBUG3) << "Daemon::~Daemon";
+
+	if(listen_fd >= 0) {
+		close(listen_fd);
+		unlink(socket_path.c_str());
+	}
+}
+
+void Daemon::Reply(int fd, const char *format, ...)
+{
+	char line[1000];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	// the client may already be gone; that must not stop the daemon
+	if(send(fd, line, strlen(line), MSG_NOSIGNAL) < 0) {
+		FILE_LOG(logWARNING) << "Daemon::Reply - unable to send status to client (" << strerror(errno) << ")";
+	}
+}
+
+void Daemon::Listen()
+{
+	FILE_LOG(logDEBUG3) << "Daemon::Listen";
+
+	struct sockaddr_un addr;
+	int fd;
+
+	if(!fill_socket_address(&addr, socket_path.c_str())) {
+		throw "The name of the socket is too long.";
+	}
+	// remove a socket that has been left behind by a daemon that is no longer running
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+		close(fd);
+		throw "Another daemon is already listening on this socket.";
+	}
+	if(fd >= 0) {
+		close(fd);
+	}
+	unlink(socket_path.c_str());
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listen_fd < 0) {
+		throw "Unable to create socket.";
+	}
+	if(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(listen_fd);
+		listen_fd = -1;
+		throw "Unable to bind socket.";
+	}
+	if(listen(listen_fd, 64) != 0) {
+		throw "Unable to listen on socket.";
+	}
+	std::cerr << "-- Waiting for jobs on " << socket_path << "\n";
+}
+
+// '\0'-terminated strings up to an empty one
+int Daemon::ParseJob(const std::string &data, DaemonJob &job)
+{
+	std::vector<std::string> fields;
+	size_t start = 0, end;
+
+	while((end = data.find('\0', start)) != std::string::npos) {
+		if(end == start) {
+			if(fields.size() < 1) {
+				return -1;
+			}
+			job.directory = fields[0];
+			job.arguments.assign(fields.begin()+1, fields.end());
+			return 1;
+		}
+		fields.push_back(data.substr(start, end-start));
+		start = end+1;
+	}
+	return 0;
+}
+
+// runs in a separate thread, so that jobs can be queued while picoscope is busy;
+// the jobs of all the clients are read at the same time, so a slow client doesn't hold up the others
+void Daemon::AcceptJobs()
+{
+	FILE_LOG(logDEBUG3) << "Daemon::AcceptJobs";
+
+	struct Client {
+		int         fd;
+		double      time_accepted;
+		std::string data;
+	};
+	std::vector<Client> clients;
+	std::vector<struct pollfd> pfd;
+	char buffer[4096];
+	DaemonJob job;
+	size_t position, i;
+	ssize_t n;
+	int fd, status;
+
+	while(!daemon_stop) {
+		pfd.resize(clients.size()+1);
+		pfd[0].fd     = listen_fd;
+		pfd[0].events = POLLIN;
+		for(i=0; i<clients.size(); i++) {
+			pfd[i+1].fd     = clients[i].fd;
+			pfd[i+1].events = POLLIN;
+		}
+		if(poll(&pfd[0], pfd.size(), 200) < 0) {
+			continue;
+		}
+		// clients are read (and dropped) from the back, so that the indices of pfd stay valid
+		for(i=clients.size(); i-- > 0; ) {
+			status = 0;
+			if(pfd[i+1].revents != 0) {
+				n = recv(clients[i].fd, buffer, sizeof(buffer), 0);
+				if(n > 0) {
+					clients[i].data.append(buffer, n);
+					status = ParseJob(clients[i].data, job);
+				} else if(!(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))) {
+					status = -1;
+				}
+			}
+			// a client that doesn't send anything must not be kept forever
+			if(status == 0 && daemon_time() - clients[i].time_accepted > daemon_read_timeout) {
+				status = -1;
+			}
+			if(status == 0) {
+				continue;
+			}
+			fd = clients[i].fd;
+			if(status < 0) {
+				Reply(fd, "failed - unable to read the job\n");
+				close(fd);
+			} else {
+				// the replies of the job are written normally
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+				job.fd            = fd;
+				job.time_received = clients[i].time_accepted;
+				{
+					std::lock_guard<std::mutex> lock(jobs_mutex);
+					job.number = ++jobs_received;
+					jobs.push_back(job);
+					position = jobs.size();
+				}
+				FILE_LOG(logDEBUG4) << "Daemon::AcceptJobs - job #" << job.number << " queued at position " << position;
+				Reply(fd, "queued %lu %lu\n", job.number, (unsigned long)position);
+				jobs_available.notify_one();
+			}
+			clients.erase(clients.begin()+i);
+		}
+		if(pfd[0].revents & POLLIN) {
+			fd = accept(listen_fd, NULL, NULL);
+			if(fd >= 0) {
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+				Client c;
+				c.fd            = fd;
+				c.time_accepted = daemon_time();
+				clients.push_back(c);
+			}
+		}
+	}
+	for(i=0; i<clients.size(); i++) {
+		Reply(clients[i].fd, "failed - daemon has been stopped\n");
+		close(clients[i].fd);
+	}
+	jobs_available.notify_one();
+}
+
+void Daemon::RunJob(DaemonJob &job)
+{
+	FILE_LOG(logDEBUG3) << "Daemon::RunJob (job=" << job.number << ")";
+
+	std::vector<char*> argv;
+	const char *error = NULL;
+	double time_started, time_finished;
+	size_t i;
+
+	time_started = daemon_time();
+	Reply(job.fd, "started %lu %.6f\n", job.number, time_started-job.time_received);
+	std::cerr << "\n-- Job #" << job.number << " (waited " << time_started-job.time_received << "s)\n";
+
+	argv.push_back((char *)"run_picoscope");
+	for(i=0; i<job.arguments.size(); i++) {
+		argv.push_back(&job.arguments[i][0]);
+	}
+	argv.push_back(NULL);
+
+	// relative filenames refer to the working directory of the client
+	if(chdir(job.directory.c_str()) != 0) {
+		error = "Unable to change to the working directory of the client.";
+	} else {
+		Args x;
+		error = Acquisition::RunJob(measurement, x, (int)argv.size()-1, &argv[0]);
+	}
+
+	time_finished = daemon_time();
+	latency_total += time_finished-job.time_received;
+	if(time_finished-job.time_received > latency_max) {
+		latency_max = time_finished-job.time_received;
+	}
+	if(error == NULL) {
+		jobs_done++;
+		Reply(job.fd, "done %lu %.6f %.6f\n", job.number, time_finished-job.time_received, time_finished-time_started);
+		std::cerr << "-- Job #" << job.number << " done: latency " << time_finished-job.time_received
+		          << "s, acquisition " << time_finished-time_started << "s\n";
+	} else {
+		jobs_failed++;
+		Reply(job.fd, "failed %lu %s\n", job.number, error);
+		std::cerr << "-- Job #" << job.number << " failed: " << error << "\n";
+	}
+	close(job.fd);
+}
+
+void Daemon::Run()
+{
+	FILE_LOG(logDEBUG3) << "Daemon::Run";
+
+	DaemonJob job;
+	bool have_job;
+
+	daemon_epoch = std::chrono::steady_clock::now();
+	daemon_stop = 0;
+	signal(SIGINT,  daemon_signal_handler);
+	signal(SIGTERM, daemon_signal_handler);
+
+	Listen();
+	std::thread listener(&Daemon::AcceptJobs, this);
+
+	while(!daemon_stop) {
+		{
+			std::unique_lock<std::mutex> lock(jobs_mutex);
+			if(jobs.empty()) {
+				jobs_available.wait_for(lock, std::chrono::milliseconds(200));
+			}
+			have_job = !jobs.empty();
+			if(have_job) {
+				job = jobs.front();
+				jobs.pop_front();
+			}
+		}
+		if(have_job) {
+			RunJob(job);
+		}
+	}
+	listener.join();
+
+	// jobs that were never started
+	while(!jobs.empty()) {
+		Reply(jobs.front().fd, "failed %lu daemon has been stopped\n", jobs.front().number);
+		close(jobs.front().fd);
+		jobs.pop_front();
+	}
+	std::cerr << "\n-- Daemon stopped after " << jobs_done+jobs_failed << " jobs (" << jobs_failed << " failed)";
+	if(jobs_done+jobs_failed > 0) {
+		std::cerr << ", mean latency " << latency_total/(jobs_done+jobs_failed)
+		          << "s, max latency " << latency_max << "s";
+	}
+	std::cerr << "\n";
+}
+
+int Daemon::Submit(const char *path, int argc, char **argv)
+{
+	FILE_LOG(logDEBUG3) << "Daemon::Submit (socket=" << path << ")";
+
+	struct sockaddr_un addr;
+	std::string job, line;
+	char cwd[4096], buffer[1000];
+	bool success = false;
+	ssize_t n, i;
+	int fd, k;
+
+	if(!fill_socket_address(&addr, path)) {
+		throw "The name of the socket is too long.";
+	}
+	if(getcwd(cwd, sizeof(cwd)) == NULL) {
+		throw "Unable to determine the working directory.";
+	}
+	// working directory, arguments (without --socket <socket>) and an empty string at the end
+	job.append(cwd).push_back('\0');
+	for(k=1; k<argc; k++) {
+		if(strcmp(argv[k], "--socket") == 0) {
+			k++;
+			continue;
+		}
+		job.append(argv[k]).push_back('\0');
+	}
+	job.push_back('\0');
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		if(fd >= 0) {
+			close(fd);
+		}
+		std::cerr << "Unable to connect to daemon at " << path << "\n";
+		throw "Unable to connect to daemon.";
+	}
+	if(send(fd, job.data(), job.size(), MSG_NOSIGNAL) != (ssize_t)job.size()) {
+		close(fd);
+		throw "Unable to send the job to daemon.";
+	}
+	// print the status as it arrives
+	while((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+		for(i=0; i<n; i++) {
+			if(buffer[i] != '\n') {
+				line += buffer[i];
+				continue;
+			}
+			std::cerr << "-- " << line << "\n";
+			if(line.compare(0, 5, "done ") == 0) {
+				success = true;
+			}
+			line.clear();
+		}
+	}
+	close(fd);
+
+	return success ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __DAEMON_H__
+#define __DAEMON_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "picoscope.h"
+#include "measurement.h"
+
+/*
+	Keeps picoscope open and runs acquisition jobs received over a unix socket.
+
+	A job consists of the working directory of the client followed by the same
+	arguments that run_picoscope accepts on the command line, each of them
+	terminated with '\0' and the whole job terminated with an empty string.
+	The daemon answers with lines of text:
+		queued <job> <position>
+		started <job> <seconds in queue>
+		done <job> <latency> <seconds of acquisition>
+		failed <job> <message>
+	and closes the connection once the job is finished.
+ */
+
+struct DaemonJob {
+	unsigned long            number;
+	int                      fd;
+	std::string              directory;
+	std::vector<std::string> arguments;
+	double                   time_received;
+};
+
+class Daemon {
+public:
+	Daemon(Picoscope *p, Measurement *m, const char *socket_path);
+	~Daemon();
+
+	// runs until SIGINT or SIGTERM is received
+	void Run();
+
+	// sends a job to a running daemon and prints the status; returns 0 on success
+	static int Submit(const char *socket_path, int argc, char **argv);
+
+private:
+	Picoscope   *picoscope;
+	Measurement *measurement;
+	std::string  socket_path;
+	int          listen_fd;
+
+	std::deque<DaemonJob> jobs;
+	unsigned long jobs_received, jobs_done, jobs_failed;
+	double        latency_total, latency_max;
+
+	void Listen();
+	void AcceptJobs();
+	// a job from the bytes that a client has sent so far: 1 when it is complete, 0 when more is needed, -1 if it is invalid
+	static int ParseJob(const std::string &data, DaemonJob &job);
+	void RunJob(DaemonJob &job);
+
+	static void Reply(int fd, const char *format, ...);
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "picoscope.h"
+#include "measurement.h"
+#include "channel.h"
+#include "args.h"
+#include "acquisition.h"
+#include "jobfile.h"
+
+#include "log.h"
+#include "timing.h"
+
+JobFile::JobFile(const char *name)
+{
+	FILE_LOG(logDEBUG3) << "JobFile::JobFile (filename=" << name << ")";
+
+	filename = name;
+}
+
+// expands a single argument into a list of values
+std::vector<std::string> JobFile::ExpandToken(const std::string &token)
+{
+	std::vector<std::string> values;
+	std::string prefix, suffix, inside;
+	size_t open, close, pos, next;
+	double from, to, step, value;
+	char number[50], rest[2];
+	long k;
+
+	if((open = token.find('{')) != std::string::npos && (close = token.find('}', open)) != std::string::npos) {
+		prefix = token.substr(0, open);
+		suffix = token.substr(close+1);
+		inside = token.substr(open+1, close-open-1);
+		for(pos=0; ; pos=next+1) {
+			next = inside.find(',', pos);
+			values.push_back(prefix + inside.substr(pos, next-pos) + suffix);
+			if(next == std::string::npos) {
+				break;
+			}
+		}
+	} else if((open = token.find('[')) != std::string::npos && (close = token.find(']', open)) != std::string::npos) {
+		prefix = token.substr(0, open);
+		suffix = token.substr(close+1);
+		inside = token.substr(open+1, close-open-1);
+		if(sscanf(inside.c_str(), "%lf:%lf:%lf%1s", &from, &to, &step, rest) != 3) {
+			std::cerr << "Invalid range '" << token << "'; use [from:to:step].\n";
+			throw "invalid range in job file";
+		}
+		if(step == 0 || (to-from)/step < 0) {
+			std::cerr << "The step in range '" << token << "' never reaches the end.\n";
+			throw "invalid range in job file";
+		}
+		// the small tolerance makes sure that the last value is not lost to rounding
+		for(k=0; (value = from+k*step), (step > 0 ? value <= to+fabs(step)*1e-9 : value >= to-fabs(step)*1e-9); k++) {
+			if(fabs(value) < fabs(step)*1e-9) {
+				value = 0.0;
+			}
+			snprintf(number, sizeof(number), "%.10g", value);
+			values.push_back(prefix + number + suffix);
+		}
+	} else {
+		values.push_back(token);
+	}
+	return values;
+}
+
+void JobFile::ExpandLine(const std::vector<std::string> &tokens, unsigned long line)
+{
+	std::vector< std::vector<std::string> > values;
+	std::vector<size_t> index(tokens.size(), 0);
+	unsigned long combinations = 1, n;
+	size_t i;
+	int name_index = -1;
+	bool name_has_sweep = false;
+	char suffix[24];
+
+	for(i=0; i<tokens.size(); i++) {
+		values.push_back(ExpandToken(tokens[i]));
+		combinations *= values[i].size();
+		if(tokens[i] == "--name" && i+1 < tokens.size()) {
+			name_index = i+1;
+		}
+	}
+	if(name_index >= 0 && values[name_index].size() > 1) {
+		name_has_sweep = true;
+	}
+
+	// every combination of values (the last argument changes fastest)
+	for(n=0; n<combinations; n++) {
+		JobFileEntry job;
+		job.line = line;
+		for(i=0; i<tokens.size(); i++) {
+			job.arguments.push_back(values[i][index[i]]);
+		}
+		if(combinations > 1 && name_index >= 0 && !name_has_sweep) {
+			snprintf(suffix, sizeof(suffix), "_%04lu", n+1);
+			job.arguments[name_index] += suffix;
+		}
+		jobs.push_back(job);
+
+		for(i=tokens.size(); i-- > 0; ) {
+			if(++index[i] < values[i].size()) {
+				break;
+			}
+			index[i] = 0;
+		}
+	}
+}
+
+bool JobFile::Tokenize(const std::string &text, std::vector<std::string> &tokens)
+{
+	std::string token;
+	size_t pos;
+	bool quoted = false, in_token = false;
+
+	tokens.clear();
+	for(pos=0; pos<text.size(); pos++) {
+		if(text[pos] == '"') {
+			quoted   = !quoted;
+			in_token = true;
+		} else if(!quoted && isspace((unsigned char)text[pos])) {
+			if(in_token) {
+				tokens.push_back(token);
+				token.clear();
+				in_token = false;
+			}
+		} else {
+			token   += text[pos];
+			in_token = true;
+		}
+	}
+	if(in_token) {
+		tokens.push_back(token);
+	}
+	return !quoted;
+}
+
+void JobFile::Read()
+{
+	FILE_LOG(logDEBUG3) << "JobFile::Read";
+
+	std::ifstream file(filename.c_str());
+	std::string line, text;
+	std::vector<std::string> tokens;
+	unsigned long line_number = 0, first_line = 0;
+	size_t pos;
+	bool continued, quoted;
+
+	if(!file) {
+		std::cerr << "Unable to open job file " << filename << "\n";
+		throw "Unable to open job file.";
+	}
+
+	jobs.clear();
+	while(std::getline(file, line)) {
+		line_number++;
+		if(text.empty()) {
+			first_line = line_number;
+		}
+		// '#' only starts a comment outside of quotes
+		for(pos=0, quoted=false; pos<line.size() && (quoted || line[pos] != '#'); pos++) {
+			if(line[pos] == '"') {
+				quoted = !quoted;
+			}
+		}
+		line.erase(pos);
+		// strip trailing whitespace and check for continuation
+		while(!line.empty() && isspace((unsigned char)line[line.size()-1])) {
+			line.erase(line.size()-1);
+		}
+		continued = !line.empty() && line[line.size()-1] == '\\';
+		if(continued) {
+			line.erase(line.size()-1);
+		}
+		text += line + " ";
+		if(continued) {
+			continue;
+		}
+
+		if(!Tokenize(text, tokens)) {
+			std::cerr << "Unterminated quote in job file " << filename << ", line " << first_line << "\n";
+			throw "Unterminated quote in job file.";
+		}
+		text.clear();
+		if(!tokens.empty()) {
+			ExpandLine(tokens, first_line);
+		}
+	}
+	std::cerr << "-- Job file " << filename << " describes " << jobs.size() << " measurement(s)\n";
+}
+
+unsigned long JobFile::Run(Measurement *m, const char *manifest)
+{
+	FILE_LOG(logDEBUG3) << "JobFile::Run (manifest=" << manifest << ")";
+
+	unsigned long i, failed = 0;
+	size_t k;
+	const char *error;
+	bool written;
+	Timing t, t_total;
+	FILE *f;
+
+	f = fopen(manifest, "wt");
+	if(f == NULL) {
+		throw "Unable to open manifest file.";
+	}
+	fprintf(f, "# job file: %s\n", filename.c_str());
+	fprintf(f, "# job\tline\tstatus\tseconds\tmetadata\tdata\targuments\n");
+	fflush(f);
+
+	t_total.Start();
+	for(i=0; i<jobs.size(); i++) {
+		std::vector<char*> argv;
+		std::vector<std::string> files;
+		Args x;
+
+		argv.push_back((char *)"run_picoscope");
+		for(k=0; k<jobs[i].arguments.size(); k++) {
+			argv.push_back(&jobs[i].arguments[k][0]);
+		}
+		argv.push_back(NULL);
+
+		std::cerr << "\n-- Job " << i+1 << "/" << jobs.size() << " (line " << jobs[i].line << ")\n";
+		t.Start();
+		error = Acquisition::RunJob(m, x, (int)argv.size()-1, &argv[0], &files);
+		t.Stop();
+		if(error != NULL) {
+			failed++;
+			std::cerr << "-- Job " << i+1 << " failed: " << error << "\n";
+		}
+
+		// without a positive length nothing has been measured and no file has been written
+		written = error == NULL && x.GetLength() > 0;
+		fprintf(f, "%lu\t%lu\t%s\t%.3f\t%s\t", i+1, jobs[i].line, error != NULL ? "failed" : (written ? "ok" : "empty"),
+			t.GetSecondsDouble(), written ? x.GetFilenameMeta() : "-");
+		if(error != NULL) {
+			fprintf(f, "%s", error);
+		} else if(!written) {
+			fprintf(f, "-");
+		} else {
+			// the files that the acquisition has actually opened (traces, results of the analysis, index, ...)
+			for(k=0; k<files.size(); k++) {
+				fprintf(f, "%s%s", k ? "," : "", files[k].c_str());
+			}
+			if(files.empty()) {
+				fprintf(f, "-");
+			}
+		}
+		fprintf(f, "\t");
+		// quoted like in the job file, so that the line can be copied back
+		for(k=0; k<jobs[i].arguments.size(); k++) {
+			const std::string &a = jobs[i].arguments[k];
+			bool space = a.empty() || a.find_first_of(" \t") != std::string::npos;
+			fprintf(f, "%s%s%s%s", k ? " " : "", space ? "\"" : "", a.c_str(), space ? "\"" : "");
+		}
+		fprintf(f, "\n");
+		fflush(f);
+	}
+	t_total.Stop();
+	fclose(f);
+
+	std::cerr << "\n-- Finished " << jobs.size() << " job(s) in " << t_total.GetSecondsDouble() << "s";
+	if(failed > 0) {
+		std::cerr << " (" << failed << " failed)";
+	}
+	std::cerr << "; manifest written to " << manifest << "\n";
+
+	return failed;
+}
@@ -0,0 +1,50 @@
+#ifndef __JOBFILE_H__
+#define __JOBFILE_H__
+
+#include <string>
+#include <vector>
+
+#include "measurement.h"
+
+/*
+	A list of measurements that are run one after another on the same open picoscope.
+
+	Every line holds the same options as the command line (a line ending with '\'
+	continues on the next one, '#' starts a comment). Double quotes keep an argument with spaces
+	together, like --trig "A<-20mV & B<-20mV" (the quotes are removed, there is no escaping). An argument may contain
+	a sweep that expands into several measurements:
+		{50mV,100mV,200mV}  - a list of values
+		[400:1600:400]ps    - a range from:to:step (text around the brackets is kept)
+	Every combination of the sweeps of a line becomes a separate measurement;
+	when there is more than one, the index of the combination is appended to --name.
+ */
+
+struct JobFileEntry {
+	unsigned long            line;
+	std::vector<std::string> arguments;
+};
+
+class JobFile {
+public:
+	JobFile(const char *filename);
+	~JobFile() {};
+
+	void Read();
+	unsigned long       GetNumberOfJobs() const { return jobs.size(); };
+	const JobFileEntry& GetJob(unsigned long i) const { return jobs[i]; };
+
+	// runs all the jobs and writes a manifest with an index of all files
+	// returns the number of jobs that failed
+	unsigned long Run(Measurement *m, const char *manifest);
+
+private:
+	std::string               filename;
+	std::vector<JobFileEntry> jobs;
+
+	// splits a line at whitespace outside of double quotes; false if a quote is not closed
+	static bool Tokenize(const std::string &text, std::vector<std::string> &tokens);
+	void ExpandLine(const std::vector<std::string> &tokens, unsigned long line);
+	static std::vector<std::string> ExpandToken(const std::string &token);
+};
+
+#endif
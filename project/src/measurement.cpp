@@ -33,6 +33,10 @@ Measurement::Measurement(Picoscope *p)
 	timebase_reported_by_osciloscope = 0.0;
 	use_signal_generator = false;
 	rate_per_second = 0.0;
+	wait_interval_ms = 200;
+	ets_cycles = ets_interleave = 0;
+	ets_sample_time_ps = 0;
+	ets_reordered = 0;
 
 	for(i=0; i<GetNumberOfChannels(); i++) {
 		// initialize the channels
@@ -41,9 +45,16 @@ Measurement::Measurement(Picoscope *p)
 		data[i] = NULL;
 		data_allocated[i] = false;
 		data_length[i] = 0;
+		cost_channel[i] = 0.0;
 	}
+	configured_handle = PICOSCOPE_HANDLE_UNITIALIZED;
+	cost_timebase = cost_trigger = cost_segments = cost_ets = 0.0;
+	ResetSkippedCalls();
+	InvalidateSettings();
 	// only a temporary setting; this needs to be fixed if more than a single channel is enabled
 	timebase = 0UL;
+	requested_interval_ps = 0UL;
+	run_seconds = 0.0;
 }
 
 Measurement::~Measurement()
@@ -104,6 +115,7 @@ void Measurement::SetTimebaseInPs(unsigned long picoseconds)
 
 	unsigned long i, result;
 
+	requested_interval_ps = picoseconds;
 	if(GetSeries() == PICO_6000) {
 		// it doesn't go beyond a certain minimum level
 		if(picoseconds < 200) {
@@ -220,6 +232,10 @@ void Measurement::SetTimebaseInPicoscope()
 
 	std::cerr << "-- Setting timebase; the interval will be " << time_interval_ns << " ns\n";
 	timebase_reported_by_osciloscope = (double)time_interval_ns;
+
+	timebase_is_set       = true;
+	timebase_in_picoscope = GetTimebase();
+	length_in_picoscope   = GetLength();
 }
 
 void Measurement::SetLength(unsigned long l)
@@ -323,12 +339,11 @@ void Measurement::AllocateMemoryBlock(unsigned long bytes)
 		for(i=0; i<GetNumberOfChannels(); i++) {
 			if(GetChannel(i)->IsEnabled()) {
 				if(data_allocated[i]) {
-					if(data_length[i] == maxlen) {
-						// no need to do anything; data is already allocated and of the proper size
-						// however it is still weird to call this function
-						std::cerr << "Warning: Memory for channel " << (char)('A'+i) << " has already been allocated.\n";
+					if(data_length[i] >= maxlen) {
+						// no need to do anything; the buffer from a previous acquisition is large enough
+						FILE_LOG(logDEBUG4) << "Measurement::AllocateMemory - reusing data[" << i << "] of length " << data_length[i];
 					} else {
-						std::cerr << "Warning: Memory for channel " << (char)('A'+i) << " has already been allocated; changing size.\n";
+						FILE_LOG(logDEBUG4) << "Measurement::AllocateMemory - data[" << i << "] is too small; changing size";
 						delete [] data[i];
 						FILE_LOG(logDEBUG4) << "Measurement::AllocateMemoryBlock - data[" << i << "]" << maxlen;
 						data[i] = new short[maxlen];
@@ -381,12 +396,11 @@ void Measurement::AllocateMemoryRapidBlock(unsigned long bytes)
 		for(i=0; i<GetNumberOfChannels(); i++) {
 			if(GetChannel(i)->IsEnabled()) {
 				if(data_allocated[i]) {
-					if(data_length[i] == maxlen) {
-						// no need to do anything; data is already allocated and of the proper size
-						// however it is still weird to call this function
-						std::cerr << "Warning: Memory for channel " << (char)('A'+i) << " has already been allocated.\n";
+					if(data_length[i] >= maxlen) {
+						// no need to do anything; the buffer from a previous acquisition is large enough
+						FILE_LOG(logDEBUG4) << "Measurement::AllocateMemory - reusing data[" << i << "] of length " << data_length[i];
 					} else {
-						std::cerr << "Warning: Memory for channel " << (char)('A'+i) << " has already been allocated; changing size.\n";
+						FILE_LOG(logDEBUG4) << "Measurement::AllocateMemory - data[" << i << "] is too small; changing size";
 						delete [] data[i];
 						// std::cerr << "allocate channel " << i << " with size" << maxlen << "\n";
 						data[i] = new short[maxlen];
@@ -409,6 +423,24 @@ void Measurement::AllocateMemoryRapidBlock(unsigned long bytes)
 	}
 }
 
+void Measurement::PrefaultMemory()
+{
+	FILE_LOG(logDEBUG3) << "Measurement::PrefaultMemory";
+
+	int i;
+	unsigned long j;
+	// a page has at least 4 kB
+	const unsigned long stride = 4096/sizeof(short);
+
+	for(i=0; i<GetNumberOfChannels(); i++) {
+		if(data_allocated[i]) {
+			for(j=0; j<data_length[i]; j+=stride) {
+				data[i][j] = 0;
+			}
+		}
+	}
+}
+
 int Measurement::GetNumberOfChannels() const
 {
 	// FILE_LOG(logDEBUG3) << "Measurement::GetNumberOfChannels";
@@ -455,84 +487,94 @@ void Measurement::RunBlock()
 	FILE_LOG(logDEBUG3) << "Measurement::RunBlock";
 
 	int i;
-	Timing t;
-	uint32_t max_length=0;
+	bool segments_changed = false;
+	Timing t, t_settings, t_sleep;
 
 	// we will have to start reading our data from beginning again
 	SetNextIndex(0);
+	// a freshly opened picoscope doesn't know about any of our settings
+	if(GetHandle() != configured_handle) {
+		InvalidateSettings();
+		configured_handle = GetHandle();
+	}
+	skipped_calls   = 0;
+	skipped_seconds = 0.0;
 	// test if channel settings have already been passed to picoscope
 	// and only pass them again if that isn't the case
 	FILE_LOG(logDEBUG4) << "Measurement::RunBlock - we have " << GetNumberOfChannels() << " channels";
 	for(i=0; i<GetNumberOfChannels(); i++) {
-		FILE_LOG(logDEBUG4) << "Measurement::RunBlock - setting channel " << (char)('A'+i) << " (which holds index " << GetChannel(i)->GetIndex() << ")";
-		GetChannel(i)->SetChannelInPicoscope();
+		if(GetChannel(i)->IsDirty()) {
+			FILE_LOG(logDEBUG4) << "Measurement::RunBlock - setting channel " << (char)('A'+i) << " (which holds index " << GetChannel(i)->GetIndex() << ")";
+			t_settings.Start();
+			GetChannel(i)->SetChannelInPicoscope();
+			t_settings.Stop();
+			cost_channel[i] = t_settings.GetSecondsDouble();
+		} else {
+			SkipSettings(1, cost_channel[i]);
+		}
+	}
+	// number of segments for rapid block mode (or back to a single one for block mode);
+	// before the timebase, which is checked against the length of a segment
+	if(segments_in_picoscope != GetNTraces()) {
+		t_settings.Start();
+		SetSegmentsInPicoscope();
+		t_settings.Stop();
+		cost_segments = t_settings.GetSecondsDouble();
+		segments_changed = true;
+	} else if(GetNTraces() > 1) {
+		SkipSettings(2, cost_segments);
+	}
+	// the memory of a segment is shared by the enabled channels
+	if(GetNTraces() > 1 && max_length_in_picoscope < GetLength()*GetNumberOfEnabledChannels()) {
+		std::cerr << "The maximum length of trace you can get with " << GetNTraces() << " traces and "
+		          << GetNumberOfEnabledChannels() << " channels is " << max_length_in_picoscope/GetNumberOfEnabledChannels()
+		          << ", but you requested " << GetLength() << "\n";
+		// the next run has to ask picoscope again
+		InvalidateSegments();
+		throw Picoscope::PicoscopeUserException("The traces don't fit into the segments of the memory of picoscope.");
 	}
 	// this fixes the timebase if more than a single channel is selected
 	FixTimebase();
-	// timebase
-	SetTimebaseInPicoscope();
+	// timebase (GetTimebase2 checks the length against the samples of a segment, so new segments need the check again)
+	if(!timebase_is_set || segments_changed || timebase_in_picoscope != GetTimebase() || length_in_picoscope != GetLength()) {
+		t_settings.Start();
+		SetTimebaseInPicoscope();
+		t_settings.Stop();
+		cost_timebase = t_settings.GetSecondsDouble();
+	} else {
+		SkipSettings(1, cost_timebase);
+	}
 	// trigger
 	if(IsTriggered()) {
-		GetTrigger()->SetTriggerInPicoscope();
-	}
-
-	// for rapid block mode
-	if(GetNTraces() > 1) {
-		// TODO - check that GetLength()*GetNumberOfEnabledChannels()*GetNTraces() doesn't exceed the limit
-		if(GetSeries() == PICO_4000) {
-			FILE_LOG(logDEBUG2) << "ps4000SetNoOfCaptures(handle=" << GetHandle() << ", nCaptures=" << GetNTraces() << ")";
-			GetPicoscope()->SetStatus(ps4000SetNoOfCaptures(
-				GetHandle(),    // handle
-				GetNTraces())); // nCaptures
+		if(GetTrigger()->IsDirty() || !trigger_in_picoscope) {
+			t_settings.Start();
+			GetTrigger()->SetTriggerInPicoscope();
+			t_settings.Stop();
+			cost_trigger = t_settings.GetSecondsDouble();
+			trigger_in_picoscope = true;
 		} else {
-			FILE_LOG(logDEBUG2) << "ps6000SetNoOfCaptures(handle=" << GetHandle() << ", nCaptures=" << GetNTraces() << ")";
-			GetPicoscope()->SetStatus(ps6000SetNoOfCaptures(
-				GetHandle(),    // handle
-				GetNTraces())); // nCaptures
+			SkipSettings(5, cost_trigger);
 		}
-		if(GetPicoscope()->GetStatus() != PICO_OK) {
-			std::cerr << "Unable to set number of captures to " << GetNTraces() << std::endl;
-			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
-		}
-		if(GetSeries() == PICO_4000) {
-			FILE_LOG(logDEBUG2) << "ps4000MemorySegments(handle=" << GetHandle() << ", nSegments=" << GetNTraces() << ", &max_length=" << max_length << ")";
-			GetPicoscope()->SetStatus(ps4000MemorySegments(
-				GetHandle(),   // handle
-				GetNTraces(),  // nSegments
-				&max_length));
-			FILE_LOG(logDEBUG2) << "->ps4000MemorySegments(... max_length=" << max_length << ")";
-		} else {
-			FILE_LOG(logDEBUG2) << "ps6000MemorySegments(handle=" << GetHandle() << ", nSegments=" << GetNTraces() << ", &max_length=" << max_length << ")";
-			GetPicoscope()->SetStatus(ps6000MemorySegments(
-				GetHandle(),   // handle
-				GetNTraces(),  // nSegments
-				&max_length));
-			FILE_LOG(logDEBUG2) << "->ps6000MemorySegments(... max_length=" << max_length << ")";
-		}
-		if(GetPicoscope()->GetStatus() != PICO_OK) {
-			std::cerr << "Unable to set number of segments to " << GetNTraces() << std::endl;
-			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
-		}
-		if(max_length < GetLength()) { // TODO: times number of enabled channels
-			std::cerr << "The maximum length of trace you can get with " << GetNTraces()
-			          << " traces is " << max_length << ", but you requested " << GetLength() << "\n";
-			throw;
-		}
-		if(GetSeries() == PICO_4000) {
-			FILE_LOG(logDEBUG2) << "ps4000SetNoOfCaptures(handle=" << GetHandle() << ", nCaptures=" << GetNTraces() << ")";
-			GetPicoscope()->SetStatus(ps4000SetNoOfCaptures(
-				GetHandle(),    // handle
-				GetNTraces())); // nCaptures
+	} else if(trigger_in_picoscope) {
+		ClearTriggerInPicoscope();
+	}
+	// equivalent-time sampling (only of triggered captures, so not during PreCapture)
+	if(IsEts() && IsTriggered()) {
+		if(ets_interleave_in_picoscope != GetEtsInterleave() || ets_cycles_in_picoscope != GetEtsCycles()) {
+			t_settings.Start();
+			SetEtsInPicoscope(true);
+			t_settings.Stop();
+			cost_ets = t_settings.GetSecondsDouble();
 		} else {
-			FILE_LOG(logDEBUG2) << "ps6000SetNoOfCaptures(handle=" << GetHandle() << ", nCaptures=" << GetNTraces() << ")";
-			GetPicoscope()->SetStatus(ps6000SetNoOfCaptures(
-				GetHandle(),    // handle
-				GetNTraces())); // nCaptures
-		}
-		if(GetPicoscope()->GetStatus() != PICO_OK) {
-			std::cerr << "Unable to set number of captures to " << GetNTraces() << std::endl;
-			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+			SkipSettings(1, cost_ets);
 		}
+	} else if(ets_interleave_in_picoscope > 0) {
+		SetEtsInPicoscope(false);
+	}
+
+	if(skipped_calls > 0) {
+		std::cerr << "-- Settings unchanged since the last run: skipped " << skipped_calls
+		          << " driver calls (~" << skipped_seconds*1e3 << " ms)\n";
 	}
 
 	//std::cerr << "\nPress a key to start fetching the data ...\n";
@@ -576,15 +618,206 @@ void Measurement::RunBlock()
 	// TODO: catch the _kbhit event!!!
 	// while (!Picoscope::IsReady() && !_kbhit()) {
 	while (!Picoscope::IsReady()) {
-		Sleep(200);
+		t_sleep.Start();
+		Sleep(wait_interval_ms);
+		t_sleep.Stop();
+		wait_latency.Add(t_sleep.GetSecondsDouble() - wait_interval_ms*1e-3);
 	}
 	t.Stop();
-	std::cerr << "OK (" << t.GetSecondsDouble() << "s)\n";
+	run_seconds = t.GetSecondsDouble();
+	std::cerr << "OK (" << run_seconds << "s)\n";
 
 	// sets the index from where we want to start reading data to zero
 	SetNextIndex(0UL);
 }
 
+void Measurement::SetSegmentsInPicoscope()
+{
+	FILE_LOG(logDEBUG3) << "Measurement::SetSegmentsInPicoscope";
+
+	uint32_t max_length=0;
+
+	// TODO - check that GetLength()*GetNumberOfEnabledChannels()*GetNTraces() doesn't exceed the limit
+	if(GetSeries() == PICO_4000) {
+		FILE_LOG(logDEBUG2) << "ps4000MemorySegments(handle=" << GetHandle() << ", nSegments=" << GetNTraces() << ", &max_length=" << max_length << ")";
+		GetPicoscope()->SetStatus(ps4000MemorySegments(
+			GetHandle(),   // handle
+			GetNTraces(),  // nSegments
+			&max_length));
+		FILE_LOG(logDEBUG2) << "->ps4000MemorySegments(... max_length=" << max_length << ")";
+	} else {
+		FILE_LOG(logDEBUG2) << "ps6000MemorySegments(handle=" << GetHandle() << ", nSegments=" << GetNTraces() << ", &max_length=" << max_length << ")";
+		GetPicoscope()->SetStatus(ps6000MemorySegments(
+			GetHandle(),   // handle
+			GetNTraces(),  // nSegments
+			&max_length));
+		FILE_LOG(logDEBUG2) << "->ps6000MemorySegments(... max_length=" << max_length << ")";
+	}
+	if(GetPicoscope()->GetStatus() != PICO_OK) {
+		std::cerr << "Unable to set number of segments to " << GetNTraces() << std::endl;
+		throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+	}
+	// the number of captures has to be set after the number of segments
+	if(GetSeries() == PICO_4000) {
+		FILE_LOG(logDEBUG2) << "ps4000SetNoOfCaptures(handle=" << GetHandle() << ", nCaptures=" << GetNTraces() << ")";
+		GetPicoscope()->SetStatus(ps4000SetNoOfCaptures(
+			GetHandle(),    // handle
+			GetNTraces())); // nCaptures
+	} else {
+		FILE_LOG(logDEBUG2) << "ps6000SetNoOfCaptures(handle=" << GetHandle() << ", nCaptures=" << GetNTraces() << ")";
+		GetPicoscope()->SetStatus(ps6000SetNoOfCaptures(
+			GetHandle(),    // handle
+			GetNTraces())); // nCaptures
+	}
+	if(GetPicoscope()->GetStatus() != PICO_OK) {
+		std::cerr << "Unable to set number of captures to " << GetNTraces() << std::endl;
+		throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+	}
+
+	segments_in_picoscope   = GetNTraces();
+	max_length_in_picoscope = max_length;
+}
+
+void Measurement::SetEts(unsigned int cycles, unsigned int interleave)
+{
+	FILE_LOG(logDEBUG3) << "Measurement::SetEts (cycles=" << cycles << ", interleave=" << interleave << ")";
+
+	if(GetSeries() == PICO_4000 && (cycles > PS4XXX_MAX_ETS_CYCLES || interleave > PS4XXX_MAX_INTERLEAVE)) {
+		throw "4000 series supports ETS with at most 400 cycles and 80 interleaves.";
+	}
+	if(GetSeries() == PICO_6000 && (cycles > PS6000_MAX_ETS_CYCLES || interleave > PS6000_MAX_INTERLEAVE)) {
+		throw "6000 series supports ETS with at most 250 cycles and 50 interleaves.";
+	}
+	ets_cycles     = cycles;
+	ets_interleave = interleave;
+	ets_reordered  = 0;
+}
+
+// switches equivalent-time sampling on (with the cycles and interleaves of SetEts) or off
+void Measurement::SetEtsInPicoscope(bool on)
+{
+	FILE_LOG(logDEBUG3) << "Measurement::SetEtsInPicoscope (on=" << on << ")";
+
+	int32_t sample_time_ps = 0;
+	int16_t cycles     = on ? (int16_t)GetEtsCycles()     : 0;
+	int16_t interleave = on ? (int16_t)GetEtsInterleave() : 0;
+
+	if(GetSeries() == PICO_4000) {
+		FILE_LOG(logDEBUG2) << "ps4000SetEts(handle=" << GetHandle() << ", mode=" << (on ? "PS4000_ETS_FAST" : "PS4000_ETS_OFF") << ", etsCycles=" << cycles << ", etsInterleave=" << interleave << ", *sampleTimePicoseconds)";
+		GetPicoscope()->SetStatus(ps4000SetEts(
+			GetHandle(),                           // handle
+			on ? PS4000_ETS_FAST : PS4000_ETS_OFF, // mode
+			cycles,                                // etsCycles
+			interleave,                            // etsInterleave
+			&sample_time_ps));                     // *sampleTimePicoseconds
+	} else {
+		FILE_LOG(logDEBUG2) << "ps6000SetEts(handle=" << GetHandle() << ", mode=" << (on ? "PS6000_ETS_FAST" : "PS6000_ETS_OFF") << ", etsCycles=" << cycles << ", etsInterleave=" << interleave << ", *sampleTimePicoseconds)";
+		GetPicoscope()->SetStatus(ps6000SetEts(
+			GetHandle(),                           // handle
+			on ? PS6000_ETS_FAST : PS6000_ETS_OFF, // mode
+			cycles,                                // etsCycles
+			interleave,                            // etsInterleave
+			&sample_time_ps));                     // *sampleTimePicoseconds
+	}
+	if(GetPicoscope()->GetStatus() != PICO_OK) {
+		std::cerr << "Unable to " << (on ? "set" : "switch off") << " equivalent-time sampling." << std::endl;
+		throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+	}
+	if(on) {
+		ets_sample_time_ps = sample_time_ps;
+		std::cerr << "-- ETS: " << cycles << " cycles, " << interleave << " interleaves, "
+		          << sample_time_ps << " ps between samples\n";
+	}
+	ets_cycles_in_picoscope     = cycles;
+	ets_interleave_in_picoscope = interleave;
+}
+
+// switches off triggering that was set by some previous run
+void Measurement::ClearTriggerInPicoscope()
+{
+	FILE_LOG(logDEBUG3) << "Measurement::ClearTriggerInPicoscope";
+
+	if(GetSeries() == PICO_4000) {
+		FILE_LOG(logDEBUG2) << "ps4000SetTriggerChannelConditions(handle=" << GetHandle() << ", *conditions=NULL, nConditions=0)";
+		GetPicoscope()->SetStatus(ps4000SetTriggerChannelConditions(
+			GetHandle(), // handle
+			NULL,        // * conditions
+			0));         // nConditions
+	} else {
+		FILE_LOG(logDEBUG2) << "ps6000SetTriggerChannelConditions(handle=" << GetHandle() << ", *conditions=NULL, nConditions=0)";
+		GetPicoscope()->SetStatus(ps6000SetTriggerChannelConditions(
+			GetHandle(), // handle
+			NULL,        // * conditions
+			0));         // nConditions
+	}
+	if(GetPicoscope()->GetStatus() != PICO_OK) {
+		std::cerr << "Unable to switch off the trigger." << std::endl;
+		throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+	}
+	// the delay would also apply to the captures without a trigger
+	if(trigger != NULL && trigger->GetLogic().delay > 0) {
+		if(GetSeries() == PICO_4000) {
+			GetPicoscope()->SetStatus(ps4000SetTriggerDelay(GetHandle(), 0));
+		} else {
+			GetPicoscope()->SetStatus(ps6000SetTriggerDelay(GetHandle(), 0));
+		}
+		if(GetPicoscope()->GetStatus() != PICO_OK) {
+			std::cerr << "Unable to switch off the trigger delay." << std::endl;
+			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+		}
+	}
+	trigger_in_picoscope = false;
+}
+
+void Measurement::InvalidateSettings()
+{
+	FILE_LOG(logDEBUG3) << "Measurement::InvalidateSettings";
+
+	int i;
+
+	for(i=0; i<GetNumberOfChannels(); i++) {
+		GetChannel(i)->SetDirty();
+	}
+	if(trigger != NULL) {
+		trigger->SetDirty();
+	}
+	timebase_is_set = false;
+	// this is what picoscope uses after it has been opened
+	segments_in_picoscope   = 1;
+	max_length_in_picoscope = 0;
+	trigger_in_picoscope    = false;
+	ets_cycles_in_picoscope = ets_interleave_in_picoscope = 0;
+}
+
+void Measurement::InvalidateSegments()
+{
+	FILE_LOG(logDEBUG3) << "Measurement::InvalidateSegments";
+
+	// (RunBlock would otherwise assume the single segment of a freshly opened picoscope)
+	if(GetHandle() != configured_handle) {
+		InvalidateSettings();
+		configured_handle = GetHandle();
+	}
+	// no number of segments is equal to this one
+	segments_in_picoscope   = 0;
+	max_length_in_picoscope = 0;
+	timebase_is_set         = false;
+}
+
+void Measurement::ResetSkippedCalls()
+{
+	skipped_calls   = skipped_calls_total   = 0;
+	skipped_seconds = skipped_seconds_total = 0.0;
+}
+
+void Measurement::SkipSettings(unsigned long calls, double seconds)
+{
+	skipped_calls         += calls;
+	skipped_calls_total   += calls;
+	skipped_seconds       += seconds;
+	skipped_seconds_total += seconds;
+}
+
 // TODO: we might want to use multiple buffers at the same time
 // returns the length of data
 // TODO: the first part only needs to be called once; so we should move the code at the end of RunBlock
@@ -636,6 +869,30 @@ unsigned long Measurement::GetNextData()
 			}
 		}
 	}
+	// the times of the samples of an ETS capture (which has to be fetched at once to be put in order)
+	if(IsEts() && IsTriggered()) {
+		if(GetNextIndex() > 0 || length_of_trace_askedfor < GetLength()) {
+			throw "An ETS trace has to fit into the buffer to be fetched at once.";
+		}
+		ets_time_fs.resize(GetMaxTraceLengthToFetch());
+		if(GetSeries() == PICO_4000) {
+			FILE_LOG(logDEBUG2) << "ps4000SetEtsTimeBuffer(handle=" << GetHandle() << ", *buffer=<ets_time_fs>, bufferLth=" << ets_time_fs.size() << ")";
+			GetPicoscope()->SetStatus(ps4000SetEtsTimeBuffer(
+				GetHandle(),                  // handle
+				&ets_time_fs[0],              // *buffer
+				(int32_t)ets_time_fs.size())); // bufferLth
+		} else {
+			FILE_LOG(logDEBUG2) << "ps6000SetEtsTimeBuffer(handle=" << GetHandle() << ", *buffer=<ets_time_fs>, bufferLth=" << ets_time_fs.size() << ")";
+			GetPicoscope()->SetStatus(ps6000SetEtsTimeBuffer(
+				GetHandle(),                   // handle
+				&ets_time_fs[0],               // *buffer
+				(uint32_t)ets_time_fs.size())); // bufferLth
+		}
+		if(GetPicoscope()->GetStatus() != PICO_OK) {
+			std::cerr << "Unable to set memory for the times of the ETS samples." << std::endl;
+			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+		}
+	}
 	// fetch data
 	length_of_trace_fetched = length_of_trace_askedfor;
 	std::cerr << "Get data for points " << GetNextIndex() << "-" << GetNextIndex()+length_of_trace_askedfor << " (" << 100.0*(GetNextIndex()+length_of_trace_askedfor)/GetLength() << "%) ... ";
@@ -684,12 +941,83 @@ unsigned long Measurement::GetNextData()
 		std::cerr << "Warning: The number of read samples was smaller than requested.\n";
 	}
 	std::cerr << "OK ("<< t.GetSecondsDouble() <<"s)\n";
+	// the interleaves of an ETS capture are put into the order of their times
+	if(IsEts() && IsTriggered() && length_of_trace_fetched > 0) {
+		ets_time_fs.resize(length_of_trace_fetched);
+		if(ets_order.sort(&ets_time_fs[0], length_of_trace_fetched)) {
+			for(i=0; i<GetNumberOfChannels(); i++) {
+				if(GetChannel(i)->IsEnabled()) {
+					ets_order.apply(data[i], length_of_trace_fetched, ets_buffer);
+				}
+			}
+			ets_reordered++;
+		}
+	}
 	SetLengthFetched(length_of_trace_fetched);
 	SetNextIndex(GetNextIndex()+length_of_trace_fetched);
 
 	return length_of_trace_fetched;
 }
 
+unsigned long Measurement::PreCapture(unsigned long n)
+{
+	FILE_LOG(logDEBUG3) << "Measurement::PreCapture (n=" << n << ")";
+
+	int i;
+	short overflow = 0;
+	uint32_t fetched;
+	unsigned long old_length  = GetLength();
+	unsigned long old_ntraces = GetNTraces();
+	bool          old_trigger = is_triggered;
+
+	for(i=0; i<GetNumberOfChannels(); i++) {
+		if(GetChannel(i)->IsEnabled()) {
+			if(data_allocated[i] == false) {
+				throw "Unable to get data. Memory is not allocated.";
+			}
+			n = data_length[i] < n ? data_length[i] : n;
+		}
+	}
+	SetLength(n);
+	SetNTraces(1);
+	is_triggered = false;
+	try {
+		RunBlock();
+		for(i=0; i<GetNumberOfChannels(); i++) {
+			if(GetChannel(i)->IsEnabled()) {
+				if(GetSeries() == PICO_4000) {
+					GetPicoscope()->SetStatus(ps4000SetDataBuffer(GetHandle(), (PS4000_CHANNEL)i, data[i], n));
+				} else {
+					GetPicoscope()->SetStatus(ps6000SetDataBuffer(GetHandle(), (PS6000_CHANNEL)i, data[i], n, PS6000_RATIO_MODE_NONE));
+				}
+				if(GetPicoscope()->GetStatus() != PICO_OK) {
+					throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+				}
+			}
+		}
+		fetched = n;
+		if(GetSeries() == PICO_4000) {
+			GetPicoscope()->SetStatus(ps4000GetValues(GetHandle(), 0, &fetched, 1, PS4000_RATIO_MODE_NONE, 0, &overflow));
+		} else {
+			GetPicoscope()->SetStatus(ps6000GetValues(GetHandle(), 0, &fetched, 1, PS6000_RATIO_MODE_NONE, 0, &overflow));
+		}
+		if(GetPicoscope()->GetStatus() != PICO_OK) {
+			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+		}
+	} catch(...) {
+		SetLength(old_length);
+		SetNTraces(old_ntraces);
+		is_triggered = old_trigger;
+		throw;
+	}
+	SetLength(old_length);
+	SetNTraces(old_ntraces);
+	is_triggered = old_trigger;
+	SetLengthFetched(fetched);
+
+	return fetched;
+}
+
 unsigned long Measurement::GetNextDataBulk()
 {
 	FILE_LOG(logDEBUG3) << "Measurement::GetNextDataBulk";
@@ -825,12 +1153,25 @@ unsigned long Measurement::GetNextDataBulk()
 	// getting timestamps
 	int64_t *timestamps;
 	PS6000_TIME_UNITS *timeunits;
+	PS4000_TIME_UNITS *timeunits_4000;
 
 	timestamps = new int64_t[traces_asked_for];
 	timeunits  = new PS6000_TIME_UNITS[traces_asked_for];
 
 	if(GetSeries() == PICO_4000) {
-		// NOT YET IMPLEMENTED
+		timeunits_4000 = new PS4000_TIME_UNITS[traces_asked_for];
+		FILE_LOG(logDEBUG2) << "ps4000GetValuesTriggerTimeOffsetBulk64(handle=" << GetHandle() << ", *timestamps, *timeunits, fromSegmentIndex=" << GetNextIndex() << ", toSegmentIndex=" << GetNextIndex()+traces_asked_for-1 << ")";
+		GetPicoscope()->SetStatus(ps4000GetValuesTriggerTimeOffsetBulk64(
+			GetHandle(),                // handle
+			timestamps,                 // *times
+			timeunits_4000,             // *timeUnits
+			GetNextIndex(),                      // fromSegmentIndex
+			GetNextIndex()+traces_asked_for-1)); // toSegmentIndex
+		// both series list the units in the same order
+		for(i=0; i<traces_asked_for; i++) {
+			timeunits[i] = (PS6000_TIME_UNITS)timeunits_4000[i];
+		}
+		delete [] timeunits_4000;
 	} else {
 		FILE_LOG(logDEBUG2) << "ps6000GetValuesTriggerTimeOffsetBulk64(handle=" << GetHandle() << ", *timestamps, *timeunits, fromSegmentIndex=" << GetNextIndex() << ", toSegmentIndex=" << GetNextIndex()+traces_asked_for-1 << ")";
 		GetPicoscope()->SetStatus(ps6000GetValuesTriggerTimeOffsetBulk64(
@@ -841,6 +1182,8 @@ unsigned long Measurement::GetNextDataBulk()
 			GetNextIndex()+traces_asked_for-1)); // toSegmentIndex
 	}
 	if(GetPicoscope()->GetStatus() != PICO_OK) {
+		delete [] timestamps;
+		delete [] timeunits;
 		std::cerr << "Unable to get timestamps." << std::endl;
 		throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
 	}
@@ -852,6 +1195,10 @@ unsigned long Measurement::GetNextDataBulk()
 	// if(timeunits[0] != timeunits[traces_asked_for-1]) {
 	// 	FILE_LOG(logWARNING) << "time unit of the first and last sample differ; rate is not reliable; TIMING seems to be broken anyway";
 	// }
+	trigger_time_ps.resize(traces_asked_for);
+	for(i=0; i<traces_asked_for; i++) {
+		trigger_time_ps[i] = TimeInPs(timestamps[i], timeunits[i]);
+	}
 
 	delete [] timestamps;
 	delete [] timeunits;
@@ -886,8 +1233,7 @@ void Measurement::WriteDataBin(FILE *f, int channel)
 	int i, j;
 
 	const unsigned int length_datachunk = 1000000;
-	char data_8bit[1000000];
-	// std::vector<char>data_8bit(1000);
+	char *data_8bit;
 
 	std::cerr << "Write binary data for channel " << (char)('A'+channel) << " ... ";
 	t.Start();
@@ -906,16 +1252,20 @@ void Measurement::WriteDataBin(FILE *f, int channel)
 			}*/
 			// TODO: if only 8 bits
 			int length_fetched   = GetLengthFetched();
-			// int length_datachunk = data_8bit.size();
+			if(GetSeries() == PICO_6000 && write_buffer[channel].size() < length_datachunk) {
+				write_buffer[channel].resize(length_datachunk);
+			}
+			data_8bit = write_buffer[channel].empty() ? NULL : &write_buffer[channel][0];
 			for(i=0; i<length_fetched; i+=length_datachunk) {
+				j = length_fetched - i < (int)length_datachunk ? length_fetched - i : length_datachunk;
 				if(GetSeries() == PICO_6000) {
-					for(j=0; j<length_datachunk && i+j<length_fetched; j++) {
-						data_8bit[j] = data[channel][i+j] >> 8;
-					}
+					// the statistics are counted in the same pass
+					count_samples<ps6000_samples>(data[channel]+i, j, sample_stats[channel], (int8_t*)data_8bit);
 					size_written = fwrite(data_8bit, sizeof(char), j, f);
 				} else {
 					// TODO: test!!!
-					size_written = fwrite(data[channel]+1, sizeof(data[0][0]), j, f);
+					count_samples<ps4000_samples>(data[channel]+i, j, sample_stats[channel]);
+					size_written = fwrite(data[channel]+i, sizeof(data[0][0]), j, f);
 				}
 				fflush(f);
 				if(size_written < j) {
@@ -969,6 +1319,99 @@ void Measurement::WriteDataTxt(FILE *f, int channel)
 	std::cerr << "OK ("<< t.GetSecondsDouble() <<"s)\n";
 }
 
+void Measurement::ExchangeData(int channel, short *&buffer, unsigned long &length)
+{
+	FILE_LOG(logDEBUG3) << "Measurement::ExchangeData (channel=" << channel << ", length=" << length << ")";
+
+	short *old_data = data[channel];
+	unsigned long old_length = data_length[channel];
+
+	if(!data_allocated[channel] || buffer == NULL || length < old_length) {
+		throw "Measurement::ExchangeData needs an allocated buffer of at least the same size.";
+	}
+	data[channel]        = buffer;
+	data_length[channel] = length;
+	buffer = old_data;
+	length = old_length;
+}
+
+void Measurement::ResetSampleStatistics()
+{
+	int i;
+
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		sample_stats[i].reset();
+	}
+}
+
+void Measurement::CountSamples(int channel)
+{
+	if(GetChannel(channel)->IsEnabled()) {
+		CountSamples(data[channel], GetLengthFetched(), sample_stats[channel]);
+	}
+}
+
+void Measurement::CountSamples(const short *x, unsigned long n, sample_statistics &s) const
+{
+	if(GetSeries() == PICO_6000) {
+		count_samples<ps6000_samples>(x, n, s);
+	} else {
+		count_samples<ps4000_samples>(x, n, s);
+	}
+}
+
+void Measurement::PrintSampleStatistics() const
+{
+	int i;
+	double scale = GetSeries() == PICO_6000 ? 1.0/(1 << ps6000_samples::shift) : 1.0;
+	char buffer[200];
+
+	std::cerr << "--";
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		const sample_statistics &s = sample_stats[i];
+		if(channels[i]->IsEnabled() && s.count > 0) {
+			snprintf(buffer, sizeof(buffer), " %c: %g .. %g, mean %.2f, rms %.2f, clipped %llu (%.3g %%);",
+				'A'+i, s.min*scale, s.max*scale, s.mean()*scale, s.rms()*scale,
+				(unsigned long long)s.clipped(), s.clipped()*100.0/s.count);
+			std::cerr << buffer;
+		}
+	}
+	std::cerr << "\n";
+}
+
+unsigned long Measurement::KeepTraces(const std::vector<uint8_t> &keep)
+{
+	FILE_LOG(logDEBUG3) << "Measurement::KeepTraces";
+
+	int i;
+	unsigned long n, kept = 0;
+	unsigned long length  = GetLength();
+	unsigned long ntraces = length > 0 ? GetLengthFetched()/length : 0;
+
+	for(n=0; n<ntraces && n<keep.size(); n++) {
+		if(!keep[n]) {
+			continue;
+		}
+		if(kept != n) {
+			for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+				if(GetChannel(i)->IsEnabled()) {
+					memmove(&data[i][kept*length], &data[i][n*length], length*sizeof(short));
+				}
+			}
+			if(n < trigger_time_ps.size()) {
+				trigger_time_ps[kept] = trigger_time_ps[n];
+			}
+		}
+		kept++;
+	}
+	if(trigger_time_ps.size() > kept) {
+		trigger_time_ps.resize(kept);
+	}
+	SetLengthFetched(kept*length);
+
+	return kept;
+}
+
 void Measurement::SetNextIndex(unsigned long index)
 {
 	FILE_LOG(logDEBUG3) << "Measurement::SetNextIndex (index=" << index << ")";
@@ -995,11 +1438,26 @@ void Measurement::SetTrigger(Trigger *tr)
 
 	is_triggered = true;
 	// TODO: must be improved for more fancy triggers
-	if(trigger != NULL) delete trigger;
+	if(trigger != NULL) {
+		// no need to pass the same trigger to picoscope again
+		if(!trigger->IsDirty() && trigger->IsSameAs(tr)) {
+			tr->SetClean();
+		}
+		delete trigger;
+	}
 	trigger = tr;
 	FILE_LOG(logDEBUG4) << "Measurement::SetTrigger - new values: trigger=" << trigger << ", is_triggered=" << is_triggered;
 }
 
+// the trigger object is kept, so that we know what has been passed to picoscope
+// in case that the same trigger is requested again
+void Measurement::RemoveTrigger()
+{
+	FILE_LOG(logDEBUG3) << "Measurement::RemoveTrigger";
+
+	is_triggered = false;
+}
+
 void Measurement::InitializeSignalGenerator()
 {
 	FILE_LOG(logDEBUG3) << "Measurement::InitializeSignalGenerator";
@@ -1054,6 +1512,26 @@ void Measurement::AddSignalGeneratorSquare(unsigned long peak_to_peak_in_microvo
 	signal_generator_frequency = frequency;
 }
 
+void Measurement::RemoveSignalGenerator()
+{
+	FILE_LOG(logDEBUG3) << "Measurement::RemoveSignalGenerator";
+
+	use_signal_generator = false;
+}
+
+int64_t Measurement::TimeInPs(int64_t t, PS6000_TIME_UNITS unit)
+{
+	switch(unit) {
+		case PS6000_FS: return t/1000;
+		case PS6000_PS: return t;
+		case PS6000_NS: return t*1000LL;
+		case PS6000_US: return t*1000000LL;
+		case PS6000_MS: return t*1000000000LL;
+		case PS6000_S : return t*1000000000000LL;
+		default: FILE_LOG(logWARNING) << "unknown time unit " << unit; return t;
+	};
+}
+
 // TODO: get rid of dependency on PS6000_TIME_UNITS in declaration
 // implementation may change
 void Measurement::SetRate(long n_events, int64_t t1, PS6000_TIME_UNITS time_unit1, int64_t t2, PS6000_TIME_UNITS time_unit2)
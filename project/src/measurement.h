@@ -14,10 +14,14 @@
 // } PICO_CHANNEL;
 
 #include <stdint.h>
+#include <vector>
 
 #include "picoscope.h"
 #include "channel.h"
 #include "trigger.h"
+#include "realtime.h"
+#include "analysis/sample-statistics.h"
+#include "analysis/ets.h"
 
 // TODO: get rid of this dependency
 #include "ps6000Api.h"
@@ -48,6 +52,10 @@ public:
 	// void SetMaxTimebase();
 	void SetTimebaseInPs(unsigned long);
 	void SetTimebaseInNs(unsigned long);
+	// a timebase that has been chosen elsewhere (by the planner)
+	void SetTimebase(unsigned long tb) { timebase = tb; };
+	// the interval that was asked for with SetTimebaseInPs (the timebase may be faster)
+	unsigned long GetRequestedIntervalPs() const { return requested_interval_ps; };
 	void FixTimebase();
 	double GetTimebaseInNs();
 	double GetReportedTimebaseInNs() const { return timebase_reported_by_osciloscope; };
@@ -76,6 +84,8 @@ public:
 	unsigned long GetMaxTracesToFetch() const { return max_traces_to_fetch; };
 	void          AllocateMemoryBlock(unsigned long);
 	void          AllocateMemoryRapidBlock(unsigned long);
+	// touches every page of the buffers, so that the first acquisition doesn't pay for page faults
+	void          PrefaultMemory();
 
 	Picoscope*  GetPicoscope()  const { return picoscope; };
 	PICO_SERIES GetSeries()     const { return GetPicoscope()->GetSeries(); };
@@ -84,28 +94,90 @@ public:
 	Channel*    GetChannel(int);
 
 	void RunBlock();
+	// how long the last RunBlock waited for picoscope to capture the traces (from arming to ready)
+	double GetRunSeconds() const { return run_seconds; };
 	unsigned long GetNextData();
 	unsigned long GetNextDataBulk();
+	// a single capture of at most n samples without a trigger into the buffers (for a quick look at the signals
+	// before the run: GetData and GetLengthFetched); length, traces and trigger are restored afterwards
+	unsigned long PreCapture(unsigned long n);
 	void WriteDataBin(FILE*,int);
 	void WriteDataTxt(FILE*,int);
 
+	// samples of the last call to GetNextData or GetNextDataBulk
+	const short*  GetData(int channel) const { return data[channel]; };
+	unsigned long GetDataLength(int channel) const { return data_length[channel]; };
+	// swaps the buffer of a channel with another one of the same size, so that the data can be
+	// processed while the next traces are being fetched (the caller then owns the old buffer)
+	void          ExchangeData(int channel, short *&buffer, unsigned long &length);
+	// keeps only the traces of the last call to GetNextDataBulk with keep[i] != 0 (moved to the front,
+	// together with their trigger times); returns the number of traces that are left
+	unsigned long KeepTraces(const std::vector<uint8_t> &keep);
+
 	unsigned long GetNextIndex() const { return next_index; };
 	void SetLengthFetched(unsigned long l);
 	unsigned long GetLengthFetched() const { return length_fetched; };
 
+	// statistics of the samples of every channel since ResetSampleStatistics(): WriteDataBin counts them
+	// while converting them to 8 bits, data that isn't written that way has to be counted with CountSamples
+	sample_statistics& GetSampleStatistics(int channel) { return sample_stats[channel]; };
+	void ResetSampleStatistics();
+	// the samples of the last call to GetNextData or GetNextDataBulk
+	void CountSamples(int channel);
+	// any samples in the format of this series (for the threads of the online analysis)
+	void CountSamples(const short *x, unsigned long n, sample_statistics &s) const;
+	// a single line with the statistics of every enabled channel (in the units of the files)
+	void PrintSampleStatistics() const;
+
 	void AddSimpleTrigger(Channel *, double, double);
 	void SetTrigger(Trigger *);
+	void RemoveTrigger();
 
 	void AddSignalGeneratorSquare(unsigned long peak_to_peak_in_microvolts, float frequency);
+	void RemoveSignalGenerator();
 	void InitializeSignalGenerator();
 
 	void SetRate(long n_events, int64_t t1, PS6000_TIME_UNITS time_unit1, int64_t t2, PS6000_TIME_UNITS time_unit2);
 	double GetRatePerSecond();
+	// trigger time offsets (in ps) of the traces of the last call to GetNextDataBulk
+	const std::vector<int64_t>& GetTriggerTimesPs() const { return trigger_time_ps; };
+	static int64_t TimeInPs(int64_t t, PS6000_TIME_UNITS unit);
+
+	// equivalent-time sampling of a repetitive signal (interleave 0 switches it off); only used for a single
+	// triggered trace, which then has to be fetched at once
+	void         SetEts(unsigned int cycles, unsigned int interleave);
+	bool         IsEts()            const { return ets_interleave > 0; };
+	unsigned int GetEtsCycles()     const { return ets_cycles; };
+	unsigned int GetEtsInterleave() const { return ets_interleave; };
+	// the interval between the samples of an ETS trace (as reported by picoscope)
+	long         GetEtsSampleTimePs() const { return ets_sample_time_ps; };
+	// the times (in fs) of the samples of the last call to GetNextData in ETS mode, in the same order as the samples
+	const std::vector<int64_t>& GetEtsTimesFs() const { return ets_time_fs; };
+	// how many of the ETS traces had to be put into the order of their times
+	unsigned long GetEtsReordered() const { return ets_reordered; };
+
+	// forget which settings have already been passed to picoscope
+	void InvalidateSettings();
+	// the segments of picoscope have been changed elsewhere (by the planner)
+	void InvalidateSegments();
+	// driver calls that were not needed because the settings didn't change
+	unsigned long GetSkippedCalls()        const { return skipped_calls; };
+	double        GetSkippedSeconds()      const { return skipped_seconds; };
+	unsigned long GetSkippedCallsTotal()   const { return skipped_calls_total; };
+	double        GetSkippedSecondsTotal() const { return skipped_seconds_total; };
+	void          ResetSkippedCalls();
+
+	// how often RunBlock checks whether the data is ready
+	void          SetWaitInterval(unsigned long ms) { wait_interval_ms = ms; };
+	// how much later than requested the waiting thread has been woken up
+	LatencyStats& GetWaitLatency() { return wait_latency; };
 
 private:
 	Picoscope         *picoscope;
 	Trigger           *trigger;
 	unsigned long      timebase;
+	unsigned long      requested_interval_ps;
+	double             run_seconds;
 	double             timebase_reported_by_osciloscope;
 	unsigned long      length;
 	unsigned long      ntraces;
@@ -119,6 +191,14 @@ private:
 	unsigned long      number_of_points_to_write;
 
 	double             rate_per_second;
+	std::vector<int64_t> trigger_time_ps;
+
+	unsigned int         ets_cycles, ets_interleave;
+	int32_t              ets_sample_time_ps;
+	std::vector<int64_t> ets_time_fs;
+	ets_sorter           ets_order;
+	std::vector<short>   ets_buffer;
+	unsigned long        ets_reordered;
 
 	bool is_triggered;
 	bool use_signal_generator;
@@ -130,9 +210,35 @@ private:
 	short *data[PICOSCOPE_N_CHANNELS];
 	bool data_allocated[PICOSCOPE_N_CHANNELS];
 	unsigned long data_length[PICOSCOPE_N_CHANNELS];
+	sample_statistics sample_stats[PICOSCOPE_N_CHANNELS];
+	// WriteDataBin converts the samples chunk by chunk; every channel has its own buffer, so they may be written in parallel
+	std::vector<char> write_buffer[PICOSCOPE_N_CHANNELS];
 
 	void SetNextIndex(unsigned long);
 
+	// settings that have already been passed to picoscope
+	short         configured_handle;
+	bool          timebase_is_set;
+	unsigned long timebase_in_picoscope;
+	unsigned long length_in_picoscope;
+	unsigned long segments_in_picoscope;
+	uint32_t      max_length_in_picoscope;
+	bool          trigger_in_picoscope;
+	unsigned int  ets_cycles_in_picoscope, ets_interleave_in_picoscope; // interleave 0: ETS is off
+	// how long it took to pass the settings last time (used to estimate the time saved)
+	double        cost_channel[PICOSCOPE_N_CHANNELS];
+	double        cost_timebase, cost_trigger, cost_segments, cost_ets;
+	unsigned long skipped_calls, skipped_calls_total;
+	double        skipped_seconds, skipped_seconds_total;
+
+	unsigned long wait_interval_ms;
+	LatencyStats  wait_latency;
+
+	void SetSegmentsInPicoscope();
+	void SetEtsInPicoscope(bool on);
+	void ClearTriggerInPicoscope();
+	void SkipSettings(unsigned long calls, double seconds);
+
 	// PICO_STATUS return_status;
 };
 
@@ -0,0 +1,712 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <math.h>
+
+#include "picoscope.h"
+#include "measurement.h"
+#include "channel.h"
+#include "args.h"
+#include "online.h"
+
+#include "log.h"
+#include "timing.h"
+
+OnlineAnalysis::OnlineAnalysis(Measurement *m, Args *a)
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::OnlineAnalysis (Measurement=" << m << ", Args=" << a << ")";
+
+	int i;
+
+	measurement = m;
+	args        = a;
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		spare[i]        = NULL;
+		spare_length[i] = 0;
+		f_features[i]   = NULL;
+		f_raw[i]        = NULL;
+		f_times[i]      = NULL;
+		f_peaks[i]      = NULL;
+		f_baselines[i]  = NULL;
+		f_energy[i]     = NULL;
+		baseline_state[i] = NAN;
+		piled_up[i]     = 0;
+	}
+	f_events       = NULL;
+	events         = NULL;
+	dt_ps          = 0.0;
+	trigger_sample = 0.0;
+	// one core is left for fetching the data
+	nthreads = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency()-1 : 1;
+
+	traces_total   = 0;
+	traces_kept    = 0;
+	seconds_busy   = 0.0;
+	seconds_waited = 0.0;
+}
+
+OnlineAnalysis::~OnlineAnalysis()
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::~OnlineAnalysis";
+
+	int i;
+
+	if(worker.joinable()) {
+		worker.join();
+	}
+	CloseFiles();
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		delete [] spare[i];
+	}
+	delete events;
+}
+
+void OnlineAnalysis::OpenFiles()
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::OpenFiles";
+
+	int i;
+	std::string name;
+	Args &x = *args;
+
+	output_files.clear();
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		hist_filename[i].clear();
+		average_filename[i].clear();
+		if(measurement->GetChannel(i)->IsEnabled()) {
+			samples_thread[i].assign(nthreads, sample_statistics());
+			if(IsPsd() && !x.IsHistOnly()) {
+				name = std::string(x.GetFilename()) + (char)('A'+i) + (x.IsBinaryOutput() ? ".psd.bin" : ".psd.txt");
+				f_features[i] = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+				if(f_features[i] == NULL) {
+					std::cerr << "Unable to open " << name << "\n";
+					throw "Unable to open file for online analysis.";
+				}
+				output_files.push_back(name);
+			}
+			// every measurement starts with empty histograms; their size doesn't change after this
+			if(IsHist()) {
+				hist_filename[i] = std::string(x.GetFilename()) + (char)('A'+i) + (x.IsBinaryOutput() ? ".hist.bin" : ".hist.txt");
+				output_files.push_back(hist_filename[i]);
+				hist[i] = psd_histograms(x.GetHistBins(), x.GetHistIntegral1Max(), x.GetHistIntegral2Max(),
+					measurement->GetSeries() == PICO_6000 ? 128 : 32768);
+				hist_thread[i].assign(nthreads, hist[i]);
+			}
+			if(x.IsAverage()) {
+				average_filename[i] = std::string(x.GetFilename()) + (char)('A'+i) + (x.IsBinaryOutput() ? ".average.bin" : ".average.txt");
+				output_files.push_back(average_filename[i]);
+				average[i] = trace_average(measurement->GetLength(), x.IsAverageRms());
+				average_thread[i].assign(nthreads, average[i]);
+			}
+			if(x.IsTiming()) {
+				name = std::string(x.GetFilename()) + (char)('A'+i) + (x.IsBinaryOutput() ? ".time.bin" : ".time.txt");
+				f_times[i] = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+				if(f_times[i] == NULL) {
+					std::cerr << "Unable to open " << name << "\n";
+					throw "Unable to open file for online analysis.";
+				}
+				output_files.push_back(name);
+			}
+			if(x.IsPeaks()) {
+				name = std::string(x.GetFilename()) + (char)('A'+i) + (x.IsBinaryOutput() ? ".peaks.bin" : ".peaks.txt");
+				f_peaks[i] = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+				if(f_peaks[i] == NULL) {
+					std::cerr << "Unable to open " << name << "\n";
+					throw "Unable to open file for online analysis.";
+				}
+				output_files.push_back(name);
+				piled_up[i] = 0;
+			}
+			if(x.IsBaseline()) {
+				name = std::string(x.GetFilename()) + (char)('A'+i) + (x.IsBinaryOutput() ? ".baseline.bin" : ".baseline.txt");
+				f_baselines[i] = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+				if(f_baselines[i] == NULL) {
+					std::cerr << "Unable to open " << name << "\n";
+					throw "Unable to open file for online analysis.";
+				}
+				output_files.push_back(name);
+				baseline_state[i] = NAN;
+			}
+			if(x.IsShaper()) {
+				name = std::string(x.GetFilename()) + (char)('A'+i) + (x.IsBinaryOutput() ? ".energy.bin" : ".energy.txt");
+				f_energy[i] = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+				if(f_energy[i] == NULL) {
+					std::cerr << "Unable to open " << name << "\n";
+					throw "Unable to open file for online analysis.";
+				}
+				output_files.push_back(name);
+			}
+			if(x.GetKeepRaw() > 0) {
+				name = x.IsBinaryOutput() ? x.GetFilenameBinary(i) : x.GetFilenameText(i);
+				f_raw[i] = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+				if(f_raw[i] == NULL) {
+					throw "Unable to open file for raw traces.";
+				}
+				output_files.push_back(name);
+			}
+		}
+	}
+	if(x.IsShaper()) {
+		shapers.assign(nthreads, pulse_shaper(x.GetShaperOptions()));
+		shaped_buffers.resize(nthreads);
+	}
+	if(x.IsCoincidence()) {
+		event_channels.clear();
+		event_channel_names.clear();
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			if(measurement->GetChannel(i)->IsEnabled()) {
+				event_channels.push_back(i);
+				event_channel_names += (char)('A'+i);
+			}
+		}
+		if(event_channels.size() < 2) {
+			throw "--coincidence needs at least two channels.";
+		}
+		name = std::string(x.GetFilename()) + (x.IsBinaryOutput() ? ".events.bin" : ".events.txt");
+		f_events = fopen(name.c_str(), x.IsBinaryOutput() ? "wb" : "wt");
+		if(f_events == NULL) {
+			std::cerr << "Unable to open " << name << "\n";
+			throw "Unable to open file for online analysis.";
+		}
+		output_files.push_back(name);
+		delete events;
+		events = new event_builder(x.GetCoincidenceOptions(), event_channels.size());
+	}
+	since_snapshot.Start();
+}
+
+void OnlineAnalysis::CloseFiles()
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::CloseFiles";
+
+	int i;
+
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(f_features[i] != NULL) {
+			fclose(f_features[i]);
+			f_features[i] = NULL;
+		}
+		if(f_raw[i] != NULL) {
+			fclose(f_raw[i]);
+			f_raw[i] = NULL;
+		}
+		if(f_times[i] != NULL) {
+			fclose(f_times[i]);
+			f_times[i] = NULL;
+		}
+		if(f_peaks[i] != NULL) {
+			fclose(f_peaks[i]);
+			f_peaks[i] = NULL;
+		}
+		if(f_baselines[i] != NULL) {
+			fclose(f_baselines[i]);
+			f_baselines[i] = NULL;
+		}
+		if(f_energy[i] != NULL) {
+			fclose(f_energy[i]);
+			f_energy[i] = NULL;
+		}
+	}
+	if(f_events != NULL) {
+		fclose(f_events);
+		f_events = NULL;
+	}
+}
+
+void OnlineAnalysis::Submit()
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::Submit";
+
+	int i;
+	unsigned long ntraces, length, first_trace;
+	Measurement *meas = measurement;
+
+	Wait();
+
+	// the measurement may be changed for the next capture (--trig <x> auto recheck) while the worker is running
+	length      = meas->GetLength();
+	ntraces     = meas->GetLengthFetched()/length;
+	first_trace = traces_total;
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(meas->GetChannel(i)->IsEnabled()) {
+			// the first time we need a buffer of our own; later we simply get the old one back
+			if(spare[i] == NULL) {
+				spare_length[i] = meas->GetDataLength(i);
+				spare[i] = new short[spare_length[i]];
+			}
+			meas->ExchangeData(i, spare[i], spare_length[i]);
+		}
+	}
+	trigger_sample = meas->GetLengthBeforeTrigger();
+	if(args->IsTiming()) {
+		spare_trigger_ps = meas->GetTriggerTimesPs();
+		dt_ps            = meas->GetTimebaseInNs()*1000.0;
+	}
+	traces_total += ntraces;
+	worker = std::thread([this, ntraces, length, first_trace]() {
+		try {
+			Analyse(ntraces, length, first_trace);
+		} catch(...) {
+			error = std::current_exception();
+		}
+	});
+}
+
+void OnlineAnalysis::Wait()
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::Wait";
+
+	Timing t;
+
+	if(worker.joinable()) {
+		t.Start();
+		worker.join();
+		t.Stop();
+		seconds_waited += t.GetSecondsDouble();
+	}
+	if(error) {
+		std::exception_ptr e = error;
+		error = NULL;
+		std::rethrow_exception(e);
+	}
+}
+
+void OnlineAnalysis::RunOnThreads(unsigned long ntraces, const std::function<void(unsigned long, unsigned long, unsigned long)> &f)
+{
+	unsigned long k, n, from, count;
+	std::vector<std::thread> helpers;
+
+	n = nthreads < ntraces ? nthreads : 1;
+	for(k=1; k<n; k++) {
+		from  = k*ntraces/n;
+		count = (k+1)*ntraces/n - from;
+		helpers.push_back(std::thread(f, k, from, count));
+	}
+	f(0, 0, ntraces/n);
+	for(k=0; k<helpers.size(); k++) {
+		helpers[k].join();
+	}
+}
+
+// runs in the background on the spare buffers
+void OnlineAnalysis::Analyse(unsigned long ntraces, unsigned long length, unsigned long first_trace)
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::Analyse (ntraces=" << ntraces << ", length=" << length << ", first_trace=" << first_trace << ")";
+
+	int i, channels = 0;
+	unsigned long k, kept = 0;
+	// data from 6000 series holds 8 bits in the upper byte; the results are scaled back to 8 bits
+	// to be the same as those calculated from the binary files
+	bool is_8bit = measurement->GetSeries() == PICO_6000;
+	short clip = is_8bit ? ps6000_samples::clip() : ps4000_samples::clip();
+	int shift  = is_8bit ? (int)ps6000_samples::shift : (int)ps4000_samples::shift;
+	timing_options timing = args->GetTimingOptions();
+	peak_options   peak   = args->GetPeakOptions();
+	baseline_options baseline;
+	Timing t;
+
+	baseline.method = args->GetBaselineMethod();
+	baseline.length = (unsigned int)trigger_sample;
+
+	timing.level   *= 1 << shift;
+	peak.threshold *= 1 << shift;
+
+	t.Start();
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(!measurement->GetChannel(i)->IsEnabled()) {
+			continue;
+		}
+		trace_span<short> traces(spare[i], ntraces, length);
+		ngamma_features &f = features[i];
+		pulse_times &tm = times[i];
+		peak_features &pk = peaks[i];
+		std::vector<float> &bl = baselines[i];
+		shaped_features &e = energies[i];
+
+		// the baselines come first, since the running estimate has to go through the traces in order
+		if(args->IsBaseline()) {
+			bl.resize(ntraces);
+			RunOnThreads(ntraces, [&](unsigned long, unsigned long from, unsigned long count) {
+				calculate_baselines_batch(traces.sub(from, count), baseline, bl, from);
+			});
+			if(baseline.method == BASELINE_RUNNING) {
+				running_baselines(bl, 0, ntraces, baseline_state[i], baseline.weight);
+			}
+		}
+
+		// traces [from, from+count) on the k-th thread
+		auto analyse = [&](unsigned long k, unsigned long from, unsigned long count) {
+			unsigned long j;
+
+			// before anything changes the samples
+			measurement->CountSamples(traces.trace(from), count*length, samples_thread[i][k]);
+			if(args->IsBaselineSubtracted()) {
+				subtract_baselines(spare[i], count, length, bl, from, clip);
+			}
+			if(IsPsd()) {
+				calculate_integrals_batch(traces.sub(from, count), args->GetPsdDt1(), args->GetPsdLength(), clip, f, from, shift);
+				// after the shift, so that the results are the same as those from the binary files
+				if(args->IsBaseline() && !args->IsBaselineSubtracted()) {
+					correct_integrals(f, bl, from, count, length, args->GetPsdLength(), 1.0/(1 << shift));
+				}
+			}
+			if(args->IsPeaks()) {
+				find_peaks_batch(traces.sub(from, count), peak, pk, from);
+				if(shift > 0) {
+					for(j=from*pk.max_peaks; j<(from+count)*pk.max_peaks; j++) {
+						pk.height[j] /= 1 << shift;
+					}
+				}
+				if(IsPsd()) {
+					flag_pileup(pk, f, from, count);
+				}
+			}
+			if(IsHist()) {
+				hist_thread[i][k].fill(f, from, count);
+			}
+			if(args->IsAverage()) {
+				accumulate_traces(traces.sub(from, count), average_thread[i][k]);
+			}
+			if(args->IsShaper()) {
+				shape_traces(traces.sub(from, count), shapers[k], (unsigned int)trigger_sample, e, shaped_buffers[k], from);
+			}
+			if(args->IsTiming()) {
+				calculate_crossing_times_batch(traces.sub(from, count), timing, tm, from);
+				add_trigger_times(tm, &spare_trigger_ps[from], dt_ps, trigger_sample, from, count);
+			}
+		};
+
+		if(IsPsd()) {
+			f.resize(ntraces);
+		}
+		if(args->IsTiming()) {
+			tm.resize(ntraces);
+		}
+		if(args->IsPeaks()) {
+			pk.resize(ntraces);
+		}
+		if(args->IsShaper()) {
+			e.resize(ntraces);
+		}
+		RunOnThreads(ntraces, analyse);
+		for(k=0; k<samples_thread[i].size(); k++) {
+			measurement->GetSampleStatistics(i).merge(samples_thread[i][k]);
+			samples_thread[i][k].reset();
+		}
+		if(IsHist()) {
+			for(k=0; k<hist_thread[i].size(); k++) {
+				hist[i].merge(hist_thread[i][k]);
+				hist_thread[i][k].reset();
+			}
+		}
+		if(args->IsAverage()) {
+			for(k=0; k<average_thread[i].size(); k++) {
+				average[i].merge(average_thread[i][k]);
+				average_thread[i][k].reset();
+			}
+		}
+
+		if(f_features[i] != NULL) {
+			if(args->IsBinaryOutput()) {
+				write_integrals_binary(f, f_features[i]);
+			} else {
+				write_integrals_text(f, f_features[i]);
+			}
+		}
+		if(f_times[i] != NULL) {
+			if(args->IsBinaryOutput()) {
+				write_times_binary(tm, f_times[i]);
+			} else {
+				write_times_text(tm, f_times[i]);
+			}
+		}
+		if(f_baselines[i] != NULL) {
+			if(args->IsBinaryOutput()) {
+				write_baselines_binary(bl, f_baselines[i], 0, ntraces, 1.0/(1 << shift));
+			} else {
+				write_baselines_text(bl, f_baselines[i], 0, ntraces, 1.0/(1 << shift));
+			}
+		}
+		if(f_energy[i] != NULL) {
+			if(args->IsBinaryOutput()) {
+				write_shaped_binary(e, f_energy[i], 0, ntraces, 1.0/(1 << shift));
+			} else {
+				write_shaped_text(e, f_energy[i], 0, ntraces, 1.0/(1 << shift));
+			}
+		}
+		if(f_peaks[i] != NULL) {
+			for(k=0; k<ntraces; k++) {
+				piled_up[i] += pk.is_piled_up(k) ? 1 : 0;
+			}
+			if(args->IsBinaryOutput()) {
+				write_peaks_binary(pk, f_peaks[i]);
+			} else {
+				write_peaks_text(pk, f_peaks[i]);
+			}
+		}
+		// every n-th trace (counting from the start of the measurement)
+		if(args->GetKeepRaw() > 0) {
+			for(k=(args->GetKeepRaw() - first_trace%args->GetKeepRaw()) % args->GetKeepRaw(); k<ntraces; k+=args->GetKeepRaw()) {
+				WriteRaw(i, traces.trace(k), length);
+				kept++;
+			}
+		}
+		channels++;
+	}
+	if(channels > 0) {
+		traces_kept += kept/channels;
+	}
+	measurement->PrintSampleStatistics();
+	// after all channels, since the events need the hits of every one of them
+	if(events != NULL) {
+		BuildEvents(ntraces, first_trace, shift);
+	}
+	if(IsHist() || args->IsAverage()) {
+		since_snapshot.Stop();
+		if(since_snapshot.GetSecondsDouble() >= 1.0) {
+			SaveHistograms();
+			SaveAverages();
+			since_snapshot.Start();
+		}
+	}
+	t.Stop();
+	seconds_busy += t.GetSecondsDouble();
+	FILE_LOG(logDEBUG2) << "OnlineAnalysis::Analyse - " << ntraces << " traces in " << t.GetSecondsDouble() << "s";
+}
+
+// same format as Measurement::WriteDataBin and Measurement::WriteDataTxt
+void OnlineAnalysis::WriteRaw(int channel, const short *trace, unsigned long length)
+{
+	unsigned long i;
+	bool is_8bit = measurement->GetSeries() == PICO_6000;
+	std::vector<char> data_8bit;
+
+	if(args->IsBinaryOutput()) {
+		if(is_8bit) {
+			data_8bit.resize(length);
+			for(i=0; i<length; i++) {
+				data_8bit[i] = trace[i] >> 8;
+			}
+			fwrite(&data_8bit[0], sizeof(char), length, f_raw[channel]);
+		} else {
+			fwrite(trace, sizeof(short), length, f_raw[channel]);
+		}
+	} else {
+		for(i=0; i<length; i++) {
+			fprintf(f_raw[channel], "%d\n", is_8bit ? trace[i]>>8 : trace[i]);
+		}
+	}
+}
+
+void OnlineAnalysis::BuildEvents(unsigned long ntraces, unsigned long first_trace, int shift)
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::BuildEvents (ntraces=" << ntraces << ", first_trace=" << first_trace << ")";
+
+	size_t k;
+	unsigned long j;
+	bool restart = false;
+	auto write = [this](const coincidence_hit *h, size_t n, uint32_t mask) { WriteEvent(h, n, mask); };
+
+	// a clock that went backwards (for example at a new repeat) starts a new run of the event builder
+	for(k=0; k<event_channels.size(); k++) {
+		const pulse_times &tm = times[event_channels[k]];
+		for(j=0; j<ntraces && tm.problem[j]; j++);
+		if(j < ntraces && tm.timestamp_ps[j] < events->get_last_time(k)) {
+			restart = true;
+		}
+	}
+	if(restart) {
+		events->restart(write);
+	}
+	for(k=0; k<event_channels.size(); k++) {
+		int i = event_channels[k];
+		const pulse_times &tm = times[i];
+
+		hits.clear();
+		for(j=0; j<ntraces; j++) {
+			if(tm.problem[j]) {
+				continue;
+			}
+			coincidence_hit h;
+			h.time_ps = tm.timestamp_ps[j];
+			h.trace   = (uint32_t)(first_trace + j);
+			h.channel = k;
+			// the amplitude of the shaped pulse or integral1, in units of 8-bit samples for 6000 series
+			if(args->IsShaper()) {
+				h.energy = energies[i].amplitude[j]/(1 << shift);
+			} else if(IsPsd()) {
+				h.energy = (float)features[i].integral1[j];
+			} else {
+				h.energy = 0;
+			}
+			hits.push_back(h);
+		}
+		events->add(k, hits.empty() ? NULL : &hits[0], hits.size());
+		// the pulses of the next segments can't come before the start of the last trace
+		if(ntraces > 0) {
+			events->advance(k, spare_trigger_ps[ntraces-1] - (int64_t)llround(trigger_sample*dt_ps));
+		}
+	}
+	events->build(write);
+}
+
+void OnlineAnalysis::WriteEvent(const coincidence_hit *h, size_t n, uint32_t mask)
+{
+	if(args->IsBinaryOutput()) {
+		write_event_binary(h, n, mask, f_events);
+	} else {
+		write_event_text(h, n, mask, event_channel_names.c_str(), f_events);
+	}
+}
+
+void OnlineAnalysis::FlushEvents()
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::FlushEvents";
+
+	if(events != NULL) {
+		events->finish();
+		events->build([this](const coincidence_hit *h, size_t n, uint32_t mask) { WriteEvent(h, n, mask); });
+		fflush(f_events);
+	}
+}
+
+void OnlineAnalysis::SaveHistograms()
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::SaveHistograms";
+
+	int i;
+
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(!hist_filename[i].empty() && !hist[i].save(hist_filename[i].c_str(), args->IsBinaryOutput())) {
+			std::cerr << "Unable to write " << hist_filename[i] << "\n";
+			throw "Unable to write histograms.";
+		}
+	}
+}
+
+// in units of 8-bit samples for 6000 series, like the other results
+void OnlineAnalysis::SaveAverages()
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::SaveAverages";
+
+	int i;
+	FILE *f;
+	double scale = measurement->GetSeries() == PICO_6000 ? 1.0/(1 << ps6000_samples::shift) : 1.0;
+
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		if(average_filename[i].empty()) {
+			continue;
+		}
+		f = fopen(average_filename[i].c_str(), args->IsBinaryOutput() ? "wb" : "wt");
+		if(f == NULL) {
+			std::cerr << "Unable to write " << average_filename[i] << "\n";
+			throw "Unable to write averages.";
+		}
+		if(args->IsBinaryOutput()) {
+			write_average_binary(average[i], f, scale);
+		} else {
+			write_average_text(average[i], f, scale);
+		}
+		fclose(f);
+	}
+}
+
+void OnlineAnalysis::WriteMetadata(FILE *f)
+{
+	FILE_LOG(logDEBUG3) << "OnlineAnalysis::WriteMetadata";
+
+	int i;
+
+	if(IsPsd()) {
+		fprintf(f, "psd:        dt1 %u, length %u\n", args->GetPsdDt1(), args->GetPsdLength());
+	}
+	if(args->IsTiming()) {
+		const timing_options &o = args->GetTimingOptions();
+		if(o.is_cfd) {
+			fprintf(f, "timing:     constant fraction %g", o.fraction);
+		} else {
+			fprintf(f, "timing:     leading edge %g below the baseline", o.level);
+		}
+		fprintf(f, ", %s interpolation, baseline from %u samples, trigger at sample %.0f, timestamps in ps\n",
+			o.is_cubic ? "cubic" : "linear", o.baseline_length, trigger_sample);
+	}
+	if(args->IsBaseline()) {
+		fprintf(f, "baseline:   %s of %.0f samples before the trigger, %s\n",
+			args->GetBaselineMethod() == BASELINE_MEDIAN ? "median of blocks" : (args->GetBaselineMethod() == BASELINE_RUNNING ? "running mean" : "mean"),
+			trigger_sample, args->IsBaselineSubtracted() ? "subtracted from the traces" : "n-gamma features corrected");
+	}
+	if(args->IsPeaks()) {
+		fprintf(f, "peaks:      threshold %g", args->GetPeakOptions().threshold);
+		if(args->GetPeakOptions().threshold <= 0) {
+			fprintf(f, " (%g sigma of the noise)", args->GetPeakOptions().nsigma);
+		}
+		fprintf(f, " over %u samples, piled up:", args->GetPeakOptions().gap);
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			if(measurement->GetChannel(i)->IsEnabled()) {
+				fprintf(f, " %c %lu", 'A'+i, piled_up[i]);
+			}
+		}
+		fprintf(f, "\n");
+	}
+	if(args->IsShaper()) {
+		fprintf(f, "shaper:     %s, amplitude from the level of %.0f samples before the trigger\n",
+			shaper_description(args->GetShaperOptions()).c_str(), trigger_sample);
+	}
+	if(events != NULL) {
+		const coincidence_statistics &s = events->get_statistics();
+		const coincidence_options    &o = events->get_options();
+		size_t a, b, n = event_channels.size();
+
+		fprintf(f, "coincidence: window %g ns, at least %u of the channels %s (%s), %llu coincidences of %llu hits in %.6f s\n",
+			o.window_ps*1e-3, o.multiplicity, event_channel_names.c_str(), args->IsShaper() ? "amplitude" : (IsPsd() ? "integral1" : "no energy"),
+			(unsigned long long)s.coincidences, (unsigned long long)s.hits(), s.seconds());
+		for(a=0; a<n; a++) {
+			fprintf(f, "singles_%c:  %llu (%.1f/s)\n", event_channel_names[a], (unsigned long long)s.singles[a], s.rate(a));
+		}
+		for(a=0; a<n; a++) {
+			for(b=a+1; b<n; b++) {
+				fprintf(f, "coinc_%c%c:   %llu, accidentals %.1f from the singles, %llu in a window delayed by %g ns\n",
+					event_channel_names[a], event_channel_names[b], (unsigned long long)s.pairs[a*n+b],
+					s.accidentals(a, b, o.window_ps), (unsigned long long)s.delayed[a*n+b], o.delay_ps*1e-3);
+			}
+		}
+		if(s.unsorted > 0) {
+			fprintf(f, "# WARNING: %llu hits were not in the order of time\n", (unsigned long long)s.unsorted);
+		}
+	}
+	if(args->IsAverage()) {
+		double scale = measurement->GetSeries() == PICO_6000 ? 1.0/(1 << ps6000_samples::shift) : 1.0;
+		unsigned long k;
+
+		fprintf(f, "average:    sum of the traces in 64 bits%s, in units of %s samples", args->IsAverageRms() ? " with the rms" : "",
+			measurement->GetSeries() == PICO_6000 ? "8-bit" : "16-bit");
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			if(!average_filename[i].empty()) {
+				const trace_average &a = average[i];
+				unsigned long lo = 0;
+				for(k=1; k<a.length(); k++) {
+					lo = a.sum[k] < a.sum[lo] ? k : lo;
+				}
+				fprintf(f, ", %c: %llu traces, minimum %.3f at sample %lu", 'A'+i, (unsigned long long)a.count,
+					a.length() > 0 ? a.mean(lo)*scale : 0.0, lo);
+			}
+		}
+		fprintf(f, "\n");
+	}
+	fprintf(f, "online:     %lu traces analysed on %u threads in %.3f s, waited %.3f s for the analysis\n",
+		traces_total, nthreads, seconds_busy, seconds_waited);
+	if(args->GetKeepRaw() > 0) {
+		fprintf(f, "psd_raw:    every %lu. trace kept (%lu traces)\n", args->GetKeepRaw(), traces_kept);
+	}
+	if(IsHist()) {
+		fprintf(f, "psd_hist:   %u bins, integral1 < %g, integral2 < %g", args->GetHistBins(), args->GetHistIntegral1Max(), args->GetHistIntegral2Max());
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			if(!hist_filename[i].empty()) {
+				fprintf(f, ", %c: %llu events (%llu with problems)", 'A'+i,
+					(unsigned long long)hist[i].integral1.entries(), (unsigned long long)hist[i].problems);
+			}
+		}
+		fprintf(f, "\n");
+	}
+}
@@ -0,0 +1,137 @@
+#ifndef __ONLINE_H__
+#define __ONLINE_H__
+
+#include <stdio.h>
+#include <thread>
+#include <exception>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "picoscope.h"
+#include "measurement.h"
+#include "args.h"
+#include "timing.h"
+#include "analysis/n-gamma.h"
+#include "analysis/histogram.h"
+#include "analysis/pulse-timing.h"
+#include "analysis/peaks.h"
+#include "analysis/baseline.h"
+#include "analysis/filters.h"
+#include "analysis/coincidence.h"
+#include "analysis/average.h"
+
+/*
+	Pulse-shape discrimination and timing of pulses while the acquisition is running.
+
+	After every call to GetNextDataBulk the buffers with the fetched traces are swapped
+	with a spare set (no copying), and the n-gamma features and/or the crossing times are calculated on worker threads
+	while picoscope fetches the next traces or waits for the next trigger.
+	Only the features are written, plus every n-th raw trace if requested.
+
+	With --hist every worker thread fills its own histograms of the features,
+	which are added to the histograms of the channel after every block of traces;
+	a snapshot of them is written at most once per second and at the end.
+	With --baseline the baseline of every trace is calculated first and either subtracted
+	from the traces or used to correct the n-gamma features.
+	With --peaks every pulse of a trace is found and piled-up traces are flagged in the features.
+	With --shaper every trace is shaped (on its own, starting from the first sample)
+	and the amplitude of the shaped pulse is written.
+	With --timing the crossing times are combined with the trigger time offsets of the segments
+	into absolute timestamps.
+	With --average every worker thread sums its traces into its own accumulators,
+	which are added to the average of the channel after every block (written like the histograms).
+	With --coincidence the timestamps of all channels are merged after every block of traces
+	and the hits within the window are written as events (hits still waiting for the other channels
+	stay in the event builder until the next block or FlushEvents).
+ */
+class OnlineAnalysis {
+public:
+	OnlineAnalysis(Measurement *m, Args *a);
+	~OnlineAnalysis();
+
+	void OpenFiles();
+	void CloseFiles();
+
+	// takes over the traces that have just been fetched and analyses them in the background
+	void Submit();
+	// waits until the traces from the previous call to Submit have been analysed and written
+	void Wait();
+
+	// writes the current histograms of all channels (when they are enabled)
+	void SaveHistograms();
+	// writes the current averages of all channels (when they are enabled)
+	void SaveAverages();
+	// builds and writes the events still waiting in the event builder (at the end of the measurement)
+	void FlushEvents();
+	void WriteMetadata(FILE *f);
+	// the names of the files that OpenFiles has opened (or that are written at the end)
+	const std::vector<std::string>& GetFiles() const { return output_files; };
+
+private:
+	Measurement *measurement;
+	Args        *args;
+
+	short         *spare[PICOSCOPE_N_CHANNELS];
+	unsigned long  spare_length[PICOSCOPE_N_CHANNELS];
+
+	FILE *f_features[PICOSCOPE_N_CHANNELS];
+	FILE *f_raw[PICOSCOPE_N_CHANNELS];
+	FILE *f_times[PICOSCOPE_N_CHANNELS];
+	FILE *f_peaks[PICOSCOPE_N_CHANNELS];
+	FILE *f_baselines[PICOSCOPE_N_CHANNELS];
+	FILE *f_energy[PICOSCOPE_N_CHANNELS];
+	ngamma_features features[PICOSCOPE_N_CHANNELS];
+	pulse_times     times[PICOSCOPE_N_CHANNELS];
+	peak_features   peaks[PICOSCOPE_N_CHANNELS];
+	unsigned long   piled_up[PICOSCOPE_N_CHANNELS];
+	std::vector<float> baselines[PICOSCOPE_N_CHANNELS];
+	// the running estimate of the baseline after the last trace
+	double          baseline_state[PICOSCOPE_N_CHANNELS];
+	shaped_features energies[PICOSCOPE_N_CHANNELS];
+	// every thread has its own shaper and a buffer for the shaped traces
+	std::vector<pulse_shaper>       shapers;
+	std::vector<std::vector<float> > shaped_buffers;
+	// events from the hits of all channels; builder channel k is the scope channel event_channels[k]
+	FILE               *f_events;
+	event_builder      *events;
+	std::vector<int>    event_channels;
+	std::string         event_channel_names;
+	std::vector<coincidence_hit> hits;
+	// trigger time offsets of the traces in the spare buffers
+	std::vector<int64_t> spare_trigger_ps;
+	double               dt_ps, trigger_sample;
+
+	psd_histograms               hist[PICOSCOPE_N_CHANNELS];
+	std::vector<psd_histograms>  hist_thread[PICOSCOPE_N_CHANNELS];
+	std::string                  hist_filename[PICOSCOPE_N_CHANNELS];
+	Timing                       since_snapshot;
+
+	trace_average                average[PICOSCOPE_N_CHANNELS];
+	std::vector<trace_average>   average_thread[PICOSCOPE_N_CHANNELS];
+	std::string                  average_filename[PICOSCOPE_N_CHANNELS];
+	std::vector<std::string>     output_files;
+
+	// statistics of the samples, added to those of the measurement after every block
+	std::vector<sample_statistics> samples_thread[PICOSCOPE_N_CHANNELS];
+
+	std::thread        worker;
+	std::exception_ptr error;
+	unsigned int       nthreads;
+
+	// statistics
+	unsigned long traces_total, traces_kept;
+	double        seconds_busy, seconds_waited;
+
+	bool IsPsd()  const { return args->IsPsd(); };
+	bool IsHist() const { return args->GetHistBins() > 0; };
+	// calls f(k, from, count) on nthreads threads for the traces [from, from+count) and waits for all of them
+	void RunOnThreads(unsigned long ntraces, const std::function<void(unsigned long, unsigned long, unsigned long)> &f);
+	void Analyse(unsigned long ntraces, unsigned long length, unsigned long first_trace);
+	void WriteRaw(int channel, const short *trace, unsigned long length);
+	// adds the timestamps of a block of traces of all channels to the event builder and writes the complete events
+	void BuildEvents(unsigned long ntraces, unsigned long first_trace, int shift);
+	void WriteEvent(const coincidence_hit *h, size_t n, uint32_t mask);
+};
+
+#endif
@@ -19,7 +19,8 @@ Picoscope::Picoscope(PICO_SERIES s) {
 	int i;
 
 	series  = s;
-	var_is_open  = false;
+	var_is_open    = false;
+	var_is_opening = false;
 	SetReady(false);
 	handle = PICOSCOPE_HANDLE_UNITIALIZED;
 	return_status = PICO_OK;
@@ -55,32 +56,24 @@ Picoscope::~Picoscope() {
 	// delete [] data; - if it was not initialized
 }
 
-PICO_STATUS Picoscope::Open() {
+// checks that picoscope can be opened at all
+void Picoscope::CheckBeforeOpen()
+{
 	// previous operation has failed: do we really want to try to proceed? (maybe we could remove this statement)
 	if(return_status != PICO_OK) {
 		throw PicoscopeException(return_status);
 	}
 	// first check if Picoscope has already been opened
-	if(var_is_open == true) {
+	if(var_is_open == true || var_is_opening == true) {
 		// TODO: this doesn't need to be fatal ...
 		throw PicoscopeUserException("Are you trying to open an already opened Picoscope?");
-		// TODO: this is wrong!!! (but the code doesn't come that far anyway)
-		return_status = PICO_OK;
-	} else {
-		// finally: open the unit
-		if(GetSeries() == PICO_4000) {
-			FILE_LOG(logINFO) << "Open Picoscope 4000 ...";
-			// std::cerr << "Open Picoscope 4000 ... ";
-			return_status = ps4000OpenUnit(&handle);
-		} else {
-			FILE_LOG(logINFO) << "Open Picoscope 6000 ...";
-			FILE_LOG(logDEBUG2) << "ps6000OpenUnit(&handle, serial=NULL)";
-			// std::cerr << "Open Picoscope 6000 ... ";
-			return_status = ps6000OpenUnit(&handle, NULL);
-			FILE_LOG(logDEBUG2) << "-> handle=" << handle;
-		}
 	}
+}
 
+// checks the status and the handle once the driver reports that the unit has been opened
+void Picoscope::CheckAfterOpen()
+{
+	var_is_opening = false;
 	// if unit has been opened successfully ...
 	if(return_status == PICO_OK) {
 		// if proper handle has been assigned ...
@@ -93,12 +86,85 @@ PICO_STATUS Picoscope::Open() {
 	} else {
 		throw PicoscopeException(return_status);
 	}
+}
+
+PICO_STATUS Picoscope::Open() {
+	CheckBeforeOpen();
+
+	// finally: open the unit
+	if(GetSeries() == PICO_4000) {
+		FILE_LOG(logINFO) << "Open Picoscope 4000 ...";
+		// std::cerr << "Open Picoscope 4000 ... ";
+		return_status = ps4000OpenUnit(&handle);
+	} else {
+		FILE_LOG(logINFO) << "Open Picoscope 6000 ...";
+		FILE_LOG(logDEBUG2) << "ps6000OpenUnit(&handle, serial=NULL)";
+		// std::cerr << "Open Picoscope 6000 ... ";
+		return_status = ps6000OpenUnit(&handle, NULL);
+		FILE_LOG(logDEBUG2) << "-> handle=" << handle;
+	}
+	CheckAfterOpen();
 	// throw PicoscopeUserException("this is not supposed to happen (just testing).");
 
 	std::cerr << "OK\n";
 	return return_status;
 }
 
+// the driver opens the unit in the background; PollOpen has to be called until it returns true
+void Picoscope::OpenAsync()
+{
+	int16_t started = 0;
+
+	CheckBeforeOpen();
+
+	if(GetSeries() == PICO_4000) {
+		FILE_LOG(logINFO) << "Open Picoscope 4000 (in background) ...";
+		FILE_LOG(logDEBUG2) << "ps4000OpenUnitAsync(&status)";
+		return_status = ps4000OpenUnitAsync(&started);
+	} else {
+		FILE_LOG(logINFO) << "Open Picoscope 6000 (in background) ...";
+		FILE_LOG(logDEBUG2) << "ps6000OpenUnitAsync(&status, serial=NULL)";
+		return_status = ps6000OpenUnitAsync(&started, NULL);
+	}
+	FILE_LOG(logDEBUG2) << "-> status=" << started;
+	if(return_status != PICO_OK) {
+		throw PicoscopeException(return_status);
+	}
+	if(started == 0) {
+		throw PicoscopeUserException("Unable to start opening Picoscope; another open operation is already in progress.");
+	}
+	var_is_opening = true;
+}
+
+// returns true once the unit opened with OpenAsync is ready to be used
+bool Picoscope::PollOpen(short *progress)
+{
+	int16_t percent = 0, complete = 0;
+
+	if(var_is_open) {
+		return true;
+	}
+	if(!var_is_opening) {
+		throw PicoscopeUserException("Picoscope::PollOpen called without Picoscope::OpenAsync.");
+	}
+
+	if(GetSeries() == PICO_4000) {
+		return_status = ps4000OpenUnitProgress(&handle, &percent, &complete);
+	} else {
+		return_status = ps6000OpenUnitProgress(&handle, &percent, &complete);
+	}
+	FILE_LOG(logDEBUG4) << "Picoscope::PollOpen - progress=" << percent << "%, complete=" << complete;
+	if(progress != NULL) {
+		*progress = percent;
+	}
+	if(return_status != PICO_OK || complete) {
+		CheckAfterOpen();
+		std::cerr << "OK\n";
+		return true;
+	}
+	return false;
+}
+
 PICO_STATUS Picoscope::Close()
 {
 	FILE_LOG(logINFO) << "Close Picoscope ...";
@@ -43,6 +43,8 @@ private:
 	PICO_SERIES series;
 	// if picoscope is open or not (for book-keeping; not really needed)
 	bool var_is_open;
+	// if OpenAsync has been called, but the unit is not ready yet
+	bool var_is_opening;
 	// 
 	static bool var_is_ready;
 	PICO_STATUS return_status; // WATCH OUT: another one is set by a measurement!!! TODO
@@ -54,11 +56,17 @@ private:
 	// >0: value is the handle to the open device
 	short handle;
 
+	void CheckBeforeOpen();
+	void CheckAfterOpen();
+
 public:
 	Picoscope(PICO_SERIES);
 	~Picoscope();
 
 	PICO_STATUS Open();
+	// opening takes seconds; other work can be done in the meantime
+	void        OpenAsync();
+	bool        PollOpen(short *progress=NULL);
 	PICO_STATUS Close();
 	// bool        IsReady()   const { return var_is_ready; };
 	static bool IsReady()            { return var_is_ready; };
@@ -0,0 +1,211 @@
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "planner.h"
+#include "picoscope.h"
+#include "measurement.h"
+#include "timing.h"
+#include "log.h"
+
+#include "picoStatus.h"
+#include "ps4000Api.h"
+#include "ps6000Api.h"
+
+Planner::Planner(Measurement *m)
+{
+	FILE_LOG(logDEBUG3) << "Planner::Planner (Measurement=" << m << ")";
+
+	measurement = m;
+	queries     = 0;
+}
+
+unsigned long Planner::SegmentSamples(unsigned long n)
+{
+	FILE_LOG(logDEBUG3) << "Planner::SegmentSamples (n=" << n << ")";
+
+	Measurement *meas = GetMeasurement();
+	uint32_t max_length = 0;
+	PICO_STATUS status;
+
+	queries++;
+	if(meas->GetSeries() == PICO_4000) {
+		// the number of segments is 16 bits only
+		if(n > 0xFFFF) {
+			return 0;
+		}
+		FILE_LOG(logDEBUG2) << "ps4000MemorySegments(handle=" << meas->GetHandle() << ", nSegments=" << n << ", &max_length)";
+		status = ps4000MemorySegments(
+			meas->GetHandle(), // handle
+			(uint16_t)n,       // nSegments
+			&max_length);      // nMaxSamples
+	} else {
+		FILE_LOG(logDEBUG2) << "ps6000MemorySegments(handle=" << meas->GetHandle() << ", nSegments=" << n << ", &max_length)";
+		status = ps6000MemorySegments(
+			meas->GetHandle(), // handle
+			(uint32_t)n,       // nSegments
+			&max_length);      // nMaxSamples
+	}
+	FILE_LOG(logDEBUG2) << "-> status=" << status << ", max_length=" << max_length;
+
+	return status == PICO_OK ? max_length : 0;
+}
+
+unsigned long Planner::MaxSegments(unsigned long samples, unsigned long limit)
+{
+	FILE_LOG(logDEBUG3) << "Planner::MaxSegments (samples=" << samples << ", limit=" << limit << ")";
+
+	unsigned long lo, hi, mid;
+
+	if(SegmentSamples(1) < samples) {
+		return 0;
+	}
+	// the memory of a single segment divided by the samples is an upper bound
+	hi = SegmentSamples(1)/samples;
+	hi = limit > 0 && limit < hi ? limit : hi;
+	lo = 1;
+	if(SegmentSamples(hi) >= samples) {
+		return hi;
+	}
+	// lo fits, hi doesn't
+	while(hi - lo > 1) {
+		mid = lo + (hi - lo)/2;
+		if(SegmentSamples(mid) >= samples) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+PICO_STATUS Planner::QueryTimebase(unsigned long timebase, float &interval_ns, unsigned long &max_samples)
+{
+	FILE_LOG(logDEBUG3) << "Planner::QueryTimebase (timebase=" << timebase << ")";
+
+	Measurement *meas = GetMeasurement();
+	PICO_STATUS status;
+
+	queries++;
+	interval_ns = 0;
+	if(meas->GetSeries() == PICO_4000) {
+		int32_t max4000 = 0;
+
+		FILE_LOG(logDEBUG2) << "ps4000GetTimebase2(handle=" << meas->GetHandle() << ", timebase=" << timebase << ", length=" << meas->GetLength() << ", &time_interval_ns, oversample=0, &maxSamples, segmentIndex=0)";
+		status = ps4000GetTimebase2(
+			meas->GetHandle(),           // handle
+			timebase,                    // timebase
+			(int32_t)meas->GetLength(),  // noSamples
+			&interval_ns,                // timeIntervalNanoseconds
+			0,                           // oversample
+			&max4000,                    // maxSamples
+			0);                          // segmentIndex
+		max_samples = max4000 > 0 ? max4000 : 0;
+	} else {
+		uint32_t max6000 = 0;
+
+		FILE_LOG(logDEBUG2) << "ps6000GetTimebase2(handle=" << meas->GetHandle() << ", timebase=" << timebase << ", length=" << meas->GetLength() << ", &time_interval_ns, oversample=0, &maxSamples, segmentIndex=0)";
+		status = ps6000GetTimebase2(
+			meas->GetHandle(),           // handle
+			timebase,                    // timebase
+			(uint32_t)meas->GetLength(), // noSamples
+			&interval_ns,                // timeIntervalNanoseconds
+			0,                           // oversample
+			&max6000,                    // maxSamples
+			0);                          // segmentIndex
+		max_samples = max6000;
+	}
+	FILE_LOG(logDEBUG2) << "-> status=" << status << ", time_interval_ns=" << interval_ns << ", maxSamples=" << max_samples;
+
+	return status;
+}
+
+MeasurementPlan Planner::Make(unsigned long ntraces)
+{
+	FILE_LOG(logDEBUG3) << "Planner::Make (ntraces=" << ntraces << ")";
+
+	Measurement *meas = GetMeasurement();
+	MeasurementPlan plan;
+	unsigned long need, tb, first, max_samples;
+	float interval_ns;
+	bool found = false;
+	PICO_STATUS status = PICO_OK;
+	Timing t;
+
+	t.Start();
+	queries = 0;
+	plan.length       = meas->GetLength();
+	plan.channels     = meas->GetNumberOfEnabledChannels() > 0 ? meas->GetNumberOfEnabledChannels() : 1;
+	plan.requested_ns = meas->GetRequestedIntervalPs()*1e-3;
+	need = plan.length*plan.channels;
+
+	// segments: as many as fit or the requested ones
+	if(ntraces == 0 || SegmentSamples(ntraces) < need) {
+		plan.max_segments = MaxSegments(need, 0);
+		plan.segments     = ntraces == 0 ? plan.max_segments : 0;
+	} else {
+		plan.segments = ntraces;
+	}
+	if(plan.segments == 0) {
+		std::cerr << "At most " << plan.max_segments << " traces of " << plan.length << " samples (of "
+		          << plan.channels << " channels) fit into the memory of picoscope, but you requested " << ntraces << "\n";
+		meas->InvalidateSegments();
+		throw Picoscope::PicoscopeUserException("The traces don't fit into the memory of picoscope.");
+	}
+	// the timebase is checked with the segments that will be used
+	SegmentSamples(plan.segments);
+	first = meas->GetTimebase() > 0 ? meas->GetTimebase()-1 : 0;
+	for(tb=first; tb<=meas->GetTimebase()+1; tb++) {
+		if(QueryTimebase(tb, interval_ns, max_samples) == PICO_OK && interval_ns <= plan.requested_ns*(1+1e-6) &&
+		   (!found || interval_ns > plan.interval_ns)) {
+			plan.timebase    = tb;
+			plan.interval_ns = interval_ns;
+			plan.max_samples = max_samples;
+			found = true;
+		}
+	}
+	// the enabled channels need a slower timebase (or the requested interval is shorter than the fastest one)
+	for(tb=meas->GetTimebase(); !found && tb<=meas->GetTimebase()+16; tb++) {
+		status = QueryTimebase(tb, interval_ns, max_samples);
+		if(status == PICO_OK) {
+			plan.timebase    = tb;
+			plan.interval_ns = interval_ns;
+			plan.max_samples = max_samples;
+			found = true;
+		}
+	}
+	meas->InvalidateSegments();
+	if(!found) {
+		std::cerr << "Picoscope doesn't accept any timebase from " << meas->GetTimebase()
+		          << " on with " << plan.channels << " channels" << std::endl;
+		throw Picoscope::PicoscopeException(status);
+	}
+	t.Stop();
+	plan.queries = queries;
+	plan.seconds = t.GetSecondsDouble();
+
+	return plan;
+}
+
+void Planner::Apply(const MeasurementPlan &plan)
+{
+	FILE_LOG(logDEBUG3) << "Planner::Apply";
+
+	GetMeasurement()->SetTimebase(plan.timebase);
+	GetMeasurement()->SetNTraces(plan.segments);
+}
+
+std::string Planner::Describe(const MeasurementPlan &plan)
+{
+	std::ostringstream s;
+
+	s << "timebase " << plan.timebase << " (" << plan.interval_ns << " ns, " << plan.requested_ns << " ns requested), "
+	  << plan.segments << (plan.segments > 1 ? " traces" : " trace") << " of " << plan.length << " samples per arm";
+	if(plan.max_segments > 0) {
+		s << " (the most that fit with " << plan.channels << (plan.channels > 1 ? " channels)" : " channel)");
+	}
+	s << ", at most " << plan.max_samples << " samples per trace; " << plan.queries << " driver queries in " << plan.seconds << " s";
+
+	return s.str();
+}
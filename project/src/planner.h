@@ -0,0 +1,60 @@
+#ifndef __PLANNER_H__
+#define __PLANNER_H__
+
+#include <string>
+
+#include "picoscope.h"
+#include "measurement.h"
+
+/*
+	The timebase and the number of segments (traces per arm in rapid block mode) of a measurement,
+	chosen by asking picoscope instead of using the formulas of the series:
+	- a segment has to hold the samples of all the enabled channels (they share its memory), so the most
+	  segments are found by bisection over ps*MemorySegments (a segment only gets shorter with more of them)
+	- the timebase is the slowest one whose interval (as reported by ps*GetTimebase2) is not longer than
+	  the requested one, out of the timebase from the formula and its neighbours; when picoscope doesn't accept
+	  any of them with the enabled channels, the next slower ones are tried
+
+	Picoscope keeps the segments of the last query, so the measurement sets them again before the next run.
+ */
+struct MeasurementPlan {
+	unsigned long timebase;
+	double        interval_ns;   // reported by picoscope
+	double        requested_ns;
+	unsigned long length;        // of a trace
+	int           channels;      // enabled
+	unsigned long segments;      // traces per arm
+	unsigned long max_segments;  // the most traces of this length that fit (0: not searched for)
+	unsigned long max_samples;   // of a trace with this timebase and these segments (reported by picoscope)
+	unsigned long queries;       // to the driver
+	double        seconds;       // that the planning took
+
+	MeasurementPlan() : timebase(0), interval_ns(0), requested_ns(0), length(0), channels(0), segments(0),
+		max_segments(0), max_samples(0), queries(0), seconds(0) {};
+};
+
+class Planner {
+public:
+	Planner(Measurement *m);
+	~Planner() {};
+
+	// the plan for 'ntraces' traces per arm (0: as many as fit) of the length and the channels of the measurement
+	MeasurementPlan Make(unsigned long ntraces);
+	// passes the timebase and the number of traces of the plan to the measurement
+	void Apply(const MeasurementPlan &plan);
+	static std::string Describe(const MeasurementPlan &plan);
+
+	Measurement* GetMeasurement() const { return measurement; };
+
+private:
+	Measurement   *measurement;
+	unsigned long queries;
+
+	// the samples of a segment when the memory is divided into n of them (0 if picoscope doesn't accept n)
+	unsigned long SegmentSamples(unsigned long n);
+	// the most segments (up to 'limit') that hold 'samples' samples each; 0 if not even a single one does
+	unsigned long MaxSegments(unsigned long samples, unsigned long limit);
+	PICO_STATUS   QueryTimebase(unsigned long timebase, float &interval_ns, unsigned long &max_samples);
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include <iostream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "realtime.h"
+
+#include "log.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// from <numaif.h>; we don't want to depend on libnuma just for these
+#define REALTIME_MPOL_DEFAULT   0
+#define REALTIME_MPOL_PREFERRED 1
+
+RealTime::RealTime()
+{
+	FILE_LOG(logDEBUG3) << "RealTime::RealTime";
+
+	struct sched_param param;
+
+	param.sched_priority = 0;
+	saved_policy   = SCHED_OTHER;
+	saved_priority = 0;
+	is_saved = pthread_getaffinity_np(pthread_self(), sizeof(saved_affinity), &saved_affinity) == 0 &&
+	           pthread_getschedparam(pthread_self(), &saved_policy, &param) == 0;
+	if(is_saved) {
+		saved_priority = param.sched_priority;
+	}
+}
+
+RealTime::~RealTime()
+{
+	FILE_LOG(logDEBUG3) << "RealTime::~RealTime";
+
+	struct sched_param param;
+
+	if(is_saved) {
+		param.sched_priority = saved_priority;
+		pthread_setschedparam(pthread_self(), saved_policy, &param);
+		pthread_setaffinity_np(pthread_self(), sizeof(saved_affinity), &saved_affinity);
+	}
+}
+
+void RealTime::PinThread(int cpu)
+{
+	FILE_LOG(logDEBUG3) << "RealTime::PinThread (cpu=" << cpu << ")";
+
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+		std::cerr << "Unable to pin thread to CPU " << cpu << "\n";
+		throw "Unable to set CPU affinity.";
+	}
+}
+
+void RealTime::SetPriority(int priority)
+{
+	FILE_LOG(logDEBUG3) << "RealTime::SetPriority (priority=" << priority << ")";
+
+	struct sched_param param;
+	int error;
+
+	param.sched_priority = priority;
+	error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if(error == EPERM) {
+		throw "Not allowed to use SCHED_FIFO (needs CAP_SYS_NICE or an rtprio limit).";
+	} else if(error != 0) {
+		std::cerr << "Unable to use SCHED_FIFO with priority " << priority << " (valid: "
+		          << sched_get_priority_min(SCHED_FIFO) << "-" << sched_get_priority_max(SCHED_FIFO) << ")\n";
+		throw "Unable to set real-time priority.";
+	}
+}
+
+void RealTime::Apply(int cpu, int priority)
+{
+	FILE_LOG(logDEBUG3) << "RealTime::Apply (cpu=" << cpu << ", priority=" << priority << ")";
+
+	if(cpu >= 0) {
+		PinThread(cpu);
+	}
+	if(priority > 0) {
+		SetPriority(priority);
+	}
+}
+
+static bool read_first_line(const std::string &filename, char *line, int size)
+{
+	FILE *f = fopen(filename.c_str(), "r");
+	bool ok;
+
+	if(f == NULL) {
+		return false;
+	}
+	ok = fgets(line, size, f) != NULL;
+	fclose(f);
+	return ok;
+}
+
+int RealTime::FindUsbNumaNode()
+{
+	FILE_LOG(logDEBUG3) << "RealTime::FindUsbNumaNode";
+
+	const char *usb_devices = "/sys/bus/usb/devices";
+	DIR *dir;
+	struct dirent *entry;
+	char line[100], path[PATH_MAX];
+	std::string device;
+	size_t slash;
+	int node = -1;
+
+	dir = opendir(usb_devices);
+	if(dir == NULL) {
+		return -1;
+	}
+	while(node < 0 && (entry = readdir(dir)) != NULL) {
+		device = std::string(usb_devices) + "/" + entry->d_name;
+		// Pico Technology
+		if(!read_first_line(device + "/idVendor", line, sizeof(line)) || strncmp(line, "0ce9", 4) != 0) {
+			continue;
+		}
+		if(realpath(device.c_str(), path) == NULL) {
+			continue;
+		}
+		// the closest PCI device above (the USB controller) knows its node
+		device = path;
+		while(node < 0 && (slash = device.rfind('/')) != std::string::npos && slash > 0) {
+			if(read_first_line(device + "/numa_node", line, sizeof(line))) {
+				node = atoi(line);
+				break;
+			}
+			device.erase(slash);
+		}
+		FILE_LOG(logDEBUG2) << "RealTime::FindUsbNumaNode - picoscope at " << path << " is on node " << node;
+	}
+	closedir(dir);
+
+	return node;
+}
+
+void RealTime::PreferNumaNode(int node)
+{
+	FILE_LOG(logDEBUG3) << "RealTime::PreferNumaNode (node=" << node << ")";
+
+	unsigned long mask;
+
+	if(node < 0 || node >= (int)(8*sizeof(mask))) {
+		return;
+	}
+	mask = 1UL << node;
+	if(syscall(SYS_set_mempolicy, REALTIME_MPOL_PREFERRED, &mask, 8*sizeof(mask)) != 0) {
+		FILE_LOG(logWARNING) << "Unable to prefer memory from NUMA node " << node << " (" << strerror(errno) << ")";
+	}
+}
+
+void RealTime::ResetNumaPolicy()
+{
+	FILE_LOG(logDEBUG3) << "RealTime::ResetNumaPolicy";
+
+	syscall(SYS_set_mempolicy, REALTIME_MPOL_DEFAULT, NULL, 0);
+}
+
+#else
+
+RealTime::RealTime() { is_saved = false; saved_policy = 0; saved_priority = 0; }
+RealTime::~RealTime() {}
+
+void RealTime::Apply(int cpu, int priority)
+{
+	if(cpu >= 0 || priority > 0) {
+		std::cerr << "Warning: CPU pinning and real-time priority are only supported on Linux.\n";
+	}
+}
+
+void RealTime::PinThread(int cpu) {}
+void RealTime::SetPriority(int priority) {}
+int  RealTime::FindUsbNumaNode() { return -1; }
+void RealTime::PreferNumaNode(int node) {}
+void RealTime::ResetNumaPolicy() {}
+
+#endif
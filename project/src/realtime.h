@@ -0,0 +1,63 @@
+#ifndef __REALTIME_H__
+#define __REALTIME_H__
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/*
+	Keeps the acquisition away from other jobs on a shared machine:
+	- pins a thread to a chosen CPU and optionally runs it with SCHED_FIFO
+	- places sample buffers on the NUMA node of the USB controller with picoscope
+
+	The object remembers the affinity and the scheduling policy of the thread
+	that created it and restores them when it is destroyed.
+	Everything apart from Linux silently does nothing.
+ */
+class RealTime {
+public:
+	RealTime();
+	~RealTime();
+
+	// cpu < 0 leaves the affinity alone, priority <= 0 leaves the policy alone
+	void Apply(int cpu, int priority);
+
+	static void PinThread(int cpu);
+	static void SetPriority(int priority);
+
+	// NUMA node of the USB controller with a Pico Technology device (-1 if unknown)
+	static int  FindUsbNumaNode();
+	// memory touched by the calling thread will preferably come from the given node
+	static void PreferNumaNode(int node);
+	static void ResetNumaPolicy();
+
+private:
+	bool      is_saved;
+#ifdef __linux__
+	cpu_set_t saved_affinity;
+#endif
+	int       saved_policy;
+	int       saved_priority;
+};
+
+/*
+	How much later than requested a sleeping thread wakes up.
+ */
+class LatencyStats {
+public:
+	LatencyStats() { Reset(); };
+	~LatencyStats() {};
+
+	void Reset() { count = 0; total = 0.0; max = 0.0; };
+	void Add(double seconds) { count++; total += seconds; if(seconds > max) max = seconds; };
+
+	unsigned long GetCount() const { return count; };
+	double        GetMean()  const { return count > 0 ? total/count : 0.0; };
+	double        GetMax()   const { return max; };
+
+private:
+	unsigned long count;
+	double        total, max;
+};
+
+#endif
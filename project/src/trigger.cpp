@@ -10,11 +10,49 @@
 #include "ps4000Api.h"
 #include "ps6000Api.h"
 
+// the member of a conditions structure (of either series, for the trigger or for the pulse width qualifier) for a channel
+template<class C, typename S> static void SetChannelState(C &conditions, int ch, S state)
+{
+	switch(ch) {
+		case 0:  conditions.channelA = state; break;
+		case 1:  conditions.channelB = state; break;
+		case 2:  conditions.channelC = state; break;
+		default: conditions.channelD = state; break;
+	}
+}
+
+void TriggerLogic::GetChannelConditions(const TriggerCondition *conditions[PICOSCOPE_N_CHANNELS]) const
+{
+	size_t t, c;
+	int i;
+
+	for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+		conditions[i] = NULL;
+	}
+	for(t=0; t<=terms.size(); t++) {
+		// the pulse width qualifier after the terms
+		size_t n = t < terms.size() ? terms[t].size() : (pwq_type != PWQ_NONE ? 1 : 0);
+		for(c=0; c<n; c++) {
+			const TriggerCondition *cond = t < terms.size() ? &terms[t][c] : &pwq;
+			if(cond->channel < 0 || cond->channel >= PICOSCOPE_N_CHANNELS) {
+				throw "the trigger uses a channel that doesn't exist";
+			}
+			if(conditions[cond->channel] == NULL) {
+				conditions[cond->channel] = cond;
+			} else if(!(*conditions[cond->channel] == *cond)) {
+				throw "picoscope only has one level (or window) and direction per channel: the trigger uses two different conditions on the same channel";
+			}
+		}
+	}
+}
+
 Trigger::Trigger(Channel *ch, double x_fraction, double y_fraction)
 {
 	FILE_LOG(logDEBUG3) << "Trigger::Trigger (channel=" << ch << " (" << ch->GetIndex() << "), x_frac=" << x_fraction << ", y_frac=" << y_fraction << ")";
 
 	channel = ch;
+	is_dirty = true;
+	hysteresis = 0;
 
 	if(channel == NULL) {
 		throw "empty channel for trigger is not allowed.";
@@ -33,6 +71,51 @@ Trigger::Trigger(Channel *ch, double x_fraction, double y_fraction)
 		throw "y fraction of trigger has to be between -1 and 1.";
 	}
 
+	// a single condition
+	TriggerCondition cond;
+	cond.channel = channel->GetIndex();
+	cond.type    = (y_frac > 0) ? TRIGGER_RISING : TRIGGER_FALLING;
+	cond.level   = y_frac;
+	logic.terms.push_back(std::vector<TriggerCondition>(1, cond));
+}
+
+Trigger::Trigger(Channel *ch, double x_fraction, const TriggerLogic &l)
+{
+	FILE_LOG(logDEBUG3) << "Trigger::Trigger (channel=" << ch << ", x_frac=" << x_fraction << ", logic with " << l.terms.size() << " terms)";
+
+	const TriggerCondition *conditions[PICOSCOPE_N_CHANNELS];
+	size_t t, c;
+
+	channel = ch;
+	is_dirty = true;
+	hysteresis = 0;
+	logic = l;
+
+	if(channel == NULL) {
+		throw "empty channel for trigger is not allowed.";
+	}
+	if(x_fraction >= 0 && x_fraction <= 1) {
+		x_frac = x_fraction;
+	} else {
+		throw "x fraction of trigger has to be between 0 and 1.";
+	}
+	if(logic.terms.empty() || logic.terms[0].empty()) {
+		throw "the trigger needs at least one condition.";
+	}
+	for(t=0; t<=logic.terms.size(); t++) {
+		size_t n = t < logic.terms.size() ? logic.terms[t].size() : (logic.pwq_type != PWQ_NONE ? 1 : 0);
+		for(c=0; c<n; c++) {
+			const TriggerCondition &cond = t < logic.terms.size() ? logic.terms[t][c] : logic.pwq;
+			if(cond.is_volts || cond.level < -1 || cond.level > 1 || cond.lower < -1 || cond.lower > 1) {
+				throw "the levels of the trigger have to be between -1 and 1.";
+			}
+			if(!GetMeasurement()->GetChannel(cond.channel)->IsEnabled()) {
+				throw "the trigger uses a channel that is not enabled.";
+			}
+		}
+	}
+	logic.GetChannelConditions(conditions);
+	y_frac = logic.terms[0][0].level;
 }
 
 Channel*     Trigger::GetChannel()     const { return channel; };
@@ -41,17 +124,33 @@ Picoscope*   Trigger::GetPicoscope()   const { return GetMeasurement()->GetPicos
 PICO_SERIES  Trigger::GetSeries()      const { return GetPicoscope()->GetSeries(); };
 short        Trigger::GetHandle()      const { return GetPicoscope()->GetHandle(); };
 
-short Trigger::GetThreshold()
+// two triggers are the same if they would pass exactly the same settings to picoscope
+bool Trigger::IsSameAs(const Trigger *tr) const
+{
+	return tr != NULL &&
+	       tr->GetChannel()   == GetChannel()   &&
+	       tr->GetXFraction() == GetXFraction() &&
+	       tr->GetYFraction() == GetYFraction() &&
+	       tr->GetLogic()     == GetLogic()     &&
+	       tr->hysteresis     == hysteresis;
+}
+
+short Trigger::ThresholdOf(double fraction)
 {
 	if(GetSeries() == PICO_4000) {
-		return (short)round(GetYFraction()*(double)PS4000_MAX_VALUE);
+		return (short)round(fraction*(double)PS4000_MAX_VALUE);
 	} else if(GetSeries() == PICO_6000) {
-		return (short)round(GetYFraction()*(double)PS6000_MAX_VALUE/256) << 8;
+		return (short)round(fraction*(double)PS6000_MAX_VALUE/256) << 8;
 	} else {
 		throw "unknown pico series";
 	}
 }
 
+short Trigger::GetThreshold()
+{
+	return ThresholdOf(GetYFraction());
+}
+
 double Trigger::GetThresholdInVolts()
 {
 	if(GetSeries() == PICO_4000) {
@@ -63,125 +162,262 @@ double Trigger::GetThresholdInVolts()
 	}
 }
 
-void Trigger::SetTriggerInPicoscope()
+short Trigger::GetHysteresis()
 {
-	int   ch_index  = GetChannel()->GetIndex();
-	short threshold = 0;
+	if(hysteresis > 0) {
+		return hysteresis;
+	}
 	// 256 is the minimum number that ever appears;
 	// the multiplication factor in hysteresis is an approximation for noise
 	// to make sure that we don't include noise in the trigger
-	short hysteresis;
+	if(GetSeries() == PICO_6000) {
+		return 256 * 2;
+	} else {
+		return 256 * 3;
+	}
+}
 
+std::string Trigger::GetDescription()
+{
+	std::string s;
+	char buffer[200];
+	size_t t, c;
+	double volts, max_value = (GetSeries() == PICO_4000) ? PS4000_MAX_VALUE : PS6000_MAX_VALUE;
+	static const char *pwq_names[] = {"", "<", ">", "in", "not in"};
 
-	// we will use just a single condition
-	if(GetSeries() == PICO_6000) {
-		hysteresis = 256 * 2;
+	for(t=0; t<=logic.terms.size(); t++) {
+		size_t n = t < logic.terms.size() ? logic.terms[t].size() : (logic.pwq_type != PWQ_NONE ? 1 : 0);
+		if(t == logic.terms.size() && n > 0) {
+			s += ", width of ";
+		}
+		for(c=0; c<n; c++) {
+			const TriggerCondition &cond = t < logic.terms.size() ? logic.terms[t][c] : logic.pwq;
+			// the levels that picoscope gets
+			volts = GetMeasurement()->GetChannel(cond.channel)->GetVoltageInVolts()/max_value;
+			if(cond.type == TRIGGER_RISING || cond.type == TRIGGER_FALLING) {
+				snprintf(buffer, sizeof(buffer), "%s%c%c%gV", c > 0 ? " & " : (t > 0 && t < logic.terms.size() ? " | " : ""),
+					'A'+cond.channel, cond.type == TRIGGER_RISING ? '>' : '<', ThresholdOf(cond.level)*volts);
+			} else {
+				snprintf(buffer, sizeof(buffer), "%s%c %s %gV:%gV", c > 0 ? " & " : (t > 0 && t < logic.terms.size() ? " | " : ""),
+					'A'+cond.channel, cond.type == TRIGGER_ENTER ? "in" : "out", ThresholdOf(cond.lower)*volts, ThresholdOf(cond.level)*volts);
+			}
+			s += buffer;
+		}
+	}
+	if(logic.pwq_type == PWQ_IN_RANGE || logic.pwq_type == PWQ_OUT_OF_RANGE) {
+		snprintf(buffer, sizeof(buffer), " %s %u:%u samples", pwq_names[logic.pwq_type], logic.pwq_lower, logic.pwq_upper);
+		s += buffer;
+	} else if(logic.pwq_type != PWQ_NONE) {
+		snprintf(buffer, sizeof(buffer), " %s %u samples", pwq_names[logic.pwq_type], logic.pwq_lower);
+		s += buffer;
+	}
+	if(logic.delay > 0) {
+		snprintf(buffer, sizeof(buffer), ", delay %u samples", logic.delay);
+		s += buffer;
+	}
+	return s;
+}
+
+/*
+	Passes the whole logic to picoscope: the threshold (or window) and the direction of every channel that is used,
+	one conditions structure per term, the pulse width qualifier and the delay.
+	The pulse width qualifier and the delay are always set, so that nothing is left from a previous trigger.
+ */
+void Trigger::SetTriggerInPicoscope()
+{
+	const TriggerCondition *conditions[PICOSCOPE_N_CHANNELS];
+	short threshold = 0;
+	short hysteresis = GetHysteresis();
+	size_t t, c;
+	int i;
+
+
+	logic.GetChannelConditions(conditions);
+	if(logic.IsSimple()) {
 		threshold = GetThreshold();
 		fprintf(stderr, "-- Setting trigger threshold to %d (%g V = %g %% of %g V)\n", threshold,
-			threshold/(double)PS6000_MAX_VALUE*GetChannel()->GetVoltageInVolts(),
-			threshold/(double)PS6000_MAX_VALUE, GetChannel()->GetVoltageInVolts());
-
-		struct tPS6000TriggerConditions conditions6000 = {
-			(ch_index == 0) ? PS6000_CONDITION_TRUE : PS6000_CONDITION_DONT_CARE,
-			(ch_index == 1) ? PS6000_CONDITION_TRUE : PS6000_CONDITION_DONT_CARE,
-			(ch_index == 2) ? PS6000_CONDITION_TRUE : PS6000_CONDITION_DONT_CARE,
-			(ch_index == 3) ? PS6000_CONDITION_TRUE : PS6000_CONDITION_DONT_CARE,
-			PS6000_CONDITION_DONT_CARE,
-			PS6000_CONDITION_DONT_CARE,
-			PS6000_CONDITION_DONT_CARE };
-		PS6000_THRESHOLD_DIRECTION direction6000 = (GetYFraction() > 0) ? PS6000_RISING : PS6000_FALLING;
-		// struct tTriggerDirections directions6000;
-		struct tPS6000TriggerChannelProperties properties6000 = {
-			threshold, hysteresis,     // threshold & hysteresis upper
-			threshold, hysteresis,     // threshold & hysteresis lower
-			(PS6000_CHANNEL)ch_index,  // channel
-			PS6000_LEVEL};             // thresholdMode
+			GetThresholdInVolts(), GetThresholdInVolts()/GetChannel()->GetVoltageInVolts(), GetChannel()->GetVoltageInVolts());
+	} else {
+		fprintf(stderr, "-- Setting trigger %s\n", GetDescription().c_str());
+	}
+	if(GetSeries() == PICO_6000) {
+		std::vector<struct tPS6000TriggerConditions>        conditions6000(logic.terms.size());
+		std::vector<struct tPS6000TriggerChannelProperties> properties6000;
+		PS6000_THRESHOLD_DIRECTION directions6000[PICOSCOPE_N_CHANNELS];
+		struct tPS6000PwqConditions pwq6000 = {
+			PS6000_CONDITION_DONT_CARE, PS6000_CONDITION_DONT_CARE, PS6000_CONDITION_DONT_CARE,
+			PS6000_CONDITION_DONT_CARE, PS6000_CONDITION_DONT_CARE, PS6000_CONDITION_DONT_CARE };
+
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			directions6000[i] = PS6000_NONE;
+			if(conditions[i] != NULL) {
+				const TriggerCondition &cond = *conditions[i];
+				bool is_window = (cond.type == TRIGGER_ENTER || cond.type == TRIGGER_EXIT);
+				struct tPS6000TriggerChannelProperties properties = {
+					ThresholdOf(cond.level), (uint16_t)hysteresis,                    // threshold & hysteresis upper
+					ThresholdOf(is_window ? cond.lower : cond.level), (uint16_t)hysteresis, // threshold & hysteresis lower
+					(PS6000_CHANNEL)i,                                                // channel
+					is_window ? PS6000_WINDOW : PS6000_LEVEL};                        // thresholdMode
+				properties6000.push_back(properties);
+				directions6000[i] = cond.type == TRIGGER_RISING  ? PS6000_RISING  :
+				                    cond.type == TRIGGER_FALLING ? PS6000_FALLING :
+				                    cond.type == TRIGGER_ENTER   ? PS6000_ENTER   : PS6000_EXIT;
+			}
+		}
+		for(t=0; t<logic.terms.size(); t++) {
+			struct tPS6000TriggerConditions term = {
+				PS6000_CONDITION_DONT_CARE, PS6000_CONDITION_DONT_CARE, PS6000_CONDITION_DONT_CARE,
+				PS6000_CONDITION_DONT_CARE, PS6000_CONDITION_DONT_CARE, PS6000_CONDITION_DONT_CARE,
+				(logic.pwq_type != PWQ_NONE) ? PS6000_CONDITION_TRUE : PS6000_CONDITION_DONT_CARE };
+			for(c=0; c<logic.terms[t].size(); c++) {
+				SetChannelState(term, logic.terms[t][c].channel, PS6000_CONDITION_TRUE);
+			}
+			conditions6000[t] = term;
+		}
 
 		GetPicoscope()->SetStatus(ps6000SetTriggerChannelConditions(
-			GetHandle(),     // handle
-			&conditions6000, // * conditions
-			1));             // nConditions
+			GetHandle(),          // handle
+			&conditions6000[0],   // * conditions
+			(int16_t)conditions6000.size())); // nConditions
 		if(GetPicoscope()->GetStatus() != PICO_OK) {
 			std::cerr << "Unable to set trigger conditions." << std::endl;
 			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
 		}
 
 		GetPicoscope()->SetStatus(ps6000SetTriggerChannelDirections(
-			GetHandle(),                                   // handle
-			(ch_index == 0) ? direction6000 : PS6000_NONE, // channelA
-			(ch_index == 1) ? direction6000 : PS6000_NONE, // channelB
-			(ch_index == 2) ? direction6000 : PS6000_NONE, // channelC
-			(ch_index == 3) ? direction6000 : PS6000_NONE, // channelD
-			PS6000_NONE,                                   // ext
-			PS6000_NONE));                                 // aux
+			GetHandle(),       // handle
+			directions6000[0], // channelA
+			directions6000[1], // channelB
+			directions6000[2], // channelC
+			directions6000[3], // channelD
+			PS6000_NONE,       // ext
+			PS6000_NONE));     // aux
 		if(GetPicoscope()->GetStatus() != PICO_OK) {
 			std::cerr << "Unable to set trigger directions." << std::endl;
 			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
 		}
 
 		GetPicoscope()->SetStatus(ps6000SetTriggerChannelProperties(
-			GetHandle(),     // handle
-			&properties6000, // * channelProperties
-			1,               // nChannelProperties
-			0,               // auxOutputEnable (not used)
-			0));             // autoTriggerMilliseconds (whether to autotrigger in case of no event)
+			GetHandle(),        // handle
+			&properties6000[0], // * channelProperties
+			(int16_t)properties6000.size(), // nChannelProperties
+			0,                  // auxOutputEnable (not used)
+			0));                // autoTriggerMilliseconds (whether to autotrigger in case of no event)
 		if(GetPicoscope()->GetStatus() != PICO_OK) {
 			std::cerr << "Unable to set trigger properties." << std::endl;
 			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
 		}
+
+		if(logic.pwq_type != PWQ_NONE) {
+			SetChannelState(pwq6000, logic.pwq.channel, PS6000_CONDITION_TRUE);
+		}
+		GetPicoscope()->SetStatus(ps6000SetPulseWidthQualifier(
+			GetHandle(),                                         // handle
+			&pwq6000,                                            // * conditions
+			(logic.pwq_type != PWQ_NONE) ? 1 : 0,                // nConditions
+			(logic.pwq_type != PWQ_NONE) ? directions6000[logic.pwq.channel] : PS6000_NONE, // direction
+			logic.pwq_lower,                                     // lower
+			logic.pwq_upper,                                     // upper
+			(PS6000_PULSE_WIDTH_TYPE)logic.pwq_type));           // type
+		if(GetPicoscope()->GetStatus() != PICO_OK) {
+			std::cerr << "Unable to set the pulse width qualifier." << std::endl;
+			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+		}
+
+		GetPicoscope()->SetStatus(ps6000SetTriggerDelay(GetHandle(), logic.delay));
+		if(GetPicoscope()->GetStatus() != PICO_OK) {
+			std::cerr << "Unable to set trigger delay." << std::endl;
+			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+		}
 	} else {
-		threshold = GetThreshold();
-		hysteresis = 256 * 3;
-		fprintf(stderr, "-- Setting trigger threshold to %d\n", threshold);
-
-		struct tPS4000TriggerConditions conditions4000 = {
-			(ch_index == 0) ? PS4000_CONDITION_TRUE : PS4000_CONDITION_DONT_CARE,
-			(ch_index == 1) ? PS4000_CONDITION_TRUE : PS4000_CONDITION_DONT_CARE,
-			(ch_index == 2) ? PS4000_CONDITION_TRUE : PS4000_CONDITION_DONT_CARE,
-			(ch_index == 3) ? PS4000_CONDITION_TRUE : PS4000_CONDITION_DONT_CARE,
-			PS4000_CONDITION_DONT_CARE,
-			PS4000_CONDITION_DONT_CARE,
-			PS4000_CONDITION_DONT_CARE };
-		PS4000_THRESHOLD_DIRECTION direction4000 = (GetYFraction() > 0) ? PS4000_RISING : PS4000_FALLING;
-		// struct tTriggerDirections directions6000;
-		struct tPS4000TriggerChannelProperties properties4000 = {
-			threshold, hysteresis,     // threshold & hysteresis upper
-			threshold, hysteresis,     // threshold & hysteresis lower
-			(PS4000_CHANNEL)ch_index,  // channel
-			PS4000_LEVEL};             // thresholdMode
+		std::vector<struct tPS4000TriggerConditions>        conditions4000(logic.terms.size());
+		std::vector<struct tPS4000TriggerChannelProperties> properties4000;
+		PS4000_THRESHOLD_DIRECTION directions4000[PICOSCOPE_N_CHANNELS];
+		struct tPS4000PwqConditions pwq4000 = {
+			PS4000_CONDITION_DONT_CARE, PS4000_CONDITION_DONT_CARE, PS4000_CONDITION_DONT_CARE,
+			PS4000_CONDITION_DONT_CARE, PS4000_CONDITION_DONT_CARE, PS4000_CONDITION_DONT_CARE };
+
+		for(i=0; i<PICOSCOPE_N_CHANNELS; i++) {
+			directions4000[i] = PS4000_NONE;
+			if(conditions[i] != NULL) {
+				const TriggerCondition &cond = *conditions[i];
+				bool is_window = (cond.type == TRIGGER_ENTER || cond.type == TRIGGER_EXIT);
+				struct tPS4000TriggerChannelProperties properties = {
+					ThresholdOf(cond.level), (uint16_t)hysteresis,                    // threshold & hysteresis upper
+					ThresholdOf(is_window ? cond.lower : cond.level), (uint16_t)hysteresis, // threshold & hysteresis lower
+					(PS4000_CHANNEL)i,                                                // channel
+					is_window ? PS4000_WINDOW : PS4000_LEVEL};                        // thresholdMode
+				properties4000.push_back(properties);
+				directions4000[i] = cond.type == TRIGGER_RISING  ? PS4000_RISING  :
+				                    cond.type == TRIGGER_FALLING ? PS4000_FALLING :
+				                    cond.type == TRIGGER_ENTER   ? PS4000_ENTER   : PS4000_EXIT;
+			}
+		}
+		for(t=0; t<logic.terms.size(); t++) {
+			struct tPS4000TriggerConditions term = {
+				PS4000_CONDITION_DONT_CARE, PS4000_CONDITION_DONT_CARE, PS4000_CONDITION_DONT_CARE,
+				PS4000_CONDITION_DONT_CARE, PS4000_CONDITION_DONT_CARE, PS4000_CONDITION_DONT_CARE,
+				(logic.pwq_type != PWQ_NONE) ? PS4000_CONDITION_TRUE : PS4000_CONDITION_DONT_CARE };
+			for(c=0; c<logic.terms[t].size(); c++) {
+				SetChannelState(term, logic.terms[t][c].channel, PS4000_CONDITION_TRUE);
+			}
+			conditions4000[t] = term;
+		}
 
 		GetPicoscope()->SetStatus(ps4000SetTriggerChannelConditions(
-			GetHandle(),     // handle
-			&conditions4000, // * conditions
-			1));             // nConditions
+			GetHandle(),          // handle
+			&conditions4000[0],   // * conditions
+			(int16_t)conditions4000.size())); // nConditions
 		if(GetPicoscope()->GetStatus() != PICO_OK) {
 			std::cerr << "Unable to set trigger conditions." << std::endl;
 			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
 		}
 
 		GetPicoscope()->SetStatus(ps4000SetTriggerChannelDirections(
-			GetHandle(),                                   // handle
-			(ch_index == 0) ? direction4000 : PS4000_NONE, // channelA
-			(ch_index == 1) ? direction4000 : PS4000_NONE, // channelB
-			(ch_index == 2) ? direction4000 : PS4000_NONE, // channelC
-			(ch_index == 3) ? direction4000 : PS4000_NONE, // channelD
-			PS4000_NONE,                                   // ext
-			PS4000_NONE));                                 // aux
+			GetHandle(),       // handle
+			directions4000[0], // channelA
+			directions4000[1], // channelB
+			directions4000[2], // channelC
+			directions4000[3], // channelD
+			PS4000_NONE,       // ext
+			PS4000_NONE));     // aux
 		if(GetPicoscope()->GetStatus() != PICO_OK) {
 			std::cerr << "Unable to set trigger directions." << std::endl;
 			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
 		}
 
 		GetPicoscope()->SetStatus(ps4000SetTriggerChannelProperties(
-			GetHandle(),     // handle
-			&properties4000, // * channelProperties
-			1,               // nChannelProperties
-			0,               // auxOutputEnable (not used)
-			0));             // autoTriggerMilliseconds (whether to autotrigger in case of no event)
+			GetHandle(),        // handle
+			&properties4000[0], // * channelProperties
+			(int16_t)properties4000.size(), // nChannelProperties
+			0,                  // auxOutputEnable (not used)
+			0));                // autoTriggerMilliseconds (whether to autotrigger in case of no event)
 		if(GetPicoscope()->GetStatus() != PICO_OK) {
 			std::cerr << "Unable to set trigger properties." << std::endl;
 			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
 		}
-	}
 
+		if(logic.pwq_type != PWQ_NONE) {
+			SetChannelState(pwq4000, logic.pwq.channel, PS4000_CONDITION_TRUE);
+		}
+		GetPicoscope()->SetStatus(ps4000SetPulseWidthQualifier(
+			GetHandle(),                                         // handle
+			&pwq4000,                                            // * conditions
+			(logic.pwq_type != PWQ_NONE) ? 1 : 0,                // nConditions
+			(logic.pwq_type != PWQ_NONE) ? directions4000[logic.pwq.channel] : PS4000_NONE, // direction
+			logic.pwq_lower,                                     // lower
+			logic.pwq_upper,                                     // upper
+			(PS4000_PULSE_WIDTH_TYPE)logic.pwq_type));           // type
+		if(GetPicoscope()->GetStatus() != PICO_OK) {
+			std::cerr << "Unable to set the pulse width qualifier." << std::endl;
+			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+		}
+
+		GetPicoscope()->SetStatus(ps4000SetTriggerDelay(GetHandle(), logic.delay));
+		if(GetPicoscope()->GetStatus() != PICO_OK) {
+			std::cerr << "Unable to set trigger delay." << std::endl;
+			throw Picoscope::PicoscopeException(GetPicoscope()->GetStatus());
+		}
+	}
+	is_dirty = false;
 }
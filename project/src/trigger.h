@@ -5,9 +5,73 @@
 #include "measurement.h"
 #include "channel.h"
 
+#include <string>
+#include <vector>
+
+// what a channel has to do to be true in a condition of the trigger
+enum TRIGGER_TYPE {
+	TRIGGER_RISING,  // through the level upwards
+	TRIGGER_FALLING, // through the level downwards
+	TRIGGER_ENTER,   // into the window between lower and level
+	TRIGGER_EXIT     // out of the window
+};
+
+// pulse width qualifier (the same order as the types of the driver)
+enum PWQ_TYPE {
+	PWQ_NONE,
+	PWQ_LESS_THAN,
+	PWQ_GREATER_THAN,
+	PWQ_IN_RANGE,
+	PWQ_OUT_OF_RANGE
+};
+
+struct TriggerCondition {
+	int          channel;
+	TRIGGER_TYPE type;
+	// fractions of the range of the channel (or volts with is_volts, until Args converts them);
+	// a window goes from lower to level
+	double       level, lower;
+	bool         is_volts;
+
+	TriggerCondition() : channel(0), type(TRIGGER_FALLING), level(0), lower(0), is_volts(false) {};
+	bool operator==(const TriggerCondition &c) const
+	{
+		return channel == c.channel && type == c.type && level == c.level && lower == c.lower && is_volts == c.is_volts;
+	}
+};
+
+/*
+	The trigger as picoscope sees it: an OR of terms, each of which is an AND of channel conditions.
+	The pulse width qualifier (when there is one) is required by every term; its channel
+	uses the same threshold as everywhere else, since picoscope only has one threshold (or window)
+	and one direction per channel. The delay is the number of samples between the trigger event
+	and the trigger point of the traces.
+ */
+struct TriggerLogic {
+	std::vector< std::vector<TriggerCondition> > terms;
+	PWQ_TYPE         pwq_type;
+	TriggerCondition pwq;
+	unsigned int     pwq_lower, pwq_upper; // in samples (only the lower one for less or greater than)
+	unsigned int     delay;                // in samples
+
+	TriggerLogic() : pwq_type(PWQ_NONE), pwq_lower(0), pwq_upper(0), delay(0) {};
+	bool operator==(const TriggerLogic &l) const
+	{
+		return terms == l.terms && pwq_type == l.pwq_type && (pwq_type == PWQ_NONE || pwq == l.pwq) &&
+		       pwq_lower == l.pwq_lower && pwq_upper == l.pwq_upper && delay == l.delay;
+	}
+	// a single level on a single channel
+	bool IsSimple() const { return terms.size() == 1 && terms[0].size() == 1 && pwq_type == PWQ_NONE && delay == 0 &&
+	                               (terms[0][0].type == TRIGGER_RISING || terms[0][0].type == TRIGGER_FALLING); };
+	// the condition of every channel that is used (NULL for the others); throws when a channel has two different ones
+	void GetChannelConditions(const TriggerCondition *conditions[PICOSCOPE_N_CHANNELS]) const;
+};
+
 class Trigger {
 public:
 	Trigger(Channel *, double, double);
+	// the channel is the one of the first condition, whose level is the y fraction
+	Trigger(Channel *, double, const TriggerLogic &);
 	~Trigger() {};
 
 	// void SetSimpleTrigger(Channel*, double, double);
@@ -27,17 +91,34 @@ public:
 
 	double GetXFraction() const { return x_frac; }
 	double GetYFraction() const { return y_frac; }
+	const TriggerLogic& GetLogic() const { return logic; }
 
 	short  GetThreshold();
 	double GetThresholdInVolts();
+	// for example "A<-0.02V & B<-0.02V | C in -0.1V:-0.05V, width of A<-0.02V > 10, delay 100"
+	std::string GetDescription();
+	// 0 for the default of the series
+	void   SetHysteresis(short h) { hysteresis = h; is_dirty = true; }
+	short  GetHysteresis();
+
+	// true if the trigger has not been passed to picoscope yet
+	bool IsDirty() const { return is_dirty; }
+	void SetDirty()      { is_dirty = true; }
+	void SetClean()      { is_dirty = false; }
+	bool IsSameAs(const Trigger *) const;
 private:
 	Channel *channel;
 	// Measurement *measurement;
 	// x_frac has to be between 0 and 1 (0 by default)
 	// y_frac has to be between -1 and 1 (0 by default)
 	double x_frac, y_frac;
+	TriggerLogic logic;
+	short hysteresis;
+	bool is_dirty;
 	// just a simple trigger on a single channel
 	// PICO_CHANNEL channel;
+
+	short ThresholdOf(double fraction);
 };
 
 #endif
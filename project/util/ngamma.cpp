@@ -0,0 +1,546 @@
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "../src/analysis/n-gamma.h"
+#include "../src/analysis/histogram.h"
+#include "../src/analysis/peaks.h"
+#include "../src/analysis/baseline.h"
+#include "../src/timing.h"
+
+using namespace std;
+
+void print_usage()
+{
+	cout <<
+		"USAGE: ngamma [options] <name> [<channels>]\n\n" <<
+		"Calculates the n-gamma integrals of all traces recorded with 'run_picoscope --name <name> --bin'.\n" <<
+		"The length of traces is read from <name>.txt, the traces from <name><channel>.bin.\n\n" <<
+		"options:\n" <<
+		"  --dt1 <n>       samples between half of the peak and the start of the second integral (default 175)\n" <<
+		"  --len <n>       length of the second integral (default 250)\n" <<
+		"  --threads <n>   number of threads (default: all cores)\n" <<
+		"  --text | --bin  output format (default: text)\n" <<
+		"  --out <file>    output file (default: <name><channel>.ngamma.txt or .ngamma.bin)\n" <<
+		"  --bits <8|16>   size of samples in the file (default 8 as written for 6000 series)\n" <<
+		"  --hist <bins> <int1 max> <int2 max>\n" <<
+		"                  also write histograms of integral2 vs. integral1, integral1 and the peak\n" <<
+		"                  to <name><channel>.hist.txt (or .hist.bin)\n" <<
+		"  --hist-only     write only the histograms\n" <<
+		"  --peaks <threshold>\n" <<
+		"                  find every pulse (drop by more than <threshold> within 4 samples, 0: 5 sigma of the noise)\n" <<
+		"                  and write them to <name><channel>.peaks.txt (or .peaks.bin); piled-up traces get problem 2\n" <<
+		"  --baseline <mean|median|running>\n" <<
+		"                  baseline of every trace from the samples before the trigger (trigger_dx in <name>.txt),\n" <<
+		"                  written to <name><channel>.baseline.txt (or .baseline.bin); the integrals are corrected for it\n\n" <<
+		"The text output has one line per trace (in the order of traces):\n" <<
+		"  integral1 integral2 peak i_peak i_start_integrate2 problem\n" <<
+		"the binary output has the same six numbers as int32 per trace.\n";
+}
+
+/*
+	A read-only view of a whole file; memory mapped where possible.
+ */
+class MappedFile {
+public:
+	MappedFile() : data(NULL), size(0), is_mapped(false) {};
+	~MappedFile() { Close(); };
+
+	bool Open(const char *filename)
+	{
+#ifndef _WIN32
+		struct stat st;
+		int fd = open(filename, O_RDONLY);
+
+		if(fd < 0) {
+			return false;
+		}
+		if(fstat(fd, &st) != 0) {
+			close(fd);
+			return false;
+		}
+		size = st.st_size;
+		if(size > 0) {
+			data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(data == MAP_FAILED) {
+				data = NULL;
+				close(fd);
+				return false;
+			}
+			// the traces are read from start to end
+			madvise((void *)data, size, MADV_SEQUENTIAL);
+			is_mapped = true;
+		}
+		close(fd);
+		return true;
+#else
+		FILE *f = fopen(filename, "rb");
+		long n;
+
+		if(f == NULL) {
+			return false;
+		}
+		fseek(f, 0, SEEK_END);
+		n = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		buffer.resize(n > 0 ? n : 1);
+		size = fread(&buffer[0], 1, n, f);
+		fclose(f);
+		data = &buffer[0];
+		return size == (size_t)n;
+#endif
+	}
+	void Close()
+	{
+#ifndef _WIN32
+		if(is_mapped) {
+			munmap((void *)data, size);
+		}
+#endif
+		is_mapped = false;
+		data = NULL;
+		size = 0;
+	}
+	const char* GetData() const { return data; };
+	size_t      GetSize() const { return size; };
+
+private:
+	const char       *data;
+	size_t            size;
+	bool              is_mapped;
+	std::vector<char> buffer;
+};
+
+/*
+	Runs task(0, thread) ... task(n-1, thread) on a fixed number of threads,
+	where 'thread' is the index of the thread that runs the task (for data that belongs to a single thread).
+
+	Every thread starts with its own contiguous range of tasks (to keep neighbouring traces together)
+	and steals from the end of the queue of another thread when it runs out of work,
+	so a thread that has been slowed down doesn't hold up everyone else.
+ */
+class WorkStealingPool {
+public:
+	WorkStealingPool(unsigned int nthreads) : queues(nthreads), queue_mutex(nthreads)
+	{
+		unsigned int i;
+
+		generation = 0;
+		stop       = false;
+		remaining  = 0;
+		for(i=0; i<nthreads; i++) {
+			threads.push_back(std::thread(&WorkStealingPool::Work, this, i));
+		}
+	}
+	~WorkStealingPool()
+	{
+		size_t i;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		start.notify_all();
+		for(i=0; i<threads.size(); i++) {
+			threads[i].join();
+		}
+	}
+
+	void Run(size_t n, std::function<void(size_t, unsigned int)> f)
+	{
+		size_t i, k, nthreads = threads.size();
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			task      = f;
+			remaining = n;
+			for(k=0; k<nthreads; k++) {
+				std::lock_guard<std::mutex> qlock(queue_mutex[k]);
+				for(i=k*n/nthreads; i<(k+1)*n/nthreads; i++) {
+					queues[k].push_back(i);
+				}
+			}
+			generation++;
+		}
+		start.notify_all();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return remaining == 0; });
+	}
+
+	size_t GetNumberOfThreads() const { return threads.size(); };
+
+private:
+	std::vector<std::thread>        threads;
+	std::vector< std::deque<size_t> > queues;
+	std::vector<std::mutex>         queue_mutex;
+	std::mutex                      mutex;
+	std::condition_variable         start, done;
+	std::function<void(size_t, unsigned int)> task;
+	unsigned long                   generation;
+	bool                            stop;
+	size_t                          remaining;
+
+	bool Next(unsigned int me, size_t &i)
+	{
+		size_t k, other;
+
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex[me]);
+			if(!queues[me].empty()) {
+				i = queues[me].front();
+				queues[me].pop_front();
+				return true;
+			}
+		}
+		for(k=1; k<queues.size(); k++) {
+			other = (me+k) % queues.size();
+			std::lock_guard<std::mutex> lock(queue_mutex[other]);
+			if(!queues[other].empty()) {
+				i = queues[other].back();
+				queues[other].pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Work(unsigned int me)
+	{
+		unsigned long seen = 0;
+		size_t i, finished;
+
+		while(true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				start.wait(lock, [&]() { return stop || generation != seen; });
+				if(stop) {
+					return;
+				}
+				seen = generation;
+			}
+			finished = 0;
+			while(Next(me, i)) {
+				task(i, me);
+				finished++;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				remaining -= finished;
+				if(remaining == 0) {
+					done.notify_all();
+				}
+			}
+		}
+	}
+};
+
+// reads the length of traces, the list of channels and the number of samples before the trigger
+// from the metadata written by run_picoscope
+bool read_metadata(const std::string &filename, unsigned long &length, std::string &channels, unsigned long &pretrigger)
+{
+	std::ifstream f(filename.c_str());
+	std::string line;
+	char buffer[100];
+
+	length     = 0;
+	pretrigger = 0;
+	while(std::getline(f, line)) {
+		if(sscanf(line.c_str(), "trigger_dx: %lu", &pretrigger) == 1) {
+			continue;
+		}
+		if(sscanf(line.c_str(), "length: %lu", &length) == 1) {
+			continue;
+		}
+		if(sscanf(line.c_str(), "channels: %99s", buffer) == 1) {
+			channels = buffer;
+		}
+	}
+	return length > 0;
+}
+
+// returns the number of piled-up traces (when looking for peaks)
+template<typename T> unsigned long process(WorkStealingPool &pool, const MappedFile &file, unsigned long length,
+	unsigned int dt1, unsigned int len2, T clip, bool binary, FILE *out, psd_histograms *hist,
+	const peak_options *peak, FILE *out_peaks, const baseline_options *baseline, FILE *out_baselines)
+{
+	const size_t chunk  = 4096;                        // traces per task
+	const size_t window = chunk*64*pool.GetNumberOfThreads(); // traces in memory before they are written
+	trace_span<T> all((const T *)file.GetData(), file.GetSize()/(length*sizeof(T)), length);
+	ngamma_features features;
+	peak_features peaks;
+	std::vector<float> baselines;
+	double baseline_state = NAN;
+	std::vector<psd_histograms> hist_thread;
+	size_t first, n, k;
+	unsigned long piled_up = 0;
+
+	features.resize(window < all.ntraces ? window : all.ntraces);
+	if(peak != NULL) {
+		peaks.resize(features.size());
+	}
+	if(hist != NULL) {
+		hist_thread.assign(pool.GetNumberOfThreads(), *hist);
+	}
+	if(baseline != NULL) {
+		baselines.resize(features.size());
+	}
+	for(first=0; first<all.ntraces; first+=n) {
+		n = all.ntraces-first < window ? all.ntraces-first : window;
+		// the file is mapped read-only, so the baseline only corrects the integrals;
+		// the running estimate has to go through the traces in order before they are used
+		if(baseline != NULL) {
+			pool.Run((n+chunk-1)/chunk, [&](size_t k, unsigned int) {
+				size_t from = k*chunk, count = (from+chunk <= n) ? chunk : n-from;
+				calculate_baselines_batch(all.sub(first+from, count), *baseline, baselines, from);
+			});
+			if(baseline->method == BASELINE_RUNNING) {
+				running_baselines(baselines, 0, n, baseline_state, baseline->weight);
+			}
+		}
+		pool.Run((n+chunk-1)/chunk, [&](size_t k, unsigned int thread) {
+			size_t from = k*chunk, count = (from+chunk <= n) ? chunk : n-from;
+			calculate_integrals_batch(all.sub(first+from, count), dt1, len2, clip, features, from);
+			if(baseline != NULL) {
+				correct_integrals(features, baselines, from, count, length, len2);
+			}
+			if(peak != NULL) {
+				find_peaks_batch(all.sub(first+from, count), *peak, peaks, from);
+				flag_pileup(peaks, features, from, count);
+			}
+			if(hist != NULL) {
+				hist_thread[thread].fill(features, from, count);
+			}
+		});
+		// in the order of traces, no matter which thread has calculated them
+		if(out_baselines != NULL) {
+			if(binary) {
+				write_baselines_binary(baselines, out_baselines, 0, n);
+			} else {
+				write_baselines_text(baselines, out_baselines, 0, n);
+			}
+		}
+		if(out_peaks != NULL) {
+			for(k=0; k<n; k++) {
+				piled_up += peaks.is_piled_up(k) ? 1 : 0;
+			}
+			if(binary) {
+				write_peaks_binary(peaks, out_peaks, 0, n);
+			} else {
+				write_peaks_text(peaks, out_peaks, 0, n);
+			}
+		}
+		if(out == NULL) {
+			continue;
+		}
+		if(binary) {
+			write_integrals_binary(features, out, 0, n);
+		} else {
+			write_integrals_text(features, out, 0, n);
+		}
+	}
+	for(k=0; k<hist_thread.size(); k++) {
+		hist->merge(hist_thread[k]);
+	}
+	return piled_up;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int dt1 = 175, len2 = 250, nthreads = std::thread::hardware_concurrency(), bits = 8;
+	unsigned int hist_bins = 0;
+	double hist_integral1_max = 0, hist_integral2_max = 0;
+	bool binary = false, hist_only = false, find_peaks = false;
+	peak_options peak;
+	baseline_options baseline;
+	bool find_baseline = false;
+	unsigned long pretrigger;
+	unsigned long piled_up;
+	const char *out_name = NULL;
+	std::string name, channels, filename;
+	unsigned long length;
+	size_t c, ntraces;
+	int i;
+	Timing t;
+
+	for(i=1; i<argc; i++) {
+		if(strcmp(argv[i], "--dt1") == 0 && i+1 < argc) {
+			dt1 = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--len") == 0 && i+1 < argc) {
+			len2 = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+			nthreads = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--bits") == 0 && i+1 < argc) {
+			bits = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--out") == 0 && i+1 < argc) {
+			out_name = argv[++i];
+		} else if(strcmp(argv[i], "--hist") == 0 && i+3 < argc) {
+			hist_bins          = atoi(argv[++i]);
+			hist_integral1_max = atof(argv[++i]);
+			hist_integral2_max = atof(argv[++i]);
+			if(hist_bins < 1 || hist_integral1_max <= 0 || hist_integral2_max <= 0) {
+				cerr << "--hist <bins> <int1 max> <int2 max> expects three positive numbers.\n";
+				return 1;
+			}
+		} else if(strcmp(argv[i], "--peaks") == 0 && i+1 < argc) {
+			peak.threshold = atof(argv[++i]);
+			find_peaks     = true;
+		} else if(strcmp(argv[i], "--baseline") == 0 && i+1 < argc) {
+			i++;
+			if(strcmp(argv[i], "mean") == 0) {
+				baseline.method = BASELINE_MEAN;
+			} else if(strcmp(argv[i], "median") == 0) {
+				baseline.method = BASELINE_MEDIAN;
+			} else if(strcmp(argv[i], "running") == 0) {
+				baseline.method = BASELINE_RUNNING;
+			} else {
+				cerr << "--baseline <mean|median|running>: unknown method " << argv[i] << "\n";
+				return 1;
+			}
+			find_baseline = true;
+		} else if(strcmp(argv[i], "--hist-only") == 0) {
+			hist_only = true;
+		} else if(strcmp(argv[i], "--bin") == 0 || strcmp(argv[i], "--binary") == 0) {
+			binary = true;
+		} else if(strcmp(argv[i], "--text") == 0 || strcmp(argv[i], "--dat") == 0) {
+			binary = false;
+		} else if(strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+			print_usage();
+			return 0;
+		} else if(argv[i][0] == '-' && argv[i][1] == '-') {
+			cerr << "Unknown option " << argv[i] << "\n";
+			return 1;
+		} else if(name.empty()) {
+			name = argv[i];
+		} else {
+			channels = argv[i];
+		}
+	}
+	if(name.empty()) {
+		print_usage();
+		return 1;
+	}
+	if(nthreads < 1) {
+		nthreads = 1;
+	}
+	if(bits != 8 && bits != 16) {
+		cerr << "Only 8 or 16 bits per sample are supported.\n";
+		return 1;
+	}
+	if(!read_metadata(name + ".txt", length, filename, pretrigger)) {
+		cerr << "Unable to read the length of traces from " << name << ".txt\n";
+		return 1;
+	}
+	// all recorded channels unless asked otherwise
+	if(channels.empty()) {
+		channels = filename;
+	}
+	if(hist_only && hist_bins == 0) {
+		cerr << "--hist-only needs --hist.\n";
+		return 1;
+	}
+	if(out_name != NULL && channels.size() > 1) {
+		cerr << "--out can only be used for a single channel.\n";
+		return 1;
+	}
+	if(find_baseline) {
+		if(pretrigger == 0) {
+			cerr << "--baseline needs samples before the trigger, but " << name << ".txt has no trigger_dx.\n";
+			return 1;
+		}
+		baseline.length = pretrigger;
+	}
+
+	WorkStealingPool pool(nthreads);
+	for(c=0; c<channels.size(); c++) {
+		MappedFile file;
+		FILE *out, *out_peaks = NULL, *out_baselines = NULL;
+
+		filename = name + channels[c] + ".bin";
+		if(!file.Open(filename.c_str())) {
+			cerr << "Unable to open " << filename << "\n";
+			return 1;
+		}
+		ntraces = file.GetSize()/(length*bits/8);
+		if(file.GetSize() % (length*bits/8) != 0) {
+			cerr << "Warning: " << filename << " doesn't contain a whole number of traces of length " << length << "; ignoring the rest.\n";
+		}
+		out = NULL;
+		if(!hist_only) {
+			filename = out_name != NULL ? std::string(out_name) : name + channels[c] + (binary ? ".ngamma.bin" : ".ngamma.txt");
+			out = fopen(filename.c_str(), binary ? "wb" : "wt");
+			if(out == NULL) {
+				cerr << "Unable to open " << filename << " for writing\n";
+				return 1;
+			}
+		}
+		if(find_peaks) {
+			filename = name + channels[c] + (binary ? ".peaks.bin" : ".peaks.txt");
+			out_peaks = fopen(filename.c_str(), binary ? "wb" : "wt");
+			if(out_peaks == NULL) {
+				cerr << "Unable to open " << filename << " for writing\n";
+				return 1;
+			}
+		}
+		if(find_baseline) {
+			filename = name + channels[c] + (binary ? ".baseline.bin" : ".baseline.txt");
+			out_baselines = fopen(filename.c_str(), binary ? "wb" : "wt");
+			if(out_baselines == NULL) {
+				cerr << "Unable to open " << filename << " for writing\n";
+				return 1;
+			}
+		}
+		// the peak of 8-bit samples is at most 128
+		psd_histograms hist(hist_bins, hist_integral1_max, hist_integral2_max, bits == 8 ? 128 : 32768);
+
+		t.Start();
+		if(bits == 8) {
+			piled_up = process<int8_t>(pool, file, length, dt1, len2, ps6000_file_samples::clip(), binary, out, hist_bins > 0 ? &hist : NULL,
+				find_peaks ? &peak : NULL, out_peaks, find_baseline ? &baseline : NULL, out_baselines);
+		} else {
+			piled_up = process<int16_t>(pool, file, length, dt1, len2, ps4000_samples::clip(), binary, out, hist_bins > 0 ? &hist : NULL,
+				find_peaks ? &peak : NULL, out_peaks, find_baseline ? &baseline : NULL, out_baselines);
+		}
+		if(out_baselines != NULL) {
+			fclose(out_baselines);
+		}
+		if(out != NULL) {
+			fclose(out);
+		}
+		if(out_peaks != NULL) {
+			fclose(out_peaks);
+			fprintf(stderr, "-- Channel %c: %lu piled-up traces (%.2f %%)\n", channels[c], piled_up, ntraces > 0 ? 100.0*piled_up/ntraces : 0.0);
+		}
+		if(hist_bins > 0) {
+			filename = name + channels[c] + (binary ? ".hist.bin" : ".hist.txt");
+			if(!hist.save(filename.c_str(), binary)) {
+				cerr << "Unable to write " << filename << "\n";
+				return 1;
+			}
+		}
+		t.Stop();
+		fprintf(stderr, "-- Channel %c: %lu traces of length %lu in %.3f s (%.2f Mtraces/s on %u threads) -> %s\n",
+			channels[c], (unsigned long)ntraces, length, t.GetSecondsDouble(), ntraces*1e-6/t.GetSecondsDouble(), nthreads, filename.c_str());
+	}
+
+	return 0;
+}
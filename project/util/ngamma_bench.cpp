@@ -0,0 +1,1322 @@
+#include <cstdio>
+#include <vector>
+#include <iostream>
+#include <string>
+#include <limits>
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../src/analysis/n-gamma.h"
+#include "../src/analysis/pulse-timing.h"
+#include "../src/analysis/peaks.h"
+#include "../src/analysis/baseline.h"
+#include "../src/analysis/histogram.h"
+#include "../src/analysis/filters.h"
+#include "../src/analysis/coincidence.h"
+#include "../src/analysis/average.h"
+#include "../src/analysis/zero-suppress.h"
+#include "../src/analysis/veto.h"
+#include "../src/analysis/sample-statistics.h"
+#include "../src/analysis/auto-trigger.h"
+#include "../src/analysis/ets.h"
+#include "../src/timing.h"
+
+using namespace std;
+
+void print_usage()
+{
+	cout <<
+		"USAGE: ngamma_bench [<ntraces> [<length> [<dt1> [<length2>]]]]\n" <<
+		"       ngamma_bench --check\n\n" <<
+		"Compares the trace-by-trace n-gamma integrals (copy into a vector + fprintf)\n" <<
+		"with the batch version on synthetic 8-bit pulses, and measures the timing, peak finding and shaping,\n" <<
+		"the averages of the traces, the event builder on random hits of 4 channels (4 hits per trace)\n" <<
+		"and the zero suppression of a long signal (ntraces*length samples) with pulses every 10000 samples,\n" <<
+		"whose conversion to 8 bits is also timed with and without the statistics of the samples.\n" <<
+		"Default: 1000000 traces of length 650 with dt1=175 and length2=250.\n\n" <<
+		"--check only tests the kernels with int8, int16 and float samples,\n" <<
+		"the sums for every possible value of int8 and int16 samples included, the shaping filters, the event builder\n" <<
+		"the averages, the zero suppression, the features of the veto and the statistics of the samples.\n";
+}
+
+// negative pulses with a fast and a slow component on top of some noise, like the ones from a scintillator
+template<typename T> void generate_pulses(std::vector<T> &buffer, size_t ntraces, size_t length, int scale, unsigned long &seed)
+{
+	size_t n, i;
+	double amplitude, slow, value;
+	long position;
+	std::vector<double> fast_shape(length), slow_shape(length);
+
+	for(i=0; i<length; i++) {
+		fast_shape[i] = exp(-(double)i/6.0);
+		slow_shape[i] = exp(-(double)i/80.0);
+	}
+	buffer.resize(ntraces*length);
+	for(n=0; n<ntraces; n++) {
+		seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+		amplitude = 10 + (seed >> 33) % 120;
+		slow      = ((seed >> 20) & 1) ? 0.3 : 0.1;
+		position  = length/6 + (long)((seed >> 40) % 8);
+		for(i=0; i<length; i++) {
+			seed  = seed*6364136223846793005ULL + 1442695040888963407ULL;
+			value = (double)((seed >> 60) % 5) - 2.0;
+			if((long)i >= position) {
+				value -= amplitude*((1-slow)*fast_shape[i-position] + slow*slow_shape[i-position]);
+			}
+			if(value < -127) {
+				value = -127;
+			}
+			buffer[n*length+i] = (T)(lround(value)*scale);
+		}
+	}
+}
+
+// the n-gamma features of a single trace from the fprintf of calculate_and_write_integrals_i
+template<typename T> std::string single_integrals(const std::vector<T> &trace, unsigned int dt1, unsigned int length2, T clip)
+{
+	std::string text;
+	FILE *f = tmpfile();
+	long size;
+
+	calculate_and_write_integrals_i(trace, dt1, length2, f, clip);
+	size = ftell(f);
+	text.resize(size);
+	rewind(f);
+	if(fread(&text[0], 1, size, f) != (size_t)size) {
+		text.clear();
+	}
+	fclose(f);
+	return text;
+}
+
+bool same_features(const ngamma_features &a, const ngamma_features &b)
+{
+	return a.integral1 == b.integral1 && a.integral2 == b.integral2 && a.peak == b.peak &&
+		a.i_peak == b.i_peak && a.i_start_integrate2 == b.i_start_integrate2 && a.problem == b.problem;
+}
+
+// sum_samples for traces filled with the same value, for every value of T
+template<typename T> int check_sums(const std::vector<size_t> &lengths)
+{
+	std::vector<T> trace;
+	int32_t v;
+	size_t k;
+	int failed = 0;
+
+	for(k=0; k<lengths.size(); k++) {
+		for(v=numeric_limits<T>::min(); v<=numeric_limits<T>::max(); v++) {
+			trace.assign(lengths[k], (T)v);
+			if(sum_samples(&trace[0], trace.size()) != (int64_t)v*(int64_t)trace.size()) {
+				if(failed++ < 10) {
+					fprintf(stderr, "  sum of %lu samples %d is wrong\n", (unsigned long)trace.size(), v);
+				}
+			}
+		}
+	}
+	return failed;
+}
+
+// the features of the veto, 16 traces at once, against a simple loop over every trace (also for a number of traces that isn't a multiple of 16)
+int check_veto(size_t length)
+{
+	const size_t ntraces = 1001;
+	std::vector<int8_t> buffer;
+	veto_options opt;
+	veto_features f;
+	unsigned long seed = 3;
+	size_t n, i, at;
+	int failed = 0;
+	double base, sum;
+	int8_t lo;
+	uint32_t tot;
+
+	generate_pulses(buffer, ntraces, length, 1, seed);
+	opt.baseline_length = length/4;
+	opt.tot_level       = 10;
+	opt.enabled[VETO_RISE] = true;
+	calculate_veto_features(trace_span<int8_t>(&buffer[0], ntraces, length), opt, f);
+	for(n=0; n<ntraces; n++) {
+		const int8_t *x = &buffer[n*length];
+		base = 0;
+		for(i=0; i<opt.baseline_length; i++) {
+			base += x[i];
+		}
+		base = (float)(base/opt.baseline_length);
+		lo  = x[0];
+		at  = 0;
+		sum = 0;
+		tot = 0;
+		for(i=0; i<length; i++) {
+			if(x[i] < lo) {
+				lo = x[i];
+				at = i;
+			}
+			sum += x[i];
+			tot += (float)x[i] < (float)(base - opt.tot_level) ? 1 : 0;
+		}
+		if(fabs(f.height[n] - (base - lo)) > 1e-3 || fabs(f.area[n] - (base*length - sum)) > 1e-2*fabs(base*length) + 1e-2 || f.tot[n] != tot ||
+		   fabs(f.rise[n] - (veto_crossing_before(x, at, base, 0.9*(base-lo)) - veto_crossing_before(x, at, base, 0.1*(base-lo)))) > 1e-3) {
+			if(failed++ < 10) {
+				fprintf(stderr, "  veto features of trace %lu: %g %g %u %g\n", (unsigned long)n, f.height[n], f.area[n], f.tot[n], f.rise[n]);
+			}
+		}
+	}
+	fprintf(stderr, "  veto features across traces: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// a long signal with sparse pulses: noise around 0 and a pulse of -2000 (decaying with tau 50) at every 'spacing' samples on average
+void generate_sparse_signal(std::vector<int16_t> &signal, size_t length, size_t spacing, unsigned long &seed)
+{
+	size_t i;
+	double pulse = 0;
+
+	signal.resize(length);
+	for(i=0; i<length; i++) {
+		seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+		if((seed >> 33) % spacing == 0) {
+			pulse += 2000;
+		}
+		pulse *= 0.98;
+		signal[i] = (int16_t)(-pulse + (double)((seed >> 20) % 41) - 20);
+	}
+}
+
+// the pieces of the windows as text (the index of every sample)
+std::string zero_suppress_text(const std::vector<int16_t> &signal, const zero_suppress_options &opt, size_t chunk, zero_suppress_statistics &stats)
+{
+	zero_suppressor<int16_t> zs(opt);
+	FILE *f = tmpfile();
+	std::string text;
+	size_t done, n;
+	long size;
+
+	stats = zero_suppress_statistics();
+	for(done=0; done<signal.size(); done+=n) {
+		n = signal.size()-done < chunk ? signal.size()-done : chunk;
+		zs.process(&signal[done], n, [&](uint64_t index, const int16_t *x, size_t k, bool is_new) {
+			write_zs_piece_text(index, x, k, is_new, f);
+		}, stats);
+	}
+	size = ftell(f);
+	text.resize(size);
+	rewind(f);
+	if(size > 0 && fread(&text[0], 1, size, f) != (size_t)size) {
+		text.clear();
+	}
+	fclose(f);
+	return text;
+}
+
+// the windows have to be the same in chunks of any size (also shorter than the windows) as in one piece,
+// and the same as from a simple search over the whole signal
+int check_zero_suppress()
+{
+	std::vector<int16_t> signal;
+	std::vector<bool> keep;
+	zero_suppress_options opt;
+	zero_suppress_statistics whole_stats, stats;
+	unsigned long seed = 5;
+	std::string whole;
+	size_t i, j, chunks[] = {1, 7, 64, 99, 1000, 65536};
+	uint64_t kept = 0, pulses = 0;
+	bool armed = true;
+	int failed = 0;
+
+	opt.level      = -100;
+	opt.hysteresis = 30;
+	opt.pre        = 100;
+	opt.post       = 300;
+	generate_sparse_signal(signal, 500000, 2000, seed);
+	whole = zero_suppress_text(signal, opt, signal.size(), whole_stats);
+	for(i=0; i<sizeof(chunks)/sizeof(chunks[0]); i++) {
+		if(zero_suppress_text(signal, opt, chunks[i], stats) != whole || stats.kept != whole_stats.kept || stats.windows != whole_stats.windows) {
+			fprintf(stderr, "  zero suppression in chunks of %lu samples is different\n", (unsigned long)chunks[i]);
+			failed++;
+		}
+	}
+	keep.assign(signal.size(), false);
+	for(i=0; i<signal.size(); i++) {
+		if(armed && signal[i] < opt.level) {
+			pulses++;
+			armed = false;
+			for(j=(i >= opt.pre ? i-opt.pre : 0); j<i+opt.post && j<signal.size(); j++) {
+				keep[j] = true;
+			}
+		} else if(!armed && signal[i] >= opt.level + opt.hysteresis) {
+			armed = true;
+		}
+	}
+	for(i=0; i<signal.size(); i++) {
+		kept += keep[i] ? 1 : 0;
+	}
+	if(whole_stats.pulses != pulses || whole_stats.kept != kept || pulses == 0) {
+		fprintf(stderr, "  zero suppression: %llu pulses and %llu samples kept instead of %llu and %llu\n",
+			(unsigned long long)whole_stats.pulses, (unsigned long long)whole_stats.kept, (unsigned long long)pulses, (unsigned long long)kept);
+		failed++;
+	}
+	fprintf(stderr, "  zero suppression in chunks and against a simple search: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// the statistics of samples of 6000 series (8 bits in the upper byte, some of them clipped) in chunks of any size,
+// against a simple loop, and the conversion to 8 bits that comes with them
+int check_sample_statistics()
+{
+	const size_t n = 300001;
+	std::vector<int16_t> x(n);
+	std::vector<int8_t> out(n);
+	sample_statistics whole, chunked;
+	uint64_t histogram[256] = {0}, low = 0, high = 0;
+	unsigned long seed = 7;
+	size_t i, k, chunks[] = {1, 13, 4096, 10000};
+	int64_t sum = 0;
+	int lo = 32767, hi = -32768, failed = 0;
+
+	for(i=0; i<n; i++) {
+		seed = seed*6364136223846793005UL + 1442695040888963407UL;
+		x[i] = (int16_t)(((int)(seed >> 56) - 128) << 8);
+		x[i] = x[i] < -32512 ? -32512 : x[i];
+		histogram[(x[i] >> 8) + 128]++;
+		sum += x[i];
+		lo = x[i] < lo ? x[i] : lo;
+		hi = x[i] > hi ? x[i] : hi;
+		low  += x[i] <= -32512 ? 1 : 0;
+		high += x[i] >=  32512 ? 1 : 0;
+	}
+	count_samples<ps6000_samples>(&x[0], n, whole, &out[0]);
+	for(i=0; i<n; i++) {
+		if(out[i] != x[i] >> 8) {
+			failed++;
+		}
+	}
+	if(whole.count != n || whole.sum != sum || whole.min != lo || whole.max != hi || whole.clipped_low != low || whole.clipped_high != high ||
+	   memcmp(whole.histogram, histogram, sizeof(histogram)) != 0 || low == 0 || high == 0) {
+		fprintf(stderr, "  statistics of the samples: %llu samples from %d to %d, %llu and %llu clipped\n",
+			(unsigned long long)whole.count, whole.min, whole.max, (unsigned long long)whole.clipped_low, (unsigned long long)whole.clipped_high);
+		failed++;
+	}
+	for(k=0; k<sizeof(chunks)/sizeof(chunks[0]); k++) {
+		sample_statistics part;
+
+		chunked.reset();
+		for(i=0; i<n; i+=chunks[k]) {
+			part.reset();
+			count_samples<ps6000_samples>(&x[i], n-i < chunks[k] ? n-i : chunks[k], part);
+			chunked.merge(part);
+		}
+		if(chunked.count != whole.count || chunked.sum != whole.sum || chunked.sum2 != whole.sum2 || chunked.min != whole.min ||
+		   chunked.max != whole.max || chunked.clipped() != whole.clipped() || memcmp(chunked.histogram, whole.histogram, sizeof(histogram)) != 0) {
+			fprintf(stderr, "  statistics of the samples in chunks of %lu are different\n", (unsigned long)chunks[k]);
+			failed++;
+		}
+	}
+	fprintf(stderr, "  statistics of the samples and their conversion: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// the crossings of all levels at once against one level at a time, on noise with negative pulses
+int check_auto_trigger()
+{
+	const size_t n = 200000;
+	std::vector<int16_t> x(n);
+	sample_statistics s;
+	noise_measurement m;
+	uint64_t count;
+	unsigned long seed = 11;
+	size_t i;
+	int d, e, failed = 0;
+	bool armed;
+
+	for(i=0; i<n; i++) {
+		seed = seed*6364136223846793005UL + 1442695040888963407UL;
+		// a baseline of 3 with noise of +-4 and a pulse of -60 every 1000 samples
+		x[i] = (int16_t)((3 + (int)((seed >> 33) % 9) - 4 - (i % 1000 < 5 ? 60 : 0)) << 8);
+	}
+	count_samples<ps6000_samples>(&x[0], n, s);
+	measure_baseline_noise(s.histogram, -1, m);
+	m.hysteresis = 3;
+	m.seconds    = n*1e-9;
+	count_noise_crossings(&x[0], n, -1, m);
+	if(m.baseline != 3 || m.rms < 2 || m.rms > 3) {
+		fprintf(stderr, "  noise: baseline %g and rms %g instead of 3 and about 2.6\n", m.baseline, m.rms);
+		failed++;
+	}
+	for(d=1; d<=128; d++) {
+		count = 0;
+		armed = true;
+		for(i=0; i<n; i++) {
+			e = (x[i] >> 8) - 3;
+			if(armed && e >= d) {
+				count++;
+				armed = false;
+			} else if(!armed && e <= d - m.hysteresis) {
+				armed = true;
+			}
+		}
+		if(count != m.crossings[d]) {
+			fprintf(stderr, "  %llu crossings of the level %d instead of %llu\n", (unsigned long long)m.crossings[d], d, (unsigned long long)count);
+			failed++;
+		}
+	}
+	// the pulses are below the baseline, the noise ends at +4
+	d = choose_trigger_distance(m, 1, 128);
+	if(m.crossings[4] == 0 || m.crossings[5] != 0 || d < 5 || noise_trigger_rate(m, d) > 1) {
+		fprintf(stderr, "  level %d for the noise of +-4\n", d);
+		failed++;
+	}
+	fprintf(stderr, "  noise crossings for the trigger level: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// 16-bit files (4000 series) clip at -32764: a pulse down to it is a problem, a pulse down to the clip of 6000 series is not
+int check_clipped_16bit(size_t length, unsigned int dt1, unsigned int length2)
+{
+	const int16_t peaks[] = { ps4000_samples::clip(), ps6000_samples::clip() };
+	const size_t position = length/6;
+	std::vector<int16_t> x(2*length, 0);
+	ngamma_features f;
+	size_t n, i;
+	int failed = 0;
+
+	for(n=0; n<2; n++) {
+		// a linear edge of 4 samples and an exponential decay
+		for(i=0; i<4; i++) {
+			x[n*length+position-3+i] = (int16_t)(peaks[n]*(int)(i+1)/4);
+		}
+		for(i=position+1; i<length; i++) {
+			x[n*length+i] = (int16_t)lround(peaks[n]*exp(-(double)(i-position)/40.0));
+		}
+	}
+	calculate_integrals_batch(trace_span<int16_t>(&x[0], 2, length), dt1, length2, ps4000_samples::clip(), f);
+	if(f.problem[0] == 0 || f.i_peak[0] != position) {
+		fprintf(stderr, "  a 16-bit trace down to %d is not marked as clipped\n", ps4000_samples::clip());
+		failed++;
+	}
+	if(f.problem[1] != 0 || f.i_peak[1] != position) {
+		fprintf(stderr, "  a 16-bit trace down to %d is marked as a problem\n", ps6000_samples::clip());
+		failed++;
+	}
+	fprintf(stderr, "  clipping of 16-bit samples: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// the bins at the edges of an axis, merging histograms with the same and with different binning,
+// and the traces with problems, which psd_histograms only counts
+int check_histograms()
+{
+	histogram_axis a(10, 0, 100), b(3, 0.1, 0.7);
+	histogram1d h1(a), h2(a), h3(b);
+	psd_histograms p1(16, 1000, 500, 128), p2(16, 1000, 500, 128), p3(32, 1000, 500, 128);
+	ngamma_features f;
+	const double values[] = { -1e-9, 0, 9.999, 10, 99.99, nextafter(100.0, 0.0), 100, 1e9 };
+	const unsigned int bins[] = { 0, 1, 1, 2, 10, 10, 11, 11 };
+	size_t i;
+	int failed = 0;
+	bool thrown;
+
+	for(i=0; i<sizeof(values)/sizeof(values[0]); i++) {
+		if(a.bin(values[i]) != bins[i]) {
+			fprintf(stderr, "  %.17g is in bin %u instead of %u\n", values[i], a.bin(values[i]), bins[i]);
+			failed++;
+		}
+	}
+	if(b.bin(nextafter(0.7, 0.0)) != 3 || b.bin(0.7) != 4 || b.bin(0.1) != 1) {
+		fprintf(stderr, "  edges of the bins from 0.1 to 0.7 are wrong\n");
+		failed++;
+	}
+
+	h1.fill(5); h1.fill(-1); h1.fill(100);
+	h2.fill(5); h2.fill(55);
+	h1.merge(h2);
+	if(h1.entries() != 5 || h1.get_counts()[1] != 2 || h1.get_counts()[6] != 1 || h1.get_counts()[0] != 1 || h1.get_counts()[11] != 1) {
+		fprintf(stderr, "  merged histogram has the wrong counts\n");
+		failed++;
+	}
+	thrown = false;
+	try {
+		h1.merge(h3);
+	} catch(const char *) {
+		thrown = true;
+	}
+	if(!thrown) {
+		fprintf(stderr, "  histograms with different binning were merged\n");
+		failed++;
+	}
+
+	// traces 1 and 3 have problems (the second one a pile-up)
+	f.resize(5);
+	for(i=0; i<5; i++) {
+		f.integral1[i] = 100*(int32_t)i;
+		f.integral2[i] = 10*(int32_t)i;
+		f.peak[i]      = 20;
+	}
+	f.problem[1] = 1;
+	f.problem[3] = 2;
+	p1.fill(f, 0, 5);
+	p2.fill(f, 1, 3);
+	p1.merge(p2);
+	if(p1.problems != 4 || p1.integral1.entries() != 4 || p1.peak.entries() != 4) {
+		fprintf(stderr, "  %llu problems and %llu entries instead of 4 and 4\n", (unsigned long long)p1.problems,
+			(unsigned long long)p1.integral1.entries());
+		failed++;
+	}
+	thrown = false;
+	try {
+		p1.merge(p3);
+	} catch(const char *) {
+		thrown = true;
+	}
+	if(!thrown) {
+		fprintf(stderr, "  n-gamma histograms with different binning were merged\n");
+		failed++;
+	}
+	fprintf(stderr, "  bins, merging and problems of the histograms: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// pulses (an edge of 3 samples and a decay of 20 samples) at a known distance: a single one, two that are
+// further apart than the holdoff (pile-up with the right spacing), two within the holdoff with a recovery of more than
+// the threshold between them (still two) and two without it (one pulse, without a false one on the second edge)
+int check_peaks()
+{
+	const size_t length = 300, start = 50, ntraces = 4;
+	const size_t distances[ntraces] = { 0, 40, 6, 4 };
+	const int nexpected[ntraces] = { 1, 2, 2, 1 };
+	std::vector<int16_t> x(ntraces*length, 0);
+	peak_options opt;
+	peak_features pk;
+	size_t n, i, k;
+	int failed = 0;
+
+	for(n=0; n<ntraces; n++) {
+		for(k=0; k<(distances[n] > 0 ? 2u : 1u); k++) {
+			for(i=start+k*distances[n]; i<length; i++) {
+				size_t d = i - start - k*distances[n];
+				x[n*length+i] += (int16_t)lround(d < 3 ? -200.0*(d+1)/3 : -200.0*exp(-(double)(d-2)/20.0));
+			}
+		}
+	}
+	opt.threshold = 20;
+	opt.holdoff   = 8;
+	find_peaks_batch(trace_span<int16_t>(&x[0], ntraces, length), opt, pk);
+	for(n=0; n<ntraces; n++) {
+		if(pk.npeaks[n] != nexpected[n]) {
+			fprintf(stderr, "  %u pulses instead of %d at the distance %lu\n", pk.npeaks[n], nexpected[n], (unsigned long)distances[n]);
+			failed++;
+		} else if(nexpected[n] == 2 && pk.spacing[n] != (int32_t)distances[n]) {
+			fprintf(stderr, "  spacing %d instead of %lu\n", pk.spacing[n], (unsigned long)distances[n]);
+			failed++;
+		}
+	}
+	if(pk.position[0] != start+2 || pk.height[0] != 200 || pk.spacing[0] != -1 || pk.is_piled_up(0)) {
+		fprintf(stderr, "  single pulse at %u with height %d and spacing %d\n", pk.position[0], pk.height[0], pk.spacing[0]);
+		failed++;
+	}
+	if(pk.position[pk.max_peaks] != start+2 || pk.position[pk.max_peaks+1] != start+2+distances[1] ||
+	   pk.height[pk.max_peaks+1] < 190 || pk.height[pk.max_peaks+1] > 210 || !pk.is_piled_up(1)) {
+		fprintf(stderr, "  two pulses at %u and %u with heights %d and %d\n",
+			pk.position[pk.max_peaks], pk.position[pk.max_peaks+1], pk.height[pk.max_peaks], pk.height[pk.max_peaks+1]);
+		failed++;
+	}
+	fprintf(stderr, "  pulses and pile-up at known distances: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// crossing times of pulses whose crossing is known: a linear edge (exact with the linear interpolation),
+// a cubic edge (exact with the cubic one), a pulse without a crossing and crossings at the first and the last sample
+int check_timing()
+{
+	const size_t length = 64;
+	std::vector<float> x(4*length, 0);
+	timing_options cfd, le;
+	pulse_times t;
+	size_t i;
+	int failed = 0;
+
+	// 0: linear edge from sample 20 down to -400 at sample 60
+	// 1: cubic edge -0.05*(i-20)^3 down to -400 at sample 40
+	// 2: no pulse at all
+	// 3: the minimum in the first sample (nothing before it crosses)
+	for(i=20; i<length; i++) {
+		x[0*length+i] = i <= 60 ? -10.0f*(i-20) : -400.0f;
+		x[1*length+i] = i <= 40 ? (float)(-0.05*(i-20)*(i-20)*(i-20)) : -400.0f + (i-40);
+	}
+	x[3*length] = -400;
+
+	cfd.fraction = 0.33;
+	calculate_crossing_times_batch(trace_span<float>(&x[0], 4, length), cfd, t);
+	// -132 is crossed 0.2 samples after sample 33
+	if(t.problem[0] != 0 || fabs(t.crossing[0] - 33.2) > 1e-6) {
+		fprintf(stderr, "  CFD crossing of a linear edge at %g instead of 33.2\n", t.crossing[0]);
+		failed++;
+	}
+	if(t.problem[2] == 0 || t.problem[3] == 0 || t.crossing[2] != -1 || t.crossing[3] != -1) {
+		fprintf(stderr, "  traces without a crossing are not marked as problems\n");
+		failed++;
+	}
+	le.is_cfd = false;
+	le.level  = 55;
+	calculate_crossing_times_batch(trace_span<float>(&x[0], 1, length), le, t);
+	if(t.problem[0] != 0 || fabs(t.crossing[0] - 25.5) > 1e-6) {
+		fprintf(stderr, "  leading-edge crossing of a linear edge at %g instead of 25.5\n", t.crossing[0]);
+		failed++;
+	}
+
+	// -120 is crossed at 20 + 2400^(1/3); the linear interpolation misses it by about 0.03 samples
+	cfd.fraction = 0.3;
+	calculate_crossing_times_batch(trace_span<float>(&x[length], 1, length), cfd, t);
+	if(t.problem[0] != 0 || fabs(t.crossing[0] - (20 + cbrt(2400.0))) < 1e-2) {
+		fprintf(stderr, "  linear crossing of a cubic edge at %g is too close to %g\n", t.crossing[0], 20 + cbrt(2400.0));
+		failed++;
+	}
+	cfd.is_cubic = true;
+	calculate_crossing_times_batch(trace_span<float>(&x[length], 1, length), cfd, t);
+	if(t.problem[0] != 0 || fabs(t.crossing[0] - (20 + cbrt(2400.0))) > 1e-4) {
+		fprintf(stderr, "  cubic crossing of a cubic edge at %g instead of %g\n", t.crossing[0], 20 + cbrt(2400.0));
+		failed++;
+	}
+
+	// crossings right after the first sample and right before the last one (the cubic falls back to the linear interpolation)
+	x.assign(2*length, 0);
+	x[1] = -400;
+	for(i=1; i<length; i++) {
+		x[length+i] = -100;
+	}
+	x[2*length-1] = -400;
+	cfd.baseline_length = 1;
+	calculate_crossing_times_batch(trace_span<float>(&x[0], 2, length), cfd, t);
+	if(t.problem[0] != 0 || fabs(t.crossing[0] - 0.3) > 1e-6) {
+		fprintf(stderr, "  crossing after the first sample at %g instead of 0.3\n", t.crossing[0]);
+		failed++;
+	}
+	// baseline 0, threshold -120: between -100 at sample 62 and -400 at sample 63
+	if(t.problem[1] != 0 || fabs(t.crossing[1] - (length-2 + 20.0/300)) > 1e-6) {
+		fprintf(stderr, "  crossing before the last sample at %g instead of %g\n", t.crossing[1], length-2 + 20.0/300);
+		failed++;
+	}
+	fprintf(stderr, "  CFD and leading-edge times of known edges: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// baselines of traces with a known DC offset and noise before a pulse: the mean, the median of blocks (with a spike
+// in the pre-trigger region and a block size that has to grow to at most 64 blocks), the running estimate of a drift
+// and the traces without samples before the trigger
+int check_baseline()
+{
+	const size_t ntraces = 200, length = 1000, pretrigger = 400;
+	std::vector<int16_t> x(ntraces*length);
+	std::vector<float> mean, median, running, none;
+	std::vector<float> blocks;
+	baseline_options opt;
+	unsigned long seed = 13;
+	double state = NAN;
+	size_t n, i, b;
+	int failed = 0;
+
+	for(n=0; n<ntraces; n++) {
+		for(i=0; i<length; i++) {
+			seed = seed*6364136223846793005UL + 1442695040888963407UL;
+			// an offset of 37 (47 for the second half of the traces) with noise of +-4 and a pulse after the trigger
+			x[n*length+i] = (int16_t)((n < ntraces/2 ? 37 : 47) + (int)((seed >> 33) % 9) - 4 - (i >= pretrigger ? 500 : 0));
+		}
+		// a spike that spoils a single block of the median
+		x[n*length+10] = -3000;
+	}
+	trace_span<int16_t> traces(&x[0], ntraces, length);
+
+	opt.length = pretrigger;
+	opt.method = BASELINE_MEAN;
+	calculate_baselines_batch(traces, opt, mean);
+	opt.method = BASELINE_MEDIAN;
+	opt.block  = 1;
+	calculate_baselines_batch(traces, opt, median);
+	for(n=0; n<ntraces; n++) {
+		// 400 samples in blocks of 1 would be 400 blocks: they have to grow to 7 samples (57 blocks)
+		blocks.clear();
+		for(b=0; b+7<=pretrigger; b+=7) {
+			blocks.push_back((float)sum_samples(traces.trace(n) + b, 7)/7);
+		}
+		std::nth_element(blocks.begin(), blocks.begin() + blocks.size()/2, blocks.end());
+		if(median[n] != blocks[blocks.size()/2]) {
+			if(failed++ < 10) {
+				fprintf(stderr, "  median of trace %lu is %g instead of %g\n", (unsigned long)n, median[n], blocks[blocks.size()/2]);
+			}
+		}
+		// the spike pulls the mean down by 3037/400, but not the median
+		if(fabs(median[n] - (n < ntraces/2 ? 37 : 47)) > 1 || fabs(mean[n] + 3037.0/pretrigger - (n < ntraces/2 ? 37 : 47)) > 1) {
+			if(failed++ < 10) {
+				fprintf(stderr, "  baselines of trace %lu: mean %g, median %g\n", (unsigned long)n, mean[n], median[n]);
+			}
+		}
+	}
+
+	// the running estimate follows the step from 37 to 47 slowly
+	opt.method = BASELINE_RUNNING;
+	opt.weight = 1.0/16;
+	calculate_baselines_batch(traces, opt, running);
+	running_baselines(running, 0, ntraces, state, opt.weight);
+	if(fabs(running[ntraces/2-1] - (37 - 3037.0/pretrigger)) > 1 || running[ntraces/2] > running[ntraces/2-1] + 1 ||
+	   fabs(running[ntraces-1] - (47 - 3037.0/pretrigger)) > 1) {
+		fprintf(stderr, "  running baseline %g, %g, %g around the step from 37 to 47\n", running[ntraces/2-1], running[ntraces/2], running[ntraces-1]);
+		failed++;
+	}
+
+	// without samples before the trigger the pulse must not be taken for the baseline
+	opt.length = 0;
+	calculate_baselines_batch(traces, opt, none);
+	for(n=0; n<ntraces; n++) {
+		if(none[n] != 0) {
+			fprintf(stderr, "  baseline %g of trace %lu without samples before the trigger\n", none[n], (unsigned long)n);
+			failed++;
+			break;
+		}
+	}
+	fprintf(stderr, "  baselines (mean, median, running): %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// the interleaves of an ETS trace (with equal times and a single short one) merged into the order of their times, and the samples with them
+int check_ets_sorter()
+{
+	const size_t n = 10007, interleaves = 7, per = (n + interleaves - 1)/interleaves;
+	std::vector<int64_t> t(n), sorted;
+	std::vector<int16_t> x(n), buffer;
+	ets_sorter sorter;
+	size_t i;
+	int failed = 0;
+
+	for(i=0; i<n; i++) {
+		t[i] = (int64_t)((i % per)*interleaves + i/per)*1000 - (i/per == 3 ? 1000 : 0);
+		x[i] = (int16_t)(t[i]/1000);
+	}
+	sorted = t;
+	std::stable_sort(sorted.begin(), sorted.end());
+	if(!sorter.sort(&t[0], n)) {
+		fprintf(stderr, "  the interleaves were not recognised\n");
+		failed++;
+	}
+	sorter.apply(&x[0], n, buffer);
+	for(i=0; i<n; i++) {
+		if(t[i] != sorted[i] || x[i] != (int16_t)(t[i]/1000)) {
+			fprintf(stderr, "  sample %lu at %lld fs (%d) instead of %lld fs\n", (unsigned long)i, (long long)t[i], x[i], (long long)sorted[i]);
+			failed++;
+			break;
+		}
+	}
+	if(sorter.sort(&t[0], n)) {
+		fprintf(stderr, "  the sorted times were sorted again\n");
+		failed++;
+	}
+	fprintf(stderr, "  order of the ETS samples: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// the average of more traces than fit into the narrow accumulators, with extreme values, and the rms of a known signal
+int check_average()
+{
+	const size_t length = 16, ntraces = 200000;
+	std::vector<int16_t> traces(length*ntraces);
+	trace_average avg(length, true), part(length, true);
+	size_t n, i;
+	int failed = 0;
+
+	for(n=0; n<ntraces; n++) {
+		for(i=0; i<length; i++) {
+			// -32768 everywhere, except for a square wave of +-1000 around 0 in the last sample
+			traces[n*length+i] = i < length-1 ? -32768 : (n % 2 ? 1000 : -1000);
+		}
+	}
+	accumulate_traces(trace_span<int16_t>(&traces[0], ntraces, length), avg);
+	// in pieces on several "threads"
+	for(n=0; n<ntraces; n+=70001) {
+		trace_average t(length, true);
+		accumulate_traces(trace_span<int16_t>(&traces[n*length], ntraces-n < 70001 ? ntraces-n : 70001, length), t);
+		part.merge(t);
+	}
+	if(avg.count != ntraces || avg.sum[0] != -32768LL*(int64_t)ntraces || avg.mean(0) != -32768 || avg.rms(0) != 0) {
+		fprintf(stderr, "  the sum of %lu traces of -32768 is wrong: %lld\n", (unsigned long)ntraces, (long long)avg.sum[0]);
+		failed++;
+	}
+	if(avg.mean(length-1) != 0 || fabs(avg.rms(length-1) - 1000) > 1e-9) {
+		fprintf(stderr, "  the square wave has mean %g and rms %g instead of 0 and 1000\n", avg.mean(length-1), avg.rms(length-1));
+		failed++;
+	}
+	if(part.sum != avg.sum || part.sum2 != avg.sum2 || part.count != avg.count) {
+		fprintf(stderr, "  the merged averages are different\n");
+		failed++;
+	}
+	fprintf(stderr, "  averages of many traces: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// hits of 'nchannels' channels at 'rate' per second each (Poisson), a fraction of them with a partner in the next channel
+void generate_hits(std::vector<std::vector<coincidence_hit> > &hits, size_t nchannels, size_t n, double rate, double fraction, unsigned long &seed)
+{
+	double t = 0, u;
+	size_t i, c;
+
+	hits.assign(nchannels, std::vector<coincidence_hit>());
+	for(i=0; i<n; i++) {
+		seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+		u = ((seed >> 11) + 0.5)/9007199254740992.0;
+		t -= log(u)/(rate*nchannels)*1e12;
+		coincidence_hit h;
+		seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+		h.time_ps = (int64_t)t;
+		h.channel = (seed >> 33) % nchannels;
+		h.trace   = hits[h.channel].size();
+		h.energy  = (float)((seed >> 43) % 1000);
+		// (not before the partner of an earlier hit)
+		if(hits[h.channel].empty() || hits[h.channel].back().time_ps <= h.time_ps) {
+			hits[h.channel].push_back(h);
+		}
+		// a partner a few ns later in the next channel (kept in the order of time of that channel)
+		seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+		if((seed >> 11)/9007199254740992.0 < fraction) {
+			c = (h.channel + 1) % nchannels;
+			h.time_ps += (int64_t)((seed >> 40) % 3000);
+			if(hits[c].empty() || hits[c].back().time_ps <= h.time_ps) {
+				h.channel = c;
+				h.trace   = hits[c].size();
+				hits[c].push_back(h);
+			}
+		}
+	}
+}
+
+// the events as text, whichever way the hits were added
+std::string build_events(const std::vector<std::vector<coincidence_hit> > &hits, const coincidence_options &opt, size_t chunk, coincidence_statistics *stats=NULL)
+{
+	const char names[] = "ABCDEFGH";
+	event_builder events(opt, hits.size());
+	std::vector<size_t> done(hits.size(), 0);
+	FILE *f = tmpfile();
+	std::string text;
+	size_t c, n, remaining = 1;
+	long size;
+	auto write = [&](const coincidence_hit *h, size_t k, uint32_t mask) { write_event_text(h, k, mask, names, f); };
+
+	while(remaining > 0) {
+		remaining = 0;
+		// the channels get chunks of different sizes
+		for(c=0; c<hits.size(); c++) {
+			n = hits[c].size() - done[c];
+			n = n < chunk*(c+1) ? n : chunk*(c+1);
+			events.add(c, n > 0 ? &hits[c][done[c]] : NULL, n);
+			done[c] += n;
+			remaining += hits[c].size() - done[c];
+		}
+		events.build(write);
+	}
+	events.finish();
+	events.build(write);
+	if(stats != NULL) {
+		*stats = events.get_statistics();
+	}
+	size = ftell(f);
+	text.resize(size);
+	rewind(f);
+	if(size > 0 && fread(&text[0], 1, size, f) != (size_t)size) {
+		text.clear();
+	}
+	fclose(f);
+	return text;
+}
+
+// the events have to be the same in chunks as all at once and as those from sorting all the hits;
+// for independent channels the coincidences have to agree with both estimates of the accidentals
+int check_coincidence()
+{
+	std::vector<std::vector<coincidence_hit> > hits;
+	std::vector<coincidence_hit> all;
+	coincidence_options opt;
+	coincidence_statistics stats;
+	unsigned long seed = 11;
+	std::string whole, text;
+	size_t c, i, k, nch;
+	uint32_t mask;
+	int failed = 0;
+	double expected, delayed;
+	FILE *f;
+	long size;
+
+	opt.window_ps    = 5000;
+	opt.multiplicity = 2;
+	generate_hits(hits, 3, 200000, 1e6, 0.3, seed);
+	whole = build_events(hits, opt, (size_t)1 << 30);
+	if(whole.empty()) {
+		fprintf(stderr, "  no coincidences were found\n");
+		failed++;
+	}
+	for(k=1; k<=1000; k*=10) {
+		if(build_events(hits, opt, k) != whole) {
+			fprintf(stderr, "  the events built in chunks of %lu hits are different\n", (unsigned long)k);
+			failed++;
+		}
+	}
+	// the same from all hits sorted by time (stable, so that hits at the same time keep the order of the channels)
+	for(c=0; c<hits.size(); c++) {
+		all.insert(all.end(), hits[c].begin(), hits[c].end());
+	}
+	std::stable_sort(all.begin(), all.end(), [](const coincidence_hit &a, const coincidence_hit &b) { return a.time_ps < b.time_ps; });
+	f = tmpfile();
+	for(i=0; i<all.size(); i=k) {
+		mask = 0;
+		for(k=i; k<all.size() && all[k].time_ps <= all[i].time_ps + opt.window_ps; k++) {
+			mask |= 1U << all[k].channel;
+		}
+		for(c=0, nch=0; c<hits.size(); c++) {
+			nch += (mask >> c) & 1;
+		}
+		if(nch >= opt.multiplicity) {
+			write_event_text(&all[i], k-i, mask, "ABC", f);
+		}
+	}
+	size = ftell(f);
+	text.resize(size);
+	rewind(f);
+	if(fread(&text[0], 1, size, f) != (size_t)size || text != whole) {
+		fprintf(stderr, "  the event builder gives different events than sorting all the hits\n");
+		failed++;
+	}
+	fclose(f);
+
+	// independent channels: every coincidence is accidental
+	opt.delay_ps = 1000000;
+	generate_hits(hits, 2, 2000000, 1e6, 0, seed);
+	build_events(hits, opt, 4096, &stats);
+	expected = stats.accidentals(0, 1, opt.window_ps);
+	delayed  = (double)stats.delayed[1];
+	if(fabs(stats.pairs[1] - expected) > 5*sqrt(expected) || fabs(delayed - expected) > 5*sqrt(expected)) {
+		fprintf(stderr, "  accidentals: %llu coincidences, %.1f expected from the singles, %.0f in the delayed window\n",
+			(unsigned long long)stats.pairs[1], expected, delayed);
+		failed++;
+	}
+	fprintf(stderr, "  events in chunks, against sorted hits and accidentals: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+// every filter has to give the same result in chunks as in one piece, and the right height for known pulses
+int check_filters()
+{
+	const size_t length = 100000;
+	std::vector<int16_t> signal(length);
+	std::vector<float> whole(length), chunked(length), lanes;
+	std::vector<shaper_options> filters(5);
+	unsigned long seed = 7;
+	size_t i, k, done, n;
+	int failed = 0;
+	double a;
+
+	// exponential pulses (tau 50 samples) on a baseline with noise
+	for(i=0; i<length; i++) {
+		seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+		signal[i] = (int16_t)(-1000 + (long)((seed >> 60) % 9) - 4);
+	}
+	for(k=500; k+2000<length; k+=3000) {
+		for(i=0; i<2000; i++) {
+			signal[k+i] -= (int16_t)lround(20000*exp(-(double)i/50));
+		}
+	}
+	filters[0].type = SHAPER_MOVING_AVERAGE; filters[0].length = 16;
+	filters[1].type = SHAPER_FIR; filters[1].taps.push_back(0.25); filters[1].taps.push_back(0.5); filters[1].taps.push_back(0.25);
+	filters[2].type = SHAPER_TRAPEZOIDAL; filters[2].rise = 20; filters[2].flat = 10; filters[2].tau = 50;
+	filters[3].type = SHAPER_TRAPEZOIDAL; filters[3].rise = 20; filters[3].flat = 10; filters[3].tau = 0;
+	filters[4].type = SHAPER_CRRC; filters[4].tau = 10; filters[4].order = 4;
+	for(k=0; k<filters.size(); k++) {
+		pulse_shaper shaper(filters[k]);
+
+		shaper.process(&signal[0], &whole[0], length);
+		shaper.reset();
+		for(done=0; done<length; done+=n) {
+			seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+			n = 1 + (seed >> 33) % 5000;
+			n = n < length-done ? n : length-done;
+			shaper.process(&signal[done], &chunked[done], n);
+		}
+		if(whole != chunked) {
+			fprintf(stderr, "  %s gives different results in chunks\n", shaper_description(filters[k]).c_str());
+			failed++;
+		}
+	}
+
+	// the flat top of the trapezoid is the height of the pulse (with the pole-zero correction)
+	{
+		pulse_shaper trapezoid(filters[2]);
+		trapezoid.process(&signal[0], &whole[0], length);
+		a = -whole[500+20+5];
+		if(fabs(a - 20000) > 20) {
+			fprintf(stderr, "  the trapezoid of a pulse of height 20000 has a flat top at %g\n", a);
+			failed++;
+		}
+	}
+	// steps: trapezoid without pole-zero correction and CR-RC^4 (peak at about 4 tau)
+	{
+		std::vector<int16_t> step(400, 0);
+		float minimum = 0;
+
+		for(i=100; i<step.size(); i++) {
+			step[i] = -10000;
+		}
+		pulse_shaper trapezoid(filters[3]), crrc(filters[4]);
+		trapezoid.process(&step[0], &whole[0], step.size());
+		if(fabs(whole[100+25] + 10000) > 1) {
+			fprintf(stderr, "  the trapezoid of a step of 10000 has a flat top at %g\n", -whole[100+25]);
+			failed++;
+		}
+		crrc.process(&step[0], &whole[0], step.size());
+		for(i=0; i<step.size(); i++) {
+			minimum = whole[i] < minimum ? whole[i] : minimum;
+		}
+		if(fabs(minimum + 10000) > 10000*0.05) {
+			fprintf(stderr, "  CR-RC^4 of a step of 10000 has a peak of %g\n", -minimum);
+			failed++;
+		}
+	}
+	// CR-RC^n of a group of traces at once
+	{
+		const size_t ntraces = 21, len = 1000;
+		pulse_shaper crrc(filters[4]);
+
+		lanes.resize(ntraces*len);
+		crrc.crrc_traces(&signal[0], len, ntraces, &lanes[0]);
+		for(k=0; k<ntraces; k++) {
+			crrc.reset();
+			crrc.process(&signal[k*len], &whole[0], len);
+			if(!std::equal(whole.begin(), whole.begin()+len, lanes.begin()+k*len)) {
+				fprintf(stderr, "  CR-RC^4 of trace %lu differs when the traces are shaped together\n", (unsigned long)k);
+				failed++;
+				break;
+			}
+		}
+	}
+	fprintf(stderr, "  filters in chunks and heights of shaped pulses: %s\n", failed ? "FAILED" : "ok");
+	return failed;
+}
+
+int check_kernels(unsigned long length, unsigned int dt1, unsigned int length2)
+{
+	const unsigned long ntraces = 20000;
+	std::vector<int8_t>  buffer8;
+	std::vector<int16_t> buffer16, trace16;
+	std::vector<float>   buffer_float;
+	ngamma_features f8, f16, f_float, f_single;
+	std::vector<size_t> lengths;
+	unsigned long seed = 3, n, i;
+	int failed = 0, k;
+	bool overflow = false;
+
+	// all values, with lengths around the vector width and the blocks of the accumulators
+	lengths.push_back(1); lengths.push_back(7); lengths.push_back(8); lengths.push_back(9); lengths.push_back(length);
+	failed += check_sums<int8_t>(lengths);
+	failed += check_sums<int16_t>(lengths);
+	// longer traces, where the sum of 16-bit samples doesn't fit into 32 bits any more
+	lengths.clear();
+	lengths.push_back(8*65536); lengths.push_back(8*65536+9); lengths.push_back(3*8*65536+5);
+	for(k=0; k<(int)lengths.size(); k++) {
+		int16_t extremes[] = { -32768, -32764, -32512, -1, 1, 32512, 32767 };
+		for(i=0; i<sizeof(extremes)/sizeof(extremes[0]); i++) {
+			trace16.assign(lengths[k], extremes[i]);
+			if(sum_samples(&trace16[0], trace16.size()) != (int64_t)extremes[i]*(int64_t)trace16.size()) {
+				fprintf(stderr, "  sum of %lu samples %d is wrong\n", (unsigned long)trace16.size(), extremes[i]);
+				failed++;
+			}
+		}
+	}
+	fprintf(stderr, "  sums of all int8 and int16 values: %s\n", failed ? "FAILED" : "ok");
+
+	// 6000 series: the 16-bit samples (8 bits in the upper byte) must give the same features as the 8-bit files,
+	// and float samples must give the same as integers
+	generate_pulses(buffer8, ntraces, length, 1, seed);
+	buffer16.resize(buffer8.size());
+	buffer_float.resize(buffer8.size());
+	for(i=0; i<buffer8.size(); i++) {
+		buffer16[i]     = buffer8[i]*256;
+		buffer_float[i] = buffer8[i];
+	}
+	calculate_integrals_batch(trace_span<int8_t>(&buffer8[0], ntraces, length), dt1, length2, (int8_t)-127, f8);
+	calculate_integrals_batch(trace_span<int16_t>(&buffer16[0], ntraces, length), dt1, length2, (int16_t)(-127*256), f16, 0, 8);
+	calculate_integrals_batch(trace_span<float>(&buffer_float[0], ntraces, length), dt1, length2, -127.0f, f_float);
+	if(!same_features(f8, f16)) {
+		fprintf(stderr, "  int16 samples of 6000 series give different features than int8\n");
+		failed++;
+	}
+	if(!same_features(f8, f_float)) {
+		fprintf(stderr, "  float samples give different features than int8\n");
+		failed++;
+	}
+
+	// random samples over the full 16-bit range against the trace-by-trace version
+	buffer16.resize(1000*length);
+	for(i=0; i<buffer16.size(); i++) {
+		seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+		buffer16[i] = (int16_t)(seed >> 48);
+	}
+	calculate_integrals_batch(trace_span<int16_t>(&buffer16[0], 1000, length), dt1, length2, (int16_t)-32768, f16);
+	for(n=0; n<1000; n++) {
+		char line[200];
+		trace16.assign(buffer16.begin()+n*length, buffer16.begin()+(n+1)*length);
+		snprintf(line, sizeof(line), "%d\t%d\t%d\t%u\t%u\t%d\n", f16.integral1[n], f16.integral2[n], f16.peak[n],
+			f16.i_peak[n], f16.i_start_integrate2[n], f16.problem[n]);
+		if(single_integrals(trace16, dt1, length2, (int16_t)-32768) != line) {
+			if(failed++ < 10) {
+				fprintf(stderr, "  full-range int16 trace %lu differs from calculate_and_write_integrals_i\n", n);
+			}
+		}
+	}
+
+	// the sum of a long trace doesn't fit into the features: it has to be marked as a problem
+	trace16.assign(70000, -32000);
+	trace16[100] = -32100;
+	calculate_integrals_batch(trace_span<int16_t>(&trace16[0], 1, trace16.size()), dt1, length2, (int16_t)-32764, f_single);
+	if(f_single.problem[0] == 0 || f_single.integral1[0] != numeric_limits<int32_t>::max()) {
+		fprintf(stderr, "  the overflow of integral1 was not recognised\n");
+		failed++;
+	}
+	if(narrow_sum((int64_t)-70000*32000, 8, overflow) != -8750000 || overflow) {
+		fprintf(stderr, "  the sum of a long trace of 6000 series doesn't fit after the shift\n");
+		failed++;
+	}
+
+	// traces without samples: nothing may be read, every trace is a problem
+	{
+		pulse_times t_empty;
+		timing_options o_empty;
+		calculate_integrals_batch(trace_span<int16_t>(&trace16[0], 3, 0), dt1, length2, (int16_t)-32764, f_single);
+		calculate_crossing_times_batch(trace_span<int16_t>(&trace16[0], 3, 0), o_empty, t_empty);
+		if(f_single.problem[0] == 0 || f_single.problem[2] == 0 || t_empty.problem[0] == 0 || t_empty.problem[2] == 0) {
+			fprintf(stderr, "  traces of length 0 are not marked as problems\n");
+			failed++;
+		}
+	}
+
+	failed += check_clipped_16bit(length, dt1, length2);
+	failed += check_baseline();
+	failed += check_timing();
+	failed += check_peaks();
+	failed += check_histograms();
+	failed += check_filters();
+	failed += check_coincidence();
+	failed += check_average();
+	failed += check_zero_suppress();
+	failed += check_veto(length);
+	failed += check_sample_statistics();
+	failed += check_auto_trigger();
+	failed += check_ets_sorter();
+
+	fprintf(stderr, "%s\n", failed ? "FAILED" : "all checks passed");
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long ntraces = 1000000, length = 650, dt1 = 175, length2 = 250;
+	const unsigned long block = 10000;
+	unsigned long done, n, seed = 1;
+	std::vector<int8_t> buffer;
+	std::vector<int8_t> trace;
+	ngamma_features features;
+	pulse_times times;
+	timing_options linear, cubic;
+	peak_features peaks;
+	peak_options peak;
+	shaper_options trapezoidal, crrc;
+	shaped_features shaped;
+	std::vector<float> shaped_buffer;
+	Timing t;
+	double seconds_single = 0, seconds_batch = 0, seconds_text = 0, seconds_binary = 0, seconds_linear = 0, seconds_cubic = 0, seconds_peaks = 0, seconds_trapezoidal = 0, seconds_crrc = 0, seconds_events = 0, seconds_average = 0, seconds_rms = 0, seconds_veto = 0;
+	std::vector<std::vector<coincidence_hit> > hits;
+	coincidence_options coincidence;
+	size_t nhits = 0;
+	std::vector<int16_t> sparse;
+	zero_suppress_options zs;
+	zero_suppress_statistics zs_stats;
+	double seconds_zs = 0, seconds_convert = 0, seconds_statistics = 0;
+	std::vector<int8_t> converted;
+	sample_statistics statistics;
+	FILE *f_null, *f_single, *f_batch;
+	long size_single, size_batch;
+	std::string text_single, text_batch;
+
+	if(argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+		print_usage();
+		return 0;
+	}
+	if(argc > 1 && strcmp(argv[1], "--check") == 0) {
+		return check_kernels(length, dt1, length2) ? 1 : 0;
+	}
+	if(argc > 1) ntraces = atol(argv[1]);
+	if(argc > 2) length  = atol(argv[2]);
+	if(argc > 3) dt1     = atol(argv[3]);
+	if(argc > 4) length2 = atol(argv[4]);
+
+#ifdef _WIN32
+	f_null = fopen("NUL", "wb");
+#else
+	f_null = fopen("/dev/null", "wb");
+#endif
+	if(f_null == NULL) {
+		cerr << "Unable to open the null device\n";
+		return 1;
+	}
+
+	// both versions have to give the same numbers
+	generate_pulses(buffer, block < ntraces ? block : ntraces, length, 1, seed);
+	f_single = tmpfile();
+	f_batch  = tmpfile();
+	for(n=0; n*length<buffer.size(); n++) {
+		trace.assign(buffer.begin()+n*length, buffer.begin()+(n+1)*length);
+		calculate_and_write_integrals_i(trace, dt1, length2, f_single);
+	}
+	calculate_integrals_batch(trace_span<int8_t>(&buffer[0], buffer.size()/length, length), dt1, length2, (int8_t)-127, features);
+	write_integrals_text(features, f_batch);
+	size_single = ftell(f_single);
+	size_batch  = ftell(f_batch);
+	text_single.resize(size_single);
+	text_batch.resize(size_batch);
+	rewind(f_single); rewind(f_batch);
+	if(size_single != size_batch ||
+	   fread(&text_single[0], 1, size_single, f_single) != (size_t)size_single ||
+	   fread(&text_batch[0],  1, size_batch,  f_batch)  != (size_t)size_batch  ||
+	   text_single != text_batch) {
+		cerr << "The batch version gives different results than calculate_and_write_integrals_i.\n";
+		return 1;
+	}
+	fclose(f_single);
+	fclose(f_batch);
+	cubic.is_cubic = true;
+	trapezoidal.type = SHAPER_TRAPEZOIDAL; trapezoidal.rise = 20; trapezoidal.flat = 10; trapezoidal.tau = 80;
+	crrc.type = SHAPER_CRRC; crrc.tau = 10; crrc.order = 4;
+	pulse_shaper shaper_trapezoidal(trapezoidal), shaper_crrc(crrc);
+	trace_average average(length, false), average_rms(length, true);
+	veto_options veto;
+	veto_features veto_values;
+	veto.baseline_length = length/4;
+	veto.tot_level       = 10;
+	veto.enabled[VETO_RISE] = true;
+
+	// the buffer of a rapid-block run is processed block by block (generating the pulses is slower than analysing them, so the same block is reused)
+	for(done=0; done<ntraces; done+=n) {
+		n = ntraces-done < block ? ntraces-done : block;
+		trace_span<int8_t> traces(&buffer[0], n, length);
+
+		t.Start();
+		for(size_t k=0; k<n; k++) {
+			trace.assign(traces.trace(k), traces.trace(k)+length);
+			calculate_and_write_integrals_i(trace, dt1, length2, f_null);
+		}
+		t.Stop(); seconds_single += t.GetSecondsDouble();
+
+		t.Start();
+		calculate_integrals_batch(traces, dt1, length2, (int8_t)-127, features);
+		t.Stop(); seconds_batch += t.GetSecondsDouble();
+
+		t.Start();
+		write_integrals_text(features, f_null, 0, n);
+		t.Stop(); seconds_text += t.GetSecondsDouble();
+
+		t.Start();
+		write_integrals_binary(features, f_null, 0, n);
+		t.Stop(); seconds_binary += t.GetSecondsDouble();
+
+		t.Start();
+		calculate_crossing_times_batch(traces, linear, times);
+		t.Stop(); seconds_linear += t.GetSecondsDouble();
+
+		t.Start();
+		calculate_crossing_times_batch(traces, cubic, times);
+		t.Stop(); seconds_cubic += t.GetSecondsDouble();
+
+		t.Start();
+		find_peaks_batch(traces, peak, peaks);
+		t.Stop(); seconds_peaks += t.GetSecondsDouble();
+
+		t.Start();
+		shape_traces(traces, shaper_trapezoidal, length/6, shaped, shaped_buffer);
+		t.Stop(); seconds_trapezoidal += t.GetSecondsDouble();
+
+		t.Start();
+		shape_traces(traces, shaper_crrc, length/6, shaped, shaped_buffer);
+		t.Stop(); seconds_crrc += t.GetSecondsDouble();
+
+		t.Start();
+		calculate_veto_features(traces, veto, veto_values);
+		t.Stop(); seconds_veto += t.GetSecondsDouble();
+
+		t.Start();
+		accumulate_traces(traces, average);
+		t.Stop(); seconds_average += t.GetSecondsDouble();
+
+		t.Start();
+		accumulate_traces(traces, average_rms);
+		t.Stop(); seconds_rms += t.GetSecondsDouble();
+	}
+
+	// 4 channels at 1 MHz each, 20% with a partner, events within 10 ns written as binary
+	generate_hits(hits, 4, 4*block, 1e6, 0.2, seed);
+	for(done=0; done<ntraces; done+=block) {
+		event_builder events(coincidence, hits.size());
+		auto write = [&](const coincidence_hit *h, size_t k, uint32_t mask) { write_event_binary(h, k, mask, f_null); };
+
+		t.Start();
+		for(size_t c=0; c<hits.size(); c++) {
+			events.add(c, &hits[c][0], hits[c].size());
+			nhits += hits[c].size();
+		}
+		events.finish();
+		events.build(write);
+		t.Stop(); seconds_events += t.GetSecondsDouble();
+	}
+
+	// the zero suppression in chunks of 10^6 samples, only counting the samples that are kept
+	zs.level = -100; zs.hysteresis = 30; zs.pre = 100; zs.post = 300;
+	generate_sparse_signal(sparse, 1000000, 10000, seed);
+	{
+		zero_suppressor<int16_t> suppressor(zs);
+		for(done=0; done<ntraces*length; done+=sparse.size()) {
+			t.Start();
+			suppressor.process(&sparse[0], sparse.size(), [](uint64_t, const int16_t *, size_t, bool) {}, zs_stats);
+			t.Stop(); seconds_zs += t.GetSecondsDouble();
+		}
+	}
+	// the conversion of the samples of 6000 series to the 8 bits of the files, without and with the statistics
+	converted.resize(sparse.size());
+	for(done=0; done<ntraces*length; done+=sparse.size()) {
+		t.Start();
+		for(size_t k=0; k<sparse.size(); k++) {
+			converted[k] = sparse[k] >> 8;
+		}
+		t.Stop(); seconds_convert += t.GetSecondsDouble();
+
+		t.Start();
+		count_samples<ps6000_samples>(&sparse[0], sparse.size(), statistics, &converted[0]);
+		t.Stop(); seconds_statistics += t.GetSecondsDouble();
+	}
+	fclose(f_null);
+
+	fprintf(stderr, "%lu traces of length %lu (dt1=%lu, length2=%lu)\n", ntraces, length, dt1, length2);
+	fprintf(stderr, "  trace by trace + fprintf: %8.3f s  (%6.2f Mtraces/s)\n", seconds_single, ntraces*1e-6/seconds_single);
+	fprintf(stderr, "  batch (integrals only):   %8.3f s  (%6.2f Mtraces/s, %.2f GS/s)\n", seconds_batch, ntraces*1e-6/seconds_batch, ntraces*length*1e-9/seconds_batch);
+	fprintf(stderr, "  batch + text:             %8.3f s  (%6.2f Mtraces/s)\n", seconds_batch+seconds_text, ntraces*1e-6/(seconds_batch+seconds_text));
+	fprintf(stderr, "  batch + binary:           %8.3f s  (%6.2f Mtraces/s)\n", seconds_batch+seconds_binary, ntraces*1e-6/(seconds_batch+seconds_binary));
+	fprintf(stderr, "  CFD 0.3, linear:          %8.3f s  (%6.2f Mtraces/s)\n", seconds_linear, ntraces*1e-6/seconds_linear);
+	fprintf(stderr, "  CFD 0.3, cubic:           %8.3f s  (%6.2f Mtraces/s)\n", seconds_cubic, ntraces*1e-6/seconds_cubic);
+	fprintf(stderr, "  peaks (pile-up):          %8.3f s  (%6.2f Mtraces/s)\n", seconds_peaks, ntraces*1e-6/seconds_peaks);
+	fprintf(stderr, "  trapezoidal 20/10/80:     %8.3f s  (%6.2f Mtraces/s)\n", seconds_trapezoidal, ntraces*1e-6/seconds_trapezoidal);
+	fprintf(stderr, "  CR-RC^4, tau 10:          %8.3f s  (%6.2f Mtraces/s)\n", seconds_crrc, ntraces*1e-6/seconds_crrc);
+	fprintf(stderr, "  veto features:            %8.3f s  (%6.2f Mtraces/s)\n", seconds_veto, ntraces*1e-6/seconds_veto);
+	fprintf(stderr, "  average:                  %8.3f s  (%6.2f Mtraces/s, %.2f GS/s)\n", seconds_average, ntraces*1e-6/seconds_average, ntraces*length*1e-9/seconds_average);
+	fprintf(stderr, "  average with rms:         %8.3f s  (%6.2f Mtraces/s, %.2f GS/s)\n", seconds_rms, ntraces*1e-6/seconds_rms, ntraces*length*1e-9/seconds_rms);
+	fprintf(stderr, "  zero suppression:         %8.3f s  (%6.2f GS/s, %.2f %% kept)\n", seconds_zs, zs_stats.samples*1e-9/seconds_zs, zs_stats.ratio()*100);
+	fprintf(stderr, "  conversion to 8 bits:     %8.3f s  (%6.2f GS/s)\n", seconds_convert, statistics.count*1e-9/seconds_convert);
+	fprintf(stderr, "  conversion + statistics:  %8.3f s  (%6.2f GS/s)\n", seconds_statistics, statistics.count*1e-9/seconds_statistics);
+	fprintf(stderr, "  events of 4 channels:     %8.3f s  (%6.2f Mhits/s)\n", seconds_events, nhits*1e-6/seconds_events);
+
+	return 0;
+}